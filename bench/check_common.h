@@ -0,0 +1,103 @@
+#pragma once
+
+// What the CPU tracer checks share: their common command line, loading a scene
+// and the high-spp reference their runs are measured against.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../src/cpu_tracer.h"
+#include "../src/mesh_loader.h"
+#include "../src/render_settings.h"
+
+// The reference uses frame indices none of the measured runs touch
+constexpr int ReferenceOffset = 1 << 16;
+
+struct CheckOptions {
+    int imageSize = 48;
+    int frames = 0;  // Of each measured run
+    int referenceFrames = 128;
+    std::unique_ptr<std::ofstream> csv;
+    std::vector<std::string> scenes;
+};
+
+// [--csv file] [--size pixels] [--frames n] [--reference-frames n] [options] [obj or scene xml files...]
+// Any other argument goes to option with the one after it (null when it is the last) and is taken
+// as a scene unless that returns true. With --csv its first line is csvHeader.
+inline void parseCheckOptions(CheckOptions& options, int argc, char** argv, const char* csvHeader,
+                              const std::vector<std::string>& defaultScenes,
+                              const std::function<bool(const std::string& arg, const char* value)>& option = {}) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--csv" && value) {
+            options.csv = std::make_unique<std::ofstream>(argv[++i]);
+            *options.csv << csvHeader << '\n';
+        } else if (arg == "--size" && value) {
+            options.imageSize = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--frames" && value) {
+            options.frames = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--reference-frames" && value) {
+            options.referenceFrames = std::max(1, std::stoi(argv[++i]));
+        } else if (option && option(arg, value)) {
+            i++;
+        } else {
+            options.scenes.push_back(arg);
+        }
+    }
+    if (options.scenes.empty()) {
+        options.scenes = defaultScenes;
+    }
+}
+
+struct CheckScene {
+    Controls camera;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Face> faces;
+};
+
+// An .obj, or the mesh and camera of a scene .xml
+inline CheckScene loadCheckScene(const std::string& path) {
+    RenderSettings settings;
+    if (path.size() > 4 && path.substr(path.size() - 4) == ".xml") {
+        loadSceneXml(settings, path);
+    } else {
+        settings.meshPath = path;
+    }
+    CheckScene scene;
+    scene.camera = settings.camera;
+    loadFromFile(scene.vertices, scene.indices, scene.faces, settings.meshPath);
+    return scene;
+}
+
+// options.referenceFrames frames of the pcg sampler, leaving the tracer on the Sobol one
+inline std::vector<glm::vec4> renderReference(CpuTracer& tracer, Controls controls, const CheckOptions& options, double& seconds) {
+    const auto start = std::chrono::steady_clock::now();
+    controls.frameOffset = ReferenceOffset;
+    controls.accumulate = 1;
+    tracer.setSampler(CpuTracer::Sampler::Random);
+    for (controls.frame = 0; controls.frame < options.referenceFrames; controls.frame++) {
+        tracer.render(controls, options.imageSize, options.imageSize);
+    }
+    tracer.setSampler(CpuTracer::Sampler::Sobol);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return tracer.accumulation();
+}
+
+// Mean of (x - ref)^2 / (ref^2 + 0.01) over pixels and channels, so dark regions count too
+inline double relativeMse(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference) {
+    double sum = 0.0;
+    for (size_t i = 0; i < image.size(); i++) {
+        for (int c = 0; c < 3; c++) {
+            const double d = image[i][c] - reference[i][c];
+            sum += d * d / (reference[i][c] * reference[i][c] + 0.01);
+        }
+    }
+    return sum / (3.0 * static_cast<double>(image.size()));
+}
@@ -0,0 +1,382 @@
+// Microbenchmark and regression check for the host paths on the output and
+// loading side that need no device: loadFromFile and readFile on the bundled
+// and on synthetic meshes, the Haar transforms and waveletDenoiseImage, and the
+// PNG encode. Reports throughput and heap allocations per call; the denoiser
+// and encoder, which the writer thread and farm workers run side by side, also
+// with 1 to N threads running independent calls. Haar round trips are checked
+// to reconstruct their input.
+//
+// Each result is compared against a baseline file of earlier results, by
+// default the committed bench/cpu-bench-baseline.txt (CPU_BENCH_BASELINE),
+// which holds the slowest of three single-core runs of each result; write a
+// new one on the machine that runs the check for a tighter bound.
+// Throughput more than the tolerance below it, allocations per call more than
+// the allocation tolerance above it or a failed check exit with 1.
+//
+// Usage: cpu-bench [--baseline file] [--write-baseline file] [--tolerance percent] [--allocation-tolerance percent]
+//                  [--threads n] [obj files...]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../external/stb/stb_image_write.h"
+#include "../src/image_writer.h"
+#include "../src/mesh_loader.h"
+#include "../src/wavelet_denoise.h"
+
+// Set by CMake to the baseline in the source tree, else looked for in the working directory
+#ifndef CPU_BENCH_BASELINE
+#define CPU_BENCH_BASELINE "cpu-bench-baseline.txt"
+#endif
+
+// Every heap allocation of the process is counted, so allocations per call are exact
+// as long as only the measured calls run. All replaceable forms are replaced, so each
+// new has its delete here; the pair is kept out of line, where the compiler can't
+// match the free against the operator new it inlined.
+namespace {
+std::atomic<size_t> allocationCount{0};
+
+[[gnu::noinline]] void* countedAllocate(size_t size, size_t alignment) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+[[gnu::noinline]] void countedFree(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void* countedNew(size_t size, size_t alignment) {
+    if (void* pointer = countedAllocate(size, alignment)) return pointer;
+    throw std::bad_alloc();
+}
+}  // namespace
+
+void* operator new(size_t size) { return countedNew(size, 0); }
+void* operator new[](size_t size) { return countedNew(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return countedNew(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return countedNew(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void* pointer) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { countedFree(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { countedFree(pointer); }
+
+namespace {
+
+constexpr int Repeats = 3;
+constexpr double DefaultTolerance = 15.0;
+// Allocations vary a little with the standard library and the thread count, so at least one more per call is accepted
+constexpr double DefaultAllocationTolerance = 10.0;
+const char* const DefaultBaseline = CPU_BENCH_BASELINE;
+
+struct Result {
+    std::string name;
+    double throughput = 0.0;  // Units per second, the unit given by the name
+    double allocations = 0.0;  // Per call
+};
+
+// Best of Repeats of threadCount threads each running run(thread) once, as units per second
+// over all threads, and the allocations of one run.
+Result measure(const std::string& name, double units, int threadCount, const std::function<void(int)>& run) {
+    double best = 1e30;
+    size_t allocations = 0;
+    for (int i = 0; i < Repeats; i++) {
+        const size_t before = allocationCount.load();
+        auto start = std::chrono::steady_clock::now();
+        if (threadCount == 1) {
+            run(0);
+        } else {
+            std::vector<std::thread> threads;
+            threads.reserve(threadCount);
+            for (int thread = 0; thread < threadCount; thread++) {
+                threads.emplace_back(run, thread);
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+        // Thread creation allocates too, one state per thread and the vector; only the first repeat is taken
+        if (i == 0) allocations = allocationCount.load() - before - (threadCount > 1 ? threadCount + 1 : 0);
+    }
+    return {name, units * threadCount / best, static_cast<double>(allocations) / threadCount};
+}
+
+// n by n quads of two alternating materials in the xz plane, normals and texture coordinates included
+std::string writeSyntheticMesh(const std::filesystem::path& directory, int n) {
+    const std::filesystem::path materials = directory / "synthetic.mtl";
+    if (!std::filesystem::exists(materials)) {
+        std::ofstream mtl(materials);
+        mtl << "newmtl light\nKd 0.8 0.8 0.8\nKe 4 4 4\nillum 1\n\nnewmtl white\nKd 0.7 0.7 0.7\nillum 2\n";
+    }
+    const std::filesystem::path path = directory / ("grid" + std::to_string(n) + ".obj");
+    std::ofstream obj(path);
+    obj << "mtllib synthetic.mtl\n";
+    for (int z = 0; z <= n; z++) {
+        for (int x = 0; x <= n; x++) {
+            obj << "v " << static_cast<float>(x) / n << " 0 " << static_cast<float>(z) / n << "\n";
+            obj << "vt " << static_cast<float>(x) / n << " " << static_cast<float>(z) / n << "\n";
+        }
+    }
+    obj << "vn 0 1 0\n";
+    for (int z = 0; z < n; z++) {
+        obj << "usemtl " << (z % 2 ? "light" : "white") << "\n";
+        for (int x = 0; x < n; x++) {
+            const int a = z * (n + 1) + x + 1;
+            const int b = a + 1;
+            const int c = a + n + 1;
+            const int d = c + 1;
+            obj << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+            obj << "f " << a << "/" << a << "/1 " << d << "/" << d << "/1 " << b << "/" << b << "/1\n";
+        }
+    }
+    return path.string();
+}
+
+// Smooth gradient with noise of a few levels, close to what the denoiser sees from a converging render
+std::vector<unsigned char> syntheticImage(int size, int channels, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 12.0f);
+    std::vector<unsigned char> image(static_cast<size_t>(size) * size * channels);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            for (int c = 0; c < channels; c++) {
+                const float base = 255.0f * (0.25f + 0.5f * static_cast<float>(x + c * y) / (2 * size));
+                image[(static_cast<size_t>(y) * size + x) * channels + c] =
+                    static_cast<unsigned char>(std::clamp(base + noise(rng), 0.0f, 255.0f));
+            }
+        }
+    }
+    return image;
+}
+
+void benchmarkMesh(const std::string& label, const std::string& file, std::vector<Result>& results) {
+    const double bytes = static_cast<double>(std::filesystem::file_size(file));
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Face> faces;
+    loadFromFile(vertices, indices, faces, file);
+    const double triangles = static_cast<double>(indices.size() / 3);
+
+    results.push_back(measure("readFile " + label + " MB/s", bytes * 1e-6, 1, [&](int) { readFile(file); }));
+    results.push_back(measure("loadFromFile " + label + " Mtri/s", triangles * 1e-6, 1, [&](int) {
+        std::vector<Vertex> v;
+        std::vector<uint32_t> i;
+        std::vector<Face> f;
+        std::vector<std::string> texturePaths;
+        loadFromFile(v, i, f, file, &texturePaths);
+    }));
+}
+
+// Largest reconstruction error of a Haar round trip, relative to the value range
+float haarRoundTripError(int size) {
+    std::mt19937 rng(size);
+    std::uniform_real_distribution<float> uniform(0.0f, 255.0f);
+    std::vector<float> original(static_cast<size_t>(size) * size);
+    for (float& value : original) {
+        value = uniform(rng);
+    }
+    std::vector<float> data = original;
+    haar2DTransform(data, size, size);
+    inverseHaar2DTransform(data, size, size);
+    float error = 0.0f;
+    for (size_t i = 0; i < data.size(); i++) {
+        error = std::max(error, std::abs(data[i] - original[i]));
+    }
+    return error / 255.0f;
+}
+
+void benchmarkImages(int size, int maxThreads, std::vector<Result>& results) {
+    const std::string label = std::to_string(size) + "^2";
+    const double megapixels = static_cast<double>(size) * size * 1e-6;
+
+    std::vector<float> channel(static_cast<size_t>(size) * size);
+    {
+        const std::vector<unsigned char> gray = syntheticImage(size, 1, 1);
+        std::copy(gray.begin(), gray.end(), channel.begin());
+    }
+    std::vector<float> work;
+    results.push_back(measure("haar2DTransform " + label + " Mpix/s", megapixels, 1, [&](int) {
+        work = channel;
+        haar2DTransform(work, size, size);
+    }));
+    haar2DTransform(channel, size, size);
+    results.push_back(measure("inverseHaar2DTransform " + label + " Mpix/s", megapixels, 1, [&](int) {
+        work = channel;
+        inverseHaar2DTransform(work, size, size);
+    }));
+
+    // RGBA8 as ImageWriter::writePng denoises it, one image per thread
+    std::vector<std::vector<unsigned char>> originals;
+    std::vector<std::vector<unsigned char>> images(maxThreads);
+    for (int thread = 0; thread < maxThreads; thread++) {
+        originals.push_back(syntheticImage(size, 4, 2 + thread));
+    }
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        results.push_back(measure("waveletDenoiseImage " + label + " x" + std::to_string(threads) + " Mpix/s", megapixels, threads,
+                                  [&](int thread) {
+                                      images[thread] = originals[thread];
+                                      waveletDenoiseImage(images[thread].data(), size, size, 4, 5.0f);
+                                  }));
+    }
+
+    // The encode alone in memory, then writePng end to end: conversion, encode and the file write
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        results.push_back(measure("png encode " + label + " x" + std::to_string(threads) + " Mpix/s", megapixels, threads, [&](int thread) {
+            std::vector<unsigned char> png;
+            stbi_write_png_to_func(
+                [](void* context, void* data, int length) {
+                    auto* out = static_cast<std::vector<unsigned char>*>(context);
+                    out->insert(out->end(), static_cast<unsigned char*>(data), static_cast<unsigned char*>(data) + length);
+                },
+                &png, size, size, 4, originals[thread].data(), size * 4);
+        }));
+    }
+    std::vector<float> pixels(originals[0].size());
+    std::transform(originals[0].begin(), originals[0].end(), pixels.begin(), [](unsigned char value) { return value / 255.0f; });
+    const std::string path = (std::filesystem::temp_directory_path() / "cpu-bench.png").string();
+    results.push_back(measure("writePng " + label + " Mpix/s", megapixels, 1,
+                              [&](int) { ImageWriter::writePng(path, pixels.data(), size, size, false); }));
+    std::filesystem::remove(path);
+}
+
+std::map<std::string, Result> readBaseline(const std::string& path) {
+    std::map<std::string, Result> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        // name \t throughput \t allocations, the name may contain spaces
+        const size_t second = line.rfind('\t');
+        const size_t first = second == std::string::npos || second == 0 ? std::string::npos : line.rfind('\t', second - 1);
+        if (first == std::string::npos) continue;
+        Result result;
+        result.name = line.substr(0, first);
+        result.throughput = std::atof(line.substr(first + 1, second - first - 1).c_str());
+        result.allocations = std::atof(line.substr(second + 1).c_str());
+        baseline[result.name] = result;
+    }
+    return baseline;
+}
+
+void writeBaseline(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    for (const Result& result : results) {
+        file << result.name << "\t" << result.throughput << "\t" << result.allocations << "\n";
+    }
+    std::printf("Baseline written to %s\n", path.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string baselinePath;
+    std::string writePath;
+    double tolerance = DefaultTolerance;
+    double allocationTolerance = DefaultAllocationTolerance;
+    int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--write-baseline" && i + 1 < argc) {
+            writePath = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::atof(argv[++i]);
+        } else if (arg == "--allocation-tolerance" && i + 1 < argc) {
+            allocationTolerance = std::atof(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            maxThreads = std::max(1, std::atoi(argv[++i]));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        files = {"../assets/CornellBox/CornellBox-Original.obj", "../assets/CornellBox/CornellBox-Water.obj",
+                 "../assets/CornellBox/MedievalBoat.obj"};
+    }
+    if (baselinePath.empty() && writePath.empty() && std::filesystem::exists(DefaultBaseline)) {
+        baselinePath = DefaultBaseline;
+    }
+
+    std::vector<Result> results;
+    bool failed = false;
+
+    for (const std::string& file : files) {
+        benchmarkMesh(std::filesystem::path(file).stem().string(), file, results);
+    }
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "cpu-bench";
+    std::filesystem::create_directories(directory);
+    for (int n : {32, 128, 512}) {
+        benchmarkMesh("grid" + std::to_string(n), writeSyntheticMesh(directory, n), results);
+    }
+    std::filesystem::remove_all(directory);
+
+    for (int size : {256, 512, 1024, 2048}) {
+        const float error = haarRoundTripError(size);
+        if (error > 1e-5f) {
+            std::printf("FAIL haar round trip %d^2: relative error %g\n", size, error);
+            failed = true;
+        }
+        benchmarkImages(size, maxThreads, results);
+    }
+
+    const std::map<std::string, Result> baseline = baselinePath.empty() ? std::map<std::string, Result>{} : readBaseline(baselinePath);
+    if (!baselinePath.empty()) {
+        std::printf("Baseline %s (%zu results), tolerance %.0f%%, allocations %.0f%%\n", baselinePath.c_str(), baseline.size(), tolerance,
+                    allocationTolerance);
+    }
+    for (const Result& result : results) {
+        auto found = baseline.find(result.name);
+        if (found == baseline.end()) {
+            std::printf("  %-44s %10.2f | %8.1f allocs\n", result.name.c_str(), result.throughput, result.allocations);
+            continue;
+        }
+        const double change = (result.throughput / found->second.throughput - 1.0) * 100.0;
+        const bool slower = change < -tolerance;
+        const double allowed = found->second.allocations + std::max(1.0, found->second.allocations * allocationTolerance / 100.0);
+        const bool allocates = result.allocations > allowed;
+        failed = failed || slower || allocates;
+        std::printf("%s %-44s %10.2f (%+6.1f%%) | %8.1f allocs (was %.1f)\n", slower || allocates ? "!" : " ", result.name.c_str(),
+                    result.throughput, change, result.allocations, found->second.allocations);
+    }
+
+    if (!writePath.empty()) {
+        writeBaseline(writePath, results);
+    }
+    if (failed) {
+        std::printf("Regressed against the baseline\n");
+    }
+    return failed ? 1 : 0;
+}
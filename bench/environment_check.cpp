@@ -0,0 +1,176 @@
+// Checks the environment importance sampling of environment_distribution.h:
+// that its density integrates to one and matches what sample() returns, and
+// the equal-time noise of the environment's direct light on diffuse surfaces
+// with importance against uniform light sampling, each combined with BSDF
+// sampling by the power heuristic the way integrator.glsl does.
+//
+// Usage: environment-check [lat-long .hdr or .pfm files...]
+// Without files a sky with a small, bright sun is synthesized.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/environment_distribution.h"
+#include "../src/image_reader.h"
+#include "../src/thread_pool.h"
+
+namespace {
+
+constexpr float Pi = 3.14159265358979323846f;
+constexpr int Estimates = 1 << 18;
+
+// Overcast gradient plus a sun of about half a degree 30 degrees above the horizon
+HdrImage syntheticSky(int width, int height) {
+    HdrImage image;
+    image.width = width;
+    image.height = height;
+    image.rgb.resize(static_cast<size_t>(width) * height * 3);
+    const glm::vec3 sun = glm::normalize(glm::vec3(std::cos(0.52f), -std::sin(0.52f), 0.3f));
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const float theta = (static_cast<float>(y) + 0.5f) / static_cast<float>(height) * Pi;
+            const float phi = (static_cast<float>(x) + 0.5f) / static_cast<float>(width) * 2.0f * Pi;
+            const glm::vec3 direction{std::sin(theta) * std::cos(phi), -std::cos(theta), std::sin(theta) * std::sin(phi)};
+            const float up = std::max(0.0f, -direction.y);
+            glm::vec3 color = glm::vec3(0.3f, 0.45f, 0.8f) * (0.2f + up) + glm::vec3(0.05f);
+            if (glm::dot(direction, sun) > std::cos(0.0045f * Pi)) {
+                color += glm::vec3(40000.0f, 36000.0f, 30000.0f);
+            }
+            float* out = &image.rgb[(static_cast<size_t>(y) * width + x) * 3];
+            out[0] = color.r;
+            out[1] = color.g;
+            out[2] = color.b;
+        }
+    }
+    return image;
+}
+
+float powerHeuristic(float pdf, float otherPdf) {
+    return pdf > 0.0f ? pdf * pdf / (pdf * pdf + otherPdf * otherPdf) : 0.0f;
+}
+
+glm::vec3 uniformSphere(glm::vec2 u) {
+    const float z = 1.0f - 2.0f * u.x;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    return {r * std::cos(2.0f * Pi * u.y), z, r * std::sin(2.0f * Pi * u.y)};
+}
+
+glm::vec3 uniformHemisphere(glm::vec2 u, glm::vec3 normal) {
+    const glm::vec3 direction = uniformSphere(u);
+    return glm::dot(direction, normal) < 0.0f ? -direction : direction;
+}
+
+// Midpoint rule over the lat-long square at twice the texel rate, dw = 2 pi^2 sin(theta) du dv,
+// which should give one up to rounding
+void checkDensity(const EnvironmentDistribution& environment) {
+    const uint32_t columns = environment.width * 2;
+    const uint32_t rows = environment.height * 2;
+    double integral = 0.0;
+    for (uint32_t y = 0; y < rows; y++) {
+        const float theta = (static_cast<float>(y) + 0.5f) / static_cast<float>(rows) * Pi;
+        for (uint32_t x = 0; x < columns; x++) {
+            const float phi = (static_cast<float>(x) + 0.5f) / static_cast<float>(columns) * 2.0f * Pi;
+            const glm::vec3 direction{std::sin(theta) * std::cos(phi), -std::cos(theta), std::sin(theta) * std::sin(phi)};
+            integral += environment.pdf(direction) * 2.0 * Pi * Pi * std::sin(theta);
+        }
+    }
+    integral /= static_cast<double>(columns) * rows;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    int mismatches = 0;
+    const int samples = 1 << 16;
+    for (int i = 0; i < samples; i++) {
+        float pdf;
+        const glm::vec3 direction = environment.sample({uniform(random), uniform(random)}, pdf);
+        if (std::abs(environment.pdf(direction) - pdf) > 1e-3f * pdf) mismatches++;
+    }
+    std::printf("  density integral %.4f, %d of %d samples off their density (texel edges)\n", integral, mismatches, samples);
+}
+
+struct Estimate {
+    double mean = 0.0;
+    double variance = 0.0;
+    double nanoseconds = 0.0;  // Per estimate
+};
+
+// Irradiance of a diffuse surface facing normal, visibility ignored: one light
+// and one BSDF sample per estimate
+Estimate irradiance(const EnvironmentDistribution& environment, glm::vec3 normal, bool importance) {
+    std::mt19937 random(importance ? 1 : 2);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    const float bsdfPdf = 1.0f / (2.0f * Pi);
+    auto lightPdf = [&](glm::vec3 direction) { return importance ? environment.pdf(direction) : 1.0f / (4.0f * Pi); };
+
+    double sum = 0.0;
+    double squares = 0.0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Estimates; i++) {
+        float value = 0.0f;
+        const glm::vec2 lightU{uniform(random), uniform(random)};
+        float pdf = 1.0f / (4.0f * Pi);
+        const glm::vec3 light = importance ? environment.sample(lightU, pdf) : uniformSphere(lightU);
+        const float lightCosine = glm::dot(light, normal);
+        if (pdf > 0.0f && lightCosine > 0.0f) {
+            const glm::vec3 radiance = environment.lookup(light);
+            value += (radiance.r + radiance.g + radiance.b) / 3.0f * lightCosine / pdf * powerHeuristic(pdf, bsdfPdf);
+        }
+        const glm::vec3 scattered = uniformHemisphere({uniform(random), uniform(random)}, normal);
+        const glm::vec3 radiance = environment.lookup(scattered);
+        value += (radiance.r + radiance.g + radiance.b) / 3.0f * glm::dot(scattered, normal) / bsdfPdf *
+                 powerHeuristic(bsdfPdf, lightPdf(scattered));
+        sum += value;
+        squares += static_cast<double>(value) * value;
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    Estimate estimate;
+    estimate.mean = sum / Estimates;
+    estimate.variance = std::max(0.0, squares / Estimates - estimate.mean * estimate.mean);
+    estimate.nanoseconds = elapsed / Estimates;
+    return estimate;
+}
+
+void compare(const std::string& name, const HdrImage& image, ThreadPool& pool) {
+    const auto start = std::chrono::steady_clock::now();
+    const EnvironmentDistribution environment = buildEnvironmentDistribution(image, 1.0f, pool);
+    std::printf("%s: %ux%u, distribution in %.1f ms on %zu threads, power %.4g\n", name.c_str(), environment.width, environment.height,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), pool.size(),
+                environment.power);
+    checkDensity(environment);
+
+    // Up, tilted and sideways facing surfaces
+    const glm::vec3 normals[] = {{0.0f, -1.0f, 0.0f}, glm::normalize(glm::vec3(0.5f, -1.0f, 0.2f)), {1.0f, 0.0f, 0.0f}};
+    for (const glm::vec3& normal : normals) {
+        const Estimate uniform = irradiance(environment, normal, false);
+        const Estimate importance = irradiance(environment, normal, true);
+        // Variance times cost is the variance after a fixed time budget, up to a constant
+        const double gain = uniform.variance * uniform.nanoseconds / std::max(importance.variance * importance.nanoseconds, 1e-30);
+        std::printf("  normal (%5.2f %5.2f %5.2f): uniform %.4g +- %.3g (%.0f ns), importance %.4g +- %.3g (%.0f ns), %.1fx less variance at equal time\n",
+                    normal.x, normal.y, normal.z, uniform.mean, std::sqrt(uniform.variance / Estimates), uniform.nanoseconds,
+                    importance.mean, std::sqrt(importance.variance / Estimates), importance.nanoseconds, gain);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    ThreadPool pool;
+    if (argc < 2) {
+        compare("synthetic sky", syntheticSky(2048, 1024), pool);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        try {
+            compare(argv[i], readHdrImage(argv[i]), pool);
+        } catch (const std::exception& e) {
+            std::printf("%s\n", e.what());
+            return 1;
+        }
+    }
+    return 0;
+}
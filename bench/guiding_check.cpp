@@ -0,0 +1,148 @@
+// Equal-time error of path guiding against BSDF-only sampling on the CPU
+// tracer, which guides and records the way guiding.glsl does. Both runs get
+// the time BSDF-only sampling takes for --frames frames; the guided run
+// spends it on the training passes of render_settings.h and then on frames from
+// the final tree, all in one accumulation. Prints relative MSE against a
+// high-spp BSDF-only reference whenever a run finishes a frame, optionally as
+// CSV for plotting. Exits with 1 when guiding is MaxRatio times worse than the
+// BSDF at equal time in any scene, which a biased or broken guide would be.
+//
+// Usage: guiding-check [--csv file] [--size pixels] [--frames n] [--reference-frames n] [--iterations n]
+//                      [--bsdf-fraction f] [obj or scene xml files...]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../src/guiding_tree.h"
+#include "check_common.h"
+
+namespace {
+
+constexpr double MaxRatio = 2.0;
+
+struct Point {
+    double seconds;
+    int samples;  // Per pixel in the image measured
+    double relMse;
+};
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<Point> renderBsdf(CpuTracer& tracer, Controls controls, const std::vector<glm::vec4>& reference, const CheckOptions& options,
+                              double& budget) {
+    tracer.setGuiding(nullptr, 0.0f, false);
+    controls.accumulate = 1;
+    std::vector<Point> points;
+    const auto start = Clock::now();
+    for (controls.frame = 0; controls.frame < options.frames; controls.frame++) {
+        tracer.render(controls, options.imageSize, options.imageSize);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        points.push_back({seconds, (controls.frame + 1) * SamplesPerFrame, relativeMse(tracer.accumulation(), reference)});
+    }
+    budget = points.back().seconds;
+    return points;
+}
+
+std::vector<Point> renderGuided(CpuTracer& tracer, GuidingTree& tree, const GuidingSettings& settings, Controls controls,
+                                const std::vector<glm::vec4>& reference, const CheckOptions& options, double budget) {
+    tree.reset();
+    controls.accumulate = 1;
+    std::vector<Point> points;
+    const auto start = Clock::now();
+    int passFrames = 0;
+    for (controls.frame = 0;; controls.frame++) {
+        const bool training = tree.iteration() < settings.iterations;
+        tracer.setGuiding(&tree, settings.bsdfFraction, training);
+        tracer.render(controls, options.imageSize, options.imageSize);
+        if (training && ++passFrames == 1 << tree.iteration()) {
+            tree.refine();
+            passFrames = 0;
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        points.push_back({seconds, (controls.frame + 1) * SamplesPerFrame, relativeMse(tracer.accumulation(), reference)});
+        if (seconds >= budget) break;
+    }
+    return points;
+}
+
+// The last point within the time, or none
+const Point* at(const std::vector<Point>& points, double seconds) {
+    const Point* found = nullptr;
+    for (const Point& point : points) {
+        if (point.seconds <= seconds) found = &point;
+    }
+    return found;
+}
+
+// False when guiding did worse than MaxRatio times the BSDF's error at equal time
+bool compareScene(const std::string& path, const GuidingSettings& settings, const CheckOptions& options) {
+    const CheckScene scene = loadCheckScene(path);
+    CpuTracer tracer{scene.vertices, scene.indices, scene.faces};
+    glm::vec3 boundsMin(INFINITY);
+    glm::vec3 boundsMax(-INFINITY);
+    for (const Vertex& vertex : scene.vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    GuidingTree tree{boundsMin, boundsMax, static_cast<uint32_t>(settings.spatialNodes), static_cast<uint32_t>(settings.quadtreeNodes)};
+
+    double referenceSeconds = 0.0;
+    const std::vector<glm::vec4> reference = renderReference(tracer, scene.camera, options, referenceSeconds);
+
+    double budget = 0.0;
+    const std::vector<Point> bsdf = renderBsdf(tracer, scene.camera, reference, options, budget);
+    const std::vector<Point> guided = renderGuided(tracer, tree, settings, scene.camera, reference, options, budget);
+
+    std::printf("%s (%dx%d, reference %d spp in %.1f s, guiding %s)\n", path.c_str(), options.imageSize, options.imageSize,
+                options.referenceFrames * SamplesPerFrame, referenceSeconds, tree.report().c_str());
+    std::printf("  %8s   %-22s %-22s\n", "time", "bsdf spp / relMSE", "guided spp / relMSE");
+    for (double fraction : {0.125, 0.25, 0.5, 0.75, 1.0}) {
+        const double seconds = budget * fraction;
+        const Point* a = at(bsdf, seconds);
+        const Point* b = at(guided, seconds);
+        char left[32] = "-";
+        char right[32] = "- (training)";
+        if (a) std::snprintf(left, sizeof(left), "%6d  %.3e", a->samples, a->relMse);
+        if (b) std::snprintf(right, sizeof(right), "%6d  %.3e", b->samples, b->relMse);
+        std::printf("  %7.2fs   %-22s %-22s\n", seconds, left, right);
+    }
+    const Point* a = at(bsdf, budget);
+    const Point* b = at(guided, budget);
+    const double ratio = a && b ? b->relMse / a->relMse : INFINITY;
+    std::printf("  equal-time relMSE ratio guided / bsdf: %.3f\n", ratio);
+
+    if (options.csv) {
+        for (const auto& [method, points] : {std::pair{"bsdf", &bsdf}, std::pair{"guided", &guided}}) {
+            for (const Point& point : *points) {
+                *options.csv << path << ',' << method << ',' << point.seconds << ',' << point.samples << ',' << point.relMse << '\n';
+            }
+        }
+    }
+    return ratio <= MaxRatio;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    GuidingSettings settings;
+    CheckOptions options;
+    options.frames = 48;
+    parseCheckOptions(options, argc, argv, "scene,method,seconds,spp,relmse",
+                      {"../assets/CornellBox/CornellBox-Glossy.obj", "../assets/CornellBox/CornellBox-Water.obj",
+                       "../assets/CornellBox-Original.obj", "../assets/CornellBox/CornellBox-Mirror.obj"},
+                      [&](const std::string& arg, const char* value) {
+                          if (!value) return false;
+                          if (arg == "--iterations") settings.iterations = std::stoi(value);
+                          else if (arg == "--bsdf-fraction") settings.bsdfFraction = std::stof(value);
+                          else return false;
+                          return true;
+                      });
+    int failures = 0;
+    for (const std::string& scene : options.scenes) {
+        failures += !compareScene(scene, settings, options);
+    }
+    return failures == 0 ? 0 : 1;
+}
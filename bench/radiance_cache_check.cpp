@@ -0,0 +1,136 @@
+// Trace time and bias of the radiance cache on the CPU tracer, which ends
+// wide paths in a RadianceGrid and records into it the way radiance_cache.glsl
+// does. Renders --frames frames with full paths and with the cache,
+// resolving it after every frame like radiance_cache_resolve.comp, and prints
+// time per frame, relative MSE against a high-spp full-path reference and the
+// relative energy the cache adds or loses, optionally as CSV for plotting.
+// Exits with 1 when the cache adds or loses more than MaxBias of the energy
+// full paths find in any scene.
+//
+// Usage: radiance-cache-check [--csv file] [--size pixels] [--frames n] [--reference-frames n] [--footprint cells]
+//                             [--resolution cells] [--budget MB] [obj or scene xml files...]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../src/radiance_grid.h"
+#include "check_common.h"
+
+namespace {
+
+constexpr double MaxBias = 0.05;
+
+struct Run {
+    std::vector<double> frameSeconds;
+    double relMse = 0.0;
+    double relBias = 0.0;  // Summed image over summed reference, minus one
+};
+
+using Clock = std::chrono::steady_clock;
+
+double relativeBias(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference) {
+    double sum = 0.0;
+    double referenceSum = 0.0;
+    for (size_t i = 0; i < image.size(); i++) {
+        for (int c = 0; c < 3; c++) {
+            sum += image[i][c];
+            referenceSum += reference[i][c];
+        }
+    }
+    return referenceSum > 0.0 ? sum / referenceSum - 1.0 : 0.0;
+}
+
+// Null grid for full paths
+Run render(CpuTracer& tracer, RadianceGrid* grid, Controls controls, const std::vector<glm::vec4>& reference, const CheckOptions& options) {
+    tracer.setRadianceCache(grid, true);
+    if (grid) grid->reset();
+    controls.accumulate = 1;
+    Run run;
+    for (controls.frame = 0; controls.frame < options.frames; controls.frame++) {
+        const auto start = Clock::now();
+        tracer.render(controls, options.imageSize, options.imageSize);
+        if (grid) grid->resolve();
+        run.frameSeconds.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    tracer.setRadianceCache(nullptr, false);
+    run.relMse = relativeMse(tracer.accumulation(), reference);
+    run.relBias = relativeBias(tracer.accumulation(), reference);
+    return run;
+}
+
+// Mean seconds per frame after the first `skip`, which fill the cache
+double meanSeconds(const Run& run, int skip) {
+    double sum = 0.0;
+    for (size_t i = skip; i < run.frameSeconds.size(); i++) sum += run.frameSeconds[i];
+    return sum / static_cast<double>(run.frameSeconds.size() - skip);
+}
+
+// False when the cache's bias over full paths exceeds MaxBias
+bool compareScene(const std::string& path, const RadianceCacheSettings& settings, const CheckOptions& options) {
+    const CheckScene scene = loadCheckScene(path);
+    CpuTracer tracer{scene.vertices, scene.indices, scene.faces};
+
+    RadianceGrid::Header header;
+    header.capacity = RadianceGrid::capacityFor(static_cast<size_t>(settings.budgetMB) << 20);
+    header.cellSize = RadianceGrid::cellSizeFor(scene.vertices, settings.resolution);
+    header.footprint = settings.footprint;
+    header.minSamples = static_cast<uint32_t>(settings.minSamples);
+    header.maxSamples = static_cast<uint32_t>(settings.maxSamples);
+    header.maxAge = static_cast<uint32_t>(settings.maxAge);
+    header.updateStride = static_cast<uint32_t>(settings.updateStride);
+    RadianceGrid grid{header};
+
+    double referenceSeconds = 0.0;
+    const std::vector<glm::vec4> reference = renderReference(tracer, scene.camera, options, referenceSeconds);
+
+    const Run full = render(tracer, nullptr, scene.camera, reference, options);
+    const Run cached = render(tracer, &grid, scene.camera, reference, options);
+
+    std::printf("%s (%dx%d, %d frames, reference %d spp in %.1f s, cache %s)\n", path.c_str(), options.imageSize, options.imageSize,
+                options.frames, options.referenceFrames * SamplesPerFrame, referenceSeconds, grid.report().c_str());
+    std::printf("  %-8s %12s %12s %12s\n", "paths", "ms / frame", "relMSE", "rel. bias");
+    for (const auto& [name, run] : {std::pair{"full", &full}, std::pair{"cached", &cached}}) {
+        std::printf("  %-8s %12.2f %12.3e %+12.4f\n", name, 1000.0 * meanSeconds(*run, 1), run->relMse, run->relBias);
+    }
+    std::printf("  trace time cached / full: %.3f\n", meanSeconds(cached, 1) / meanSeconds(full, 1));
+    // Both runs draw the same samples, so this is the cache's own bias and not the reference's noise
+    const double bias = (1.0 + cached.relBias) / (1.0 + full.relBias) - 1.0;
+    std::printf("  rel. bias cached / full: %+.4f\n", bias);
+
+    if (options.csv) {
+        for (const auto& [name, run] : {std::pair{"full", &full}, std::pair{"cached", &cached}}) {
+            for (size_t frame = 0; frame < run->frameSeconds.size(); frame++) {
+                *options.csv << path << ',' << name << ',' << frame << ',' << run->frameSeconds[frame] << ',' << run->relMse << ','
+                     << run->relBias << '\n';
+            }
+        }
+    }
+    return std::abs(bias) <= MaxBias;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    RadianceCacheSettings settings;
+    CheckOptions options;
+    options.frames = 32;
+    parseCheckOptions(options, argc, argv, "scene,paths,frame,seconds,relmse,relbias",
+                      {"../assets/CornellBox/CornellBox-Glossy.obj", "../assets/CornellBox/CornellBox-Water.obj",
+                       "../assets/CornellBox-Original.obj", "../assets/CornellBox/CornellBox-Mirror.obj"},
+                      [&](const std::string& arg, const char* value) {
+                          if (!value) return false;
+                          if (arg == "--footprint") settings.footprint = std::stof(value);
+                          else if (arg == "--resolution") settings.resolution = std::stoi(value);
+                          else if (arg == "--budget") settings.budgetMB = std::stoi(value);
+                          else return false;
+                          return true;
+                      });
+    int failures = 0;
+    for (const std::string& scene : options.scenes) {
+        failures += !compareScene(scene, settings, options);
+    }
+    return failures == 0 ? 0 : 1;
+}
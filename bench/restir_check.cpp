@@ -0,0 +1,142 @@
+// Equal-time error of reservoir resampled direct light against BSDF-only
+// sampling on the CPU tracer, which leaves first hits' direct light to
+// reservoirs and runs the temporal and spatial passes the way
+// restir_temporal.comp and restir_spatial.comp do. Both runs trace
+// --samples-per-frame paths per pixel and frame, fewer than a final frame's;
+// the resampled run gets the time BSDF-only sampling takes for --frames
+// frames. Prints relative MSE against a high-spp BSDF-only reference whenever
+// a run finishes a frame, optionally as CSV for plotting, and the energy the
+// resampled image has over the BSDF-only one. Exits with 1 when resampling is
+// MaxRatio times worse than the BSDF at equal time or gains or loses more
+// than MaxBias of its energy in any scene.
+//
+// Usage: restir-check [--csv file] [--size pixels] [--frames n] [--reference-frames n] [--samples-per-frame n]
+//                     [--candidates n] [--neighbors n] [--radius pixels] [obj or scene xml files...]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "check_common.h"
+
+namespace {
+
+constexpr double MaxRatio = 1.5;
+constexpr double MaxBias = 0.1;
+
+struct Point {
+    double seconds;
+    int samples;  // Per pixel in the image measured
+    double relMse;
+};
+
+struct Run {
+    std::vector<Point> points;
+    double energy = 0.0;  // Summed over the final image's pixels and channels
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Disabled settings for BSDF-only sampling; a zero budget renders options.frames frames and sets it
+Run render(CpuTracer& tracer, const LightResamplingSettings& settings, Controls controls, const std::vector<glm::vec4>& reference,
+           const CheckOptions& options, double& budget) {
+    tracer.setLightResampling(settings);
+    controls.accumulate = 1;
+    Run run;
+    std::vector<Point>& points = run.points;
+    const auto start = Clock::now();
+    for (controls.frame = 0;; controls.frame++) {
+        tracer.render(controls, options.imageSize, options.imageSize);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        points.push_back({seconds, (controls.frame + 1) * controls.samplesPerFrame, relativeMse(tracer.accumulation(), reference)});
+        if (budget > 0.0 ? seconds >= budget : controls.frame + 1 == options.frames) break;
+    }
+    for (const glm::vec4& pixel : tracer.accumulation()) {
+        run.energy += static_cast<double>(pixel.r) + pixel.g + pixel.b;
+    }
+    tracer.setLightResampling(LightResamplingSettings{});
+    if (budget == 0.0) budget = points.back().seconds;
+    return run;
+}
+
+// The last point within the time, or none
+const Point* at(const std::vector<Point>& points, double seconds) {
+    const Point* found = nullptr;
+    for (const Point& point : points) {
+        if (point.seconds <= seconds) found = &point;
+    }
+    return found;
+}
+
+// False when resampling did worse than MaxRatio times the BSDF's error at equal time or is biased
+bool compareScene(const std::string& path, LightResamplingSettings settings, int samplesPerFrame, const CheckOptions& options) {
+    const CheckScene scene = loadCheckScene(path);
+    CpuTracer tracer{scene.vertices, scene.indices, scene.faces};
+
+    double referenceSeconds = 0.0;
+    const std::vector<glm::vec4> reference = renderReference(tracer, scene.camera, options, referenceSeconds);
+
+    Controls controls = scene.camera;
+    controls.samplesPerFrame = samplesPerFrame;
+    double budget = 0.0;
+    const Run bsdf = render(tracer, LightResamplingSettings{}, controls, reference, options, budget);
+    settings.enabled = true;
+    const Run resampled = render(tracer, settings, controls, reference, options, budget);
+
+    std::printf("%s (%dx%d, %d paths per frame, reference %d spp in %.1f s)\n", path.c_str(), options.imageSize, options.imageSize,
+                samplesPerFrame, options.referenceFrames * scene.camera.samplesPerFrame, referenceSeconds);
+    std::printf("  %8s   %-22s %-22s\n", "time", "bsdf spp / relMSE", "restir spp / relMSE");
+    for (double fraction : {0.125, 0.25, 0.5, 0.75, 1.0}) {
+        const double seconds = budget * fraction;
+        const Point* a = at(bsdf.points, seconds);
+        const Point* b = at(resampled.points, seconds);
+        char left[32] = "-";
+        char right[32] = "-";
+        if (a) std::snprintf(left, sizeof(left), "%6d  %.3e", a->samples, a->relMse);
+        if (b) std::snprintf(right, sizeof(right), "%6d  %.3e", b->samples, b->relMse);
+        std::printf("  %7.2fs   %-22s %-22s\n", seconds, left, right);
+    }
+    const Point* a = at(bsdf.points, budget);
+    const Point* b = at(resampled.points, budget);
+    const double ratio = a && b ? b->relMse / a->relMse : INFINITY;
+    std::printf("  equal-time relMSE ratio restir / bsdf: %.3f\n", ratio);
+    const double bias = resampled.energy / bsdf.energy - 1.0;
+    std::printf("  rel. energy restir / bsdf: %+.4f\n", bias);
+
+    if (options.csv) {
+        for (const auto& [method, points] : {std::pair{"bsdf", &bsdf}, std::pair{"restir", &resampled}}) {
+            for (const Point& point : points->points) {
+                *options.csv << path << ',' << method << ',' << point.seconds << ',' << point.samples << ',' << point.relMse << '\n';
+            }
+        }
+    }
+    return ratio <= MaxRatio && std::abs(bias) <= MaxBias;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    LightResamplingSettings settings;
+    int samplesPerFrame = 16;
+    CheckOptions options;
+    options.frames = 64;
+    parseCheckOptions(options, argc, argv, "scene,method,seconds,spp,relmse",
+                      {"../assets/CornellBox/CornellBox-Glossy.obj", "../assets/CornellBox/CornellBox-Water.obj",
+                       "../assets/CornellBox-Original.obj", "../assets/CornellBox/CornellBox-Mirror.obj"},
+                      [&](const std::string& arg, const char* value) {
+                          if (!value) return false;
+                          if (arg == "--samples-per-frame") samplesPerFrame = std::max(1, std::stoi(value));
+                          else if (arg == "--candidates") settings.candidates = std::max(1, std::stoi(value));
+                          else if (arg == "--neighbors") settings.neighbors = std::stoi(value);
+                          else if (arg == "--radius") settings.radius = std::stof(value);
+                          else return false;
+                          return true;
+                      });
+    int failures = 0;
+    for (const std::string& scene : options.scenes) {
+        failures += !compareScene(scene, settings, samplesPerFrame, options);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+// Checks the Sobol sampler: stratification of its 1D and 2D nets, L2 star
+// discrepancy against the pcg sampler, and equal-spp error of the CPU tracer
+// against a high-spp reference on the given scenes, at 1, 2, 4... frames up
+// to --frames. Exits with 1 when a net is not stratified or the Sobol points
+// are no less discrepant than random ones.
+//
+// Usage: sampler-check [--csv file] [--size pixels] [--frames n] [--reference-frames n] [obj or scene xml files...]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../src/blue_noise.h"
+#include "../src/sobol.h"
+#include "check_common.h"
+
+namespace {
+
+// Every elementary interval of area 1/N holds exactly one of the N points.
+bool isNet(const std::vector<glm::vec2>& points, int log2Count) {
+    const int count = 1 << log2Count;
+    for (int k = 0; k <= log2Count; k++) {
+        const int columns = 1 << k;
+        const int rows = count / columns;
+        std::vector<int> cells(count, 0);
+        for (const glm::vec2& p : points) {
+            const int cell = static_cast<int>(p.y * rows) * columns + static_cast<int>(p.x * columns);
+            if (++cells[cell] > 1) return false;
+        }
+    }
+    return true;
+}
+
+bool isStratified(const std::vector<float>& values) {
+    std::vector<int> bins(values.size(), 0);
+    for (float value : values) {
+        if (++bins[static_cast<size_t>(value * static_cast<float>(values.size()))] > 1) return false;
+    }
+    return true;
+}
+
+// Warnock's closed form of the L2 star discrepancy.
+double l2StarDiscrepancy(const std::vector<glm::vec2>& points) {
+    const double n = static_cast<double>(points.size());
+    double sum1 = 0.0;
+    double sum2 = 0.0;
+    for (const glm::vec2& p : points) {
+        sum1 += (1.0 - p.x * p.x) * (1.0 - p.y * p.y);
+        for (const glm::vec2& q : points) {
+            sum2 += (1.0 - std::max(p.x, q.x)) * (1.0 - std::max(p.y, q.y));
+        }
+    }
+    return std::sqrt(1.0 / 9.0 - sum1 / (2.0 * n) + sum2 / (n * n));
+}
+
+std::vector<glm::vec2> sobolPoints(const std::vector<uint32_t>& matrices, const std::vector<uint32_t>& blueNoise, glm::uvec2 pixel,
+                                   uint32_t dimension, int count) {
+    std::vector<glm::vec2> points(count);
+    for (int i = 0; i < count; i++) {
+        sobol::PixelSampler sampler{matrices.data(), blueNoise.data(), pixel.x, pixel.y, static_cast<uint32_t>(i)};
+        sampler.get2D(dimension, points[i].x, points[i].y);
+    }
+    return points;
+}
+
+std::vector<glm::vec2> randomPoints(uint32_t seed, int count) {
+    std::vector<glm::vec2> points(count);
+    for (glm::vec2& p : points) {
+        seed = seed * 747796405u + 2891336453u;
+        p.x = static_cast<float>(sobol::hash(seed) >> 8) * (1.0f / 16777216.0f);
+        seed = seed * 747796405u + 2891336453u;
+        p.y = static_cast<float>(sobol::hash(seed) >> 8) * (1.0f / 16777216.0f);
+    }
+    return points;
+}
+
+int checkNets(const std::vector<uint32_t>& matrices, const std::vector<uint32_t>& blueNoise) {
+    const std::vector<uint32_t> noShift(blueNoise.size(), 0);
+    int failures = 0;
+    int checks = 0;
+    for (const auto* tile : {&noShift, &blueNoise}) {
+        for (uint32_t dimension : {sobol::DimLens, sobol::bounceDimension(0) + sobol::DimBsdf, sobol::bounceDimension(5) + sobol::DimBsdf}) {
+            for (glm::uvec2 pixel : {glm::uvec2(0, 0), glm::uvec2(17, 40), glm::uvec2(300, 129)}) {
+                for (int log2Count = 1; log2Count <= 12; log2Count++) {
+                    const int count = 1 << log2Count;
+                    std::vector<glm::vec2> points = sobolPoints(matrices, *tile, pixel, dimension, count);
+                    std::vector<float> values(count);
+                    for (int i = 0; i < count; i++) {
+                        sobol::PixelSampler sampler{matrices.data(), tile->data(), pixel.x, pixel.y, static_cast<uint32_t>(i)};
+                        values[i] = sampler.get1D(dimension);
+                    }
+                    failures += !isNet(points, log2Count) + !isStratified(values);
+                    checks += 2;
+                }
+            }
+        }
+    }
+    std::printf("Stratification: %d/%d nets pass (1D and (0,m,2), m <= 12, with and without the blue-noise shift)\n", checks - failures, checks);
+    return failures;
+}
+
+int checkDiscrepancy(const std::vector<uint32_t>& matrices, const std::vector<uint32_t>& blueNoise) {
+    int failures = 0;
+    std::printf("L2 star discrepancy, mean over 16 pixels:\n");
+    for (int count : {64, 256, 1024}) {
+        double random = 0.0;
+        double qmc = 0.0;
+        for (uint32_t i = 0; i < 16; i++) {
+            glm::uvec2 pixel(i * 13, i * 7);
+            random += l2StarDiscrepancy(randomPoints(i + 1, count)) / 16.0;
+            qmc += l2StarDiscrepancy(sobolPoints(matrices, blueNoise, pixel, sobol::bounceDimension(1) + sobol::DimBsdf, count)) / 16.0;
+        }
+        std::printf("  N = %4d   random %.5f | sobol %.5f\n", count, random, qmc);
+        failures += qmc >= random;
+    }
+    return failures;
+}
+
+std::vector<glm::vec4> render(CpuTracer& tracer, CpuTracer::Sampler sampler, Controls controls, int frames, int imageSize) {
+    tracer.setSampler(sampler);
+    controls.accumulate = 1;
+    for (controls.frame = 0; controls.frame < frames; controls.frame++) {
+        tracer.render(controls, imageSize, imageSize);
+    }
+    return tracer.accumulation();
+}
+
+double rmse(const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference) {
+    double sum = 0.0;
+    for (size_t i = 0; i < image.size(); i++) {
+        const glm::vec3 d = glm::vec3(image[i]) - glm::vec3(reference[i]);
+        sum += glm::dot(d, d) / 3.0;
+    }
+    return std::sqrt(sum / static_cast<double>(image.size()));
+}
+
+void compareScene(const std::string& path, const CheckOptions& options) {
+    const CheckScene scene = loadCheckScene(path);
+    CpuTracer tracer{scene.vertices, scene.indices, scene.faces};
+
+    double seconds = 0.0;
+    const std::vector<glm::vec4> reference = renderReference(tracer, scene.camera, options, seconds);
+
+    const int size = options.imageSize;
+    std::printf("%s (%dx%d, reference %d spp in %.1f s)\n", path.c_str(), size, size, options.referenceFrames * SamplesPerFrame,
+                seconds);
+    for (int frames = 1; frames <= options.frames; frames *= 2) {
+        const double random = rmse(render(tracer, CpuTracer::Sampler::Random, scene.camera, frames, size), reference);
+        const double qmc = rmse(render(tracer, CpuTracer::Sampler::Sobol, scene.camera, frames, size), reference);
+        std::printf("  %5d spp   RMSE random %.5f | sobol %.5f\n", frames * SamplesPerFrame, random, qmc);
+        if (options.csv) {
+            *options.csv << path << ',' << frames * SamplesPerFrame << ',' << random << ',' << qmc << '\n';
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    CheckOptions options;
+    options.frames = 8;
+    options.referenceFrames = 64;
+    parseCheckOptions(options, argc, argv, "scene,spp,random,sobol", {"../assets/CornellBox-Original.obj"});
+
+    const std::vector<uint32_t> matrices = sobol::generatorMatrices();
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<uint32_t> blueNoise = generateBlueNoise(sobol::BlueNoiseSize);
+    std::printf("Blue noise %dx%d tile in %.1f ms\n", sobol::BlueNoiseSize, sobol::BlueNoiseSize,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    const int failures = checkNets(matrices, blueNoise) + checkDiscrepancy(matrices, blueNoise);
+
+    for (const std::string& scene : options.scenes) {
+        compareScene(scene, options);
+    }
+    return failures == 0 ? 0 : 1;
+}
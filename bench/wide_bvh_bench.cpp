@@ -0,0 +1,149 @@
+// Microbenchmark for the host side traversal kernels. Reports Mrays/s for the
+// binary BVH, the wide BVH with single rays and with 8/16-ray packets.
+//
+// Usage: wide-bvh-bench [obj files...]
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/mesh_loader.h"
+#include "../src/scene_query.h"
+
+namespace {
+
+constexpr int ImageSize = 512;
+constexpr int Repeats = 3;
+
+double measure(size_t rayCount, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < Repeats; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return static_cast<double>(rayCount) / best * 1e-6;
+}
+
+template <int K>
+size_t tracePackets(const SceneQuery::Traversal& wide, const std::vector<Ray>& rays, std::vector<RayHit>& hits) {
+    size_t hitCount = 0;
+    RayPacket<K> packet;
+    for (size_t first = 0; first < rays.size(); first += K) {
+        const int lanes = static_cast<int>(std::min<size_t>(K, rays.size() - first));
+        for (int lane = 0; lane < lanes; lane++) {
+            packet.set(lane, rays[first + lane]);
+        }
+        wide.intersect(packet, lanes == K ? RayPacket<K>::FullMask : (1u << lanes) - 1u);
+        for (int lane = 0; lane < lanes; lane++) {
+            hits[first + lane] = packet.hits[lane];
+            hitCount += packet.hits[lane].valid();
+        }
+    }
+    return hitCount;
+}
+
+void benchmarkRays(const char* label, const Bvh& bvh, const SceneQuery::Traversal& wide, const std::vector<Ray>& rays) {
+    std::vector<RayHit> reference(rays.size());
+    std::vector<RayHit> hits(rays.size());
+
+    double binary = measure(rays.size(), [&] {
+        for (size_t i = 0; i < rays.size(); i++) {
+            reference[i] = RayHit{};
+            bvh.intersect(rays[i], reference[i]);
+        }
+    });
+    double single = measure(rays.size(), [&] {
+        for (size_t i = 0; i < rays.size(); i++) {
+            hits[i] = RayHit{};
+            wide.intersect(rays[i], hits[i]);
+        }
+    });
+    size_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        mismatches += reference[i].valid() != hits[i].valid() || std::abs(reference[i].t - hits[i].t) > 1e-4f;
+    }
+    double packet8 = measure(rays.size(), [&] { tracePackets<8>(wide, rays, hits); });
+    double packet16 = measure(rays.size(), [&] { tracePackets<16>(wide, rays, hits); });
+    for (size_t i = 0; i < rays.size(); i++) {
+        mismatches += reference[i].valid() != hits[i].valid() || std::abs(reference[i].t - hits[i].t) > 1e-4f;
+    }
+
+    std::printf("  %-10s binary %7.2f | wide%d %7.2f | packet8 %7.2f | packet16 %7.2f Mrays/s | mismatches %zu\n", label, binary,
+                DefaultWideBvhWidth, single, packet8, packet16, mismatches);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        files.emplace_back(argv[i]);
+    }
+    if (files.empty()) {
+        files = {"../assets/CornellBox/CornellBox-Original.obj", "../assets/CornellBox/CornellBox-Sphere.obj",
+                 "../assets/CornellBox/CornellBox-Glossy.obj", "../assets/CornellBox/MedievalBoat.obj"};
+    }
+
+#if defined(WIDE_BVH_USE_AVX2)
+    std::printf("Kernel: AVX2, BVH%d\n", DefaultWideBvhWidth);
+#elif defined(WIDE_BVH_USE_SSE)
+    std::printf("Kernel: SSE, BVH%d\n", DefaultWideBvhWidth);
+#else
+    std::printf("Kernel: scalar, BVH%d\n", DefaultWideBvhWidth);
+#endif
+
+    for (const auto& file : files) {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<Face> faces;
+        loadFromFile(vertices, indices, faces, file);
+
+        auto start = std::chrono::steady_clock::now();
+        Bvh bvh{vertices, indices};
+        auto built = std::chrono::steady_clock::now();
+        SceneQuery::Traversal wide{bvh};
+        auto collapsed = std::chrono::steady_clock::now();
+
+        std::printf("%s: %zu triangles, binary build %.2f ms, collapse %.2f ms, %zu wide nodes (%.1f KiB)\n", file.c_str(),
+                    indices.size() / 3, std::chrono::duration<double, std::milli>(built - start).count(),
+                    std::chrono::duration<double, std::milli>(collapsed - built).count(), wide.nodeCount(),
+                    static_cast<double>(wide.memoryFootprint()) / 1024.0);
+
+        // Coherent primary rays in scanline packets, framed like the auto-framing key does
+        Controls controls;
+        controls.cameraPosition = SceneQuery(vertices, indices, faces).frameCamera(controls.fov, 1.0f);
+        std::vector<Ray> primary;
+        primary.reserve(ImageSize * ImageSize);
+        for (int y = 0; y < ImageSize; y++) {
+            for (int x = 0; x < ImageSize; x++) {
+                primary.push_back(SceneQuery::cameraRay(controls, glm::vec2(x + 0.5f, y + 0.5f), ImageSize, ImageSize));
+            }
+        }
+        benchmarkRays("primary", bvh, wide, primary);
+
+        // Incoherent rays from the primary hit points in uniform random directions
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+        std::vector<Ray> secondary;
+        secondary.reserve(primary.size());
+        for (const Ray& ray : primary) {
+            RayHit hit;
+            if (!wide.intersect(ray, hit)) continue;
+            glm::vec3 direction;
+            do {
+                direction = glm::vec3(uniform(rng), uniform(rng), uniform(rng));
+            } while (glm::dot(direction, direction) > 1.0f || glm::dot(direction, direction) < 1e-4f);
+            Ray bounce;
+            bounce.origin = ray.origin + ray.direction * hit.t;
+            bounce.direction = glm::normalize(direction);
+            secondary.push_back(bounce);
+        }
+        benchmarkRays("secondary", bvh, wide, secondary);
+    }
+    return 0;
+}
@@ -1,324 +1,1448 @@
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <string>
-#include <fstream>
 #include <iostream>
+#include <memory>
+#include <unordered_map>
 
 #include "src/mesh_loader.h"
+#include "src/checkpoint.h"
 #include "src/context.h"
-#include "src/wavelet_denoise.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "external/stb/stb_image_write.h"
+#include "src/cpu_tracer.h"
+#include "src/environment_map.h"
+#include "src/geometry_residency.h"
+#include "src/image_writer.h"
+#include "src/light_groups.h"
+#include "src/light_resampling.h"
+#include "src/mesh_clusters.h"
+#include "src/mesh_lod.h"
+#include "src/path_guiding.h"
+#include "src/radiance_cache.h"
+#include "src/blue_noise.h"
+#include "src/readback.h"
+#include "src/render_farm.h"
+#include "src/render_settings.h"
+#include "src/scene_bundle.h"
+#include "src/scene_edit.h"
+#include "src/scene_query.h"
+#include "src/sobol.h"
+#include "src/stage_timer.h"
+#include "src/startup_timeline.h"
+#include "src/texture_set.h"
+#include "src/thread_pool.h"
+#include "src/uniform_ring.h"
+#include "src/view_batch.h"
+#include "src/wavefront.h"
+
+// Renders on the host when no ray tracing capable device is available.
+int renderOnCpu(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+                const RenderSettings& settings) {
+    const OutputSettings& output = settings.output;
+    const int frames = settings.frames;
+    auto start = std::chrono::steady_clock::now();
+    CpuTracer tracer{vertices, indices, faces};
+    auto built = std::chrono::steady_clock::now();
+    std::cout << "CPU BVH: " << tracer.getBvh().nodes.size() << " nodes in "
+              << std::chrono::duration<double, std::milli>(built - start).count() << " ms" << std::endl;
+
+    ImageWriter writer;
+    Controls controls = settings.camera;
+    controls.accumulate = 1;
+    for (controls.frame = 0; controls.frame < frames; controls.frame++) {
+        tracer.render(controls, settings.width, settings.height);
+        if (!output.sequence.empty() && output.captureEvery > 0 && (controls.frame + 1) % output.captureEvery == 0) {
+            OutputFrame frame{reinterpret_cast<const float*>(tracer.accumulation().data()), settings.width, settings.height};
+            frame.path = ImageWriter::formatPath(output.sequence, controls.frame);
+            writer.push(std::move(frame));
+            writer.flush();
+        }
+    }
+    auto rendered = std::chrono::steady_clock::now();
+    std::cout << "CPU render: " << frames << " frame(s) in "
+              << std::chrono::duration<double, std::milli>(rendered - built).count() << " ms" << std::endl;
+
+    OutputFrame frame{reinterpret_cast<const float*>(tracer.accumulation().data()), settings.width, settings.height};
+    frame.path = output.path;
+    frame.denoise = true;
+    writer.push(std::move(frame));
+    writer.flush();
+    return 0;
+}
+
+// Traces render farm shards on the host until the coordinator runs out of work.
+int runCpuWorker(FarmConnection& coordinator, FarmJob job, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                 const std::vector<Face>& faces, const Controls& camera) {
+    CpuTracer tracer{vertices, indices, faces};
+    do {
+        Controls controls = camera;
+        controls.accumulate = 1;
+        controls.frameOffset = job.firstFrame;
+        for (controls.frame = 0; controls.frame < job.frameCount; controls.frame++) {
+            tracer.render(controls, job.width, job.height);
+        }
+        const int64_t samples = static_cast<int64_t>(job.frameCount) * controls.samplesPerFrame;
+        if (!coordinator.sendResult(reinterpret_cast<const float*>(tracer.accumulation().data()), job.width, job.height, samples)) {
+            return 1;
+        }
+    } while (coordinator.receiveJob(job) && job.frameCount > 0);
+    return 0;
+}
 
 int main(int argc, char** argv) {
     if (argc < 2) {
-        std::cout << "Usage: ./main <file name> \n";
+        std::cout << "Usage: ./main <file.obj | scene.xml | settings.ini> [--cpu] [--frames <count>] [--output <file>]\n"
+                     "       [--width <pixels>] [--height <pixels>] [--scale <0.1-1>]\n"
+                     "       [--sequence <pattern> --capture-every <frames>] [--pipe <command>]\n"
+                     "       [--spp <samples>] [--samples-per-frame <paths>] [--preview-samples <paths>]\n"
+                     "       [--farm <local workers>] [--listen <port>] [--shards <count>] [--worker <host:port>]\n"
+                     "       [--integrator megakernel|wavefront] [--timings] [--backend pipeline|rayquery]\n"
+                     "       [--workgroup <W>x<H>] [--material-cache <materials>] [--compare-backends]\n"
+                     "       [--validate-picks]\n"
+                     "       [--compress-textures] [--texture-budget <MB>]\n"
+                     "       [--stream-geometry] [--cluster-triangles <count>] [--geometry-budget <MB>]\n"
+                     "       [--lod-levels <count>] [--lod-pixels <pixels>] [--bundle <file>]\n"
+                     "       [--environment <file.hdr|file.pfm>] [--environment-intensity <scale>]\n"
+                     "       [--environment-sampling importance|uniform]\n"
+                     "       [--light-groups <count>] [--light-group <N>=<intensity>[:<r>,<g>,<b>]]\n"
+                     "       [--guiding] [--guiding-iterations <count>] [--guiding-bsdf-fraction <0-1>] (experimental, off by default)\n"
+                     "       [--restir] [--restir-candidates <count>] [--restir-neighbors <0-8>] [--restir-unbiased]\n"
+                     "       [--radiance-cache] [--cache-budget <MB>] [--cache-resolution <cells>] [--cache-footprint <cells>]\n"
+                     "       [--cache-update-stride <samples>]\n"
+                     "       [--views <file> | --orbit <count>] [--view-output <pattern>]\n"
+                     "       [--checkpoint <file>] [--checkpoint-every <frames>] [--resume <file>]\n";
         return 0;
     }
-    Context context;
+    RenderSettings settings = parseRenderSettings(argc, argv);
+    if (settings.farm.localWorkers > 0 || settings.farm.port > 0) {
+        return runFarmCoordinator(settings, argc, argv);
+    }
 
-    //  ==================== SWAPCHAIN & COMMAND BUFFER ====================
-    vk::SwapchainCreateInfoKHR scInfo;
-    scInfo.setSurface(*context.surface);
-    scInfo.setMinImageCount(3);
-    scInfo.setImageFormat(vk::Format::eR8G8B8A8Unorm);
-    scInfo.setImageColorSpace(vk::ColorSpaceKHR::eSrgbNonlinear);
-    scInfo.setImageExtent({WIDTH, HEIGHT});
-    scInfo.setImageArrayLayers(1);
-    scInfo.setImageUsage(vk::ImageUsageFlagBits::eTransferDst);
-    scInfo.setPreTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity);
-    scInfo.setPresentMode(vk::PresentModeKHR::eFifo);
-    scInfo.setClipped(true);
-    scInfo.setQueueFamilyIndices(context.queueFamilyIndex);
-    vk::UniqueSwapchainKHR sc = context.device->createSwapchainKHRUnique(scInfo);
-
-    std::vector<vk::Image> scImages = context.device->getSwapchainImagesKHR(*sc);
-
-    vk::CommandBufferAllocateInfo commandBufferInfo;
-    commandBufferInfo.setCommandPool(*context.commandPool);
-    commandBufferInfo.setCommandBufferCount(static_cast<uint32_t>(scImages.size()));
-    std::vector<vk::UniqueCommandBuffer> commandBuffers = context.device->allocateCommandBuffersUnique(commandBufferInfo);
+    // A worker takes the image size from its first shard
+    FarmConnection coordinator;
+    FarmJob farmJob;
+    if (!settings.farm.coordinator.empty()) {
+        coordinator = FarmConnection::connect(settings.farm.coordinator);
+        if (!coordinator.receiveJob(farmJob) || farmJob.frameCount == 0) {
+            return 0;
+        }
+        settings.width = farmJob.width;
+        settings.height = farmJob.height;
+    }
+    const bool farmWorker = coordinator.isOpen();
+    // Workers render at the job's size in a hidden window and never present
+    const bool presents = !farmWorker;
+    const OutputSettings& output = settings.output;
+    bool useCpu = settings.useCpu;
 
-    //  ==================== LOADING IMAGE & OBJECT DATA ====================
-    Image outputImage{context,
-                      {WIDTH, HEIGHT},
-                      vk::Format::eR8G8B8A8Unorm,
-                      vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst};
+    //  ==================== STARTUP TASKS ====================
+    // File loading and host side preprocessing run on the pool while the main
+    // thread creates the device (GLFW wants the main thread), see startup.report below.
+    StartupTimeline startup;
+    ThreadPool pool;
 
-    // Load mesh
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
     std::vector<Face> faces;
-    loadFromFile(vertices, indices, faces, argv[1]);
+    std::vector<std::string> texturePaths;
+    std::vector<MeshCluster> clusters;
+    std::vector<std::vector<MeshLod>> lods;
+    SerializedAccels serializedAccels;
+    const SceneBundle::Key bundleKey = SceneBundle::Key::of(
+        settings.meshPath, settings.geometry.clustered() ? static_cast<uint32_t>(settings.geometry.clusterTriangles) : 0,
+        static_cast<uint32_t>(settings.geometry.lodLevels));
+    bool bundleLoaded = false;
+    std::future<void> meshTask = pool.submit([&, tracesOnGpu = !useCpu] {
+        // A bundle of this mesh and these settings replaces parsing, clustering, LODs and BLAS builds
+        SceneBundle bundle;
+        if (tracesOnGpu && !settings.geometry.bundle.empty() &&
+            startup.time("read bundle", [&] { return readSceneBundle(settings.geometry.bundle, bundleKey, bundle); })) {
+            vertices = std::move(bundle.vertices);
+            indices = std::move(bundle.indices);
+            faces = std::move(bundle.faces);
+            texturePaths = std::move(bundle.texturePaths);
+            clusters = std::move(bundle.clusters);
+            lods = std::move(bundle.lods);
+            serializedAccels = std::move(bundle.accels);
+            bundleLoaded = true;
+            return;
+        }
+        startup.time("load mesh", [&] { loadFromFile(vertices, indices, faces, settings.meshPath, &texturePaths); });
+        if (tracesOnGpu) {
+            clusters = startup.time("clusters", [&] { return buildClusters(vertices, indices, faces, bundleKey.clusterTriangles); });
+        }
+    });
+    std::future<std::unordered_map<std::string, std::vector<char>>> shaderTask;
+    std::future<std::vector<uint32_t>> blueNoiseTask;
+    std::future<HdrImage> environmentTask;
+    if (!useCpu) {
+        shaderTask = pool.submit([&] { return startup.time("read shaders", [] { return Context::readShaderBlobs(); }); });
+        blueNoiseTask = pool.submit([&] { return startup.time("blue noise", [] { return generateBlueNoise(sobol::BlueNoiseSize); }); });
+        if (!settings.environment.path.empty()) {
+            environmentTask = pool.submit([&] {
+                return startup.time("read environment", [&] { return readHdrImage(settings.environment.path); });
+            });
+        }
+    } else if (!settings.environment.path.empty()) {
+        std::cerr << "The CPU tracer has no environment lighting, ignoring " << settings.environment.path << "." << std::endl;
+    }
 
-    Buffer vertexBuffer{context, Buffer::Type::AccelInput, sizeof(Vertex) * vertices.size(), vertices.data()};
-    Buffer indexBuffer{context, Buffer::Type::AccelInput, sizeof(uint32_t) * indices.size(), indices.data()};
-    Buffer faceBuffer{context, Buffer::Type::AccelInput, sizeof(Face) * faces.size(), faces.data()};
+    std::unique_ptr<Context> contextPtr;
+    if (!useCpu) {
+        try {
+            contextPtr = startup.time("device", [&] { return std::make_unique<Context>(settings.width, settings.height, presents); });
+        } catch (const std::exception& e) {
+            std::cerr << "Vulkan ray tracing unavailable (" << e.what() << "), falling back to the CPU tracer." << std::endl;
+            glfwTerminate();
+            useCpu = true;
+        }
+    }
+    meshTask.get();
 
-    //  ==================== CREATE TLAS & BLAS ====================
-    vk::AccelerationStructureGeometryTrianglesDataKHR triangleData;
-    triangleData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
-    triangleData.setVertexData(vertexBuffer.deviceAddress);
-    triangleData.setVertexStride(sizeof(Vertex));
-    triangleData.setMaxVertex(static_cast<uint32_t>(vertices.size()));
-    triangleData.setIndexType(vk::IndexType::eUint32);
-    triangleData.setIndexData(indexBuffer.deviceAddress);
-
-    vk::AccelerationStructureGeometryKHR triangleGeometry;
-    triangleGeometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
-    triangleGeometry.setGeometry({triangleData});
-    triangleGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
-
-    const auto primitiveCount = static_cast<uint32_t>(indices.size() / 3);
-
-    Accel bottomAccel{context, triangleGeometry, primitiveCount, vk::AccelerationStructureTypeKHR::eBottomLevel};
-
-    // Create top level accel struct
-    vk::TransformMatrixKHR transformMatrix = std::array{
-        std::array{1.0f, 0.0f, 0.0f, 0.0f},
-        std::array{0.0f, 1.0f, 0.0f, 0.0f},
-        std::array{0.0f, 0.0f, 1.0f, 0.0f},
+    if (useCpu) {
+        if (settings.views.enabled()) {
+            std::cerr << "The CPU tracer has no view batches, rendering the camera only." << std::endl;
+        }
+        if (farmWorker) {
+            return runCpuWorker(coordinator, farmJob, vertices, indices, faces, settings.camera);
+        }
+        return renderOnCpu(vertices, indices, faces, settings);
+    }
+    Context& context = *contextPtr;
+    context.controls = settings.camera;
+    if (farmWorker || settings.compareBackends) {
+        context.controls.accumulate = 1;
+    }
+    if (farmWorker) {
+        context.controls.frameOffset = farmJob.firstFrame;
+    }
+
+    // Checkpoints hold the composed accumulation only, light groups would compose it away,
+    // a resumed guided render would lack its guiding tree and a view batch has many images
+    const bool checkpointing = (!output.checkpoint.empty() || !output.resume.empty()) && !settings.compareBackends;
+    if (checkpointing && settings.lightGroups.count > 0) {
+        std::cerr << "Checkpoints don't cover light group accumulation, not checkpointing." << std::endl;
+    }
+    if (checkpointing && settings.guiding.enabled) {
+        std::cerr << "Checkpoints don't cover the path guiding tree, not checkpointing." << std::endl;
+    }
+    if (checkpointing && settings.views.enabled()) {
+        std::cerr << "Checkpoints don't cover view batches, not checkpointing." << std::endl;
+    }
+    const bool useCheckpoints = checkpointing && settings.lightGroups.count == 0 && !settings.guiding.enabled && !settings.views.enabled();
+    const uint64_t settingsHash = useCheckpoints ? checkpointHash(settings) : 0;
+    Checkpoint checkpoint;
+    if (useCheckpoints && !output.resume.empty()) {
+        if (!readCheckpoint(output.resume, checkpoint)) {
+            std::cerr << "No checkpoint in " << output.resume << ", starting over." << std::endl;
+        } else if (checkpoint.hash != settingsHash) {
+            std::cerr << "Checkpoint " << output.resume << " is of another scene or other settings, starting over." << std::endl;
+            checkpoint = {};
+        } else {
+            context.controls = checkpoint.controls;
+        }
+    }
+
+    context.shaderBlobs = shaderTask.get();
+    // The host BVH is only needed by picking and framing, build it alongside the GPU setup
+    std::future<std::unique_ptr<SceneQuery>> sceneQueryTask = pool.submit([&] {
+        return startup.time("host BVH", [&] { return std::make_unique<SceneQuery>(vertices, indices, faces); });
+    });
+
+    //  ==================== SWAPCHAIN & COMMAND BUFFER ====================
+    Swapchain swapchain = startup.time("swapchain", [&] { return Swapchain{context}; });
+
+    // Recorded once per swapchain image and frame parity, see recordCommandBuffers
+    auto allocateCommandBuffers = [&] {
+        vk::CommandBufferAllocateInfo commandBufferInfo;
+        commandBufferInfo.setCommandPool(*context.commandPool);
+        commandBufferInfo.setCommandBufferCount(static_cast<uint32_t>(2 * swapchain.images.size()));
+        return context.device->allocateCommandBuffersUnique(commandBufferInfo);
     };
+    std::vector<vk::UniqueCommandBuffer> commandBuffers = allocateCommandBuffers();
 
-    vk::AccelerationStructureInstanceKHR accelInstance;
-    accelInstance.setTransform(transformMatrix);
-    accelInstance.setMask(0xFF);
-    accelInstance.setAccelerationStructureReference(bottomAccel.buffer.deviceAddress);
-    accelInstance.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+    // Up to FramesInFlight frames are queued at once, each acquiring with its own semaphore
+    // and fenced on its own. Present waits for the image's render-finished semaphore, and
+    // imageFences holds the fence of the frame last submitted to each image, whose command
+    // buffers and controls slot the next frame on that image reuses.
+    constexpr uint32_t FramesInFlight = 2;
+    struct FrameSync {
+        vk::UniqueSemaphore imageAcquired;
+        vk::UniqueFence submitted;
+    };
+    std::array<FrameSync, FramesInFlight> frameSync;
+    for (FrameSync& sync : frameSync) {
+        sync.imageAcquired = context.device->createSemaphoreUnique({});
+        sync.submitted = context.device->createFenceUnique({vk::FenceCreateFlagBits::eSignaled});
+    }
+    std::vector<vk::UniqueSemaphore> renderFinished;
+    std::vector<vk::Fence> imageFences;
+    auto createPresentSync = [&] {
+        renderFinished.clear();
+        for (size_t image = 0; image < swapchain.images.size(); image++) {
+            renderFinished.push_back(context.device->createSemaphoreUnique({}));
+        }
+        imageFences.assign(swapchain.images.size(), nullptr);
+    };
+    createPresentSync();
 
-    Buffer instancesBuffer{context, Buffer::Type::AccelInput, sizeof(vk::AccelerationStructureInstanceKHR), &accelInstance};
+    //  ==================== LOADING IMAGE & OBJECT DATA ====================
+    // The output is settings.width x settings.height whatever size the window's framebuffer
+    // ends up, the swapchain blit only scales it for display. Interactive frames trace at
+    // renderScale of it, accumulated frames always at full resolution.
+    const vk::Extent2D outputExtent{static_cast<uint32_t>(std::max(1, settings.width)), static_cast<uint32_t>(std::max(1, settings.height))};
+    auto traceExtent = [&] {
+        const float scale = context.controls.accumulate == 1 ? 1.0f : settings.renderScale;
+        return vk::Extent2D{std::max(1u, static_cast<uint32_t>(static_cast<float>(outputExtent.width) * scale)),
+                            std::max(1u, static_cast<uint32_t>(static_cast<float>(outputExtent.height) * scale))};
+    };
+    // The largest rectangle of the output's aspect centered in the swapchain image, the rest is cleared
+    auto displayRect = [&] {
+        const float scale = std::min(static_cast<float>(swapchain.extent.width) / outputExtent.width,
+                                     static_cast<float>(swapchain.extent.height) / outputExtent.height);
+        const vk::Extent2D extent{std::clamp(static_cast<uint32_t>(outputExtent.width * scale + 0.5f), 1u, swapchain.extent.width),
+                                  std::clamp(static_cast<uint32_t>(outputExtent.height * scale + 0.5f), 1u, swapchain.extent.height)};
+        const vk::Offset2D offset{static_cast<int32_t>((swapchain.extent.width - extent.width) / 2),
+                                  static_cast<int32_t>((swapchain.extent.height - extent.height) / 2)};
+        return std::make_pair(offset, extent);
+    };
 
-    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
-    instancesData.setArrayOfPointers(false);
-    instancesData.setData(instancesBuffer.deviceAddress);
+    const vk::Format outputFormat = vk::Format::eR32G32B32A32Sfloat;
+    const vk::ImageUsageFlags outputUsage =
+        vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+    vk::Extent2D renderExtent = traceExtent();
 
-    vk::AccelerationStructureGeometryKHR instanceGeometry;
-    instanceGeometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
-    instanceGeometry.setGeometry({instancesData});
-    instanceGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+    // Linear filtering of float formats is optional
+    const vk::FormatProperties outputFormatProperties = context.physicalDevice.getFormatProperties(outputFormat);
+    const vk::Filter upscaleFilter = outputFormatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear
+                                         ? vk::Filter::eLinear
+                                         : vk::Filter::eNearest;
 
-    Accel topAccel{context, instanceGeometry, 1, vk::AccelerationStructureTypeKHR::eTopLevel};
+    // Sampler tables, see sampler.glsl
+    const std::vector<uint32_t> sobolMatrices = sobol::generatorMatrices();
+    const std::vector<uint32_t> blueNoise = blueNoiseTask.get();
+    Buffer sobolBuffer{context, Buffer::Type::Storage, sizeof(uint32_t) * sobolMatrices.size(), sobolMatrices.data()};
+    Buffer blueNoiseBuffer{context, Buffer::Type::Storage, sizeof(uint32_t) * blueNoise.size(), blueNoise.data()};
 
-    //  ==================== SHADERS ====================
-    const std::vector<char> raygenCode = readFile("../shaders/raygen.rgen.spv");
-    const std::vector<char> missCode = readFile("../shaders/miss.rmiss.spv");
-    const std::vector<char> chitCode = readFile("../shaders/closesthit.rchit.spv");
+    //  ==================== TEXTURES ====================
+    TextureSet textures = startup.time("textures", [&] { return TextureSet{context, texturePaths, settings.textures, pool}; });
+    std::cout << textures.report() << std::endl;
 
-    std::vector<vk::UniqueShaderModule> shaderModules(3);
-    shaderModules[0] = context.device->createShaderModuleUnique({{}, raygenCode.size(), reinterpret_cast<const uint32_t*>(raygenCode.data())});
-    shaderModules[1] = context.device->createShaderModuleUnique({{}, missCode.size(), reinterpret_cast<const uint32_t*>(missCode.data())});
-    shaderModules[2] = context.device->createShaderModuleUnique({{}, chitCode.size(), reinterpret_cast<const uint32_t*>(chitCode.data())});
+    //  ==================== ENVIRONMENT ====================
+    HdrImage environmentImage;
+    if (environmentTask.valid()) {
+        try {
+            environmentImage = environmentTask.get();
+        } catch (const std::exception& e) {
+            std::cerr << "Environment not loaded (" << e.what() << "), misses stay black." << std::endl;
+        }
+    }
+    EnvironmentMap environment = startup.time("environment", [&] {
+        return EnvironmentMap{context, environmentImage, settings.environment, pool};
+    });
+    environmentImage = {};
+    std::cout << environment.report() << std::endl;
 
-    std::vector<vk::PipelineShaderStageCreateInfo> shaderStages(3);
-    shaderStages[0] = {{}, vk::ShaderStageFlagBits::eRaygenKHR, *shaderModules[0], "main"};
-    shaderStages[1] = {{}, vk::ShaderStageFlagBits::eMissKHR, *shaderModules[1], "main"};
-    shaderStages[2] = {{}, vk::ShaderStageFlagBits::eClosestHitKHR, *shaderModules[2], "main"};
+    //  ==================== VIEW BATCH ====================
+    std::vector<BatchView> batchViews;
+    if (settings.views.enabled() && settings.integrator == Integrator::Wavefront) {
+        std::cerr << "View batches need the megakernel integrator, rendering the camera only." << std::endl;
+    } else if (settings.views.enabled() && settings.compareBackends) {
+        std::cerr << "View batches don't run with --compare-backends, rendering the camera only." << std::endl;
+    } else if (!settings.views.viewsPath.empty()) {
+        batchViews = readViews(settings.views.viewsPath, settings.camera.fov);
+    } else if (settings.views.orbitViews > 0) {
+        batchViews = orbitViews(settings.views.orbitViews, vertices, settings.camera);
+    }
+    ViewBatch viewBatch{context, std::move(batchViews),
+                        {static_cast<uint32_t>(settings.width), static_cast<uint32_t>(settings.height)}};
+    std::cout << viewBatch.report() << std::endl;
 
-    std::vector<vk::RayTracingShaderGroupCreateInfoKHR> shaderGroups(3);
-    shaderGroups[0] = {vk::RayTracingShaderGroupTypeKHR::eGeneral, 0, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
-    shaderGroups[1] = {vk::RayTracingShaderGroupTypeKHR::eGeneral, 1, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
-    shaderGroups[2] = {vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup, VK_SHADER_UNUSED_KHR, 2, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+    //  ==================== LIGHT GROUPS ====================
+    LightGroupSettings lightGroupSettings = settings.lightGroups;
+    if (settings.integrator == Integrator::Wavefront && lightGroupSettings.count > 0) {
+        std::cerr << "Light groups need the megakernel integrator, summing all emitters." << std::endl;
+        lightGroupSettings.count = 0;
+    } else if (viewBatch.count() > 0 && lightGroupSettings.count > 0) {
+        std::cerr << "View batches accumulate without light groups, summing all emitters." << std::endl;
+        lightGroupSettings.count = 0;
+    }
+    LightGroups lightGroups{context, vertices, indices, faces, lightGroupSettings, environment.enabled()};
+    std::cout << lightGroups.report() << std::endl;
+
+    //  ==================== PATH GUIDING ====================
+    GuidingSettings guidingSettings = settings.guiding;
+    if (guidingSettings.enabled && settings.integrator == Integrator::Wavefront) {
+        std::cerr << "Path guiding needs the megakernel integrator, sampling the BSDF only." << std::endl;
+        guidingSettings.enabled = false;
+    } else if (guidingSettings.enabled && settings.compareBackends) {
+        std::cerr << "Path guiding restarts would skew the backend timings, sampling the BSDF only." << std::endl;
+        guidingSettings.enabled = false;
+    }
+    PathGuiding guiding{context, vertices, guidingSettings};
+    std::cout << guiding.report() << std::endl;
+
+    // Raygen writes this frame's samples and first-hit G-buffer, reproject.comp blends them into
+    // the accumulation. G-buffer and accumulation ping-pong so the previous frame stays readable.
+    struct FrameImages {
+        Image sample;
+        std::array<Image, 2> accumulation;
+        std::array<Image, 2> position;
+        std::array<Image, 2> normal;
+        Image firstBrdf;  // For the light resampling passes, see integrator.glsl
+        // Per pixel RGB of each light group, see light_groups.glsl
+        Buffer groupSamples;
+        std::array<Buffer, 2> groupAccumulation;
+    };
+    auto createFrameImages = [&](vk::Extent2D extent) {
+        auto storage = [&](vk::Format format, vk::ImageUsageFlags usage = {}) {
+            return Image{context, extent, format, vk::ImageUsageFlagBits::eStorage | usage};
+        };
+        const vk::DeviceSize groupBytes = sizeof(float) * 3 * std::max(1u, lightGroups.count()) * extent.width * extent.height;
+        auto groupBuffer = [&] { return Buffer{context, Buffer::Type::DeviceStorage, groupBytes}; };
+        return FrameImages{
+            storage(outputFormat),
+            {Image{context, extent, outputFormat, outputUsage}, Image{context, extent, outputFormat, outputUsage}},
+            // Also read back by --validate-picks
+            {storage(vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eTransferSrc),
+             storage(vk::Format::eR32G32B32A32Sfloat, vk::ImageUsageFlagBits::eTransferSrc)},
+            {storage(vk::Format::eR16G16B16A16Sfloat), storage(vk::Format::eR16G16B16A16Sfloat)},
+            storage(vk::Format::eR16G16B16A16Sfloat),
+            groupBuffer(),
+            {groupBuffer(), groupBuffer()},
+        };
+    };
+    FrameImages frameImages = createFrameImages(renderExtent);
+    int current = 1;  // Parity of the latest accumulation, flipped before each frame
 
-    //  ==================== PIPELINE & DESCRIPTOR SETS ====================
+    // A resumed checkpoint becomes the latest accumulation, see resumedHistory in reproject.comp
+    bool resumed = false;
+    if (!checkpoint.pixels.empty()) {
+        if (static_cast<uint32_t>(checkpoint.width) != renderExtent.width || static_cast<uint32_t>(checkpoint.height) != renderExtent.height) {
+            std::cerr << "Checkpoint is " << checkpoint.width << "x" << checkpoint.height << ", rendering " << renderExtent.width << "x"
+                      << renderExtent.height << ", starting over." << std::endl;
+            context.controls.frame = 0;
+        } else {
+            Buffer staging{context, Buffer::Type::Staging, sizeof(float) * checkpoint.pixels.size(), checkpoint.pixels.data()};
+            const vk::Image image = *frameImages.accumulation[current].image;
+            const vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+            context.transferSubmit(
+                [&](vk::CommandBuffer commandBuffer) {
+                    Image::setImageLayout(commandBuffer, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+                    vk::BufferImageCopy region;
+                    region.setImageSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+                    region.setImageExtent({renderExtent.width, renderExtent.height, 1});
+                    commandBuffer.copyBufferToImage(*staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+                },
+                {{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead, vk::ImageLayout::eTransferDstOptimal,
+                  vk::ImageLayout::eGeneral, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, range}});
+            resumed = context.controls.frame > 0;
+            std::cout << "Resumed " << output.resume << " at frame " << context.controls.frame << std::endl;
+        }
+        checkpoint = {};
+    }
+
+    //  ==================== BACKEND ====================
+    Backend backend = settings.backend;
+    if (backend == Backend::Pipeline && !context.rayTracingPipelineSupported) {
+        std::cerr << "Ray tracing pipelines unavailable, using the ray query backend." << std::endl;
+        backend = Backend::RayQuery;
+    } else if (backend == Backend::RayQuery && !context.rayQuerySupported) {
+        std::cerr << "Ray queries unavailable, using the ray tracing pipeline backend." << std::endl;
+        backend = Backend::Pipeline;
+    }
+    if (settings.integrator == Integrator::Wavefront && !context.rayTracingPipelineSupported) {
+        throw std::runtime_error("The wavefront integrator needs ray tracing pipelines!");
+    }
+    // Backends timed one after the other by --compare-backends
+    std::vector<Backend> backends{backend};
+    if (settings.compareBackends) {
+        backends.clear();
+        if (context.rayTracingPipelineSupported) backends.push_back(Backend::Pipeline);
+        if (context.rayQuerySupported) backends.push_back(Backend::RayQuery);
+        backend = backends.front();
+    }
+    auto usesBackend = [&](Backend candidate) { return std::find(backends.begin(), backends.end(), candidate) != backends.end(); };
+
+    //  ==================== LIGHT RESAMPLING ====================
+    // Decided ahead of the pipelines, RESAMPLED_LIGHTS is a specialization constant of both backends
+    bool resampleLights = settings.resampling.enabled;
+    const bool hasEmitters = std::any_of(faces.begin(), faces.end(), [](const Face& face) {
+        return face.emission[0] > 0.0f || face.emission[1] > 0.0f || face.emission[2] > 0.0f;
+    });
+    if (resampleLights && settings.integrator == Integrator::Wavefront) {
+        std::cerr << "Resampled lights need the megakernel integrator, finding emitters by the BSDF only." << std::endl;
+        resampleLights = false;
+    } else if (resampleLights && !context.rayQuerySupported) {
+        std::cerr << "Resampled lights need ray queries, finding emitters by the BSDF only." << std::endl;
+        resampleLights = false;
+    } else if (resampleLights && lightGroups.count() > 0) {
+        std::cerr << "Resampled lights are summed without light groups, finding emitters by the BSDF only." << std::endl;
+        resampleLights = false;
+    } else if (resampleLights && viewBatch.count() > 0) {
+        std::cerr << "View batches accumulate without resampled lights, finding emitters by the BSDF only." << std::endl;
+        resampleLights = false;
+    } else if (resampleLights && !hasEmitters) {
+        std::cerr << "No emissive faces to resample, finding emitters by the BSDF only." << std::endl;
+        resampleLights = false;
+    }
+
+    //  ==================== RADIANCE CACHE ====================
+    RadianceCacheSettings cacheSettings = settings.radianceCache;
+    if (cacheSettings.enabled && settings.integrator == Integrator::Wavefront) {
+        std::cerr << "The radiance cache needs the megakernel integrator, tracing full paths." << std::endl;
+        cacheSettings.enabled = false;
+    } else if (cacheSettings.enabled && lightGroups.count() > 0) {
+        std::cerr << "Cached radiance is summed without light groups, tracing full paths." << std::endl;
+        cacheSettings.enabled = false;
+    } else if (cacheSettings.enabled && viewBatch.count() > 0) {
+        std::cerr << "View batches accumulate without the radiance cache, tracing full paths." << std::endl;
+        cacheSettings.enabled = false;
+    }
+    RadianceCache radianceCache{context, vertices, cacheSettings};
+    std::cout << radianceCache.report() << std::endl;
+
+    //  ==================== PIPELINE LAYOUT & DESCRIPTOR SETS ====================
+    // Shared by raygen.rgen and pathtrace.comp
+    vk::ShaderStageFlags traceStages = vk::ShaderStageFlagBits::eCompute;
+    vk::ShaderStageFlags hitStages = vk::ShaderStageFlagBits::eCompute;
+    vk::ShaderStageFlags missStages = vk::ShaderStageFlagBits::eCompute;
+    vk::PipelineStageFlags tracePipelineStages = vk::PipelineStageFlagBits::eComputeShader;
+    if (context.rayTracingPipelineSupported) {
+        traceStages |= vk::ShaderStageFlagBits::eRaygenKHR;
+        hitStages |= vk::ShaderStageFlagBits::eClosestHitKHR;
+        missStages |= vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eMissKHR;
+        tracePipelineStages |= vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+    }
     std::vector<vk::DescriptorSetLayoutBinding> bindings{
-        {0, vk::DescriptorType::eAccelerationStructureKHR, 1, vk::ShaderStageFlagBits::eRaygenKHR},  // Binding = 0 : TLAS
-        {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eRaygenKHR},              // Binding = 1 : Storage image
-        {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},         // Binding = 2 : Vertices
-        {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},         // Binding = 3 : Indices
-        {4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},         // Binding = 4 : Faces
+        {0, vk::DescriptorType::eAccelerationStructureKHR, 1, traceStages},  // Binding = 0 : TLAS
+        {1, vk::DescriptorType::eStorageImage, 1, traceStages},              // Binding = 1 : Storage image
+        {2, vk::DescriptorType::eStorageBuffer, 1, hitStages},               // Binding = 2 : Vertices
+        {3, vk::DescriptorType::eStorageBuffer, 1, hitStages},               // Binding = 3 : Indices
+        {4, vk::DescriptorType::eStorageBuffer, 1, hitStages},               // Binding = 4 : Faces
+        {5, vk::DescriptorType::eStorageBuffer, 1, traceStages},             // Binding = 5 : Sobol matrices
+        {6, vk::DescriptorType::eStorageBuffer, 1, traceStages},             // Binding = 6 : Blue noise
+        {7, vk::DescriptorType::eStorageImage, 1, traceStages},              // Binding = 7 : First-hit position
+        {8, vk::DescriptorType::eStorageImage, 1, traceStages},              // Binding = 8 : First-hit normal
+        {LightResampling::BrdfBinding, vk::DescriptorType::eStorageImage, 1, traceStages},  // Binding = 9 : First-hit BRDF
+        {RadianceCache::HeaderBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},  // Binding = 10 : Radiance cache header
+        {RadianceCache::CellsBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},   // Binding = 11 : Radiance cache cells
+        {TextureSet::Binding, vk::DescriptorType::eCombinedImageSampler, textures.count(), hitStages},  // Binding = 13 : Diffuse maps
+        {14, vk::DescriptorType::eUniformBufferDynamic, 1, traceStages},  // Binding = 14 : Controls
+        {GeometryResidency::PrimitivesBinding, vk::DescriptorType::eStorageBuffer, 1, hitStages},  // Binding = 15 : Cluster primitives
+        {GeometryResidency::HitsBinding, vk::DescriptorType::eStorageBuffer, 1, hitStages},        // Binding = 16 : Cluster hits
+        {EnvironmentMap::Binding, vk::DescriptorType::eStorageBuffer, 1, missStages},              // Binding = 17 : Environment
+        {LightGroups::TableBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},           // Binding = 18 : Light groups
+        {LightGroups::SamplesBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},         // Binding = 19 : Group samples
+        {PathGuiding::TreeBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},            // Binding = 20 : Guiding tree
+        {PathGuiding::RecordsBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},         // Binding = 21 : Guiding records
+        {ViewBatch::ViewsBinding, vk::DescriptorType::eStorageBuffer, 1, traceStages},             // Binding = 22 : Batch views
+        {ViewBatch::ImageBinding, vk::DescriptorType::eStorageImage, 1, traceStages},              // Binding = 23 : View accumulation
+        {GeometryResidency::MaterialsBinding, vk::DescriptorType::eStorageBuffer, 1, hitStages},      // Binding = 24 : Materials
+        {GeometryResidency::FaceMaterialsBinding, vk::DescriptorType::eStorageBuffer, 1, hitStages},  // Binding = 25 : Face materials
     };
 
     vk::DescriptorSetLayoutCreateInfo descSetLayoutInfo;
     descSetLayoutInfo.setBindings(bindings);
     vk::UniqueDescriptorSetLayout descSetLayout = context.device->createDescriptorSetLayoutUnique(descSetLayoutInfo);
 
-    vk::PushConstantRange pushRange;
-    pushRange.setOffset(0);
-    pushRange.setSize(sizeof(Controls));
-    pushRange.setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR);
-
     vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
     pipelineLayoutInfo.setSetLayouts(*descSetLayout);
-    pipelineLayoutInfo.setPushConstantRanges(pushRange);
     vk::UniquePipelineLayout pipelineLayout = context.device->createPipelineLayoutUnique(pipelineLayoutInfo);
 
-    vk::RayTracingPipelineCreateInfoKHR rtPipelineInfo;
-    rtPipelineInfo.setStages(shaderStages);
-    rtPipelineInfo.setGroups(shaderGroups);
-    rtPipelineInfo.setMaxPipelineRayRecursionDepth(4);
-    rtPipelineInfo.setLayout(*pipelineLayout);
+    //  ==================== PIPELINES ====================
+    // Compiled on the pool while the main thread builds the acceleration structures
+    vk::UniquePipeline pipeline;
+    Buffer raygenSBT, missSBT, hitSBT;
+    vk::StridedDeviceAddressRegionKHR raygenRegion, missRegion, hitRegion;
+    vk::UniquePipeline rayQueryPipeline;
+    const RayQuerySettings& rayQuery = settings.rayQuery;
+    std::future<void> pipelineTask = pool.submit([&] {
+        startup.time("pipelines", [&] {
+            // Ray tracing pipeline and its shader binding table
+            if (usesBackend(Backend::Pipeline) && settings.integrator == Integrator::Megakernel) {
+                std::vector<vk::UniqueShaderModule> shaderModules(3);
+                shaderModules[0] = context.loadShader("raygen.rgen.spv");
+                shaderModules[1] = context.loadShader("miss.rmiss.spv");
+                shaderModules[2] = context.loadShader("closesthit.rchit.spv");
 
-    auto result = context.device->createRayTracingPipelineKHRUnique(nullptr, nullptr, rtPipelineInfo);
-    if (result.result != vk::Result::eSuccess) {
-        throw std::runtime_error("Failed to create RT pipeline!");
-    }
+                // Cluster hits are only counted for geometry streaming, see clusters.glsl
+                const vk::Bool32 countClusterHits = settings.geometry.stream;
+                vk::SpecializationMapEntry countHitsEntry{3, 0, sizeof(vk::Bool32)};
+                vk::SpecializationInfo hitSpecialization{1, &countHitsEntry, sizeof(vk::Bool32), &countClusterHits};
+                const std::array<uint32_t, 5> raygenConstants{lightGroups.count(), static_cast<vk::Bool32>(guiding.enabled()), viewBatch.count(),
+                                                              static_cast<vk::Bool32>(resampleLights),
+                                                              static_cast<vk::Bool32>(radianceCache.enabled())};
+                const std::array<vk::SpecializationMapEntry, 5> raygenEntries{
+                    vk::SpecializationMapEntry{4, 0, sizeof(uint32_t)}, vk::SpecializationMapEntry{5, sizeof(uint32_t), sizeof(vk::Bool32)},
+                    vk::SpecializationMapEntry{6, 2 * sizeof(uint32_t), sizeof(uint32_t)},
+                    vk::SpecializationMapEntry{7, 3 * sizeof(uint32_t), sizeof(vk::Bool32)},
+                    vk::SpecializationMapEntry{8, 4 * sizeof(uint32_t), sizeof(vk::Bool32)}};
+                vk::SpecializationInfo raygenSpecialization;
+                raygenSpecialization.setMapEntries(raygenEntries);
+                raygenSpecialization.setDataSize(sizeof(raygenConstants));
+                raygenSpecialization.setPData(raygenConstants.data());
+                std::vector<vk::PipelineShaderStageCreateInfo> shaderStages(3);
+                shaderStages[0] = {{}, vk::ShaderStageFlagBits::eRaygenKHR, *shaderModules[0], "main", &raygenSpecialization};
+                shaderStages[1] = {{}, vk::ShaderStageFlagBits::eMissKHR, *shaderModules[1], "main"};
+                shaderStages[2] = {{}, vk::ShaderStageFlagBits::eClosestHitKHR, *shaderModules[2], "main", &hitSpecialization};
+
+                std::vector<vk::RayTracingShaderGroupCreateInfoKHR> shaderGroups(3);
+                using GroupType = vk::RayTracingShaderGroupTypeKHR;
+                shaderGroups[0] = {GroupType::eGeneral, 0, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+                shaderGroups[1] = {GroupType::eGeneral, 1, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+                shaderGroups[2] = {GroupType::eTrianglesHitGroup, VK_SHADER_UNUSED_KHR, 2, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR};
+
+                vk::RayTracingPipelineCreateInfoKHR rtPipelineInfo;
+                rtPipelineInfo.setStages(shaderStages);
+                rtPipelineInfo.setGroups(shaderGroups);
+                rtPipelineInfo.setMaxPipelineRayRecursionDepth(4);
+                rtPipelineInfo.setLayout(*pipelineLayout);
+
+                auto result = context.device->createRayTracingPipelineKHRUnique(nullptr, nullptr, rtPipelineInfo);
+                if (result.result != vk::Result::eSuccess) {
+                    throw std::runtime_error("Failed to create RT pipeline!");
+                }
 
-    vk::UniquePipeline pipeline = std::move(result.value);
+                pipeline = std::move(result.value);
 
-    //  ==================== MAKE RAYTRACING PROPERTIES ====================
-    auto properties = context.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
-    auto rtProperties = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+                using RtProperties = vk::PhysicalDeviceRayTracingPipelinePropertiesKHR;
+                auto rtProperties = context.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, RtProperties>().get<RtProperties>();
 
-    uint32_t handleSize = rtProperties.shaderGroupHandleSize;
-    uint32_t handleSizeAligned = rtProperties.shaderGroupHandleAlignment;
-    auto groupCount = static_cast<uint32_t>(shaderGroups.size());
-    uint32_t sbtSize = groupCount * handleSizeAligned;
+                uint32_t handleSize = rtProperties.shaderGroupHandleSize;
+                uint32_t handleSizeAligned = rtProperties.shaderGroupHandleAlignment;
+                auto groupCount = static_cast<uint32_t>(shaderGroups.size());
+                uint32_t sbtSize = groupCount * handleSizeAligned;
 
-    std::vector<uint8_t> handleStorage(sbtSize);
-    if (context.device->getRayTracingShaderGroupHandlesKHR(*pipeline, 0, groupCount, sbtSize, handleStorage.data()) != vk::Result::eSuccess) {
-        throw std::runtime_error("Failed to process RT group handles!");
+                std::vector<uint8_t> handleStorage(sbtSize);
+                if (context.device->getRayTracingShaderGroupHandlesKHR(*pipeline, 0, groupCount, sbtSize, handleStorage.data()) !=
+                    vk::Result::eSuccess) {
+                    throw std::runtime_error("Failed to process RT group handles!");
+                }
+
+                raygenSBT = Buffer{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 0 * handleSizeAligned};
+                missSBT = Buffer{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 1 * handleSizeAligned};
+                hitSBT = Buffer{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 2 * handleSizeAligned};
+
+                uint32_t stride = rtProperties.shaderGroupHandleAlignment;
+                uint32_t size = rtProperties.shaderGroupHandleAlignment;
+
+                raygenRegion = vk::StridedDeviceAddressRegionKHR{raygenSBT.deviceAddress, stride, size};
+                missRegion = vk::StridedDeviceAddressRegionKHR{missSBT.deviceAddress, stride, size};
+                hitRegion = vk::StridedDeviceAddressRegionKHR{hitSBT.deviceAddress, stride, size};
+            }
+
+            // Ray query pipeline
+            if (usesBackend(Backend::RayQuery) && settings.integrator == Integrator::Megakernel) {
+                // The material cache is clamped to the shared memory the device has
+                const uint32_t sharedMaterials = context.physicalDevice.getProperties().limits.maxComputeSharedMemorySize / sizeof(Face);
+                const std::array<uint32_t, 9> constants{static_cast<uint32_t>(rayQuery.workgroupWidth),
+                                                        static_cast<uint32_t>(rayQuery.workgroupHeight),
+                                                        std::min(static_cast<uint32_t>(rayQuery.materialCacheSize), sharedMaterials),
+                                                        static_cast<vk::Bool32>(settings.geometry.stream), lightGroups.count(),
+                                                        static_cast<vk::Bool32>(guiding.enabled()), viewBatch.count(),
+                                                        static_cast<vk::Bool32>(resampleLights),
+                                                        static_cast<vk::Bool32>(radianceCache.enabled())};
+                const std::array<vk::SpecializationMapEntry, 9> entries{vk::SpecializationMapEntry{0, 0, sizeof(uint32_t)},
+                                                                        vk::SpecializationMapEntry{1, sizeof(uint32_t), sizeof(uint32_t)},
+                                                                        vk::SpecializationMapEntry{2, 2 * sizeof(uint32_t), sizeof(uint32_t)},
+                                                                        vk::SpecializationMapEntry{3, 3 * sizeof(uint32_t), sizeof(vk::Bool32)},
+                                                                        vk::SpecializationMapEntry{4, 4 * sizeof(uint32_t), sizeof(uint32_t)},
+                                                                        vk::SpecializationMapEntry{5, 5 * sizeof(uint32_t), sizeof(vk::Bool32)},
+                                                                        vk::SpecializationMapEntry{6, 6 * sizeof(uint32_t), sizeof(uint32_t)},
+                                                                        vk::SpecializationMapEntry{7, 7 * sizeof(uint32_t), sizeof(vk::Bool32)},
+                                                                        vk::SpecializationMapEntry{8, 8 * sizeof(uint32_t), sizeof(vk::Bool32)}};
+                vk::SpecializationInfo specialization;
+                specialization.setMapEntries(entries);
+                specialization.setDataSize(sizeof(constants));
+                specialization.setPData(constants.data());
+
+                vk::UniqueShaderModule pathtraceModule = context.loadShader("pathtrace.comp.spv");
+                vk::ComputePipelineCreateInfo rayQueryPipelineInfo;
+                rayQueryPipelineInfo.setStage({{}, vk::ShaderStageFlagBits::eCompute, *pathtraceModule, "main", &specialization});
+                rayQueryPipelineInfo.setLayout(*pipelineLayout);
+                auto rayQueryResult = context.device->createComputePipelineUnique(nullptr, rayQueryPipelineInfo);
+                if (rayQueryResult.result != vk::Result::eSuccess) {
+                    throw std::runtime_error("Failed to create ray query pipeline!");
+                }
+                rayQueryPipeline = std::move(rayQueryResult.value);
+                std::cout << "Ray query workgroup " << constants[0] << "x" << constants[1] << ", material cache " << constants[2]
+                          << " faces" << std::endl;
+            }
+        });
+    });
+
+    //  ==================== CREATE TLAS & BLAS ====================
+    // One BLAS per cluster at its LOD level, paged against the device memory budget when streaming
+    if (settings.geometry.lodLevels > 1 && !bundleLoaded) {
+        lods = startup.time("mesh LODs", [&] { return buildClusterLods(vertices, indices, faces, clusters, settings.geometry.lodLevels, pool); });
+    }
+    GeometryResidency geometry = startup.time("acceleration structures", [&] {
+        return GeometryResidency{context, vertices, indices, faces, clusters, lods, std::move(serializedAccels), settings.geometry,
+                                 context.controls, renderExtent.height};
+    });
+    // Written when missing, stale or serialized by another driver, the next run loads it instead
+    if (!settings.geometry.bundle.empty() && !geometry.deserializing()) {
+        startup.time("write bundle", [&] {
+            try {
+                const SceneBundle bundle{vertices, indices, faces, texturePaths, clusters, lods, geometry.serializeAll()};
+                writeSceneBundle(settings.geometry.bundle, bundleKey, bundle);
+            } catch (const std::exception& e) {
+                std::cerr << "Scene bundle not written: " << e.what() << std::endl;
+            }
+        });
     }
+    clusters.clear();
+    lods.clear();
+    const Accel& topAccel = geometry.topLevel();
+    const Buffer& vertexBuffer = geometry.vertexBuffer();
+    const Buffer& indexBuffer = geometry.indexBuffer();
+    const Buffer& faceBuffer = geometry.faceBuffer();
+
+    //  ==================== REPROJECTION ====================
+    vk::UniqueShaderModule reprojectModule = context.loadShader("reproject.comp.spv");
 
-    //  ==================== BINDING SHADERS FOR RAYTRACING STRUCTURE ====================
-    Buffer raygenSBT{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 0 * handleSizeAligned};
-    Buffer missSBT{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 1 * handleSizeAligned};
-    Buffer hitSBT{context, Buffer::Type::ShaderBindingTable, handleSize, handleStorage.data() + 2 * handleSizeAligned};
+    std::vector<vk::DescriptorSetLayoutBinding> reprojectBindings;
+    for (uint32_t binding = 0; binding < 7; binding++) {
+        reprojectBindings.push_back({binding, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute});
+    }
+    reprojectBindings.push_back({7, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eCompute});
+    // Group samples, previous and current group accumulation
+    for (uint32_t binding = 8; binding < 11; binding++) {
+        reprojectBindings.push_back({binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute});
+    }
+    vk::DescriptorSetLayoutCreateInfo reprojectSetLayoutInfo;
+    reprojectSetLayoutInfo.setBindings(reprojectBindings);
+    vk::UniqueDescriptorSetLayout reprojectSetLayout = context.device->createDescriptorSetLayoutUnique(reprojectSetLayoutInfo);
 
-    uint32_t stride = rtProperties.shaderGroupHandleAlignment;
-    uint32_t size = rtProperties.shaderGroupHandleAlignment;
+    vk::PipelineLayoutCreateInfo reprojectLayoutInfo;
+    reprojectLayoutInfo.setSetLayouts(*reprojectSetLayout);
+    vk::UniquePipelineLayout reprojectLayout = context.device->createPipelineLayoutUnique(reprojectLayoutInfo);
 
-    vk::StridedDeviceAddressRegionKHR raygenRegion{raygenSBT.deviceAddress, stride, size};
-    vk::StridedDeviceAddressRegionKHR missRegion{missSBT.deviceAddress, stride, size};
-    vk::StridedDeviceAddressRegionKHR hitRegion{hitSBT.deviceAddress, stride, size};
+    vk::ComputePipelineCreateInfo reprojectPipelineInfo;
+    reprojectPipelineInfo.setStage({{}, vk::ShaderStageFlagBits::eCompute, *reprojectModule, "main"});
+    reprojectPipelineInfo.setLayout(*reprojectLayout);
+    auto reprojectResult = context.device->createComputePipelineUnique(nullptr, reprojectPipelineInfo);
+    if (reprojectResult.result != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to create reprojection pipeline!");
+    }
+    vk::UniquePipeline reprojectPipeline = std::move(reprojectResult.value);
+
+    ReprojectControls reprojectControls;
+    reprojectControls.previousCameraPosition = context.controls.cameraPosition;
+    reprojectControls.previousFov = context.controls.fov;
+
+    //  ==================== FRAME CONTROLS ====================
+    // Controls and reprojection controls of each frame, one slot per swapchain image. Only
+    // the slot is written per frame, the command buffers reading it are recorded once.
+    enum ControlsBlock : uint32_t { TraceControls = 0, ReprojectionControls = 1 };
+    UniformRing frameControls{context, static_cast<uint32_t>(swapchain.images.size()), {sizeof(Controls), sizeof(ReprojectControls)}};
+    const vk::DescriptorBufferInfo traceControlsInfo = frameControls.descriptorInfo(TraceControls);
+    const vk::DescriptorBufferInfo reprojectControlsInfo = frameControls.descriptorInfo(ReprojectionControls);
 
     //  ==================== CREATE DESCRIPTOR SETS ====================
-    vk::UniqueDescriptorSet descSet = context.allocateDescSet(*descSetLayout);
-    std::vector<vk::WriteDescriptorSet> writes(bindings.size());
-    for (int i = 0; i < bindings.size(); i++) {
-        writes[i].setDstSet(*descSet);
-        writes[i].setDescriptorType(bindings[i].descriptorType);
-        writes[i].setDescriptorCount(bindings[i].descriptorCount);
-        writes[i].setDstBinding(bindings[i].binding);
-    }
-    writes[0].setPNext(&topAccel.descAccelInfo);
-    writes[1].setImageInfo(outputImage.descImageInfo);
-    writes[2].setBufferInfo(vertexBuffer.descBufferInfo);
-    writes[3].setBufferInfo(indexBuffer.descBufferInfo);
-    writes[4].setBufferInfo(faceBuffer.descBufferInfo);
-    context.device->updateDescriptorSets(writes, nullptr);
+    // One set per frame parity for both passes
+    std::array<vk::UniqueDescriptorSet, 2> descSets{context.allocateDescSet(*descSetLayout), context.allocateDescSet(*descSetLayout)};
+    std::array<vk::UniqueDescriptorSet, 2> reprojectSets{context.allocateDescSet(*reprojectSetLayout),
+                                                         context.allocateDescSet(*reprojectSetLayout)};
+    for (const vk::UniqueDescriptorSet& descSet : descSets) {
+        std::vector<vk::WriteDescriptorSet> writes(bindings.size());
+        for (int i = 0; i < bindings.size(); i++) {
+            writes[i].setDstSet(*descSet);
+            writes[i].setDescriptorType(bindings[i].descriptorType);
+            writes[i].setDescriptorCount(bindings[i].descriptorCount);
+            writes[i].setDstBinding(bindings[i].binding);
+        }
+        writes[0].setPNext(&topAccel.descAccelInfo);
+        writes[2].setBufferInfo(vertexBuffer.descBufferInfo);
+        writes[3].setBufferInfo(indexBuffer.descBufferInfo);
+        writes[4].setBufferInfo(faceBuffer.descBufferInfo);
+        writes[5].setBufferInfo(sobolBuffer.descBufferInfo);
+        writes[6].setBufferInfo(blueNoiseBuffer.descBufferInfo);
+        writes[10].setBufferInfo(radianceCache.headerBuffer().descBufferInfo);
+        writes[11].setBufferInfo(radianceCache.cellBuffer().descBufferInfo);
+        writes[12].setImageInfo(textures.descriptorInfos());
+        writes[13].setBufferInfo(traceControlsInfo);
+        writes[14].setBufferInfo(geometry.primitiveBuffer().descBufferInfo);
+        writes[15].setBufferInfo(geometry.hitBuffer().descBufferInfo);
+        writes[16].setBufferInfo(environment.buffer().descBufferInfo);
+        writes[17].setBufferInfo(lightGroups.tableBuffer().descBufferInfo);
+        writes[19].setBufferInfo(guiding.treeBuffer().descBufferInfo);
+        writes[20].setBufferInfo(guiding.recordBuffer().descBufferInfo);
+        writes[21].setBufferInfo(viewBatch.viewBuffer().descBufferInfo);
+        writes[22].setImageInfo(viewBatch.image().descImageInfo);
+        writes[23].setBufferInfo(geometry.materialBuffer().descBufferInfo);
+        writes[24].setBufferInfo(geometry.faceMaterialBuffer().descBufferInfo);
+        // Frame images and group samples are written by writeFrameDescriptors
+        std::erase_if(writes, [](const vk::WriteDescriptorSet& write) {
+            return (write.descriptorType == vk::DescriptorType::eStorageImage && write.dstBinding != ViewBatch::ImageBinding) ||
+                   write.dstBinding == LightGroups::SamplesBinding;
+        });
+        context.device->updateDescriptorSets(writes, nullptr);
+    }
+    for (const vk::UniqueDescriptorSet& reprojectSet : reprojectSets) {
+        vk::WriteDescriptorSet write{*reprojectSet, 7, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, reprojectControlsInfo};
+        context.device->updateDescriptorSets(write, nullptr);
+    }
+
+    //  ==================== WAVEFRONT ====================
+    std::unique_ptr<WavefrontIntegrator> wavefront;
+    if (settings.integrator == Integrator::Wavefront) {
+        const SceneBindings scene{&topAccel, &vertexBuffer, &indexBuffer, &faceBuffer, &sobolBuffer, &blueNoiseBuffer, &textures,
+                                  &geometry.primitiveBuffer(), &geometry.hitBuffer(), &environment.buffer(), geometry.streaming()};
+        wavefront = startup.time("wavefront", [&] {
+            return std::make_unique<WavefrontIntegrator>(context, scene, traceControlsInfo, renderExtent);
+        });
+        std::cout << "Integrator: wavefront" << std::endl;
+    }
+
+    //  ==================== RESAMPLED LIGHTS ====================
+    std::unique_ptr<LightResampling> resampling;
+    if (resampleLights) {
+        resampling = startup.time("light resampling", [&] {
+            return std::make_unique<LightResampling>(context, topAccel, vertices, indices, faces, settings.resampling, traceControlsInfo,
+                                                     reprojectControlsInfo, renderExtent);
+        });
+        std::cout << resampling->report() << std::endl;
+    }
+    // Stage timings, averaged and printed every TimingReportFrames frames
+    constexpr int TimingReportFrames = 16;
+    std::unique_ptr<StageTimer> timer;
+    if (settings.stageTimings || settings.compareBackends) {
+        const uint32_t traceMarks = wavefront ? WavefrontIntegrator::MarksPerFrame : 1;
+        timer = std::make_unique<StageTimer>(context, traceMarks + (resampling ? LightResampling::MarksPerFrame : 0) +
+                                                          (radianceCache.enabled() ? RadianceCache::MarksPerFrame : 0) + 1);
+    }
+
+    auto writeFrameDescriptors = [&] {
+        std::vector<vk::WriteDescriptorSet> writes;
+        auto write = [&](vk::DescriptorSet set, uint32_t binding, const Image& image) {
+            writes.push_back({set, binding, 0, 1, vk::DescriptorType::eStorageImage, &image.descImageInfo});
+        };
+        auto writeBuffer = [&](vk::DescriptorSet set, uint32_t binding, const Buffer& buffer) {
+            writes.push_back({set, binding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &buffer.descBufferInfo});
+        };
+        for (int i = 0; i < 2; i++) {
+            const int previous = 1 - i;
+            write(*descSets[i], 1, frameImages.sample);
+            write(*descSets[i], 7, frameImages.position[i]);
+            write(*descSets[i], 8, frameImages.normal[i]);
+            write(*descSets[i], LightResampling::BrdfBinding, frameImages.firstBrdf);
+            write(*reprojectSets[i], 0, frameImages.sample);
+            write(*reprojectSets[i], 1, frameImages.position[i]);
+            write(*reprojectSets[i], 2, frameImages.normal[i]);
+            write(*reprojectSets[i], 3, frameImages.position[previous]);
+            write(*reprojectSets[i], 4, frameImages.normal[previous]);
+            write(*reprojectSets[i], 5, frameImages.accumulation[previous]);
+            write(*reprojectSets[i], 6, frameImages.accumulation[i]);
+            writeBuffer(*descSets[i], LightGroups::SamplesBinding, frameImages.groupSamples);
+            writeBuffer(*reprojectSets[i], 8, frameImages.groupSamples);
+            writeBuffer(*reprojectSets[i], 9, frameImages.groupAccumulation[previous]);
+            writeBuffer(*reprojectSets[i], 10, frameImages.groupAccumulation[i]);
+            if (wavefront) {
+                wavefront->bindImages(i, frameImages.sample, frameImages.position[i], frameImages.normal[i]);
+            }
+            if (resampling) {
+                resampling->bindImages(i, frameImages.sample, frameImages.position[i], frameImages.normal[i], frameImages.firstBrdf,
+                                       frameImages.position[previous], frameImages.normal[previous]);
+            }
+        }
+        context.device->updateDescriptorSets(writes, nullptr);
+    };
+    writeFrameDescriptors();
+
+    //  ==================== HOST SCENE QUERIES ====================
+    std::unique_ptr<SceneQuery> sceneQuery = sceneQueryTask.get();
+    // The first hit the last frame stored for a pixel of its trace extent, w its distance or 0 for a miss
+    auto readFirstHit = [&](uint32_t x, uint32_t y) {
+        Buffer texel{context, Buffer::Type::Readback, sizeof(glm::vec4)};
+        const vk::Image image = *frameImages.position[current].image;
+        context.device->waitIdle();
+        context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+            Image::setImageLayout(commandBuffer, image, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
+            vk::BufferImageCopy region;
+            region.setImageSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+            region.setImageOffset({static_cast<int32_t>(x), static_cast<int32_t>(y), 0});
+            region.setImageExtent({1, 1, 1});
+            commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, *texel.buffer, region);
+            Image::setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral);
+        });
+        glm::vec4 hit;
+        void* mapped = context.device->mapMemory(*texel.memory, 0, sizeof(glm::vec4));
+        if (!(texel.memoryFlags & vk::MemoryPropertyFlagBits::eHostCoherent)) {
+            context.device->invalidateMappedMemoryRanges(vk::MappedMemoryRange{*texel.memory, 0, VK_WHOLE_SIZE});
+        }
+        std::memcpy(&hit, mapped, sizeof(glm::vec4));
+        context.device->unmapMemory(*texel.memory);
+        return hit;
+    };
+    context.onPick = [&](double x, double y) {
+        RayHit hit;
+        int width, height;
+        glfwGetWindowSize(context.window, &width, &height);
+        if (settings.validatePicks) {
+            // The host ray aims at the GPU's hit, so sample 0's jitter within the pixel doesn't matter
+            const vk::Extent2D extent = renderExtent;  // Of the frame images, not yet resized to a changed traceExtent()
+            const auto px = std::min(static_cast<uint32_t>(x / width * extent.width), extent.width - 1);
+            const auto py = std::min(static_cast<uint32_t>(y / height * extent.height), extent.height - 1);
+            const glm::vec4 gpuHit = readFirstHit(px, py);
+            Ray ray = SceneQuery::cameraRay(context.controls, glm::vec2(px, py) + 0.5f, extent.width, extent.height);
+            float t = 0.0f;
+            if (gpuHit.w > 0.0f) {
+                ray.direction = glm::normalize(glm::vec3(gpuHit) - ray.origin);
+                t = glm::distance(glm::vec3(gpuHit), ray.origin);
+            }
+            std::cout << "Pick: GPU first hit " << (gpuHit.w > 0.0f ? "at distance " + std::to_string(t) : std::string("missed"))
+                      << (sceneQuery->validateHit(ray, t) ? ", host agrees" : ", host DISAGREES") << std::endl;
+        }
+        if (!sceneQuery->pick(context.controls, x, y, width, height, hit)) {
+            std::cout << "Pick: nothing under cursor" << std::endl;
+            return;
+        }
+        const Face& face = faces[hit.primitive];
+        std::cout << "Pick: primitive " << hit.primitive << " at distance " << hit.t << ", illum " << face.illum << ", diffuse ("
+                  << face.diffuse[0] << ", " << face.diffuse[1] << ", " << face.diffuse[2] << ")" << std::endl;
+    };
+    // Light group edits only change the composition in reproject.comp
+    context.onLightKey = [&](int key) {
+        if (lightGroups.count() == 0) {
+            return false;
+        }
+        if (key >= GLFW_KEY_0 && key <= GLFW_KEY_8) {
+            if (!lightGroups.select(key - GLFW_KEY_0)) {
+                return true;
+            }
+        } else if (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) {
+            lightGroups.adjust(key == GLFW_KEY_UP ? 0.1f : -0.1f, context.controls.light_intensity);
+        } else {
+            return false;
+        }
+        std::cout << lightGroups.describeSelection(context.controls.light_intensity) << std::endl;
+        return true;
+    };
+    context.onFrameScene = [&] {
+        context.controls.cameraPosition = sceneQuery->frameCamera(context.controls.fov,
+                                                                 static_cast<float>(outputExtent.width) / outputExtent.height);
+    };
+
+    std::vector<float> lightVisibility = sceneQuery->lightVisibility(context.controls.cameraPosition);
+    auto visibleLights = std::count_if(lightVisibility.begin(), lightVisibility.end(), [](float v) { return v > 0.0f; });
+    std::cout << "Emitters visible from camera: " << visibleLights << "/" << lightVisibility.size() << std::endl;
+
+    //  ==================== LIVE EDITS ====================
+    // Saved edits of the mesh and its materials are parsed on the pool, diffed against the
+    // loaded scene and patched into its buffers between frames
+    const bool liveEdits = !farmWorker && !settings.compareBackends;
+    SceneWatcher sceneWatcher{settings.meshPath};
+    std::future<LoadedMesh> reloadTask;
+    bool commandsDirty = true;  // The recorded frames reference stale state, see COMMAND RECORDING
+    auto applySceneEdit = [&](const LoadedMesh& mesh) {
+        using Milliseconds = std::chrono::duration<double, std::milli>;
+        const auto begin = std::chrono::steady_clock::now();
+        const SceneEdit edit = diffScene(vertices, indices, faces, texturePaths, mesh);
+        const auto diffed = std::chrono::steady_clock::now();
+        if (!edit.restart.empty()) {
+            std::cerr << "Scene edit not applied, " << edit.restart << ": restart to see it." << std::endl;
+            return;
+        }
+        if (edit.empty()) {
+            std::cout << "Scene edit: nothing changed (diff " << Milliseconds(diffed - begin).count() << " ms)" << std::endl;
+            return;
+        }
+
+        context.device->waitIdle();
+        std::cout << "Scene edit: diff " << Milliseconds(diffed - begin).count() << " ms";
+        if (!edit.faces.empty()) {
+            const auto start = std::chrono::steady_clock::now();
+            if (geometry.patchFaces(edit.faces)) {
+                for (const vk::UniqueDescriptorSet& descSet : descSets) {
+                    const vk::WriteDescriptorSet write{*descSet, GeometryResidency::MaterialsBinding, 0, vk::DescriptorType::eStorageBuffer,
+                                                       nullptr, geometry.materialBuffer().descBufferInfo};
+                    context.device->updateDescriptorSets(write, nullptr);
+                }
+                commandsDirty = true;
+            }
+            for (const auto& [primitive, face] : edit.faces) {
+                faces[primitive] = face;
+            }
+            std::cout << ", " << edit.faces.size() << " material face(s) patched in "
+                      << Milliseconds(std::chrono::steady_clock::now() - start).count() << " ms";
+        }
+        if (!edit.vertices.empty()) {
+            const auto start = std::chrono::steady_clock::now();
+            const uint32_t rebuilt = geometry.patchVertices(mesh.vertices, edit.vertices, indices);
+            for (uint32_t vertex : edit.vertices) {
+                vertices[vertex] = mesh.vertices[vertex];
+            }
+            std::cout << ", " << edit.vertices.size() << " vertices moved, " << rebuilt << " BLAS(es) and the TLAS rebuilt in "
+                      << Milliseconds(std::chrono::steady_clock::now() - start).count() << " ms";
+        }
+        // The host BVH keeps the emitters and the geometry it was built from
+        if (!edit.vertices.empty() || edit.emissionChanged) {
+            const auto start = std::chrono::steady_clock::now();
+            sceneQuery = std::make_unique<SceneQuery>(vertices, indices, faces);
+            std::cout << ", host BVH rebuilt in " << Milliseconds(std::chrono::steady_clock::now() - start).count() << " ms";
+        }
+        std::cout << std::endl;
+        if (edit.emissionChanged && lightGroups.count() > 0) {
+            std::cerr << "Light groups keep the emitters they were made from until a restart." << std::endl;
+        }
+        if ((edit.emissionChanged || !edit.vertices.empty()) && resampling) {
+            std::cerr << "Resampled lights keep the emitters they were made from until a restart." << std::endl;
+        }
+        // The tree and the cache learned the old scene's light
+        guiding.restart();
+        radianceCache.restart();
+        context.controls.frame = 0;
+    };
+
+    //  ==================== OUTPUT ====================
+    ImageWriter writer;
+    auto readback = std::make_unique<ReadbackRing>(context, renderExtent);
+    if (!output.pipeCommand.empty()) {
+        writer.openPipe(output.pipeCommand);
+    }
+
+    //  ==================== COMMAND RECORDING ====================
+    // One command buffer per swapchain image and frame parity, reading the controls of the
+    // image's ring slot. Re-recorded only when what they reference changes: resize, swapchain,
+    // backend or a material table that outgrew its buffer.
+    auto recordFrame = [&](vk::CommandBuffer commandBuffer, uint32_t image, int parity) {
+        const uint32_t controlsOffset = frameControls.offset(image % frameControls.slots());
+        commandBuffer.begin(vk::CommandBufferBeginInfo());
+        // The previous frame may still be reprojecting and blitting the images this one traces into
+        vk::MemoryBarrier previousFrame{vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                                       vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {},
+                                      previousFrame, nullptr, nullptr);
+        if (timer) {
+            timer->begin(commandBuffer);
+        }
+        if (wavefront) {
+            wavefront->record(commandBuffer, controlsOffset, parity, static_cast<uint32_t>(context.controls.samplesPerFrame), timer.get());
+        } else {
+            if (backend == Backend::Pipeline) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSets[parity], controlsOffset);
+                commandBuffer.traceRaysKHR(raygenRegion, missRegion, hitRegion, {}, renderExtent.width, renderExtent.height, 1);
+            } else {
+                const uint32_t groupWidth = static_cast<uint32_t>(rayQuery.workgroupWidth);
+                const uint32_t groupHeight = static_cast<uint32_t>(rayQuery.workgroupHeight);
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *rayQueryPipeline);
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descSets[parity], controlsOffset);
+                commandBuffer.dispatch((renderExtent.width + groupWidth - 1) / groupWidth, (renderExtent.height + groupHeight - 1) / groupHeight, 1);
+            }
+            if (timer) {
+                timer->mark(commandBuffer, "trace");
+            }
+        }
+
+        // The resampling passes add to the samples and the cache resolve rewrites the cells the trace wrote
+        vk::MemoryBarrier traceDone{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+        commandBuffer.pipelineBarrier(tracePipelineStages, vk::PipelineStageFlagBits::eComputeShader, {}, traceDone, nullptr, nullptr);
+        if (resampling) {
+            resampling->record(commandBuffer, controlsOffset, parity, timer.get());
+        }
+        radianceCache.record(commandBuffer, tracePipelineStages, timer.get());
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *reprojectPipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *reprojectLayout, 0, *reprojectSets[parity], controlsOffset);
+        commandBuffer.dispatch((renderExtent.width + 15) / 16, (renderExtent.height + 15) / 16, 1);
+
+        vk::MemoryBarrier reprojectDone{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead};
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, reprojectDone,
+                                      nullptr, nullptr);
+        if (timer) {
+            timer->mark(commandBuffer, "reproject");
+        }
+
+        // Farm workers never show their window, their frames stop at the accumulation
+        if (presents) {
+            vk::Image srcImage = *frameImages.accumulation[parity].image;
+            vk::Image dstImage = swapchain.images[image];
+            Image::setImageLayout(commandBuffer, srcImage, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
+            Image::setImageLayout(commandBuffer, dstImage, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+            const auto [displayOffset, displayExtent] = displayRect();
+            if (displayExtent != swapchain.extent) {
+                const vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+                commandBuffer.clearColorImage(dstImage, vk::ImageLayout::eTransferDstOptimal, vk::ClearColorValue{std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}},
+                                              range);
+                vk::MemoryBarrier cleared{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite};
+                commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, cleared, nullptr,
+                                              nullptr);
+            }
+            Image::blitImage(commandBuffer, srcImage, renderExtent, dstImage, displayExtent, upscaleFilter, displayOffset);
+            Image::setImageLayout(commandBuffer, srcImage, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral);
+            Image::setImageLayout(commandBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR);
+        }
+
+        commandBuffer.end();
+    };
+    auto recordCommandBuffers = [&] {
+        // Frames still in flight may be executing the buffers about to be re-recorded
+        context.device->waitIdle();
+        const auto begin = std::chrono::steady_clock::now();
+        for (uint32_t image = 0; image < swapchain.images.size(); image++) {
+            for (int parity = 0; parity < 2; parity++) {
+                recordFrame(*commandBuffers[2 * image + parity], image, parity);
+            }
+        }
+        commandsDirty = false;
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "Recorded " << commandBuffers.size() << " command buffers in " << milliseconds << " ms" << std::endl;
+    };
+
+    // Host time per frame. The frame time is wall clock from one frame to the next, which
+    // includes waiting for the GPU; the rest splits the host's own work from that wait.
+    struct HostFrameTime {
+        double wait = 0.0;    // Fences and acquire, blocked on the GPU or the presentation engine
+        double record = 0.0;  // Writing the controls, and re-recording when dirty
+        double submit = 0.0;  // Submit, capture bookkeeping and present
+        double frame = 0.0;   // Wall clock between frames
+        int frames = 0;
+    } hostTime;
+    auto reportHostTime = [&] {
+        const int frames = std::max(1, hostTime.frames);
+        std::cout << "Host: " << hostTime.frame / frames << " ms per frame, of which " << (hostTime.record + hostTime.submit) / frames
+                  << " ms on the host (controls " << hostTime.record / frames << " ms, submit and present " << hostTime.submit / frames
+                  << " ms) and " << hostTime.wait / frames << " ms waiting, over " << hostTime.frames << " frame(s)" << std::endl;
+        hostTime = {};
+    };
+
+    //  ==================== RESIZING ====================
+    // Pending captures are written out before the image they copy from goes away.
+    auto recreateOutput = [&] {
+        context.device->waitIdle();
+        readback->drain(writer);
+        writer.flush();
+        readback.reset();
+
+        renderExtent = traceExtent();
+        frameImages = createFrameImages(renderExtent);
+        readback = std::make_unique<ReadbackRing>(context, renderExtent);
+        if (wavefront) {
+            wavefront->resize(renderExtent);
+        }
+        if (resampling) {
+            resampling->resize(renderExtent);
+        }
+        writeFrameDescriptors();
+        context.controls.frame = 0;
+        commandsDirty = true;
+    };
+
+    // Blocks until the current output image is copied and written
+    auto captureNow = [&](const OutputFrame& frame) {
+        context.device->waitIdle();
+        readback->drain(writer);
+        while (!readback->capture(*frameImages.accumulation[current].image, frame)) {
+            writer.flush();
+            readback->poll(writer);
+        }
+        readback->drain(writer);
+        writer.flush();
+    };
+
+    // The accumulation and the controls continuing from it, written on the writer thread
+    auto checkpointFrame = [&](int nextFrame) {
+        Controls next = context.controls;
+        next.frame = nextFrame;
+        OutputFrame frame;
+        frame.consume = [path = output.checkpoint, hash = settingsHash, next](const OutputFrame& frame) {
+            try {
+                writeCheckpoint(path, hash, next, frame.pixels, frame.width, frame.height);
+            } catch (const std::exception& e) {
+                std::cerr << "Checkpoint not written (" << e.what() << ")" << std::endl;
+            }
+        };
+        return frame;
+    };
+    bool checkpointDue = false;
+
+    auto recreateSwapchain = [&] {
+        // A minimized window has no framebuffer, wait until it comes back
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(context.window, &width, &height);
+        while ((width == 0 || height == 0) && !glfwWindowShouldClose(context.window)) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(context.window, &width, &height);
+        }
+        context.device->waitIdle();
+        context.framebufferResized = false;
+
+        swapchain = Swapchain{context, *swapchain.swapchain};
+        commandBuffers.clear();
+        commandBuffers = allocateCommandBuffers();
+        createPresentSync();
+        commandsDirty = true;
+    };
+
+    pipelineTask.get();
+
+    //  ==================== RENDER VIEW BATCH ====================
+    // All views advance one frame per launch, then each view's layer is read back and
+    // written out on the writer thread while the next one is copied. No window loop.
+    if (viewBatch.count() > 0) {
+        const vk::Extent2D extent = viewBatch.extent();
+        const auto begin = std::chrono::steady_clock::now();
+        context.controls.accumulate = 1;
+        for (context.controls.frame = 0; context.controls.frame < settings.frames;) {
+            frameControls.write(0, TraceControls, context.controls);
+            const uint32_t controlsOffset = frameControls.offset(0);
+            context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+                if (backend == Backend::Pipeline) {
+                    commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
+                    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSets[0], controlsOffset);
+                    commandBuffer.traceRaysKHR(raygenRegion, missRegion, hitRegion, {}, extent.width, extent.height, viewBatch.count());
+                } else {
+                    const uint32_t groupWidth = static_cast<uint32_t>(rayQuery.workgroupWidth);
+                    const uint32_t groupHeight = static_cast<uint32_t>(rayQuery.workgroupHeight);
+                    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *rayQueryPipeline);
+                    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descSets[0], controlsOffset);
+                    commandBuffer.dispatch((extent.width + groupWidth - 1) / groupWidth, (extent.height + groupHeight - 1) / groupHeight,
+                                           viewBatch.count());
+                }
+            });
+            context.controls.frame++;
+            // Streamed clusters follow the hits of every view. A swap doesn't restart the batch,
+            // with views far apart it might never settle.
+            geometry.update(context.controls, extent.height);
+            guiding.update();
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "View batch: " << viewBatch.count() << " views x " << settings.frames << " frame(s) in " << milliseconds << " ms, "
+                  << milliseconds / viewBatch.count() << " ms per view" << std::endl;
+
+        ReadbackRing viewReadback{context, extent};
+        for (uint32_t view = 0; view < viewBatch.count(); view++) {
+            auto request = [&] {
+                OutputFrame frame;
+                frame.path = ImageWriter::formatPath(settings.views.pattern, static_cast<int>(view));
+                frame.denoise = true;
+                return frame;
+            };
+            while (!viewReadback.capture(*viewBatch.image().image, request(), view)) {
+                writer.flush();
+                viewReadback.poll(writer);
+            }
+            viewReadback.poll(writer);
+        }
+        viewReadback.drain(writer);
+        writer.flush();
+        std::cout << geometry.report() << std::endl;
+
+        glfwDestroyWindow(context.window);
+        glfwTerminate();
+        return 0;
+    }
 
     //  ==================== RUN WINDOW ====================
+    bool startupReported = false;
     uint32_t imageIndex = 0;
-    vk::UniqueSemaphore imageAcquiredSemaphore = context.device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+    uint64_t frameNumber = 0;
+    auto lastFrame = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(context.window)) {
         glfwPollEvents();
+        if (context.framebufferResized) {
+            recreateSwapchain();
+        }
+        if (traceExtent() != renderExtent) {
+            recreateOutput();
+        }
+        if (liveEdits && !reloadTask.valid() && sceneWatcher.changed()) {
+            reloadTask = pool.submit([&] {
+                LoadedMesh mesh;
+                loadFromFile(mesh.vertices, mesh.indices, mesh.faces, settings.meshPath, &mesh.texturePaths);
+                return mesh;
+            });
+        }
+        if (reloadTask.valid() && reloadTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            try {
+                applySceneEdit(reloadTask.get());
+            } catch (const std::exception& e) {
+                std::cerr << "Scene edit not applied (" << e.what() << ")" << std::endl;
+            }
+        }
 
-        // Acquire next image
-        imageIndex = context.device->acquireNextImageKHR(*sc, UINT64_MAX, *imageAcquiredSemaphore).value;
-
-        // Record commands
-        vk::CommandBuffer commandBuffer = *commandBuffers[imageIndex];
-        commandBuffer.begin(vk::CommandBufferBeginInfo());
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *pipeline);
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSet, nullptr);
-        commandBuffer.pushConstants(*pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(Controls), &context.controls);
-        commandBuffer.traceRaysKHR(raygenRegion, missRegion, hitRegion, {}, WIDTH, HEIGHT, 1);
-
-        vk::Image srcImage = *outputImage.image;
-        vk::Image dstImage = scImages[imageIndex];
-        Image::setImageLayout(commandBuffer, srcImage, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
-        Image::setImageLayout(commandBuffer, dstImage, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-        Image::copyImage(commandBuffer, srcImage, dstImage);
-        Image::setImageLayout(commandBuffer, srcImage, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral);
-        Image::setImageLayout(commandBuffer, dstImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::ePresentSrcKHR);
+        // Acquire next image once the frame that last used this frame's sync objects is done.
+        // Without presenting the images only pick the command buffers and controls slots.
+        const auto waitBegin = std::chrono::steady_clock::now();
+        FrameSync& sync = frameSync[frameNumber % FramesInFlight];
+        (void)context.device->waitForFences(*sync.submitted, true, UINT64_MAX);
+        if (!presents) {
+            imageIndex = static_cast<uint32_t>(frameNumber % swapchain.images.size());
+        } else {
+            try {
+                imageIndex = context.device->acquireNextImageKHR(*swapchain.swapchain, UINT64_MAX, *sync.imageAcquired).value;
+            } catch (const vk::OutOfDateKHRError&) {
+                recreateSwapchain();
+                continue;
+            }
+        }
+        if (imageFences[imageIndex]) {
+            (void)context.device->waitForFences(imageFences[imageIndex], true, UINT64_MAX);
+        }
+        imageFences[imageIndex] = *sync.submitted;
+        hostTime.wait += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitBegin).count();
 
-        commandBuffer.end();
+        // Only the controls of this frame's slot change, the commands were recorded before
+        const auto hostBegin = std::chrono::steady_clock::now();
+        // Previews trace few paths so the view follows the input, the wavefront waves are recorded per path
+        const int samplesPerFrame = context.controls.accumulate == 1 ? settings.samplesPerFrame : settings.previewSamplesPerFrame;
+        if (samplesPerFrame != context.controls.samplesPerFrame) {
+            context.controls.samplesPerFrame = samplesPerFrame;
+            commandsDirty = commandsDirty || wavefront;
+        }
+        if (commandsDirty) {
+            recordCommandBuffers();
+        }
+        current = 1 - current;
+        const uint32_t slot = imageIndex % frameControls.slots();
+        reprojectControls.cameraPosition = context.controls.cameraPosition;
+        reprojectControls.fov = context.controls.fov;
+        reprojectControls.accumulate = context.controls.accumulate;
+        reprojectControls.resetHistory = context.controls.frame == 0;
+        reprojectControls.resumedHistory = resumed;
+        resumed = false;
+        reprojectControls.lightGroups = lightGroups.count();
+        lightGroups.writeScales(context.controls.light_intensity, reprojectControls.lightGroupScales);
+        frameControls.write(slot, TraceControls, context.controls);
+        frameControls.write(slot, ReprojectionControls, reprojectControls);
+        const auto hostRecorded = std::chrono::steady_clock::now();
 
         // Submit
-        context.queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer));
+        // The first command writes the swapchain image in a transfer, the acquire only has to finish by then
+        const vk::PipelineStageFlags acquiredStage = vk::PipelineStageFlagBits::eTransfer;
+        vk::SubmitInfo submitInfo;
+        submitInfo.setCommandBuffers(*commandBuffers[2 * imageIndex + current]);
+        if (presents) {
+            submitInfo.setWaitSemaphores(*sync.imageAcquired);
+            submitInfo.setWaitDstStageMask(acquiredStage);
+            submitInfo.setSignalSemaphores(*renderFinished[imageIndex]);
+        }
+        context.device->resetFences(*sync.submitted);
+        context.queue.submit(submitInfo, *sync.submitted);
+        frameNumber++;
+        reprojectControls.previousCameraPosition = context.controls.cameraPosition;
+        reprojectControls.previousFov = context.controls.fov;
+
+        // Capture every N frames; the copy is fenced on its own and skipped if the ring is full
+        if (output.captureEvery > 0 && (context.controls.frame + 1) % output.captureEvery == 0) {
+            OutputFrame frame;
+            if (!output.sequence.empty()) {
+                frame.path = ImageWriter::formatPath(output.sequence, context.controls.frame);
+            }
+            frame.toPipe = !output.pipeCommand.empty();
+            readback->capture(*frameImages.accumulation[current].image, std::move(frame));
+        }
+        // Checkpoints are skipped like captures while the ring is full, then retried next frame
+        checkpointDue = checkpointDue || (useCheckpoints && (context.controls.frame + 1) % output.checkpointEvery == 0);
+        if (checkpointDue && readback->capture(*frameImages.accumulation[current].image, checkpointFrame(context.controls.frame + 1))) {
+            checkpointDue = false;
+        }
+        readback->poll(writer);
 
         // Present image
-        vk::PresentInfoKHR presentInfo;
-        presentInfo.setSwapchains(*sc);
-        presentInfo.setImageIndices(imageIndex);
-        presentInfo.setWaitSemaphores(*imageAcquiredSemaphore);
-        if (auto result1 = context.queue.presentKHR(presentInfo); result1 != vk::Result::eSuccess) {
-            throw std::runtime_error("failed to present.");
-        }
-        context.queue.waitIdle();
+        if (presents) {
+            vk::PresentInfoKHR presentInfo;
+            presentInfo.setSwapchains(*swapchain.swapchain);
+            presentInfo.setImageIndices(imageIndex);
+            presentInfo.setWaitSemaphores(*renderFinished[imageIndex]);
+            try {
+                vk::Result result1 = context.queue.presentKHR(presentInfo);
+                if (result1 == vk::Result::eSuboptimalKHR) {
+                    context.framebufferResized = true;
+                } else if (result1 != vk::Result::eSuccess) {
+                    throw std::runtime_error("failed to present.");
+                }
+            } catch (const vk::OutOfDateKHRError&) {
+                context.framebufferResized = true;
+            }
+        }
+        hostTime.record += std::chrono::duration<double, std::milli>(hostRecorded - hostBegin).count();
+        hostTime.submit += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hostRecorded).count();
+        // Timings, guiding records and cluster hit counts are read back from this frame, and
+        // only then; otherwise the next frame is recorded while this one runs
+        if (timer || guiding.training() || settings.geometry.clustered()) {
+            const auto fenceBegin = std::chrono::steady_clock::now();
+            (void)context.device->waitForFences(*sync.submitted, true, UINT64_MAX);
+            hostTime.wait += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fenceBegin).count();
+        }
+        const auto frameEnd = std::chrono::steady_clock::now();
+        hostTime.frame += std::chrono::duration<double, std::milli>(frameEnd - lastFrame).count();
+        lastFrame = frameEnd;
+        hostTime.frames++;
         context.controls.frame++;
+        // Swapping clusters for proxies, other LOD levels or back changes the image, start accumulating again
+        if (geometry.update(context.controls, renderExtent.height) && !farmWorker && !settings.compareBackends) {
+            context.controls.frame = 0;
+        }
+        // A guiding training pass may end here, the accumulation keeps its frames
+        guiding.update();
+        if (!startupReported) {
+            std::cout << startup.report("first frame") << std::endl;
+            startupReported = true;
+        }
+        if (timer) {
+            timer->collect();
+            if (!settings.compareBackends && timer->frames() == TimingReportFrames) {
+                std::cout << (wavefront ? "Wavefront: " : "Megakernel: ") << timer->report() << std::endl;
+                reportHostTime();
+                std::cout << geometry.report() << std::endl;
+            }
+        }
+
+        // Backend comparison: the same frames with every backend, then exit
+        if (settings.compareBackends && context.controls.frame == std::max(settings.frames, TimingReportFrames)) {
+            std::cout << "Backend " << backendName(backend) << ": " << timer->report() << std::endl;
+            reportHostTime();
+            std::cout << geometry.report() << std::endl;
+            auto next = std::find(backends.begin(), backends.end(), backend) + 1;
+            if (next == backends.end()) {
+                break;
+            }
+            backend = *next;
+            commandsDirty = true;
+            context.controls.frame = 0;
+        }
+
+        // A farm worker sends each finished shard and moves on to the next one
+        if (farmWorker && context.controls.frame == farmJob.frameCount) {
+            const int64_t samples = static_cast<int64_t>(farmJob.frameCount) * context.controls.samplesPerFrame;
+            bool sent = false;
+            OutputFrame result;
+            result.consume = [&](const OutputFrame& frame) { sent = coordinator.sendResult(frame.pixels, frame.width, frame.height, samples); };
+            captureNow(result);
+            if (!sent || !coordinator.receiveJob(farmJob) || farmJob.frameCount == 0) {
+                break;
+            }
+            if (farmJob.width != settings.width || farmJob.height != settings.height) {
+                std::cerr << "Farm shard of " << farmJob.width << "x" << farmJob.height << " after " << settings.width << "x"
+                          << settings.height << ", leaving the farm." << std::endl;
+                break;
+            }
+            context.controls.frame = 0;
+            context.controls.frameOffset = farmJob.firstFrame;
+        }
     }
 
-    context.device->waitIdle();
-    constexpr vk::DeviceSize imageSize = WIDTH * HEIGHT * 4;
-
-    vk::BufferCreateInfo stagingBufferInfo(
-        vk::BufferCreateFlags(),
-        imageSize,
-        vk::BufferUsageFlagBits::eTransferDst,
-        vk::SharingMode::eExclusive
-    );
-    vk::UniqueBuffer stagingBuffer = context.device->createBufferUnique(stagingBufferInfo);
-    vk::MemoryRequirements memRequirements = context.device->getBufferMemoryRequirements(*stagingBuffer);
-
-    uint32_t memType = 0;
-    vk::PhysicalDeviceMemoryProperties memProperties = context.physicalDevice.getMemoryProperties();
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((memRequirements.memoryTypeBits & (1 << i)) &&
-            ((memProperties.memoryTypes[i].propertyFlags &
-                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent) ==
-                (vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent))) {
-            memType = i;
-        }
-    }
-    if (memType == 0) {throw std::runtime_error("Failed to find suitable memory type!");}
-
-    vk::MemoryAllocateInfo allocInfo(memRequirements.size, memType);
-    vk::UniqueDeviceMemory stagingBufferMemory = context.device->allocateMemoryUnique(allocInfo);
-
-    context.device->bindBufferMemory(*stagingBuffer, *stagingBufferMemory, 0);
-
-    vk::CommandBufferAllocateInfo copyAllocInfo(
-        *context.commandPool,
-        vk::CommandBufferLevel::ePrimary,
-        1
-    );
-    auto copyCmdBuffers = context.device->allocateCommandBuffersUnique(copyAllocInfo);
-    vk::CommandBuffer copyCmdBuffer = *copyCmdBuffers.front();
-
-    copyCmdBuffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-
-    Image::setImageLayout(
-        copyCmdBuffer,
-        *outputImage.image,
-        vk::ImageLayout::eGeneral,
-        vk::ImageLayout::eTransferSrcOptimal);
-
-    vk::BufferImageCopy region{};
-    region.setBufferOffset(0);
-    region.setBufferRowLength(0);
-    region.setBufferImageHeight(0);
-    region.imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
-        region.imageOffset = vk::Offset3D{0, 0, 0};
-        region.imageExtent = vk::Extent3D{WIDTH, HEIGHT, 1};
-
-
-    copyCmdBuffer.copyImageToBuffer(
-        *outputImage.image,
-        vk::ImageLayout::eTransferSrcOptimal,
-        *stagingBuffer,
-        region);
-
-    Image::setImageLayout(
-        copyCmdBuffer,
-        *outputImage.image,
-        vk::ImageLayout::eTransferSrcOptimal,
-        vk::ImageLayout::eGeneral);
-
-    copyCmdBuffer.end();
-
-    vk::SubmitInfo copySubmitInfo;
-    copySubmitInfo.setCommandBuffers(copyCmdBuffer);
-    context.queue.submit(copySubmitInfo);
-    context.queue.waitIdle();
-
-    if (void* data = context.device->mapMemory(*stagingBufferMemory, 0, imageSize)) {
-        waveletDenoiseImage(static_cast<unsigned char*>(data), WIDTH, HEIGHT, 4, 5.0f);
-        stbi_write_png("output.png", WIDTH, HEIGHT, 4, data, static_cast<int>(WIDTH * 4));
-        context.device->unmapMemory(*stagingBufferMemory);
-        std::cout << "Image dumped to output.png" << std::endl;
-    } else {
-        std::cerr << "Failed to map staging buffer memory." << std::endl;
+    if (useCheckpoints && context.controls.frame > 0) {
+        captureNow(checkpointFrame(context.controls.frame));
+    }
+    if (!farmWorker) {
+        OutputFrame finalFrame;
+        finalFrame.path = output.path;
+        finalFrame.denoise = true;
+        captureNow(finalFrame);
     }
+    if (readback->skippedCaptures() > 0 || writer.droppedFrames() > 0) {
+        std::cout << "Capture skipped " << readback->skippedCaptures() << " frame(s), writer dropped " << writer.droppedFrames()
+                  << std::endl;
+    }
+
     glfwDestroyWindow(context.window);
     glfwTerminate();
 }
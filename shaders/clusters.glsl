@@ -0,0 +1,21 @@
+// Mesh clusters of GeometryResidency: every TLAS instance is one cluster,
+// traced through its own BLAS or, while paged out, a box proxy. The instance
+// custom index selects the first primitive of the triangles it was built
+// from, and hits are counted per instance so the host knows which clusters
+// the rays reach.
+
+// Set by the host when it streams geometry, otherwise nothing is counted
+layout(constant_id = 3) const bool COUNT_CLUSTER_HITS = false;
+
+layout(binding = 15, set = 0) readonly buffer ClusterPrimitives { uint clusterFirstPrimitive[]; };
+layout(binding = 16, set = 0) buffer ClusterHits { uint clusterHits[]; };
+
+uint clusterPrimitive(uint customIndex, uint primitive) {
+    return clusterFirstPrimitive[customIndex] + primitive;
+}
+
+void countClusterHit(uint instance) {
+    if (COUNT_CLUSTER_HITS) {
+        atomicAdd(clusterHits[instance], 1u);
+    }
+}
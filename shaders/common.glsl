@@ -10,6 +10,11 @@ struct HitPayload {
     float illum;
     vec3 brdf;
     bool done;
+    uint primitive;
+    // Ray cone for texture filtering: width at the ray origin on the way in,
+    // at the hit on the way out, and its spread angle
+    float coneWidth;
+    float coneSpread;
 };
 
 const highp float M_PI = 3.14159265358979323846;
@@ -39,3 +44,57 @@ float rand(inout uint seed) {
     uint val = pcg(seed);
     return (float(val) * (1.0 / float(0xffffffffu)));
 }
+
+void createCoordinateSystem(in vec3 N, out vec3 T, out vec3 B) {
+
+    if(abs(N.x) > abs(N.y)) T = vec3(N.z, 0, -N.x) / sqrt(N.x * N.x + N.z * N.z);
+    else T = vec3(0, -N.z, N.y) / sqrt(N.y * N.y + N.z * N.z);
+
+    B = cross(N, T);
+}
+
+vec3 sampleHemisphere_less(float rand1, float rand2) {
+    vec3 dir;
+    dir.x = cos(2 * M_PI * rand2) * sqrt(1 - rand1 * rand1);
+    dir.y = sin(2 * M_PI * rand2) * sqrt(1 - rand1 * rand1);
+    dir.z = rand1;
+    return dir;
+}
+
+vec3 sampleHemisphere(float rand1, float rand2, float shininess) {
+    float r = sqrt(rand1) / (shininess * 0.2);
+    float theta = 2.0 * M_PI * rand2;
+    
+    float x = r * cos(theta);
+    float y = r * sin(theta);
+    float z = sqrt(1.0 - rand1);
+    
+    return vec3(x, y, z);
+}
+
+vec3 sampleDirection(float rand1, float rand2, vec3 normal, float shininess) {
+    vec3 tangent;
+    vec3 bitangent;
+    createCoordinateSystem(normal, tangent, bitangent);
+    vec3 dir = sampleHemisphere(rand1, rand2, shininess);
+    return dir.x * tangent + dir.y * bitangent + dir.z * normal;
+}
+
+// Solid angle density of sampleDirection at the cosine to the normal
+float sampleDirectionPdf(float cosine, float shininess) {
+    float k2 = (shininess * 0.2) * (shininess * 0.2);
+    float d = cosine * cosine + k2 * (1.0 - cosine * cosine);
+    return cosine > 0.0 ? k2 * cosine / (M_PI * d * d) : 0.0;
+}
+
+// z of the sampleHemisphere direction pointing at the cosine to the normal, what the BSDF weight multiplies by
+float sampleDirectionZ(float cosine, float shininess) {
+    float k2 = (shininess * 0.2) * (shininess * 0.2);
+    return cosine / sqrt(cosine * cosine + k2 * (1.0 - cosine * cosine));
+}
+
+// What the integrator's BSDF sample of a diffuse or glossy hit converges to per solid angle, before the
+// incoming light: its weight brdf * z / (1 / 2pi) times the density the direction is drawn with
+vec3 scatteredLight(vec3 brdf, float cosine, float shininess) {
+    return brdf * sampleDirectionZ(cosine, shininess) * 2.0 * M_PI * sampleDirectionPdf(cosine, shininess);
+}
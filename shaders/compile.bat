@@ -2,4 +2,16 @@
 %VULKAN_SDK%/Bin/glslc.exe closesthit.rchit -o closesthit.rchit.spv --target-env=vulkan1.3
 %VULKAN_SDK%/Bin/glslc.exe miss.rmiss -o miss.rmiss.spv --target-env=vulkan1.3
 %VULKAN_SDK%/Bin/glslc.exe denoise.comp -o denoise.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe reproject.comp -o reproject.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_generate.comp -o wavefront_generate.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_prepare.comp -o wavefront_prepare.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_extend.rgen -o wavefront_extend.rgen.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_classify.comp -o wavefront_classify.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_scatter.comp -o wavefront_scatter.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_shade.comp -o wavefront_shade.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe wavefront_accumulate.comp -o wavefront_accumulate.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe pathtrace.comp -o pathtrace.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe restir_temporal.comp -o restir_temporal.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe restir_spatial.comp -o restir_spatial.comp.spv --target-env=vulkan1.3
+%VULKAN_SDK%/Bin/glslc.exe radiance_cache_resolve.comp -o radiance_cache_resolve.comp.spv --target-env=vulkan1.3
 pause
\ No newline at end of file
@@ -0,0 +1,13 @@
+// Per-frame controls, mirrors Controls of controls.h. Bound as a dynamic
+// uniform buffer: each pre-recorded command buffer selects its slot of the
+// host's UniformRing, so the controls change without re-recording.
+layout(binding = 14, set = 0) uniform FrameControls {
+    vec3 cameraPosition;
+    float fov;
+    float light_intensity;
+
+    int frame;
+    int accumulate;
+    int frameOffset;
+    int samplesPerFrame;
+};
@@ -0,0 +1,120 @@
+// Lat-long environment lighting the misses, see src/environment_distribution.h
+// for the CPU mirror. Rows run from the scene's up (-y, the loader flips Y)
+// down, columns once around it from +x. Expects common.glsl to be included.
+#ifndef ENVIRONMENT_GLSL
+#define ENVIRONMENT_GLSL
+
+layout(binding = 17, set = 0) readonly buffer Environment {
+    uint environmentWidth;  // 0 without an environment
+    uint environmentHeight;
+    uint environmentSampling;
+    uint environmentPadding;
+    // RGB texels, then the marginal CDF over rows (height + 1),
+    // then the conditional CDF of every row (width + 1 each)
+    float environmentData[];
+};
+
+const uint ENVIRONMENT_IMPORTANCE = 0;
+const uint ENVIRONMENT_UNIFORM = 1;
+
+bool environmentEnabled() {
+    return environmentWidth != 0;
+}
+
+uint environmentMarginal() {
+    return 3 * environmentWidth * environmentHeight;
+}
+
+uint environmentConditional(uint row) {
+    return environmentMarginal() + environmentHeight + 1 + row * (environmentWidth + 1);
+}
+
+vec2 environmentUv(vec3 direction) {
+    direction = normalize(direction);
+    float u = atan(direction.z, direction.x) / (2.0 * M_PI);
+    return vec2(u < 0.0 ? u + 1.0 : u, acos(clamp(-direction.y, -1.0, 1.0)) / M_PI);
+}
+
+uvec2 environmentTexel(vec2 uv) {
+    return min(uvec2(uv * vec2(environmentWidth, environmentHeight)), uvec2(environmentWidth - 1, environmentHeight - 1));
+}
+
+// Largest i below count with cdf[i] <= u, the CDF starting at environmentData[offset]
+uint environmentSearch(uint offset, uint count, float u) {
+    uint low = 0;
+    uint high = count;
+    while (high - low > 1) {
+        uint middle = (low + high) / 2;
+        if (environmentData[offset + middle] <= u) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Nearest texel, black without an environment
+vec3 environmentRadiance(vec3 direction) {
+    if (!environmentEnabled()) {
+        return vec3(0.0);
+    }
+    uvec2 texel = environmentTexel(environmentUv(direction));
+    uint i = 3 * (texel.y * environmentWidth + texel.x);
+    return vec3(environmentData[i], environmentData[i + 1], environmentData[i + 2]);
+}
+
+// Solid angle density of sampleEnvironment producing the direction
+float environmentPdf(vec3 direction) {
+    if (!environmentEnabled()) {
+        return 0.0;
+    }
+    if (environmentSampling == ENVIRONMENT_UNIFORM) {
+        return 1.0 / (4.0 * M_PI);
+    }
+    vec2 uv = environmentUv(direction);
+    uvec2 texel = environmentTexel(uv);
+    float sinTheta = sin(uv.y * M_PI);
+    if (sinTheta <= 0.0) {
+        return 0.0;
+    }
+    uint marginal = environmentMarginal() + texel.y;
+    uint conditional = environmentConditional(texel.y) + texel.x;
+    float mass = (environmentData[marginal + 1] - environmentData[marginal]) *
+                 (environmentData[conditional + 1] - environmentData[conditional]);
+    return mass * float(environmentWidth * environmentHeight) / (2.0 * M_PI * M_PI * sinTheta);
+}
+
+// A row from the marginal CDF, a column from its conditional CDF, then a point
+// within the texel from what is left of u. Uniform over the sphere for comparisons.
+vec3 sampleEnvironment(vec2 u, out float pdf) {
+    if (environmentSampling == ENVIRONMENT_UNIFORM) {
+        float z = 1.0 - 2.0 * u.x;
+        float r = sqrt(max(0.0, 1.0 - z * z));
+        pdf = 1.0 / (4.0 * M_PI);
+        return vec3(r * cos(2.0 * M_PI * u.y), z, r * sin(2.0 * M_PI * u.y));
+    }
+    uint marginal = environmentMarginal();
+    uint row = environmentSearch(marginal, environmentHeight, u.x);
+    float rowStart = environmentData[marginal + row];
+    float rowMass = environmentData[marginal + row + 1] - rowStart;
+    uint conditional = environmentConditional(row);
+    uint column = environmentSearch(conditional, environmentWidth, u.y);
+    float columnStart = environmentData[conditional + column];
+    float columnMass = environmentData[conditional + column + 1] - columnStart;
+
+    vec2 within = clamp(vec2(u.y - columnStart, u.x - rowStart) / max(vec2(columnMass, rowMass), vec2(1e-20)), 0.0, 1.0);
+    vec2 uv = (vec2(column, row) + within) / vec2(environmentWidth, environmentHeight);
+    float phi = 2.0 * M_PI * uv.x;
+    float theta = M_PI * uv.y;
+    float sinTheta = sin(theta);
+    pdf = sinTheta > 0.0 ? rowMass * columnMass * float(environmentWidth * environmentHeight) / (2.0 * M_PI * M_PI * sinTheta) : 0.0;
+    return vec3(sinTheta * cos(phi), -cos(theta), sinTheta * sin(phi));
+}
+
+// Weight of a sample of one strategy against another drawn alongside it
+float powerHeuristic(float pdf, float otherPdf) {
+    return pdf > 0.0 ? pdf * pdf / (pdf * pdf + otherPdf * otherPdf) : 0.0;
+}
+
+#endif
@@ -0,0 +1,192 @@
+// Path guiding by the spatial-directional tree of src/guiding_tree.h, which
+// the host rebuilds between training passes from what paths record here.
+//
+// With PATH_GUIDING, diffuse and glossy bounces in a trained spatial leaf draw
+// their direction from the BSDF with probability guidingBsdfFraction and from
+// the leaf's quadtree otherwise. The BSDF weight is scaled by the BSDF's
+// density over the mixture's, so guided and unguided renders converge to the
+// same image. While guidingRecording is set every such bounce records the
+// luminance found behind it over the density of its direction.
+//
+// Mirror and dielectric bounces are never guided, and in glossy scenes the
+// mixture does no better than the BSDF at equal time (guiding-check), so it
+// is meant for mostly diffuse scenes and stays off unless asked for.
+
+layout(constant_id = 5) const bool PATH_GUIDING = false;
+
+layout(binding = 20, set = 0) readonly buffer GuidingTree {
+    uint guidingSpatialNodes;  // Ahead of the quadtree nodes in guidingNodes
+    uint guidingRecording;
+    float guidingBsdfFraction;
+    uint guidingPadding;
+    // Spatial nodes (first child or 0, axis, split bits, quadtree root), then two
+    // per quadtree node: the energy bits of its four quadrants, then their children
+    uvec4 guidingNodes[];
+};
+
+// 64-bit (low, high) sums: a sample count per spatial node, then the fixed
+// point energy per quadrant, 4 * quadtree node + quadrant
+layout(binding = 21, set = 0) buffer GuidingRecords { uint guidingRecords[]; };
+
+const float GUIDING_FIXED_POINT = 65536.0;
+const float GUIDING_MAX_RECORD = 65535.0;
+const uint GUIDING_MAX_RECORDS = 8;  // One per bounce
+
+// Guided bounces of the current path and the light found behind each
+struct GuideRecord {
+    uint leaf;
+    uint slot;
+    float pdf;    // Of the direction, over the BSDF and cosine factor of the unguided weight
+    vec3 weight;  // Path weight after the bounce
+    vec3 radiance;
+};
+GuideRecord guideRecords[GUIDING_MAX_RECORDS];
+uint guideRecordCount = 0;
+
+uint guidingLeaf(vec3 position) {
+    uint node = 0;
+    uvec4 current = guidingNodes[0];
+    while (current.x != 0) {
+        node = current.x + (position[current.y] >= uintBitsToFloat(current.z) ? 1u : 0u);
+        current = guidingNodes[node];
+    }
+    return node;
+}
+
+vec4 quadEnergy(uint node) {
+    return uintBitsToFloat(guidingNodes[guidingSpatialNodes + 2 * node]);
+}
+
+uvec4 quadChildren(uint node) {
+    return guidingNodes[guidingSpatialNodes + 2 * node + 1];
+}
+
+bool guidingTrained(uint leaf) {
+    return dot(quadEnergy(guidingNodes[leaf].w), vec4(1.0)) > 0.0;
+}
+
+// Equal-area mapping between the unit square and the sphere of directions
+vec2 guidingSquare(vec3 direction) {
+    float phi = atan(direction.y, direction.x) / (2.0 * M_PI);
+    return clamp(vec2(0.5 * (clamp(direction.z, -1.0, 1.0) + 1.0), phi < 0.0 ? phi + 1.0 : phi), vec2(0.0), vec2(0.99999994));
+}
+
+vec3 guidingDirection(vec2 square) {
+    float cosTheta = 2.0 * square.x - 1.0;
+    float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+    float phi = 2.0 * M_PI * square.y;
+    return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+}
+
+vec3 sampleGuiding(uint leaf, vec2 u, out float pdf) {
+    uint node = guidingNodes[leaf].w;
+    vec2 origin = vec2(0.0);
+    float size = 1.0;
+    float density = 1.0;
+    while (true) {
+        vec4 energy = quadEnergy(node);
+        float total = dot(energy, vec4(1.0));
+        if (total <= 0.0) {
+            break;
+        }
+        // Column by the energy of its two quadrants, then the row within it, reusing u
+        float left = (energy.x + energy.z) / total;
+        uint x = u.x < left ? 0u : 1u;
+        u.x = x == 0u ? u.x / left : (u.x - left) / (1.0 - left);
+        float bottom = energy[x] / (energy[x] + energy[x + 2]);
+        uint y = u.y < bottom ? 0u : 1u;
+        u.y = y == 0u ? u.y / bottom : (u.y - bottom) / (1.0 - bottom);
+        u = min(u, vec2(0.99999994));
+        uint quadrant = x + 2 * y;
+        density *= 4.0 * energy[quadrant] / total;
+        size *= 0.5;
+        origin += vec2(x, y) * size;
+        uint child = quadChildren(node)[quadrant];
+        if (child == 0) {
+            break;
+        }
+        node = child;
+    }
+    pdf = density / (4.0 * M_PI);
+    return guidingDirection(origin + u * size);
+}
+
+float guidingPdf(uint leaf, vec3 direction) {
+    vec2 p = guidingSquare(direction);
+    uint node = guidingNodes[leaf].w;
+    float density = 1.0;
+    while (true) {
+        vec4 energy = quadEnergy(node);
+        float total = dot(energy, vec4(1.0));
+        if (total <= 0.0) {
+            break;
+        }
+        uvec2 xy = uvec2(greaterThanEqual(p, vec2(0.5)));
+        uint quadrant = xy.x + 2 * xy.y;
+        density *= 4.0 * energy[quadrant] / total;
+        p = 2.0 * p - vec2(xy);
+        uint child = quadChildren(node)[quadrant];
+        if (child == 0) {
+            break;
+        }
+        node = child;
+    }
+    return density / (4.0 * M_PI);
+}
+
+// Quadrant the direction falls into, 4 * quadtree node + quadrant
+uint guidingSlot(uint leaf, vec3 direction) {
+    vec2 p = guidingSquare(direction);
+    uint node = guidingNodes[leaf].w;
+    while (true) {
+        uvec2 xy = uvec2(greaterThanEqual(p, vec2(0.5)));
+        uint quadrant = xy.x + 2 * xy.y;
+        uint child = quadChildren(node)[quadrant];
+        if (child == 0) {
+            return 4 * node + quadrant;
+        }
+        p = 2.0 * p - vec2(xy);
+        node = child;
+    }
+}
+
+// Density of the BSDF and guide mixture of the leaf, 1 - bsdfFraction of it the guide's
+float guidedPdf(uint leaf, float bsdfFraction, vec3 direction, float cosine, float shininess) {
+    float pdf = bsdfFraction * sampleDirectionPdf(cosine, shininess);
+    return bsdfFraction < 1.0 ? pdf + (1.0 - bsdfFraction) * guidingPdf(leaf, direction) : pdf;
+}
+
+// A 64-bit add as two 32-bit atomics, the high word taking the carry
+void addGuidingRecord(uint index, uint value) {
+    if (value == 0) {
+        return;
+    }
+    uint old = atomicAdd(guidingRecords[2 * index], value);
+    if (old + value < old) {
+        atomicAdd(guidingRecords[2 * index + 1], 1u);
+    }
+}
+
+void openGuideRecord(uint leaf, vec3 direction, float pdf, vec3 weight) {
+    if (guidingRecording != 0 && guideRecordCount < GUIDING_MAX_RECORDS) {
+        guideRecords[guideRecordCount] = GuideRecord(leaf, guidingSlot(leaf, direction), pdf, weight, vec3(0.0));
+        guideRecordCount++;
+    }
+}
+
+// Light reaching the camera through the recorded bounces, before light_intensity
+void addGuidedLight(vec3 light) {
+    for (uint i = 0; i < guideRecordCount; i++) {
+        guideRecords[i].radiance += max(light, vec3(0.0)) / max(guideRecords[i].weight, vec3(1e-8));
+    }
+}
+
+// At the end of a path
+void closeGuideRecords() {
+    for (uint i = 0; i < guideRecordCount; i++) {
+        float value = dot(guideRecords[i].radiance, vec3(0.2126, 0.7152, 0.0722)) / guideRecords[i].pdf;
+        addGuidingRecord(guideRecords[i].leaf, 1u);
+        addGuidingRecord(guidingSpatialNodes + guideRecords[i].slot, uint(clamp(value, 0.0, GUIDING_MAX_RECORD) * GUIDING_FIXED_POINT));
+    }
+    guideRecordCount = 0;
+}
@@ -0,0 +1,302 @@
+// The megakernel path tracer shared by raygen.rgen and pathtrace.comp.
+// Expects the includer to declare `payload`, traceClosest(origin, direction),
+// which fills payload with the closest hit or sets payload.done on a miss, and
+// traceVisible(origin, direction), true when the ray leaves the scene.
+//
+// Diffuse and glossy hits sample the environment as a light as well, weighted
+// against the BSDF sample finding it by the power heuristic. With light groups
+// the light is summed per group and light_intensity left to reproject.comp.
+// With PATH_GUIDING their bounces follow guiding.glsl. With VIEW_COUNT the
+// pixel is traced from the view'th camera of views.glsl. With RESAMPLED_LIGHTS
+// emitters found by the first bounce off a diffuse or glossy first hit are left
+// to restir_spatial.comp, which adds their light from the pixel's reservoir.
+// With RADIANCE_CACHE wide paths end in radiance_cache.glsl.
+
+layout(binding = 1, set = 0, rgba32f) uniform image2D sampleImage;
+layout(binding = 5, set = 0) readonly buffer SobolMatrices { uint sobolMatrices[]; };
+layout(binding = 6, set = 0) readonly buffer BlueNoise { uint blueNoise[]; };
+#include "sampler.glsl"
+layout(binding = 7, set = 0, rgba32f) uniform image2D positionImage;
+layout(binding = 8, set = 0, rgba16f) uniform image2D normalImage;  // w the first hit's shininess
+// BSDF of the first hit for light_resampling.glsl, a the share of samples whose emitter light it adds
+layout(binding = 9, set = 0, rgba16f) uniform image2D firstBrdfImage;
+layout(constant_id = 7) const bool RESAMPLED_LIGHTS = false;
+#include "controls.glsl"
+#include "environment.glsl"
+#include "light_groups.glsl"
+#include "guiding.glsl"
+#include "views.glsl"
+#include "radiance_cache.glsl"
+
+// Light of the current pixel per group, unused without light groups
+vec3 groupColor[LIGHT_GROUPS + 1];
+
+void addLight(inout vec3 color, uint group, vec3 light) {
+    if (PATH_GUIDING) {
+        addGuidedLight(light);
+    }
+    if (RADIANCE_CACHE) {
+        addCachedLight(light);
+    }
+    if (LIGHT_GROUPS > 0) {
+        groupColor[min(group, LIGHT_GROUPS - 1)] += light;
+    } else {
+        color += light * light_intensity;
+    }
+}
+
+void renderPixel(uvec2 pixel, uvec2 size, uint view) {
+
+    int maxSamples = samplesPerFrame;
+    vec3 color = vec3(0.0);
+    for (uint group = 0; group <= LIGHT_GROUPS; group++) {
+        groupColor[group] = vec3(0.0);
+    }
+    // G-buffer of the first primary hit for reproject.comp, w is the hit distance (0 on a miss)
+    vec4 firstPosition = vec4(0.0);
+    vec3 firstNormal = vec3(0.0);
+    float firstShininess = 0.0;
+    vec3 firstBrdf = vec3(0.0);
+    // The reservoirs shade the first hit of sample 0, so only samples scattering off that surface too leave them their light
+    bool resampledPixel = false;
+    uint resampledSamples = 0;
+    // The controls' camera looks down -Z, a batch view anywhere
+    vec3 eye = cameraPosition;
+    float fieldOfView = fov;
+    mat3 cameraBasis = mat3(1.0);
+    if (VIEW_COUNT > 0) {
+        const BatchView batchView = batchViews[view];
+        eye = batchView.positionFov.xyz;
+        fieldOfView = batchView.positionFov.w;
+        cameraBasis = mat3(batchView.right.xyz, batchView.up.xyz, batchView.back.xyz);
+    }
+    for(uint sampleNum = 0; sampleNum < maxSamples; sampleNum++) {
+
+
+        PixelSampler sampler = createSampler(pixel, sampleNum + maxSamples * (frame + frameOffset));
+
+        const vec2 screenPos = vec2(pixel) + get2D(sampler, DIM_LENS);
+        const vec2 inUV = screenPos / vec2(size);
+        vec2 d = inUV * 2.0 - 1.0;
+        float aspectRatio = float(size.x) / float(size.y);
+        float scale = tan(radians(fieldOfView) * 0.5);
+
+        d.x *= aspectRatio * scale;
+        d.y *= scale;
+        vec4 origin = vec4(eye, 1);
+        vec3 direction = cameraBasis * normalize(vec3(d.x, d.y, -1));
+
+        vec3 weight = vec3(1.0);
+        // Density of the BSDF sample that led here, 0 for the camera and specular bounces
+        float scatterPdf = 0.0;
+        payload.done = false;
+        // Primary cone: one pixel wide at unit distance, kept through the bounces
+        payload.coneWidth = 0.0;
+        payload.coneSpread = 2.0 * scale / float(size.y);
+        bool resampledSample = false;
+        const bool updatesCache = RADIANCE_CACHE && sampleNum % cacheUpdateStride == 0;
+        // Footprint the diffuse and glossy bounces add to the primary cone, and the solid angle density of the last one
+        float spread = 0.0;
+        float bouncePdf = 0.0;
+
+        for(uint depth = 0; depth < 8; depth++){
+            if (depth > 2) {
+                float maxComponent = max(weight.r, max(weight.g, weight.b));
+                float rrProbability = clamp(maxComponent, 0.1, 0.9);
+
+                if (get1D(sampler, bounceDimension(depth) + DIM_RR) > rrProbability) {
+                    break;
+                }
+                weight /= rrProbability;
+            }
+            traceClosest(origin.xyz, direction.xyz);
+            if (RADIANCE_CACHE && bouncePdf > 0.0 && !payload.done) {
+                spread += distance(origin.xyz, payload.position) / sqrt(bouncePdf);
+            }
+            if (sampleNum == 0 && depth == 0 && !payload.done) {
+                firstPosition = vec4(payload.position, distance(payload.position, eye));
+                firstNormal = payload.normal;
+                firstBrdf = payload.brdf;
+                resampledPixel = RESAMPLED_LIGHTS && (payload.illum == 2.0 || payload.illum == 3.0);
+            }
+            // A miss after a diffuse or glossy bounce is also found by that bounce's light sample
+            float misWeight = 1.0;
+            if (payload.done && scatterPdf > 0.0) {
+                misWeight = powerHeuristic(scatterPdf, environmentPdf(direction.xyz));
+            }
+            uint group = LIGHT_GROUPS == 0 || payload.done ? environmentGroup : emitterGroup(payload.emission);
+            if (depth == 1 && resampledSample && !payload.done) {
+                // Added by the reservoirs, the guiding tree still learns where it came from
+                if (PATH_GUIDING) {
+                    addGuidedLight(weight * payload.emission);
+                }
+                if (RADIANCE_CACHE) {
+                    addCachedLight(weight * payload.emission);
+                }
+            } else {
+                addLight(color, group, weight * payload.emission * misWeight);
+            }
+
+            const bool scattering = !payload.done && (payload.illum == 2.0 || payload.illum == 3.0);
+            const float shininess = payload.illum == 2.0 ? 5.0 : payload.shininess;
+            if (depth == 0 && resampledPixel && scattering) {
+                // At an edge the first hit may be another surface than sample 0's, whose light the reservoirs don't find
+                resampledSample = sampleNum == 0 ||
+                                  (payload.brdf == firstBrdf && abs(distance(payload.position, eye) - firstPosition.w) <= 0.1 * firstPosition.w &&
+                                   dot(normalize(payload.normal), normalize(firstNormal)) >= 0.9);
+                resampledSamples += resampledSample ? 1 : 0;
+                firstShininess = sampleNum == 0 ? shininess : firstShininess;
+            }
+            if (RADIANCE_CACHE && scattering) {
+                vec3 cached;
+                if (depth > 0 && payload.coneWidth + spread > cacheFootprint * cacheCellSize &&
+                    cachedRadiance(payload.position, payload.normal, cached)) {
+                    addLight(color, group, weight * cached);
+                    break;
+                }
+                if (updatesCache) {
+                    openCacheRecord(payload.position, payload.normal, weight);
+                }
+            }
+            // Share of BSDF directions, below 1 in a trained leaf of the guiding tree
+            uint leaf = 0;
+            float bsdfFraction = 1.0;
+            if (PATH_GUIDING && scattering) {
+                leaf = guidingLeaf(payload.position);
+                bsdfFraction = guidingTrained(leaf) ? guidingBsdfFraction : 1.0;
+            }
+
+            // Light sample of the environment, shadowed by anything in the way
+            if (scattering && environmentEnabled()) {
+                float lightPdf;
+                vec3 lightDirection = sampleEnvironment(get2D(sampler, bounceDimension(depth) + DIM_LIGHT), lightPdf);
+                float cosine = dot(lightDirection, payload.normal);
+                if (lightPdf > 0.0 && cosine > 0.0 && traceVisible(payload.position, lightDirection)) {
+                    // Guided, the BSDF density the weights use is scaled the same way as the bounce's below
+                    float scatterDensity = 1.0 / (2.0 * M_PI);
+                    if (bsdfFraction < 1.0) {
+                        float normalCosine = dot(lightDirection, normalize(payload.normal));
+                        scatterDensity *= guidedPdf(leaf, bsdfFraction, lightDirection, normalCosine, shininess) /
+                                          sampleDirectionPdf(normalCosine, shininess);
+                    }
+                    addLight(color, environmentGroup, weight * payload.brdf * cosine * environmentRadiance(lightDirection) *
+                                                      powerHeuristic(lightPdf, scatterDensity) / lightPdf);
+                }
+            }
+
+            origin.xyz = payload.position;
+            scatterPdf = 0.0;
+            bouncePdf = 0.0;
+            if (payload.illum == 5.0) {
+                direction.xyz = reflect(direction.xyz, payload.normal);
+                weight *= payload.specular;
+            } else if (scattering) {
+                vec2 u = get2D(sampler, bounceDimension(depth) + DIM_BSDF);
+                float pdf = 1.0 / (2.0 * M_PI);
+                if (PATH_GUIDING) {
+                    // u.x picks the technique and is stretched back to [0, 1) for it, saving a dimension
+                    const bool guided = u.x >= bsdfFraction;
+                    float guidePdf = 0.0;
+                    if (guided) {
+                        direction.xyz = sampleGuiding(leaf, vec2((u.x - bsdfFraction) / (1.0 - bsdfFraction), u.y), guidePdf);
+                    } else {
+                        direction.xyz = sampleDirection(u.x / bsdfFraction, u.y, payload.normal, shininess);
+                    }
+                    const vec3 sampled = normalize(direction.xyz);
+                    const float cosine = dot(sampled, normalize(payload.normal));
+                    if (cosine <= 0.0) {
+                        break;
+                    }
+                    // The guide's density of a BSDF direction takes another descent, a guided one came with it
+                    if (!guided && bsdfFraction < 1.0) {
+                        guidePdf = guidingPdf(leaf, sampled);
+                    }
+                    // The unguided weight, z over pdf, with pdf scaled by the mixture's density over the BSDF's
+                    const float bsdfPdf = sampleDirectionPdf(cosine, shininess);
+                    const float mixturePdf = bsdfFraction * bsdfPdf + (1.0 - bsdfFraction) * guidePdf;
+                    pdf *= mixturePdf / bsdfPdf;
+                    const float z = sampleDirectionZ(cosine, shininess);
+                    weight *= payload.brdf * z / pdf;
+                    // Recorded over z / pdf, the guide learns the light times the BSDF lobe
+                    openGuideRecord(leaf, sampled, pdf / z, weight);
+                    bouncePdf = mixturePdf;
+                } else {
+                    direction.xyz = sampleDirection(u.x, u.y, payload.normal, shininess);
+                    weight *= payload.brdf * dot(direction.xyz, payload.normal) / pdf;
+                    if (RADIANCE_CACHE) {
+                        bouncePdf = sampleDirectionPdf(dot(normalize(direction.xyz), normalize(payload.normal)), shininess);
+                    }
+                }
+                scatterPdf = pdf;
+            } else if (payload.illum == 7.0) {
+                float cosi = dot(direction.xyz, payload.normal);
+                float etai = 1.0;          // Air IOR
+                float etat = payload.ior;
+                vec3 n = payload.normal;
+
+                if (cosi >= 0.0) {
+                    float temp = etai;
+                    etai = etat * 0.94;
+                    etat = temp * 1.06;
+                    n = -payload.normal;
+                } else {
+                    cosi = -cosi;
+                }
+
+                float eta = etai / etat;
+                float k = 1.0 - eta * eta * (1.0 - cosi * cosi);
+
+                vec3 refracted;
+                if (k >= 0.0) { refracted = normalize(eta * direction.xyz + (eta * cosi - sqrt(k)) * n); } 
+                else { refracted = reflect(direction.xyz, payload.normal); }
+
+                vec3 reflected = reflect(direction.xyz, payload.normal);
+
+                float R0 = pow((etai - etat) / (etai + etat), 2.0);
+                float fresnel = R0 + (1.0 - R0) * pow(1.0 - cosi, 5.0);
+                fresnel = clamp(fresnel + 0.1, 0.0, 1.0);
+
+                if (get1D(sampler, bounceDimension(depth) + DIM_FRESNEL) < fresnel) {
+                    direction.xyz = reflected;
+                    weight *= payload.specular * payload.ior;
+                } else {
+                    direction.xyz = refracted;
+                    weight *= payload.transmittance * 10.0;
+                }
+            }
+            if(payload.done){
+                break;
+            }
+        }
+        if (PATH_GUIDING) {
+            closeGuideRecords();
+        }
+        if (RADIANCE_CACHE) {
+            closeCacheRecords();
+        }
+    }
+    color /= maxSamples;
+    if (LIGHT_GROUPS > 0) {
+        uint first = ((pixel.y * size.x) + pixel.x) * LIGHT_GROUPS * 3;
+        for (uint group = 0; group < LIGHT_GROUPS; group++) {
+            vec3 mean = groupColor[group] / float(maxSamples);
+            lightGroupSamples[first + group * 3 + 0] = mean.r;
+            lightGroupSamples[first + group * 3 + 1] = mean.g;
+            lightGroupSamples[first + group * 3 + 2] = mean.b;
+            color += mean;
+        }
+    }
+
+    if (VIEW_COUNT > 0) {
+        accumulateView(pixel, view, color);
+        return;
+    }
+
+    // Accumulation moved to reproject.comp, which blends this into the reprojected history
+    imageStore(sampleImage, ivec2(pixel), vec4(color, 1.0));
+    imageStore(positionImage, ivec2(pixel), firstPosition);
+    imageStore(normalImage, ivec2(pixel), vec4(firstNormal, firstShininess));
+    if (RESAMPLED_LIGHTS) {
+        imageStore(firstBrdfImage, ivec2(pixel), vec4(firstBrdf, float(resampledSamples) / float(maxSamples)));
+    }
+}
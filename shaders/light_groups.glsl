@@ -0,0 +1,25 @@
+// Emitters accumulated apart so reproject.comp can relight the image without
+// tracing again, see src/light_groups.h. With LIGHT_GROUPS 0 the integrator
+// sums every emitter into one color scaled by light_intensity as before.
+
+layout(constant_id = 4) const uint LIGHT_GROUPS = 0;
+
+layout(binding = 18, set = 0) readonly buffer LightGroupTable {
+    uint lightGroupEmitters;  // Entries of emitterGroups
+    uint overflowGroup;       // Of emissions missing from the table
+    uint environmentGroup;
+    uint lightGroupPadding;
+    vec4 emitterGroups[];     // xyz an emission, w the bits of its group
+};
+
+// The frame's mean of every group per pixel, RGB, LIGHT_GROUPS per pixel row-major
+layout(binding = 19, set = 0) writeonly buffer LightGroupSamples { float lightGroupSamples[]; };
+
+uint emitterGroup(vec3 emission) {
+    for (uint i = 0; i < lightGroupEmitters; i++) {
+        if (emitterGroups[i].xyz == emission) {
+            return floatBitsToUint(emitterGroups[i].w);
+        }
+    }
+    return overflowGroup;
+}
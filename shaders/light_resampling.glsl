@@ -0,0 +1,178 @@
+// Reservoir resampling of the emissive triangles for the direct light of first
+// hits (Bitterli et al. 2020, "Spatiotemporal reservoir-based resampling for
+// real-time ray tracing with dynamic direct lighting"), shared by
+// restir_temporal.comp and restir_spatial.comp, see src/light_resampling.h.
+//
+// Candidates are drawn by emitted power and weighed by the unshadowed light
+// they bring to the first hit, with the BSDF the integrator converges to (see
+// scatteredLight). Unless UNBIASED, only the reservoir finally kept traces a
+// shadow ray.
+// Expects common.glsl and GL_EXT_ray_query.
+
+layout(constant_id = 0) const uint CANDIDATES = 8;
+layout(constant_id = 1) const uint NEIGHBORS = 4;
+layout(constant_id = 2) const float SPATIAL_RADIUS = 16.0;
+layout(constant_id = 3) const uint HISTORY_LIMIT = 20;  // Temporal history kept, in frames of candidates
+// Normalizes reuse by the inputs whose surface could have produced the sample instead of all of them
+layout(constant_id = 4) const bool UNBIASED = false;
+
+const uint MAX_NEIGHBORS = 8;
+
+layout(binding = 0, set = 0) uniform accelerationStructureEXT topLevelAS;
+layout(binding = 1, set = 0, rgba32f) uniform image2D sampleImage;
+layout(binding = 2, set = 0, rgba32f) readonly uniform image2D positionImage;
+layout(binding = 3, set = 0, rgba16f) readonly uniform image2D normalImage;  // w the first hit's shininess
+layout(binding = 4, set = 0, rgba16f) readonly uniform image2D firstBrdfImage;
+layout(binding = 5, set = 0, rgba32f) readonly uniform image2D previousPositionImage;
+layout(binding = 6, set = 0, rgba16f) readonly uniform image2D previousNormalImage;
+
+// The reprojection controls of the frame, mirrors the block of reproject.comp
+layout(binding = 7, set = 0) uniform ReprojectControls {
+    vec3 reprojectCameraPosition;
+    float reprojectFov;
+    vec3 previousCameraPosition;
+    float previousFov;
+    int reprojectAccumulate;
+    int resetHistory;
+    int maxMovingHistory;
+    float depthTolerance;
+    float normalThreshold;
+    uint reprojectLightGroups;
+    int resumedHistory;
+    vec4 lightGroupScales[8];
+};
+#include "controls.glsl"
+
+// Mirrors EmitterEntry of light_resampling.cpp
+struct Emitter {
+    vec4 corner;    // w the area
+    vec4 edge1;     // w the probability of drawing this or an earlier emitter
+    vec4 edge2;     // w the probability of drawing this emitter
+    vec4 emission;
+};
+
+layout(binding = 8, set = 0) readonly buffer Emitters {
+    uint emitterCount;
+    uint emitterPadding[3];
+    Emitter emitters[];
+};
+
+struct Reservoir {
+    vec2 uv;       // Of the chosen point on the emitter
+    uint emitter;
+    float W;       // Contribution weight of the chosen point, 0 for none
+    float wSum;
+    float M;       // Candidates seen
+    vec2 padding;
+};
+
+layout(binding = 9, set = 0) readonly buffer PreviousReservoirs { Reservoir previousReservoirs[]; };
+layout(binding = 10, set = 0) buffer CandidateReservoirs { Reservoir candidateReservoirs[]; };
+layout(binding = 11, set = 0) buffer Reservoirs { Reservoir reservoirs[]; };
+
+// The first hit of a pixel as the megakernel left it
+struct Surface {
+    vec3 position;
+    float depth;  // From the camera, 0 on a miss
+    vec3 normal;
+    float shininess;
+    vec3 brdf;
+    float coverage;  // Share of the pixel's samples leaving their direct light to the reservoirs, 0 for none
+};
+
+Surface loadSurface(ivec2 pixel) {
+    const vec4 position = imageLoad(positionImage, pixel);
+    const vec4 normal = imageLoad(normalImage, pixel);
+    const vec4 brdf = imageLoad(firstBrdfImage, pixel);
+    return Surface(position.xyz, position.w, normal.xyz, normal.w, brdf.rgb, position.w > 0.0 ? brdf.a : 0.0);
+}
+
+Reservoir emptyReservoir() {
+    return Reservoir(vec2(0.0), 0u, 0.0, 0.0, 0.0, vec2(0.0));
+}
+
+uint pixelSeed(uvec2 pixel, uint salt) {
+    const uvec2 hashed = pcg2d(uvec2(pixel.x | (pixel.y << 16), uint(frame + frameOffset) * 2u + salt));
+    return hashed.x ^ hashed.y;
+}
+
+vec3 emitterPoint(uint emitter, vec2 uv) {
+    return emitters[emitter].corner.xyz + uv.x * emitters[emitter].edge1.xyz + uv.y * emitters[emitter].edge2.xyz;
+}
+
+// A point on an emitter drawn by power, uniform over its area, and its area density
+void sampleEmitter(inout uint seed, out uint emitter, out vec2 uv, out float areaPdf) {
+    const float u = rand(seed);
+    uint low = 0;
+    uint high = emitterCount - 1;
+    while (low < high) {
+        const uint middle = (low + high) / 2;
+        if (u < emitters[middle].edge1.w) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    emitter = low;
+    const float r = sqrt(rand(seed));
+    const float v = rand(seed);
+    uv = vec2(r * (1.0 - v), r * v);
+    areaPdf = emitters[emitter].edge2.w / max(emitters[emitter].corner.w, 1e-12);
+}
+
+// Unshadowed light from the point reaching the camera through the surface, per unit emitter area
+vec3 emitterLight(Surface surface, uint emitter, vec2 uv) {
+    const vec3 toLight = emitterPoint(emitter, uv) - surface.position;
+    const float distance2 = dot(toLight, toLight);
+    const vec3 direction = toLight * inversesqrt(max(distance2, 1e-12));
+    const float cosine = dot(direction, normalize(surface.normal));
+    if (cosine <= 0.0 || distance2 <= 1e-12) {
+        return vec3(0.0);
+    }
+    // Emitters light both sides, as the integrator counts emission hit from either
+    const float lightCosine = abs(dot(direction, normalize(cross(emitters[emitter].edge1.xyz, emitters[emitter].edge2.xyz))));
+    return scatteredLight(surface.brdf, cosine, surface.shininess) * emitters[emitter].emission.rgb * lightCosine / distance2;
+}
+
+float targetPdf(Surface surface, uint emitter, vec2 uv) {
+    return dot(emitterLight(surface, emitter, uv), vec3(0.2126, 0.7152, 0.0722));
+}
+
+bool emitterVisible(vec3 position, uint emitter, vec2 uv) {
+    const vec3 toLight = emitterPoint(emitter, uv) - position;
+    const float lightDistance = length(toLight);
+    rayQueryEXT rayQuery;
+    rayQueryInitializeEXT(rayQuery, topLevelAS, gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT, 0xff, position, 0.001,
+                          toLight / lightDistance, max(lightDistance - 0.002, 0.001));
+    while (rayQueryProceedEXT(rayQuery)) {
+    }
+    return rayQueryGetIntersectionTypeEXT(rayQuery, true) == gl_RayQueryCommittedIntersectionNoneEXT;
+}
+
+// Adds a candidate of resampling weight w
+void updateReservoir(inout Reservoir reservoir, uint emitter, vec2 uv, float w, float M, inout uint seed) {
+    reservoir.wSum += w;
+    reservoir.M += M;
+    if (w > 0.0 && rand(seed) * reservoir.wSum < w) {
+        reservoir.emitter = emitter;
+        reservoir.uv = uv;
+    }
+}
+
+// Merges another pixel's reservoir, its sample weighed by the target at this surface
+void mergeReservoir(inout Reservoir reservoir, Reservoir other, Surface surface, inout uint seed) {
+    const float target = other.W > 0.0 ? targetPdf(surface, other.emitter, other.uv) : 0.0;
+    updateReservoir(reservoir, other.emitter, other.uv, target * other.W * other.M, other.M, seed);
+}
+
+// W of a merged reservoir, with normalization the candidates that could have produced its sample
+void finalizeReservoir(inout Reservoir reservoir, Surface surface, float normalization) {
+    const float target = targetPdf(surface, reservoir.emitter, reservoir.uv);
+    reservoir.W = target > 0.0 && normalization > 0.0 ? reservoir.wSum / (normalization * target) : 0.0;
+}
+
+// Whether a surface of the previous frame or a neighbour shows the same geometry as this one
+bool similarSurface(Surface surface, vec3 normal, float depth) {
+    return depth > 0.0 && abs(depth - surface.depth) <= depthTolerance * surface.depth * 2.0 &&
+           dot(normalize(surface.normal), normalize(normal)) >= normalThreshold;
+}
@@ -0,0 +1,39 @@
+// Face materials as packed by mesh_loader.h (FACE_STRIDE floats per face).
+// Expects the faces buffer to be declared before inclusion. FACE_DATA may be
+// defined first to read faces through a cache, and FACE_MATERIAL to map a
+// primitive to its entry in a deduplicated material table read by FACE_DATA.
+
+#ifndef FACE_DATA
+#define FACE_DATA(i) faces[i]
+#endif
+#ifndef FACE_MATERIAL
+#define FACE_MATERIAL(primitive) (primitive)
+#endif
+
+const uint FACE_STRIDE = 16;
+
+struct Face {
+    vec3 diffuse;
+    vec3 emission;
+    vec3 specular;
+    vec3 transmittance;
+    float shininess;
+    float ior;
+    float illum;
+    int diffuseTexture;  // -1 for none
+};
+
+Face unpackFace(uint index) {
+
+    uint offset = FACE_MATERIAL(index) * FACE_STRIDE;
+    Face f;
+    f.diffuse = vec3(FACE_DATA(offset +  0), FACE_DATA(offset +  1), FACE_DATA(offset + 2));
+    f.emission = vec3(FACE_DATA(offset +  3), FACE_DATA(offset +  4), FACE_DATA(offset + 5));
+    f.specular = vec3(FACE_DATA(offset + 6), FACE_DATA(offset + 7), FACE_DATA(offset + 8));
+    f.transmittance = vec3(FACE_DATA(offset + 9), FACE_DATA(offset + 10), FACE_DATA(offset + 11));
+    f.shininess = FACE_DATA(offset + 12);
+    f.ior = FACE_DATA(offset + 13);
+    f.illum = FACE_DATA(offset + 14);
+    f.diffuseTexture = int(FACE_DATA(offset + 15));
+    return f;
+}
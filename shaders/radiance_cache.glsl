@@ -0,0 +1,124 @@
+// World-space radiance cache of src/radiance_grid.h, resolved between frames
+// by radiance_cache_resolve.comp.
+//
+// With RADIANCE_CACHE every updateStride'th sample opens a record at each
+// diffuse or glossy vertex, and the light its path finds afterwards is added
+// to the vertex's cell over the path weight that reached it. Once the path's
+// footprint is wider than cacheFootprint cells, the next diffuse or glossy
+// vertex ends the path with the resolved radiance of its cell, when it has one.
+
+layout(constant_id = 8) const bool RADIANCE_CACHE = false;
+
+layout(binding = 10, set = 0) readonly buffer RadianceCacheHeader {
+    uint cacheCapacity;  // A power of two
+    float cacheCellSize;
+    float cacheFootprint;
+    uint cacheMinSamples;
+    uint cacheMaxSamples;
+    uint cacheMaxAge;
+    uint cacheUpdateStride;
+    uint cachePadding;
+};
+
+// CACHE_CELL_WORDS per cell: checksum (0 when free), the frame's fixed point
+// RGB sum, its record count, age, resolved RGB (float bits), resolved samples
+layout(binding = 11, set = 0) buffer RadianceCacheCells { uint cacheCells[]; };
+
+const uint CACHE_CELL_WORDS = 12;
+const uint CACHE_MAX_PROBES = 8;
+const float CACHE_FIXED_POINT = 1024.0;
+const float CACHE_MAX_RECORD = 1000.0;
+const uint CACHE_MAX_UPDATES = 1024;
+const uint CACHE_NO_CELL = 0xffffffffu;
+const uint CACHE_MAX_RECORDS = 8;  // One per bounce
+
+uint cacheHashWord(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint cacheHash(vec3 position, vec3 normal) {
+    const ivec3 cell = ivec3(floor(position / cacheCellSize));
+    const vec3 a = abs(normal);
+    const uint axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+    const uint bin = 2 * axis + (normal[axis] < 0.0 ? 1 : 0);
+    return cacheHashWord(uint(cell.x) + cacheHashWord(uint(cell.y) + cacheHashWord(uint(cell.z) + cacheHashWord(bin))));
+}
+
+uint cacheChecksum(uint hash) {
+    return cacheHashWord(hash ^ 0x9e3779b9u) | 1u;
+}
+
+uint claimCacheCell(vec3 position, vec3 normal) {
+    const uint hash = cacheHash(position, normal);
+    const uint key = cacheChecksum(hash);
+    for (uint probe = 0; probe < CACHE_MAX_PROBES; probe++) {
+        const uint cell = (hash + probe) & (cacheCapacity - 1);
+        const uint previous = atomicCompSwap(cacheCells[cell * CACHE_CELL_WORDS], 0u, key);
+        if (previous == 0u || previous == key) {
+            return cell;
+        }
+    }
+    return CACHE_NO_CELL;
+}
+
+bool cachedRadiance(vec3 position, vec3 normal, out vec3 radiance) {
+    const uint hash = cacheHash(position, normal);
+    const uint key = cacheChecksum(hash);
+    radiance = vec3(0.0);
+    for (uint probe = 0; probe < CACHE_MAX_PROBES; probe++) {
+        const uint word = ((hash + probe) & (cacheCapacity - 1)) * CACHE_CELL_WORDS;
+        if (cacheCells[word] != key) {
+            continue;
+        }
+        if (cacheCells[word + 9] < cacheMinSamples) {
+            return false;
+        }
+        radiance = uintBitsToFloat(uvec3(cacheCells[word + 6], cacheCells[word + 7], cacheCells[word + 8]));
+        return true;
+    }
+    return false;
+}
+
+// Open records of the current path and the light found behind each
+struct CacheRecord {
+    uint cell;
+    vec3 weight;  // Path weight reaching the vertex
+    vec3 radiance;
+};
+CacheRecord cacheRecords[CACHE_MAX_RECORDS];
+uint cacheRecordCount = 0;
+
+void openCacheRecord(vec3 position, vec3 normal, vec3 weight) {
+    if (cacheRecordCount >= CACHE_MAX_RECORDS) {
+        return;
+    }
+    const uint cell = claimCacheCell(position, normal);
+    if (cell != CACHE_NO_CELL) {
+        cacheRecords[cacheRecordCount++] = CacheRecord(cell, weight, vec3(0.0));
+    }
+}
+
+void addCachedLight(vec3 light) {
+    for (uint i = 0; i < cacheRecordCount; i++) {
+        cacheRecords[i].radiance += max(light, vec3(0.0)) / max(cacheRecords[i].weight, vec3(1e-8));
+    }
+}
+
+// At the end of a path
+void closeCacheRecords() {
+    for (uint i = 0; i < cacheRecordCount; i++) {
+        const uint word = cacheRecords[i].cell * CACHE_CELL_WORDS;
+        if (atomicAdd(cacheCells[word + 4], 1u) < CACHE_MAX_UPDATES) {
+            const uvec3 fixedPoint = uvec3(clamp(cacheRecords[i].radiance, vec3(0.0), vec3(CACHE_MAX_RECORD)) * CACHE_FIXED_POINT);
+            atomicAdd(cacheCells[word + 1], fixedPoint.r);
+            atomicAdd(cacheCells[word + 2], fixedPoint.g);
+            atomicAdd(cacheCells[word + 3], fixedPoint.b);
+        }
+    }
+    cacheRecordCount = 0;
+}
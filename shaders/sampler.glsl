@@ -0,0 +1,83 @@
+// Owen-scrambled Sobol sampler, see src/sobol.h for the CPU mirror.
+// Expects the sobolMatrices and blueNoise buffers to be declared before inclusion.
+
+const uint SOBOL_BITS = 32;
+const uint BLUE_NOISE_SIZE = 64;
+
+// Dimension layout of one path: the lens sample, then six per bounce
+const uint DIM_LENS = 0;
+const uint DIM_RR = 0;
+const uint DIM_BSDF = 1;
+const uint DIM_FRESNEL = 3;
+const uint DIM_LIGHT = 4;
+
+uint bounceDimension(uint depth) {
+    return 2 + depth * 6;
+}
+
+uint sobolSample(uint index, uint dimension) {
+    uint result = 0;
+    for (uint bit = 0; index != 0; bit++, index >>= 1) {
+        if ((index & 1u) != 0) result ^= sobolMatrices[dimension * SOBOL_BITS + bit];
+    }
+    return result;
+}
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint hashCombine(uint seed, uint value) {
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+uint laineKarrasPermutation(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed) {
+    return bitfieldReverse(laineKarrasPermutation(bitfieldReverse(x), seed));
+}
+
+float toFloat(uint x) {
+    return float(x >> 8) * (1.0 / 16777216.0);
+}
+
+struct PixelSampler {
+    uvec2 pixel;
+    uint index;
+    uint tileSeed;
+};
+
+PixelSampler createSampler(uvec2 pixel, uint index) {
+    return PixelSampler(pixel, index, hash((pixel.x / BLUE_NOISE_SIZE) | ((pixel.y / BLUE_NOISE_SIZE) << 16)));
+}
+
+uint blueNoiseShift(PixelSampler s, uint dimension) {
+    uint tx = (s.pixel.x + dimension * 37u) % BLUE_NOISE_SIZE;
+    uint ty = (s.pixel.y + dimension * 23u) % BLUE_NOISE_SIZE;
+    return blueNoise[ty * BLUE_NOISE_SIZE + tx] << 20;
+}
+
+float get1D(PixelSampler s, uint dimension) {
+    uint seed = hash(hashCombine(s.tileSeed, dimension));
+    uint shuffled = nestedUniformScramble(s.index, seed);
+    return toFloat(nestedUniformScramble(sobolSample(shuffled, 0), hashCombine(seed, 0)) ^ blueNoiseShift(s, dimension));
+}
+
+vec2 get2D(PixelSampler s, uint dimension) {
+    uint seed = hash(hashCombine(s.tileSeed, dimension));
+    uint shuffled = nestedUniformScramble(s.index, seed);
+    return vec2(toFloat(nestedUniformScramble(sobolSample(shuffled, 0), hashCombine(seed, 0)) ^ blueNoiseShift(s, dimension)),
+                toFloat(nestedUniformScramble(sobolSample(shuffled, 1), hashCombine(seed, 1)) ^ blueNoiseShift(s, dimension + 1)));
+}
@@ -0,0 +1,82 @@
+// Surface attributes of a triangle hit, shared by closesthit.rchit and pathtrace.comp.
+// Expects the vertices, indices and faces buffers to be declared before inclusion,
+// and GL_EXT_nonuniform_qualifier to be enabled.
+
+#include "material.glsl"
+
+// Diffuse maps, see src/texture_set.h
+layout(binding = 13, set = 0) uniform sampler2D textures[];
+
+struct Vertex {
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+};
+
+Vertex unpackVertex(uint index) {
+
+    uint stride = 8;
+    uint offset = index * stride;
+    Vertex v;
+    v.position = vec3(vertices[offset +  0], vertices[offset +  1], vertices[offset + 2]);
+    v.normal = vec3(vertices[offset +  3], vertices[offset +  4], vertices[offset + 5]);
+    v.uv = vec2(vertices[offset + 6], vertices[offset + 7]);
+
+    return v;
+}
+
+vec3 calcNormal(Vertex v0, Vertex v1, Vertex v2) {
+
+    vec3 e01 = v1.normal - v0.normal;
+    vec3 e02 = v2.normal - v0.normal;
+    return -normalize(cross(e01, e02));
+}
+
+// Mip level from the ray cone footprint (Akenine-Moller et al. 2021, "Improved
+// Shader and Texture Level of Detail Using Ray Cones"), with the triangle's
+// texel to world area ratio standing in for the UV derivatives.
+float coneLod(uint map, Vertex v0, Vertex v1, Vertex v2, vec3 normal, vec3 direction, float coneWidth) {
+
+    vec2 size = vec2(textureSize(textures[nonuniformEXT(map)], 0));
+    float texelArea = abs(determinant(mat2((v1.uv - v0.uv) * size, (v2.uv - v0.uv) * size)));
+    float worldArea = length(cross(v1.position - v0.position, v2.position - v0.position));
+    float cosine = max(abs(dot(normal, direction)), 1e-3);
+    return 0.5 * log2(max(texelArea, 1e-12) / max(worldArea, 1e-12)) + log2(max(coneWidth, 1e-12) / cosine);
+}
+
+void setSurfacePayload(inout HitPayload hit, uint primitive, vec2 attribs, vec3 direction, float hitDistance) {
+
+    const Vertex v0 = unpackVertex(indices[3 * primitive + 0]);
+    const Vertex v1 = unpackVertex(indices[3 * primitive + 1]);
+    const Vertex v2 = unpackVertex(indices[3 * primitive + 2]);
+
+    const vec3 barycentricCoords = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+    const vec3 position = v0.position * barycentricCoords.x +
+                          v1.position * barycentricCoords.y +
+                          v2.position * barycentricCoords.z;
+    const vec3 normal = v0.normal * barycentricCoords.x +
+                        v1.normal * barycentricCoords.y +
+                        v2.normal * barycentricCoords.z;
+
+    const Face face = unpackFace(primitive);
+    hit.coneWidth += hit.coneSpread * hitDistance;
+    vec3 diffuse = face.diffuse;
+    if (face.diffuseTexture >= 0) {
+        const vec2 uv = v0.uv * barycentricCoords.x + v1.uv * barycentricCoords.y + v2.uv * barycentricCoords.z;
+        const uint map = uint(face.diffuseTexture);
+        const float lod = coneLod(map, v0, v1, v2, normalize(normal), direction, hit.coneWidth);
+        diffuse *= textureLod(textures[nonuniformEXT(map)], uv, lod).rgb;
+    }
+    hit.brdf = diffuse / M_PI;
+    hit.emission = face.emission;
+    hit.position = position;
+    // Normals from the file may disagree with the winding, keep them on the geometric normal's side
+    const vec3 geometricNormal = -cross(v1.position - v0.position, v2.position - v0.position);
+    hit.normal = dot(normal, geometricNormal) > 0.0 ? -normal : normal;
+    hit.specular = face.specular;
+    hit.transmittance = face.transmittance;
+    hit.shininess = face.shininess;
+    hit.ior = face.ior;
+    hit.illum = face.illum;
+    hit.primitive = primitive;
+}
@@ -0,0 +1,23 @@
+// Cameras of a view batch, see src/view_batch.h. With VIEW_COUNT above 0 the
+// launch is VIEW_COUNT deep and each slice traces one view into its own layer
+// of viewAccumulation, averaged over the frames in place of reproject.comp;
+// the controls' camera is unused then.
+
+layout(constant_id = 6) const uint VIEW_COUNT = 0;
+
+// Mirrors BatchView of view_batch.h. The basis turns raygen's camera space, looking down -Z, into the world.
+struct BatchView {
+    vec4 positionFov;  // w is the vertical field of view in degrees
+    vec4 right;
+    vec4 up;
+    vec4 back;
+};
+
+layout(binding = 22, set = 0) readonly buffer BatchViews { BatchView batchViews[]; };
+layout(binding = 23, set = 0, rgba32f) uniform image2DArray viewAccumulation;  // rgb mean, a frames
+
+void accumulateView(uvec2 pixel, uint view, vec3 color) {
+    const ivec3 texel = ivec3(pixel, view);
+    const vec3 history = frame == 0 ? vec3(0.0) : imageLoad(viewAccumulation, texel).rgb;
+    imageStore(viewAccumulation, texel, vec4((history * float(frame) + color) / float(frame + 1), float(frame + 1)));
+}
@@ -0,0 +1,92 @@
+// Declarations shared by the wavefront stages, see src/wavefront.h.
+// One path per pixel is in flight per wave; stages hand paths to each other
+// through queues of path indices with atomic counters. The TLAS (binding 0)
+// is only declared by wavefront_extend.rgen.
+
+layout(binding = 1, set = 0, rgba32f) uniform image2D sampleImage;
+layout(binding = 2, set = 0) buffer Vertices{float vertices[];};
+layout(binding = 3, set = 0) buffer Indices{uint indices[];};
+layout(binding = 4, set = 0) buffer Faces{float faces[];};
+layout(binding = 5, set = 0) readonly buffer SobolMatrices { uint sobolMatrices[]; };
+layout(binding = 6, set = 0) readonly buffer BlueNoise { uint blueNoise[]; };
+layout(binding = 7, set = 0, rgba32f) uniform image2D positionImage;
+layout(binding = 8, set = 0, rgba16f) uniform image2D normalImage;
+
+const uint MAX_DEPTH = 8;
+
+// Shading is split by material so every shade dispatch runs a single branch
+const uint CLASS_MISS = 0;
+const uint CLASS_DIFFUSE = 1;     // illum 2
+const uint CLASS_GLOSSY = 2;      // illum 3
+const uint CLASS_MIRROR = 3;      // illum 5
+const uint CLASS_DIELECTRIC = 4;  // illum 7
+const uint CLASS_OTHER = 5;       // Emission only, the path continues straight on
+const uint MATERIAL_CLASSES = 6;
+
+struct PathState {
+    vec4 origin;  // w is the ray cone width at the origin
+    vec4 direction;
+    vec4 weight;
+    vec4 color;
+};
+
+struct Hit {
+    vec4 position;  // w is the hit distance, 0 on a miss
+    vec4 normal;    // w holds the face index bits
+    vec4 albedo;    // Textured diffuse color, w the ray cone width at the hit
+};
+
+layout(binding = 9, set = 0) buffer Paths { PathState paths[]; };
+layout(binding = 10, set = 0) buffer Hits { Hit hits[]; };
+// Two ray queues (ping-ponged by depth) followed by the material sorted queue, pathCount entries each
+layout(binding = 11, set = 0) buffer Queues { uint queues[]; };
+layout(binding = 12, set = 0) buffer Counters {
+    uint rayCount[2];
+    uint classCount[MATERIAL_CLASSES];
+    uint classOffset[MATERIAL_CLASSES];
+    uint classCursor[MATERIAL_CLASSES];
+    uint traceArgs[3];
+    uint rayDispatchArgs[3];
+    uint shadeArgs[MATERIAL_CLASSES * 3];
+};
+
+#include "controls.glsl"
+layout(push_constant) uniform WavefrontControls {
+    uint sampleNum;
+    uint depth;
+    uint pathCount;
+    uint mode;
+};
+
+#include "sampler.glsl"
+#include "material.glsl"
+
+uint rayQueue(uint parity) {
+    return parity * pathCount;
+}
+
+uint sortedQueue() {
+    return 2 * pathCount;
+}
+
+uvec2 pathPixel(uint path) {
+    uint width = uint(imageSize(sampleImage).x);
+    return uvec2(path % width, path / width);
+}
+
+PixelSampler pathSampler(uint path) {
+    return createSampler(pathPixel(path), sampleNum + uint(samplesPerFrame) * uint(frame + frameOffset));
+}
+
+uint materialClass(uint path) {
+    Hit hit = hits[path];
+    if (hit.position.w == 0.0) {
+        return CLASS_MISS;
+    }
+    float illum = faces[floatBitsToUint(hit.normal.w) * FACE_STRIDE + 14];
+    if (illum == 2.0) return CLASS_DIFFUSE;
+    if (illum == 3.0) return CLASS_GLOSSY;
+    if (illum == 5.0) return CLASS_MIRROR;
+    if (illum == 7.0) return CLASS_DIELECTRIC;
+    return CLASS_OTHER;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Void-and-cluster (Ulichney 1993) dither array of size x size, each pixel
+// holding its rank in [0, size * size). Tiles seamlessly.
+inline std::vector<uint32_t> generateBlueNoise(int size, float sigma = 1.9f, uint32_t seed = 1) {
+    const int count = size * size;
+
+    // Toroidal Gaussian energy splatted by every set pixel
+    std::vector<float> kernel(count);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const int dx = std::min(x, size - x);
+            const int dy = std::min(y, size - y);
+            kernel[y * size + x] = std::exp(-static_cast<float>(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+    }
+
+    std::vector<uint8_t> pattern(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    auto toggle = [&](int pixel, bool set) {
+        pattern[pixel] = set;
+        const int px = pixel % size;
+        const int py = pixel / size;
+        const float sign = set ? 1.0f : -1.0f;
+        for (int y = 0; y < size; y++) {
+            const float* row = &kernel[((y - py + size) % size) * size];
+            for (int x = 0; x < size; x++) {
+                energy[y * size + x] += sign * row[(x - px + size) % size];
+            }
+        }
+    };
+    // Tightest cluster is the set pixel with the most energy, largest void the empty one with the least
+    auto tightestCluster = [&] {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+        }
+        return best;
+    };
+    auto largestVoid = [&] {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+        }
+        return best;
+    };
+
+    // Random initial pattern, relaxed by moving cluster pixels into voids
+    const int initial = std::max(1, count / 10);
+    uint32_t state = seed;
+    for (int placed = 0; placed < initial;) {
+        state = state * 747796405u + 2891336453u;
+        const int pixel = static_cast<int>((state >> 8) % static_cast<uint32_t>(count));
+        if (!pattern[pixel]) {
+            toggle(pixel, true);
+            placed++;
+        }
+    }
+    for (int iteration = 0; iteration < count; iteration++) {
+        const int cluster = tightestCluster();
+        toggle(cluster, false);
+        const int emptiest = largestVoid();
+        toggle(emptiest, true);
+        if (emptiest == cluster) break;
+    }
+
+    std::vector<uint32_t> ranks(count);
+    const std::vector<uint8_t> prototype = pattern;
+    const std::vector<float> prototypeEnergy = energy;
+
+    // Ranks below the prototype come from removing clusters, the rest from filling voids.
+    // Past half full this is the same as ranking the tightest clusters of empty pixels.
+    for (int rank = initial - 1; rank >= 0; rank--) {
+        const int cluster = tightestCluster();
+        toggle(cluster, false);
+        ranks[cluster] = static_cast<uint32_t>(rank);
+    }
+    pattern = prototype;
+    energy = prototypeEnergy;
+    for (int rank = initial; rank < count; rank++) {
+        const int emptiest = largestVoid();
+        toggle(emptiest, true);
+        ranks[emptiest] = static_cast<uint32_t>(rank);
+    }
+    return ranks;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "scene_data.h"
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void grow(const Aabb& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+    glm::vec3 centroid() const { return (min + max) * 0.5f; }
+    float area() const {
+        glm::vec3 e = max - min;
+        if (e.x < 0.0f) return 0.0f;
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+// A node is a leaf when count > 0, in which case leftFirst indexes primIndices.
+// Inner nodes store their left child in leftFirst, the right child follows it.
+struct BvhNode {
+    Aabb bounds;
+    uint32_t leftFirst = 0;
+    uint32_t count = 0;
+};
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMin = 0.001f;
+    float tMax = 1000.0f;
+};
+
+// Same convention as the closest hit shader: (u, v) weight vertices 1 and 2.
+struct RayHit {
+    float t = std::numeric_limits<float>::max();
+    float u = 0.0f;
+    float v = 0.0f;
+    uint32_t primitive = UINT32_MAX;
+    bool valid() const { return primitive != UINT32_MAX; }
+};
+
+struct BvhTriangle {
+    glm::vec3 v0;
+    glm::vec3 e1;
+    glm::vec3 e2;
+};
+
+// Moller-Trumbore, no culling to match eTriangleFacingCullDisable.
+inline bool intersectTriangle(const BvhTriangle& tri, const glm::vec3& origin, const glm::vec3& direction, float tMin, float tMax,
+                              RayHit& hit) {
+    glm::vec3 p = glm::cross(direction, tri.e2);
+    float det = glm::dot(tri.e1, p);
+    if (std::abs(det) < 1e-12f) return false;
+    float invDet = 1.0f / det;
+    glm::vec3 s = origin - tri.v0;
+    float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+    glm::vec3 q = glm::cross(s, tri.e1);
+    float v = glm::dot(direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = glm::dot(tri.e2, q) * invDet;
+    if (t < tMin || t >= tMax) return false;
+    hit.t = t;
+    hit.u = u;
+    hit.v = v;
+    return true;
+}
+
+class Bvh {
+public:
+    static constexpr int BinCount = 16;
+    static constexpr uint32_t MaxLeafSize = 4;
+    static constexpr uint32_t ParallelThreshold = 4096;
+    // Deepest inner node; nodes there become leaves whatever their size, so the
+    // traversal stack, which holds at most one node per level, cannot overflow
+    static constexpr uint32_t MaxDepth = 64;
+
+    Bvh() = default;
+    Bvh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) { build(vertices, indices); }
+
+    void build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+        const auto primitiveCount = static_cast<uint32_t>(indices.size() / 3);
+        triangles.resize(primitiveCount);
+        primBounds.resize(primitiveCount);
+        primIndices.resize(primitiveCount);
+        nodes.assign(std::max<uint32_t>(1, 2 * primitiveCount), BvhNode{});
+        nodeCount = 1;
+
+        parallelFor(primitiveCount, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                BvhTriangle& tri = triangles[i];
+                tri.v0 = vertices[indices[3 * i + 0]].position;
+                tri.e1 = vertices[indices[3 * i + 1]].position - tri.v0;
+                tri.e2 = vertices[indices[3 * i + 2]].position - tri.v0;
+                primBounds[i] = Aabb{};
+                primBounds[i].grow(tri.v0);
+                primBounds[i].grow(tri.v0 + tri.e1);
+                primBounds[i].grow(tri.v0 + tri.e2);
+                primIndices[i] = i;
+            }
+        });
+
+        nodes[0].leftFirst = 0;
+        nodes[0].count = primitiveCount;
+        if (primitiveCount > 0) {
+            subdivide(0, 0);
+        }
+        nodes.resize(nodeCount);
+    }
+
+    bool intersect(const Ray& ray, RayHit& hit) const {
+        if (triangles.empty()) return false;
+
+        const glm::vec3 invDir = 1.0f / ray.direction;
+        float tMax = ray.tMax;
+        uint32_t stack[MaxDepth];
+        uint32_t stackSize = 0;
+        uint32_t nodeIndex = 0;
+
+        if (intersectAabb(nodes[0].bounds, ray.origin, invDir, ray.tMin, tMax) == std::numeric_limits<float>::max()) {
+            return false;
+        }
+
+        while (true) {
+            const BvhNode& node = nodes[nodeIndex];
+            if (node.count > 0) {
+                for (uint32_t i = 0; i < node.count; i++) {
+                    uint32_t prim = primIndices[node.leftFirst + i];
+                    if (intersectTriangle(triangles[prim], ray.origin, ray.direction, ray.tMin, tMax, hit)) {
+                        hit.primitive = prim;
+                        tMax = hit.t;
+                    }
+                }
+                if (stackSize == 0) break;
+                nodeIndex = stack[--stackSize];
+                continue;
+            }
+
+            uint32_t near = node.leftFirst;
+            uint32_t far = node.leftFirst + 1;
+            float tNear = intersectAabb(nodes[near].bounds, ray.origin, invDir, ray.tMin, tMax);
+            float tFar = intersectAabb(nodes[far].bounds, ray.origin, invDir, ray.tMin, tMax);
+            if (tNear > tFar) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+
+            if (tNear == std::numeric_limits<float>::max()) {
+                if (stackSize == 0) break;
+                nodeIndex = stack[--stackSize];
+            } else {
+                nodeIndex = near;
+                if (tFar != std::numeric_limits<float>::max()) {
+                    stack[stackSize++] = far;
+                }
+            }
+        }
+        return hit.valid();
+    }
+
+    const Aabb& bounds() const { return nodes[0].bounds; }
+    const std::vector<BvhTriangle>& getTriangles() const { return triangles; }
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> primIndices;
+
+private:
+    struct Bin {
+        Aabb bounds;
+        uint32_t count = 0;
+    };
+
+    template <typename Func>
+    static void parallelFor(uint32_t count, Func&& func) {
+        const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+        const uint32_t chunk = (count + threadCount - 1) / threadCount;
+        if (threadCount == 1 || count < ParallelThreshold) {
+            func(0, count);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (uint32_t begin = 0; begin < count; begin += chunk) {
+            threads.emplace_back([&func, begin, end = std::min(count, begin + chunk)] { func(begin, end); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    static float intersectAabb(const Aabb& box, const glm::vec3& origin, const glm::vec3& invDir, float tMin, float tMax) {
+        glm::vec3 t0 = (box.min - origin) * invDir;
+        glm::vec3 t1 = (box.max - origin) * invDir;
+        glm::vec3 tSmall = glm::min(t0, t1);
+        glm::vec3 tLarge = glm::max(t0, t1);
+        float tEnter = std::max(std::max(tSmall.x, tSmall.y), std::max(tSmall.z, tMin));
+        float tExit = std::min(std::min(tLarge.x, tLarge.y), std::min(tLarge.z, tMax));
+        return tEnter <= tExit ? tEnter : std::numeric_limits<float>::max();
+    }
+
+    void subdivide(uint32_t nodeIndex, uint32_t depth) {
+        BvhNode& node = nodes[nodeIndex];
+        Aabb centroidBounds;
+        for (uint32_t i = 0; i < node.count; i++) {
+            const Aabb& box = primBounds[primIndices[node.leftFirst + i]];
+            node.bounds.grow(box);
+            centroidBounds.grow(box.centroid());
+        }
+        if (node.count <= MaxLeafSize || depth >= MaxDepth) return;
+
+        // Binned SAH over the centroid bounds of every axis
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = node.bounds.area() * static_cast<float>(node.count);
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f) continue;
+
+            std::array<Bin, BinCount> bins{};
+            float scale = BinCount / extent;
+            for (uint32_t i = 0; i < node.count; i++) {
+                const Aabb& box = primBounds[primIndices[node.leftFirst + i]];
+                int b = std::min(BinCount - 1, static_cast<int>((box.centroid()[axis] - centroidBounds.min[axis]) * scale));
+                bins[b].count++;
+                bins[b].bounds.grow(box);
+            }
+
+            std::array<float, BinCount - 1> leftCost{};
+            Aabb leftBox;
+            uint32_t leftCount = 0;
+            for (int i = 0; i < BinCount - 1; i++) {
+                leftBox.grow(bins[i].bounds);
+                leftCount += bins[i].count;
+                leftCost[i] = leftBox.area() * static_cast<float>(leftCount);
+            }
+            Aabb rightBox;
+            uint32_t rightCount = 0;
+            for (int i = BinCount - 1; i > 0; i--) {
+                rightBox.grow(bins[i].bounds);
+                rightCount += bins[i].count;
+                float cost = leftCost[i - 1] + rightBox.area() * static_cast<float>(rightCount);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+        if (bestAxis < 0) return;
+
+        // Partition primitives around the chosen bin boundary
+        float scale = BinCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        auto first = primIndices.begin() + node.leftFirst;
+        auto middle = std::partition(first, first + node.count, [&](uint32_t prim) {
+            int b = std::min(BinCount - 1, static_cast<int>((primBounds[prim].centroid()[bestAxis] - centroidBounds.min[bestAxis]) * scale));
+            return b < bestSplit;
+        });
+        auto leftCount = static_cast<uint32_t>(middle - first);
+        if (leftCount == 0 || leftCount == node.count) return;
+
+        uint32_t leftIndex = nodeCount.fetch_add(2);
+        nodes[leftIndex].leftFirst = node.leftFirst;
+        nodes[leftIndex].count = leftCount;
+        nodes[leftIndex + 1].leftFirst = node.leftFirst + leftCount;
+        nodes[leftIndex + 1].count = node.count - leftCount;
+        node.leftFirst = leftIndex;
+        node.count = 0;
+
+        // Large subtrees are built concurrently; node slots are claimed atomically
+        if (nodes[leftIndex].count >= ParallelThreshold && nodes[leftIndex + 1].count >= ParallelThreshold) {
+            auto left = std::async(std::launch::async, [this, leftIndex, depth] { subdivide(leftIndex, depth + 1); });
+            subdivide(leftIndex + 1, depth + 1);
+            left.get();
+        } else {
+            subdivide(leftIndex, depth + 1);
+            subdivide(leftIndex + 1, depth + 1);
+        }
+    }
+
+    std::vector<BvhTriangle> triangles;
+    std::vector<Aabb> primBounds;
+    std::atomic<uint32_t> nodeCount{0};
+};
@@ -0,0 +1,143 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "scene_bundle.h"
+
+namespace {
+
+constexpr char Magic[8] = {'V', 'P', 'T', 'C', 'K', 'P', 'T', '2'};
+
+// FNV-1a over the bytes of each field
+class Hasher {
+public:
+    template <typename T>
+    void value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        bytes(&value, sizeof(T));
+    }
+    void string(const std::string& text) {
+        value<uint64_t>(text.size());
+        bytes(text.data(), text.size());
+    }
+    uint64_t result() const { return hash; }
+
+private:
+    void bytes(const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 0x100000001b3ull;
+        }
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+};
+
+void hashFile(Hasher& hasher, const SceneBundle::FileStamp& file) {
+    hasher.string(file.path);
+    hasher.value(file.size);
+    hasher.value(file.time);
+}
+
+}  // namespace
+
+uint64_t checkpointHash(const RenderSettings& settings) {
+    Hasher hasher;
+    // The mesh with its material libraries and diffuse maps
+    for (const SceneBundle::FileStamp& file : SceneBundle::Key::of(settings.meshPath, 0, 1).files) {
+        hashFile(hasher, file);
+    }
+    hasher.value(settings.width);
+    hasher.value(settings.height);
+    hasher.value(settings.renderScale);
+    hasher.value(settings.samplesPerFrame);
+    hasher.value(settings.integrator);
+    hasher.value(settings.backend);
+    hasher.value(settings.textures.compress);
+    hasher.value(settings.textures.budgetMB);
+    hasher.value(settings.geometry.stream);
+    hasher.value(settings.geometry.clusterTriangles);
+    hasher.value(settings.geometry.budgetMB);
+    hasher.value(settings.geometry.lodLevels);
+    hasher.value(settings.geometry.lodPixels);
+    if (!settings.environment.path.empty()) {
+        hashFile(hasher, SceneBundle::FileStamp::of(settings.environment.path));
+    }
+    hasher.value(settings.environment.intensity);
+    hasher.value(settings.environment.sampling);
+    hasher.value(settings.guiding.enabled);
+    hasher.value(settings.guiding.iterations);
+    hasher.value(settings.guiding.bsdfFraction);
+    hasher.value(settings.resampling.enabled);
+    hasher.value(settings.resampling.candidates);
+    hasher.value(settings.resampling.neighbors);
+    hasher.value(settings.resampling.radius);
+    hasher.value(settings.resampling.historyLimit);
+    hasher.value(settings.resampling.unbiased);
+    hasher.value(settings.radianceCache.enabled);
+    hasher.value(settings.radianceCache.budgetMB);
+    hasher.value(settings.radianceCache.resolution);
+    hasher.value(settings.radianceCache.footprint);
+    hasher.value(settings.radianceCache.updateStride);
+    hasher.value(settings.radianceCache.minSamples);
+    hasher.value(settings.radianceCache.maxSamples);
+    hasher.value(settings.radianceCache.maxAge);
+    hasher.value(settings.camera.cameraPosition);
+    hasher.value(settings.camera.fov);
+    return hasher.result();
+}
+
+bool readCheckpoint(const std::string& path, Checkpoint& checkpoint) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    char magic[sizeof(Magic)];
+    Checkpoint result;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&result.hash), sizeof(result.hash));
+    file.read(reinterpret_cast<char*>(&result.controls), sizeof(result.controls));
+    file.read(reinterpret_cast<char*>(&result.width), sizeof(result.width));
+    file.read(reinterpret_cast<char*>(&result.height), sizeof(result.height));
+    if (!file || !std::equal(std::begin(magic), std::end(magic), Magic) || result.width <= 0 || result.height <= 0) {
+        return false;
+    }
+
+    const auto size = static_cast<uint64_t>(result.width) * result.height * 4;
+    const auto begin = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::end);
+    if (static_cast<uint64_t>(file.tellg()) - begin != size * sizeof(float)) {
+        return false;
+    }
+    file.seekg(static_cast<std::streamoff>(begin));
+    result.pixels.resize(size);
+    file.read(reinterpret_cast<char*>(result.pixels.data()), static_cast<std::streamsize>(size * sizeof(float)));
+    if (!file) {
+        return false;
+    }
+    checkpoint = std::move(result);
+    return true;
+}
+
+void writeCheckpoint(const std::string& path, uint64_t hash, const Controls& controls, const float* pixels, int width, int height) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + temporary);
+        }
+        file.write(Magic, sizeof(Magic));
+        file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        file.write(reinterpret_cast<const char*>(&controls), sizeof(controls));
+        file.write(reinterpret_cast<const char*>(&width), sizeof(width));
+        file.write(reinterpret_cast<const char*>(&height), sizeof(height));
+        file.write(reinterpret_cast<const char*>(pixels), static_cast<std::streamsize>(sizeof(float) * 4 * width * height));
+        if (!file) {
+            throw std::runtime_error("failed to write " + temporary);
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "controls.h"
+#include "render_settings.h"
+
+// Progress of a progressive render: the float accumulation (rgb mean, a the
+// pixel's history length in frames, i.e. its sample count over samplesPerFrame)
+// and the controls it continues from, whose frame index keeps the sampler
+// drawing fresh samples. Only valid for the scene and settings it was made
+// from, told apart by checkpointHash.
+struct Checkpoint {
+    uint64_t hash = 0;
+    Controls controls;
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;  // RGBA32F, top row first
+};
+
+// Of the mesh, its material files and the environment as they are now, and every setting that changes the image.
+uint64_t checkpointHash(const RenderSettings& settings);
+
+// False when the file is missing, truncated or not a checkpoint.
+bool readCheckpoint(const std::string& path, Checkpoint& checkpoint);
+// Through a temporary file, so an interrupted write leaves the previous checkpoint in place.
+void writeCheckpoint(const std::string& path, uint64_t hash, const Controls& controls, const float* pixels, int width, int height);
@@ -1,4 +1,8 @@
 #include "context.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 // The key callback function
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -6,14 +10,22 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (action != GLFW_PRESS && action != GLFW_REPEAT)
         return;
 
-    // Retrieve our controls instance from the window's user pointer.
-    auto* controls = reinterpret_cast<Controls*>(glfwGetWindowUserPointer(window));
-    if (!controls)
+    // Retrieve our context instance from the window's user pointer.
+    auto* context = reinterpret_cast<Context*>(glfwGetWindowUserPointer(window));
+    if (!context)
+        return;
+    Controls* controls = &context->controls;
+
+    // Light groups are relit by reproject.comp, their edits keep the accumulation
+    if (context->onLightKey && context->onLightKey(key)) {
         return;
+    }
 
     constexpr float moveSpeed = 0.1f;
     constexpr float fovStep = 5.0f;
 
+    // Camera changes keep the accumulated history, reproject.comp carries it over
+    const Controls previous = *controls;
     switch (key) {
         case GLFW_KEY_W: controls->cameraPosition.z -= moveSpeed; break;
         case GLFW_KEY_S: controls->cameraPosition.z += moveSpeed; break;
@@ -27,21 +39,49 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         case GLFW_KEY_B: controls->accumulate = 1; break;
         case GLFW_KEY_UP: controls->light_intensity += 0.1f; break;
         case GLFW_KEY_DOWN: controls->light_intensity -= 0.1f; break;
+        case GLFW_KEY_Z:
+            if (context->onFrameScene) context->onFrameScene();
+            break;
         default: break;
     }
 
-    controls->frame = 0;
+    if (controls->accumulate != previous.accumulate || controls->light_intensity != previous.light_intensity) {
+        controls->frame = 0;
+    }
     std::cout << "Accumulate: " << controls->accumulate << std::endl;
 }
 
-Context::Context() {
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+    auto* context = reinterpret_cast<Context*>(glfwGetWindowUserPointer(window));
+    if (context)
+        context->framebufferResized = true;
+}
+
+// Left click picks the surface under the cursor
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    auto* context = reinterpret_cast<Context*>(glfwGetWindowUserPointer(window));
+    if (!context || !context->onPick)
+        return;
+
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    context->onPick(x, y);
+}
+
+Context::Context(int width, int height, bool visible) {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Pathtracing", nullptr, nullptr);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+    window = glfwCreateWindow(width, height, "Vulkan Pathtracing", nullptr, nullptr);
 
-    glfwSetWindowUserPointer(window, &controls);
+    glfwSetWindowUserPointer(window, this);
     glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // Prepase extensions and layers
     uint32_t glfwExtensionCount = 0;
@@ -66,7 +106,11 @@ Context::Context() {
     VULKAN_HPP_DEFAULT_DISPATCHER.init(*instance);
 
     // Pick first gpu
-    physicalDevice = instance->enumeratePhysicalDevices().front();
+    std::vector physicalDevices = instance->enumeratePhysicalDevices();
+    if (physicalDevices.empty()) {
+        throw std::runtime_error("No Vulkan physical device found!");
+    }
+    physicalDevice = physicalDevices.front();
 
     // Create debug messenger
     vk::DebugUtilsMessengerCreateInfoEXT messengerInfo;
@@ -93,13 +137,24 @@ Context::Context() {
         }
     }
 
+    // A transfer only family runs uploads and readbacks beside the main queue
+    transferQueueFamilyIndex = queueFamilyIndex;
+    for (int i = 0; i < queueFamilies.size(); i++) {
+        const vk::QueueFlags flags = queueFamilies[i].queueFlags;
+        if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+            transferQueueFamilyIndex = i;
+            break;
+        }
+    }
+
     // Create device
     const float queuePriority = 1.0f;
-    vk::DeviceQueueCreateInfo queueCreateInfo;
-    queueCreateInfo.setQueueFamilyIndex(queueFamilyIndex);
-    queueCreateInfo.setQueuePriorities(queuePriority);
+    std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos{{{}, queueFamilyIndex, 1, &queuePriority}};
+    if (separateTransfer()) {
+        queueCreateInfos.push_back({{}, transferQueueFamilyIndex, 1, &queuePriority});
+    }
 
-    const std::vector deviceExtensions{
+    std::vector deviceExtensions{
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
         VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
@@ -107,7 +162,6 @@ Context::Context() {
         VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
         VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
         VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
-        VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
         VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
     };
 
@@ -115,19 +169,41 @@ Context::Context() {
         throw std::runtime_error("Some extensions are not supported!");
     }
 
+    // Either backend is enough: the ray tracing pipeline or inline ray queries from compute
+    rayTracingPipelineSupported = checkDeviceExtensionSupport({VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME});
+    rayQuerySupported = checkDeviceExtensionSupport({VK_KHR_RAY_QUERY_EXTENSION_NAME});
+    if (!rayTracingPipelineSupported && !rayQuerySupported) {
+        throw std::runtime_error("Neither ray tracing pipelines nor ray queries are supported!");
+    }
+    if (rayTracingPipelineSupported) deviceExtensions.push_back(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+    if (rayQuerySupported) deviceExtensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+    // Lets geometry streaming size its residency to what the driver grants this process
+    memoryBudgetSupported = checkDeviceExtensionSupport({VK_EXT_MEMORY_BUDGET_EXTENSION_NAME});
+    if (memoryBudgetSupported) deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
     vk::DeviceCreateInfo deviceInfo;
-    deviceInfo.setQueueCreateInfos(queueCreateInfo);
+    deviceInfo.setQueueCreateInfos(queueCreateInfos);
     deviceInfo.setPEnabledExtensionNames(deviceExtensions);
 
     vk::PhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{true};
     vk::PhysicalDeviceRayTracingPipelineFeaturesKHR rayTracingPipelineFeatures{true};
+    rayTracingPipelineFeatures.setRayTracingPipelineTraceRaysIndirect(true);  // Wavefront extend stage
     vk::PhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{true};
+    vk::PhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{true};
+    // Bindless textures: an unsized sampler array indexed per hit
+    vk::PhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures;
+    descriptorIndexingFeatures.setRuntimeDescriptorArray(true);
+    descriptorIndexingFeatures.setShaderSampledImageArrayNonUniformIndexing(true);
     vk::StructureChain createInfoChain{
         deviceInfo,
         bufferDeviceAddressFeatures,
         rayTracingPipelineFeatures,
         accelerationStructureFeatures,
+        rayQueryFeatures,
+        descriptorIndexingFeatures,
     };
+    if (!rayTracingPipelineSupported) createInfoChain.unlink<vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>();
+    if (!rayQuerySupported) createInfoChain.unlink<vk::PhysicalDeviceRayQueryFeaturesKHR>();
 
     device = physicalDevice.createDeviceUnique(createInfoChain.get<vk::DeviceCreateInfo>());
     VULKAN_HPP_DEFAULT_DISPATCHER.init(*device);
@@ -140,16 +216,26 @@ Context::Context() {
     commandPoolInfo.setQueueFamilyIndex(queueFamilyIndex);
     commandPool = device->createCommandPoolUnique(commandPoolInfo);
 
+    transferQueue = device->getQueue(transferQueueFamilyIndex, 0);
+    commandPoolInfo.setQueueFamilyIndex(transferQueueFamilyIndex);
+    transferCommandPool = device->createCommandPoolUnique(commandPoolInfo);
+    std::cout << "Queue family " << queueFamilyIndex << ", transfers on "
+              << (separateTransfer() ? "family " + std::to_string(transferQueueFamilyIndex) : std::string("the same queue")) << std::endl;
+
     // Create descriptor pool
+    // Sized for the sets of every integrator and compute pass, for both frame parities,
+    // each tracing set with a full texture array
     std::vector<vk::DescriptorPoolSize> poolSizes{
-        {vk::DescriptorType::eAccelerationStructureKHR, 1},
-        {vk::DescriptorType::eStorageImage, 1},
-        {vk::DescriptorType::eStorageBuffer, 3},
+        {vk::DescriptorType::eAccelerationStructureKHR, 8},
+        {vk::DescriptorType::eStorageImage, 64},
+        {vk::DescriptorType::eStorageBuffer, 96},
+        {vk::DescriptorType::eUniformBufferDynamic, 16},
+        {vk::DescriptorType::eCombinedImageSampler, 4 * MaxTextures},
     };
 
     vk::DescriptorPoolCreateInfo descPoolInfo;
     descPoolInfo.setPoolSizes(poolSizes);
-    descPoolInfo.setMaxSets(1);
+    descPoolInfo.setMaxSets(16);
     descPoolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
     descPool = device->createDescriptorPoolUnique(descPoolInfo);
 }
@@ -175,6 +261,29 @@ bool Context::checkDeviceExtensionSupport(const std::vector<const char*>& requir
     }
 }
 
+Context::MemoryBudget Context::deviceLocalBudget() const {
+    MemoryBudget total;
+    if (memoryBudgetSupported) {
+        auto chain = physicalDevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        const vk::PhysicalDeviceMemoryProperties& properties = chain.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+        const auto& budget = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+            if (properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+                total.budget += budget.heapBudget[i];
+                total.usage += budget.heapUsage[i];
+            }
+        }
+        return total;
+    }
+    const vk::PhysicalDeviceMemoryProperties properties = physicalDevice.getMemoryProperties();
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        if (properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+            total.budget += properties.memoryHeaps[i].size;
+        }
+    }
+    return total;
+}
+
 uint32_t Context::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const {
     vk::PhysicalDeviceMemoryProperties memProperties = physicalDevice.getMemoryProperties();
     for (uint32_t i = 0; i != memProperties.memoryTypeCount; ++i) {
@@ -201,6 +310,63 @@ void Context::oneTimeSubmit(const std::function<void(vk::CommandBuffer)>& func)
      queue.waitIdle();
 }
 
+void Context::transferSubmit(const std::function<void(vk::CommandBuffer)>& func, std::vector<vk::ImageMemoryBarrier> handOver,
+                             std::vector<vk::BufferMemoryBarrier> bufferHandOver) const {
+    if (!separateTransfer()) {
+        oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+            func(commandBuffer);
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr,
+                                          bufferHandOver, handOver);
+        });
+        return;
+    }
+
+    // Release on the transfer queue, which makes the writes available, then acquire on the main
+    // queue, which makes them visible to the accesses the barriers name
+    std::vector<vk::ImageMemoryBarrier> release = handOver;
+    for (size_t i = 0; i < handOver.size(); i++) {
+        release[i].setDstAccessMask({});
+        handOver[i].setSrcAccessMask({});
+        for (vk::ImageMemoryBarrier* barrier : {&release[i], &handOver[i]}) {
+            barrier->setSrcQueueFamilyIndex(transferQueueFamilyIndex);
+            barrier->setDstQueueFamilyIndex(queueFamilyIndex);
+        }
+    }
+    std::vector<vk::BufferMemoryBarrier> bufferRelease = bufferHandOver;
+    for (size_t i = 0; i < bufferHandOver.size(); i++) {
+        bufferRelease[i].setDstAccessMask({});
+        bufferHandOver[i].setSrcAccessMask({});
+        for (vk::BufferMemoryBarrier* barrier : {&bufferRelease[i], &bufferHandOver[i]}) {
+            barrier->setSrcQueueFamilyIndex(transferQueueFamilyIndex);
+            barrier->setDstQueueFamilyIndex(queueFamilyIndex);
+        }
+    }
+
+    vk::CommandBufferAllocateInfo commandBufferInfo;
+    commandBufferInfo.setCommandPool(*transferCommandPool);
+    commandBufferInfo.setCommandBufferCount(1);
+    vk::UniqueCommandBuffer transferCommands = std::move(device->allocateCommandBuffersUnique(commandBufferInfo).front());
+    transferCommands->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    func(*transferCommands);
+    transferCommands->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+                                      bufferRelease, release);
+    transferCommands->end();
+
+    vk::UniqueSemaphore transferred = device->createSemaphoreUnique({});
+    transferQueue.submit(vk::SubmitInfo().setCommandBuffers(*transferCommands).setSignalSemaphores(*transferred));
+
+    commandBufferInfo.setCommandPool(*commandPool);
+    vk::UniqueCommandBuffer acquireCommands = std::move(device->allocateCommandBuffersUnique(commandBufferInfo).front());
+    acquireCommands->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    acquireCommands->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, nullptr,
+                                     bufferHandOver, handOver);
+    acquireCommands->end();
+
+    const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    queue.submit(vk::SubmitInfo{*transferred, waitStage, *acquireCommands});
+    queue.waitIdle();
+}
+
 vk::UniqueDescriptorSet Context::allocateDescSet(vk::DescriptorSetLayout descSetLayout) {
      vk::DescriptorSetAllocateInfo descSetInfo;
      descSetInfo.setDescriptorPool(*descPool);
@@ -208,6 +374,68 @@ vk::UniqueDescriptorSet Context::allocateDescSet(vk::DescriptorSetLayout descSet
      return std::move(device->allocateDescriptorSetsUnique(descSetInfo).front());
 }
 
+vk::UniqueShaderModule Context::loadShader(const std::string& name) const {
+    if (auto blob = shaderBlobs.find(name); blob != shaderBlobs.end()) {
+        const std::vector<char>& code = blob->second;
+        return device->createShaderModuleUnique({{}, code.size(), reinterpret_cast<const uint32_t*>(code.data())});
+    }
+    const std::string path = (std::filesystem::path(TRACER_SHADER_DIR) / name).generic_string();
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + path);
+    }
+    std::vector<char> code(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(code.data(), static_cast<std::streamsize>(code.size()));
+    return device->createShaderModuleUnique({{}, code.size(), reinterpret_cast<const uint32_t*>(code.data())});
+}
+
+std::unordered_map<std::string, std::vector<char>> Context::readShaderBlobs() {
+    std::unordered_map<std::string, std::vector<char>> blobs;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(TRACER_SHADER_DIR, error)) {
+        if (entry.path().extension() != ".spv") continue;
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<char> code{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        blobs.emplace(entry.path().filename().generic_string(), std::move(code));
+    }
+    return blobs;
+}
+
+Swapchain::Swapchain(const Context& context, vk::SwapchainKHR oldSwapchain) {
+    vk::SurfaceCapabilitiesKHR capabilities = context.physicalDevice.getSurfaceCapabilitiesKHR(*context.surface);
+    if (capabilities.currentExtent.width != UINT32_MAX) {
+        extent = capabilities.currentExtent;
+    } else {
+        int width, height;
+        glfwGetFramebufferSize(context.window, &width, &height);
+        extent.width = std::clamp(static_cast<uint32_t>(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        extent.height = std::clamp(static_cast<uint32_t>(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    }
+
+    uint32_t imageCount = std::max(3u, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+    }
+
+    vk::SwapchainCreateInfoKHR scInfo;
+    scInfo.setSurface(*context.surface);
+    scInfo.setMinImageCount(imageCount);
+    scInfo.setImageFormat(vk::Format::eR8G8B8A8Unorm);
+    scInfo.setImageColorSpace(vk::ColorSpaceKHR::eSrgbNonlinear);
+    scInfo.setImageExtent(extent);
+    scInfo.setImageArrayLayers(1);
+    scInfo.setImageUsage(vk::ImageUsageFlagBits::eTransferDst);
+    scInfo.setPreTransform(vk::SurfaceTransformFlagBitsKHR::eIdentity);
+    scInfo.setPresentMode(vk::PresentModeKHR::eFifo);
+    scInfo.setClipped(true);
+    scInfo.setQueueFamilyIndices(context.queueFamilyIndex);
+    scInfo.setOldSwapchain(oldSwapchain);
+    swapchain = context.device->createSwapchainKHRUnique(scInfo);
+
+    images = context.device->getSwapchainImagesKHR(*swapchain);
+}
+
 Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const void* data) {
     vk::BufferUsageFlags usage;
     vk::MemoryPropertyFlags memoryProps;
@@ -228,14 +456,43 @@ Buffer::Buffer(const Context& context, Type type, vk::DeviceSize size, const voi
             memoryProps = Memory::eDeviceLocal;
             break;
         case Type::ShaderBindingTable:
-            usage = Usage::eShaderBindingTableKHR | Usage::eShaderDeviceAddress;
+            usage = Usage::eShaderBindingTableKHR | Usage::eShaderDeviceAddress | Usage::eTransferDst;
+            memoryProps = Memory::eDeviceLocal;
+            break;
+        case Type::DeviceAccelInput:
+            usage = Usage::eAccelerationStructureBuildInputReadOnlyKHR | Usage::eStorageBuffer | Usage::eShaderDeviceAddress |
+                    Usage::eTransferDst;
+            memoryProps = Memory::eDeviceLocal;
+            break;
+        case Type::Readback:
+            usage = Usage::eTransferDst;
+            memoryProps = Memory::eHostVisible | Memory::eHostCached;
+            break;
+        case Type::Storage:
+            usage = Usage::eStorageBuffer;
+            memoryProps = Memory::eHostVisible | Memory::eHostCoherent;
+            break;
+        case Type::DeviceStorage:
+            usage = Usage::eStorageBuffer | Usage::eIndirectBuffer | Usage::eShaderDeviceAddress | Usage::eTransferDst;
+            memoryProps = Memory::eDeviceLocal;
+            break;
+        case Type::DeviceCopy:
+            usage = Usage::eTransferSrc | Usage::eTransferDst;
+            memoryProps = Memory::eDeviceLocal;
+            break;
+        case Type::Staging:
+            usage = Usage::eTransferSrc;
+            memoryProps = Memory::eHostVisible | Memory::eHostCoherent;
+            break;
+        case Type::Uniform:
+            usage = Usage::eUniformBuffer;
             memoryProps = Memory::eHostVisible | Memory::eHostCoherent;
             break;
     }
 
     allocateBuffer(context, size, usage, memoryProps);
     if (data) {
-        copyData(context, data, size);
+        upload(context, data, size);
     }
 }
 
@@ -243,39 +500,67 @@ void Buffer::allocateBuffer(const Context& context, vk::DeviceSize size, vk::Buf
     buffer = context.device->createBufferUnique({{}, size, usage});
 
     vk::MemoryRequirements requirements = context.device->getBufferMemoryRequirements(*buffer);
-    uint32_t memoryTypeIndex = context.findMemoryType(requirements.memoryTypeBits, memoryProps);
+    uint32_t memoryTypeIndex;
+    try {
+        memoryTypeIndex = context.findMemoryType(requirements.memoryTypeBits, memoryProps);
+    } catch (const std::runtime_error&) {
+        // Host cached memory is optional, coherent host memory always exists
+        if (!(memoryProps & vk::MemoryPropertyFlagBits::eHostCached)) throw;
+        memoryProps = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        memoryTypeIndex = context.findMemoryType(requirements.memoryTypeBits, memoryProps);
+    }
+    memoryFlags = context.physicalDevice.getMemoryProperties().memoryTypes[memoryTypeIndex].propertyFlags;
 
+    const bool hasDeviceAddress = static_cast<bool>(usage & vk::BufferUsageFlagBits::eShaderDeviceAddress);
     vk::MemoryAllocateFlagsInfo flagsInfo{vk::MemoryAllocateFlagBits::eDeviceAddress};
 
     vk::MemoryAllocateInfo memoryInfo;
     memoryInfo.setAllocationSize(requirements.size);
     memoryInfo.setMemoryTypeIndex(memoryTypeIndex);
-    memoryInfo.setPNext(&flagsInfo);
+    if (hasDeviceAddress) {
+        memoryInfo.setPNext(&flagsInfo);
+    }
     memory = context.device->allocateMemoryUnique(memoryInfo);
 
     context.device->bindBufferMemory(*buffer, *memory, 0);
 
-    vk::BufferDeviceAddressInfoKHR bufferDeviceAI{*buffer};
-    deviceAddress = context.device->getBufferAddressKHR(&bufferDeviceAI);
+    if (hasDeviceAddress) {
+        vk::BufferDeviceAddressInfoKHR bufferDeviceAI{*buffer};
+        deviceAddress = context.device->getBufferAddressKHR(&bufferDeviceAI);
+    }
 
     descBufferInfo.setBuffer(*buffer);
     descBufferInfo.setOffset(0);
     descBufferInfo.setRange(size);
 }
 
-void Buffer::copyData(const Context& context, const void* data, vk::DeviceSize size) {
-    void* mapped = context.device->mapMemory(*memory, 0, size);
+void Buffer::copyData(const Context& context, const void* data, vk::DeviceSize size, vk::DeviceSize offset) {
+    void* mapped = context.device->mapMemory(*memory, offset, size);
     memcpy(mapped, data, size);
     context.device->unmapMemory(*memory);
 }
 
-Image::Image(const Context& context, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage) {
+void Buffer::upload(const Context& context, const void* data, vk::DeviceSize size, vk::DeviceSize offset) {
+    if (memoryFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        copyData(context, data, size, offset);
+        return;
+    }
+    Buffer staging{context, Type::Staging, size, data};
+    const vk::BufferMemoryBarrier handOver{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead, VK_QUEUE_FAMILY_IGNORED,
+                                           VK_QUEUE_FAMILY_IGNORED, *buffer, offset, size};
+    context.transferSubmit(
+        [&](vk::CommandBuffer commandBuffer) { commandBuffer.copyBuffer(*staging.buffer, *buffer, vk::BufferCopy{0, offset, size}); }, {},
+        {handOver});
+}
+
+Image::Image(const Context& context, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t arrayLayers) {
+    const uint32_t layers = std::max(arrayLayers, 1u);
     // Create image
     vk::ImageCreateInfo imageInfo;
     imageInfo.setImageType(vk::ImageType::e2D);
     imageInfo.setExtent({extent.width, extent.height, 1});
     imageInfo.setMipLevels(1);
-    imageInfo.setArrayLayers(1);
+    imageInfo.setArrayLayers(layers);
     imageInfo.setFormat(format);
     imageInfo.setUsage(usage);
     image = context.device->createImageUnique(imageInfo);
@@ -294,9 +579,9 @@ Image::Image(const Context& context, vk::Extent2D extent, vk::Format format, vk:
     // Create image view
     vk::ImageViewCreateInfo imageViewInfo;
     imageViewInfo.setImage(*image);
-    imageViewInfo.setViewType(vk::ImageViewType::e2D);
+    imageViewInfo.setViewType(arrayLayers > 0 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D);
     imageViewInfo.setFormat(format);
-    imageViewInfo.setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+    imageViewInfo.setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, layers});
     view = context.device->createImageViewUnique(imageViewInfo);
 
     // Set image info
@@ -325,7 +610,7 @@ void Image::setImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk:
     barrier.setImage(image);
     barrier.setOldLayout(oldLayout);
     barrier.setNewLayout(newLayout);
-    barrier.setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1});
+    barrier.setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS});
     barrier.setSrcAccessMask(toAccessFlags(oldLayout));
     barrier.setDstAccessMask(toAccessFlags(newLayout));
     commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,  //
@@ -333,18 +618,26 @@ void Image::setImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk:
                                   {}, {}, {}, barrier);
 }
 
-void Image::copyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage) {
-    vk::ImageCopy copyRegion;
-    copyRegion.setSrcSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
-    copyRegion.setDstSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
-    copyRegion.setExtent({WIDTH, HEIGHT, 1});
-    commandBuffer.copyImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage, vk::ImageLayout::eTransferDstOptimal, copyRegion);
+// Blit instead of copy so the float accumulation image converts to the swapchain format,
+// and so a reduced render resolution is scaled up to the window.
+void Image::blitImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Extent2D srcExtent, vk::Image dstImage,
+                      vk::Extent2D dstExtent, vk::Filter filter, vk::Offset2D dstOffset) {
+    vk::ImageBlit blitRegion;
+    blitRegion.setSrcSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+    blitRegion.setDstSubresource({vk::ImageAspectFlagBits::eColor, 0, 0, 1});
+    blitRegion.setSrcOffsets({vk::Offset3D{0, 0, 0}, vk::Offset3D{static_cast<int32_t>(srcExtent.width), static_cast<int32_t>(srcExtent.height), 1}});
+    blitRegion.setDstOffsets({vk::Offset3D{dstOffset.x, dstOffset.y, 0},
+                              vk::Offset3D{dstOffset.x + static_cast<int32_t>(dstExtent.width), dstOffset.y + static_cast<int32_t>(dstExtent.height), 1}});
+    commandBuffer.blitImage(srcImage, vk::ImageLayout::eTransferSrcOptimal, dstImage, vk::ImageLayout::eTransferDstOptimal, blitRegion,
+                            filter);
 }
 
-Accel::Accel(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount, vk::AccelerationStructureTypeKHR type) {
+Accel::Accel(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount, vk::AccelerationStructureTypeKHR type,
+             vk::BuildAccelerationStructureFlagsKHR flags)
+    : type(type), flags(flags) {
     vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
     buildGeometryInfo.setType(type);
-    buildGeometryInfo.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    buildGeometryInfo.setFlags(flags);
     buildGeometryInfo.setGeometries(geometry);
 
     // Create buffer
@@ -360,7 +653,18 @@ Accel::Accel(const Context& context, vk::AccelerationStructureGeometryKHR geomet
     accelInfo.setType(type);
     accel = context.device->createAccelerationStructureKHRUnique(accelInfo);
 
-    // Build
+    build(context, geometry, primitiveCount);
+    descAccelInfo.setAccelerationStructures(*accel);
+}
+
+void Accel::build(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount) {
+    vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo;
+    buildGeometryInfo.setType(type);
+    buildGeometryInfo.setFlags(flags);
+    buildGeometryInfo.setGeometries(geometry);
+    vk::AccelerationStructureBuildSizesInfoKHR buildSizesInfo = context.device->getAccelerationStructureBuildSizesKHR(  //
+        vk::AccelerationStructureBuildTypeKHR::eDevice, buildGeometryInfo, primitiveCount);
+
     Buffer scratchBuffer{context, Buffer::Type::Scratch, buildSizesInfo.buildScratchSize};
     buildGeometryInfo.setScratchData(scratchBuffer.deviceAddress);
     buildGeometryInfo.setDstAccelerationStructure(*accel);
@@ -373,7 +677,98 @@ Accel::Accel(const Context& context, vk::AccelerationStructureGeometryKHR geomet
         buildRangeInfo.setTransformOffset(0);
         commandBuffer.buildAccelerationStructuresKHR(buildGeometryInfo, &buildRangeInfo);
     });
+}
+
+
+namespace {
+
+// Serialized acceleration structures start with the driver and compatibility UUIDs,
+// then the serialized size, the deserialized size and the count of BLAS handles
+constexpr size_t SerializedHeaderSize = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+
+vk::DeviceSize queryAccelProperty(const Context& context, vk::AccelerationStructureKHR accel, vk::QueryType type) {
+    vk::UniqueQueryPool queryPool = context.device->createQueryPoolUnique({{}, type, 1});
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+        commandBuffer.resetQueryPool(*queryPool, 0, 1);
+        commandBuffer.writeAccelerationStructuresPropertiesKHR(accel, type, *queryPool, 0);
+    });
+    return context.device
+        ->getQueryPoolResult<vk::DeviceSize>(*queryPool, 0, 1, sizeof(vk::DeviceSize),
+                                             vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait)
+        .value;
+}
 
+}  // namespace
+
+Accel::Accel(const Context& context, const std::vector<uint8_t>& serialized, vk::AccelerationStructureTypeKHR type) : type(type) {
+    const vk::DeviceSize size = deserializedSize(serialized);
+    buffer = Buffer{context, Buffer::Type::AccelStorage, size};
+    vk::AccelerationStructureCreateInfoKHR accelInfo;
+    accelInfo.setBuffer(*buffer.buffer);
+    accelInfo.setSize(size);
+    accelInfo.setType(type);
+    accel = context.device->createAccelerationStructureKHRUnique(accelInfo);
+
+    Buffer source{context, Buffer::Type::AccelInput, serialized.size(), serialized.data()};
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+        vk::CopyMemoryToAccelerationStructureInfoKHR copyInfo;
+        copyInfo.setSrc(source.deviceAddress);
+        copyInfo.setDst(*accel);
+        copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eDeserialize);
+        commandBuffer.copyMemoryToAccelerationStructureKHR(copyInfo);
+    });
     descAccelInfo.setAccelerationStructures(*accel);
 }
 
+void Accel::compact(const Context& context) {
+    const vk::DeviceSize size = queryAccelProperty(context, *accel, vk::QueryType::eAccelerationStructureCompactedSizeKHR);
+    Buffer compactBuffer{context, Buffer::Type::AccelStorage, size};
+    vk::AccelerationStructureCreateInfoKHR accelInfo;
+    accelInfo.setBuffer(*compactBuffer.buffer);
+    accelInfo.setSize(size);
+    accelInfo.setType(type);
+    vk::UniqueAccelerationStructureKHR compacted = context.device->createAccelerationStructureKHRUnique(accelInfo);
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+        commandBuffer.copyAccelerationStructureKHR({*accel, *compacted, vk::CopyAccelerationStructureModeKHR::eCompact});
+    });
+
+    // The old structure goes before the buffer it lives in
+    accel = std::move(compacted);
+    buffer = std::move(compactBuffer);
+    descAccelInfo.setAccelerationStructures(*accel);
+}
+
+std::vector<uint8_t> Accel::serialize(const Context& context) const {
+    const vk::DeviceSize size = queryAccelProperty(context, *accel, vk::QueryType::eAccelerationStructureSerializationSizeKHR);
+    Buffer destination{context, Buffer::Type::AccelInput, size};
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {
+        vk::CopyAccelerationStructureToMemoryInfoKHR copyInfo;
+        copyInfo.setSrc(*accel);
+        copyInfo.setDst(destination.deviceAddress);
+        copyInfo.setMode(vk::CopyAccelerationStructureModeKHR::eSerialize);
+        commandBuffer.copyAccelerationStructureToMemoryKHR(copyInfo);
+    });
+
+    std::vector<uint8_t> data(size);
+    void* mapped = context.device->mapMemory(*destination.memory, 0, size);
+    memcpy(data.data(), mapped, size);
+    context.device->unmapMemory(*destination.memory);
+    return data;
+}
+
+bool Accel::compatible(const Context& context, const std::vector<uint8_t>& serialized) {
+    if (serialized.size() < SerializedHeaderSize) {
+        return false;
+    }
+    vk::AccelerationStructureVersionInfoKHR versionInfo;
+    versionInfo.setPVersionData(serialized.data());
+    return context.device->getAccelerationStructureCompatibilityKHR(versionInfo) == vk::AccelerationStructureCompatibilityKHR::eCompatible;
+}
+
+vk::DeviceSize Accel::deserializedSize(const std::vector<uint8_t>& serialized) {
+    uint64_t size = 0;
+    if (serialized.size() >= SerializedHeaderSize) {
+        memcpy(&size, serialized.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(size));
+    }
+    return size;
+}
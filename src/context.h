@@ -3,26 +3,34 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <functional>
 #include <iostream>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
-constexpr int WIDTH = 1200;
-constexpr int HEIGHT = 1200;
+#include "controls.h"
 
-extern vk::DispatchLoaderDynamic defaultDispatchLoaderDynamic;
+// Where loadShader finds the SPIR-V: the build tree's shaders folder when CMake compiles them,
+// else the output of shaders/compile.bat seen from a build folder beside it.
+#ifndef TRACER_SHADER_DIR
+#define TRACER_SHADER_DIR "../shaders"
+#endif
 
-struct Controls {
-    glm::vec3 cameraPosition = glm::vec3(0, -1, 5);
-    float fov = 45.0f;
-    float light_intensity = 1.0f;
-    int frame = 0;
-    int accumulate = 0;
-};
+extern vk::DispatchLoaderDynamic defaultDispatchLoaderDynamic;
 
 class Context {
     public:
-    Context();
+    // Sampled images the descriptor pool holds per bindless texture array
+    static constexpr uint32_t MaxTextures = 1024;
+
+    // Device local memory over all such heaps, in bytes.
+    struct MemoryBudget {
+        vk::DeviceSize budget = 0;  // What this process may use, the heap sizes without VK_EXT_memory_budget
+        vk::DeviceSize usage = 0;   // In use by this process, 0 without VK_EXT_memory_budget
+    };
+
+    // A hidden window still gives the device a surface, for processes that never present (farm workers).
+    Context(int width, int height, bool visible = true);
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsMessengerCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                                                                       VkDebugUtilsMessageTypeFlagsEXT messageTypes,
@@ -34,11 +42,22 @@ class Context {
 
     uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties) const;
     bool checkDeviceExtensionSupport(const std::vector<const char*>& requiredExtensions) const;
+    MemoryBudget deviceLocalBudget() const;
 
     void oneTimeSubmit(const std::function<void(vk::CommandBuffer)>& func) const;
+    // Records func on the transfer queue and waits for it. With a dedicated transfer family the
+    // images of handOver and buffers of bufferHandOver are released to the main family there and
+    // acquired on the main queue, each barrier's layout transition done once across both;
+    // otherwise it all runs on the main queue.
+    void transferSubmit(const std::function<void(vk::CommandBuffer)>& func, std::vector<vk::ImageMemoryBarrier> handOver,
+                        std::vector<vk::BufferMemoryBarrier> bufferHandOver = {}) const;
+    // Whether transfers run on a family of their own, usually a copy engine beside the main queue.
+    bool separateTransfer() const { return transferQueueFamilyIndex != queueFamilyIndex; }
     vk::UniqueDescriptorSet allocateDescSet(vk::DescriptorSetLayout descSetLayout);
-    const int WIDTH = 1200;
-    const int HEIGHT = 1200;
+    // The SPIR-V of a stage by file name, e.g. "raygen.rgen.spv", in TRACER_SHADER_DIR.
+    vk::UniqueShaderModule loadShader(const std::string& name) const;
+    // Every .spv of TRACER_SHADER_DIR keyed by its file name, for reading shaders while the device is created.
+    static std::unordered_map<std::string, std::vector<char>> readShaderBlobs();
 
     GLFWwindow* window;
     vk::DynamicLoader dl;
@@ -50,8 +69,34 @@ class Context {
     uint32_t queueFamilyIndex;
     vk::Queue queue;
     vk::UniqueCommandPool commandPool;
+    // The main family and queue above when the device has no dedicated transfer family
+    uint32_t transferQueueFamilyIndex;
+    vk::Queue transferQueue;
+    vk::UniqueCommandPool transferCommandPool;
     vk::UniqueDescriptorPool descPool;
     Controls controls;
+    std::unordered_map<std::string, std::vector<char>> shaderBlobs;  // Looked up by loadShader before the file
+    bool framebufferResized = false;
+    bool rayTracingPipelineSupported = false;
+    bool rayQuerySupported = false;
+    bool memoryBudgetSupported = false;
+
+    // Optional host side scene queries hooked to the window
+    std::function<void(double x, double y)> onPick;
+    std::function<void()> onFrameScene;
+    // Light edit keys, true when handled without touching the accumulation
+    std::function<bool(int key)> onLightKey;
+};
+
+class Swapchain {
+public:
+    Swapchain() = default;
+    // Sized to the window's framebuffer, reusing resources of oldSwapchain when given.
+    Swapchain(const Context& context, vk::SwapchainKHR oldSwapchain = nullptr);
+
+    vk::UniqueSwapchainKHR swapchain;
+    std::vector<vk::Image> images;
+    vk::Extent2D extent;
 };
 
 class Buffer {
@@ -60,31 +105,46 @@ public:
         Scratch,
         AccelInput,
         AccelStorage,
-        ShaderBindingTable,
+        ShaderBindingTable,  // GPU only, filled through upload
+        DeviceAccelInput,    // GPU only scene geometry, filled through upload
+        Readback,
+        Storage,
+        DeviceStorage,  // GPU only, also usable for indirect arguments and cleared by fillBuffer
+        DeviceCopy,     // GPU only, copied between queues
+        Staging,        // Host visible transfer source
+        Uniform,        // Host visible uniform buffer, see UniformRing
     };
 
     Buffer() = default;
+    // data goes in through upload
     Buffer(const Context& context, Type type, vk::DeviceSize size, const void* data = nullptr);
 
     uint64_t getDeviceAddress() const { return deviceAddress; }
     const vk::DescriptorBufferInfo& getDescriptorInfo() const { return descBufferInfo; }
 
     void allocateBuffer(const Context& context, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags memoryProps);
-    void copyData(const Context& context, const void* data, vk::DeviceSize size);
+    void copyData(const Context& context, const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0);
+    // copyData for host visible memory, else a staged copy on the transfer queue handed to the main
+    // queue. Waits for it, so the range must not be in use by a frame in flight.
+    void upload(const Context& context, const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0);
 
     vk::UniqueBuffer buffer;
     vk::UniqueDeviceMemory memory;
     vk::DescriptorBufferInfo descBufferInfo;
+    vk::MemoryPropertyFlags memoryFlags;
     uint64_t deviceAddress = 0;
 };
 
 class Image {
 public:
     Image() = default;
-    Image(const Context& context, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage);
+    // With arrayLayers the view is a 2D array of that many layers, else a plain 2D view.
+    Image(const Context& context, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t arrayLayers = 0);
     static vk::AccessFlags toAccessFlags(vk::ImageLayout layout);
     static void setImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
-    static void copyImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage);
+    // Scales all of srcImage onto the dstExtent rectangle of dstImage at dstOffset.
+    static void blitImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Extent2D srcExtent, vk::Image dstImage,
+                          vk::Extent2D dstExtent, vk::Filter filter, vk::Offset2D dstOffset = {});
 
     vk::UniqueImage image;
     vk::UniqueImageView view;
@@ -94,9 +154,43 @@ public:
 
 struct Accel {
     Accel() = default;
-    Accel(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount, vk::AccelerationStructureTypeKHR type);
-
+    Accel(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount, vk::AccelerationStructureTypeKHR type,
+          vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    // From the output of serialize, which must be compatible with the device.
+    Accel(const Context& context, const std::vector<uint8_t>& serialized, vk::AccelerationStructureTypeKHR type);
+
+    // Builds again into the same acceleration structure, e.g. a TLAS whose instances changed.
+    // The geometry may not need more memory than at creation.
+    void build(const Context& context, vk::AccelerationStructureGeometryKHR geometry, uint32_t primitiveCount);
+
+    // Copies into a structure of the compacted size, needs eAllowCompaction at build.
+    void compact(const Context& context);
+    // Driver specific, loads only where compatible says so. BLAS only: a serialized TLAS
+    // holds the addresses of its instances' BLASes.
+    std::vector<uint8_t> serialize(const Context& context) const;
+    static bool compatible(const Context& context, const std::vector<uint8_t>& serialized);
+    static vk::DeviceSize deserializedSize(const std::vector<uint8_t>& serialized);
+
+    vk::AccelerationStructureTypeKHR type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+    vk::BuildAccelerationStructureFlagsKHR flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
     Buffer buffer;
     vk::UniqueAccelerationStructureKHR accel;
     vk::WriteDescriptorSetAccelerationStructureKHR descAccelInfo;
+};
+
+class TextureSet;
+
+// Scene resources the ray tracing passes bind at bindings 0, 2-6, 13, 15 and 16.
+struct SceneBindings {
+    const Accel* topAccel;
+    const Buffer* vertices;
+    const Buffer* indices;
+    const Buffer* faces;
+    const Buffer* sobolMatrices;
+    const Buffer* blueNoise;
+    const TextureSet* textures;
+    const Buffer* clusterPrimitives;
+    const Buffer* clusterHits;
+    const Buffer* environment;
+    bool countClusterHits = false;  // COUNT_CLUSTER_HITS of clusters.glsl
 };
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Emitter groups the megakernel can accumulate apart, see light_groups.h.
+constexpr int MaxLightGroups = 8;
+
+// Paths per pixel a frame traces by default (maxSamples of integrator.glsl), see Controls::samplesPerFrame.
+constexpr int SamplesPerFrame = 128;
+
+// Mirrors the uniform block of controls.glsl, read by every tracing pass.
+struct Controls {
+    glm::vec3 cameraPosition = glm::vec3(0, -1, 5);
+    float fov = 45.0f;
+    float light_intensity = 1.0f;
+    int frame = 0;
+    int accumulate = 0;
+    int frameOffset = 0;  // Shifts the RNG stream, so render farm shards draw disjoint samples
+    int samplesPerFrame = SamplesPerFrame;  // Paths per pixel of each frame, fewer keep previews responsive
+};
+
+// Mirrors the uniform block of reproject.comp.
+struct ReprojectControls {
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float fov = 45.0f;
+    glm::vec3 previousCameraPosition = glm::vec3(0.0f);
+    float previousFov = 45.0f;
+    int accumulate = 0;
+    int resetHistory = 1;
+    int maxMovingHistory = 16;    // Frames of history kept while the camera moves
+    float depthTolerance = 0.05f;  // Relative hit distance difference still treated as the same surface
+    float normalThreshold = 0.9f;
+    uint32_t lightGroups = 0;  // Accumulated apart and composed with the scales below, 0 for none
+    int resumedHistory = 0;    // The previous accumulation is a restored checkpoint, taken as is
+    alignas(16) glm::vec4 lightGroupScales[MaxLightGroups] = {};
+};
@@ -0,0 +1,699 @@
+#include "cpu_tracer.h"
+
+#include "blue_noise.h"
+#include "sobol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+constexpr float M_PI_F = 3.14159265358979323846f;
+
+// ==================== RNG (common.glsl) ====================
+uint32_t pcg(uint32_t& state) {
+    uint32_t prev = state * 747796405u + 2891336453u;
+    uint32_t word = ((prev >> ((prev >> 28u) + 4u)) ^ prev) * 277803737u;
+    state = prev;
+    return (word >> 22u) ^ word;
+}
+
+glm::uvec2 pcg2d(glm::uvec2 v) {
+    v = v * 1664525u + 1013904223u;
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v = v ^ (v >> 16u);
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v = v ^ (v >> 16u);
+    return v;
+}
+
+float rand(uint32_t& seed) {
+    uint32_t val = pcg(seed);
+    return static_cast<float>(val) * (1.0f / static_cast<float>(0xffffffffu));
+}
+
+// ==================== SAMPLING (raygen.rgen) ====================
+void createCoordinateSystem(const glm::vec3& N, glm::vec3& T, glm::vec3& B) {
+    if (std::abs(N.x) > std::abs(N.y)) T = glm::vec3(N.z, 0, -N.x) / std::sqrt(N.x * N.x + N.z * N.z);
+    else T = glm::vec3(0, -N.z, N.y) / std::sqrt(N.y * N.y + N.z * N.z);
+    B = glm::cross(N, T);
+}
+
+glm::vec3 sampleHemisphere(float rand1, float rand2, float shininess) {
+    float r = std::sqrt(rand1) / (shininess * 0.2f);
+    float theta = 2.0f * M_PI_F * rand2;
+    return {r * std::cos(theta), r * std::sin(theta), std::sqrt(1.0f - rand1)};
+}
+
+glm::vec3 sampleDirection(float rand1, float rand2, const glm::vec3& normal, float shininess) {
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    createCoordinateSystem(normal, tangent, bitangent);
+    glm::vec3 dir = sampleHemisphere(rand1, rand2, shininess);
+    return dir.x * tangent + dir.y * bitangent + dir.z * normal;
+}
+
+// ==================== GUIDING (guiding.glsl) ====================
+// Solid angle density of sampleDirection at the cosine to the normal
+float sampleDirectionPdf(float cosine, float shininess) {
+    const float k2 = (shininess * 0.2f) * (shininess * 0.2f);
+    const float d = cosine * cosine + k2 * (1.0f - cosine * cosine);
+    return cosine > 0.0f ? k2 * cosine / (M_PI_F * d * d) : 0.0f;
+}
+
+// z of the sampleHemisphere direction pointing at the cosine to the normal, what the BSDF weight multiplies by
+float sampleDirectionZ(float cosine, float shininess) {
+    const float k2 = (shininess * 0.2f) * (shininess * 0.2f);
+    return cosine / std::sqrt(cosine * cosine + k2 * (1.0f - cosine * cosine));
+}
+
+float luminance(const glm::vec3& color) {
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// A guided vertex of the path and the radiance found behind it
+struct GuideRecord {
+    uint32_t leaf;
+    uint32_t slot;
+    float pdf;         // Of the direction, over the BSDF and cosine factor of the unguided weight
+    glm::vec3 weight;  // Path weight after the bounce
+    glm::vec3 radiance;
+};
+
+// ==================== RADIANCE CACHE (radiance_cache.glsl) ====================
+// A diffuse or glossy vertex recording into the cache and the light found behind it
+struct CacheRecord {
+    uint32_t cell;
+    glm::vec3 weight;  // Path weight reaching the vertex
+    glm::vec3 radiance;
+};
+
+// ==================== LIGHT RESAMPLING (light_resampling.glsl) ====================
+using FirstHit = CpuTracer::FirstHit;
+using Reservoir = CpuTracer::Reservoir;
+
+constexpr int MaxNeighbors = 8;
+// The tolerances main.cpp leaves reproject.comp at, which the reservoirs share
+const ReprojectControls Reprojection{};
+
+uint32_t pixelSeed(int x, int y, const Controls& controls, uint32_t salt) {
+    const glm::uvec2 hashed = pcg2d(glm::uvec2(static_cast<uint32_t>(x) | (static_cast<uint32_t>(y) << 16u),
+                                               static_cast<uint32_t>(controls.frame + controls.frameOffset) * 2u + salt));
+    return hashed.x ^ hashed.y;
+}
+
+glm::vec3 emitterPoint(const EmitterEntry& emitter, const glm::vec2& uv) {
+    return glm::vec3(emitter.corner) + uv.x * glm::vec3(emitter.edge1) + uv.y * glm::vec3(emitter.edge2);
+}
+
+// A point on an emitter drawn by power, uniform over its area, and its area density
+void sampleEmitter(const std::vector<EmitterEntry>& emitters, uint32_t& seed, uint32_t& emitter, glm::vec2& uv, float& areaPdf) {
+    const float u = rand(seed);
+    uint32_t low = 0;
+    uint32_t high = static_cast<uint32_t>(emitters.size()) - 1;
+    while (low < high) {
+        const uint32_t middle = (low + high) / 2;
+        if (u < emitters[middle].edge1.w) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    emitter = low;
+    const float r = std::sqrt(rand(seed));
+    const float v = rand(seed);
+    uv = glm::vec2(r * (1.0f - v), r * v);
+    areaPdf = emitters[emitter].edge2.w / std::max(emitters[emitter].corner.w, 1e-12f);
+}
+
+// What the integrator's BSDF sample converges to per solid angle, see common.glsl
+glm::vec3 scatteredLight(const glm::vec3& brdf, float cosine, float shininess) {
+    return brdf * sampleDirectionZ(cosine, shininess) * 2.0f * M_PI_F * sampleDirectionPdf(cosine, shininess);
+}
+
+// Unshadowed light from the point reaching the camera through the surface, per unit emitter area
+glm::vec3 emitterLight(const FirstHit& surface, const EmitterEntry& emitter, const glm::vec2& uv) {
+    const glm::vec3 toLight = emitterPoint(emitter, uv) - surface.position;
+    const float distance2 = glm::dot(toLight, toLight);
+    const glm::vec3 direction = toLight / std::sqrt(std::max(distance2, 1e-12f));
+    const float cosine = glm::dot(direction, glm::normalize(surface.normal));
+    if (cosine <= 0.0f || distance2 <= 1e-12f) {
+        return glm::vec3(0.0f);
+    }
+    const float lightCosine = std::abs(glm::dot(direction, glm::normalize(glm::cross(glm::vec3(emitter.edge1), glm::vec3(emitter.edge2)))));
+    return scatteredLight(surface.brdf, cosine, surface.shininess) * glm::vec3(emitter.emission) * lightCosine / distance2;
+}
+
+float targetPdf(const FirstHit& surface, const EmitterEntry& emitter, const glm::vec2& uv) {
+    return luminance(emitterLight(surface, emitter, uv));
+}
+
+bool emitterVisible(const Bvh& bvh, const glm::vec3& position, const EmitterEntry& emitter, const glm::vec2& uv) {
+    const glm::vec3 toLight = emitterPoint(emitter, uv) - position;
+    const float lightDistance = glm::length(toLight);
+    Ray ray;
+    ray.origin = position;
+    ray.direction = toLight / lightDistance;
+    ray.tMax = std::max(lightDistance - 0.002f, 0.001f);
+    RayHit hit;
+    return !bvh.intersect(ray, hit);
+}
+
+void updateReservoir(Reservoir& reservoir, uint32_t emitter, const glm::vec2& uv, float w, float M, uint32_t& seed) {
+    reservoir.wSum += w;
+    reservoir.M += M;
+    if (w > 0.0f && rand(seed) * reservoir.wSum < w) {
+        reservoir.emitter = emitter;
+        reservoir.uv = uv;
+    }
+}
+
+void mergeReservoir(Reservoir& reservoir, const Reservoir& other, const FirstHit& surface, const std::vector<EmitterEntry>& emitters,
+                    uint32_t& seed) {
+    const float target = other.W > 0.0f ? targetPdf(surface, emitters[other.emitter], other.uv) : 0.0f;
+    updateReservoir(reservoir, other.emitter, other.uv, target * other.W * other.M, other.M, seed);
+}
+
+void finalizeReservoir(Reservoir& reservoir, const FirstHit& surface, const std::vector<EmitterEntry>& emitters, float normalization) {
+    const float target = targetPdf(surface, emitters[reservoir.emitter], reservoir.uv);
+    reservoir.W = target > 0.0f && normalization > 0.0f ? reservoir.wSum / (normalization * target) : 0.0f;
+}
+
+bool similarSurface(const FirstHit& surface, const glm::vec3& normal, float depth) {
+    return depth > 0.0f && std::abs(depth - surface.depth) <= Reprojection.depthTolerance * surface.depth * 2.0f &&
+           glm::dot(glm::normalize(surface.normal), glm::normalize(normal)) >= Reprojection.normalThreshold;
+}
+
+// The pixel of the previous frame showing the same surface, -1 for none, as restir_temporal.comp finds it
+int previousPixel(const FirstHit& surface, const Controls& previous, const std::vector<FirstHit>& previousHits, int width, int height) {
+    const glm::vec3 q = surface.position - previous.cameraPosition;
+    if (q.z >= 0.0f) {
+        return -1;
+    }
+    const float scale = std::tan(glm::radians(previous.fov) * 0.5f);
+    const float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+    const glm::vec2 d = glm::vec2(q) / -q.z;
+    const glm::vec2 uv = (glm::vec2(d.x / (aspectRatio * scale), d.y / scale) + 1.0f) * 0.5f;
+    const glm::ivec2 tap = glm::ivec2(glm::floor(uv * glm::vec2(width, height)));
+    if (tap.x < 0 || tap.y < 0 || tap.x >= width || tap.y >= height) {
+        return -1;
+    }
+    const FirstHit& hit = previousHits[static_cast<size_t>(tap.y) * width + tap.x];
+    if (hit.depth == 0.0f || std::abs(glm::length(q) - hit.depth) > Reprojection.depthTolerance * hit.depth ||
+        glm::dot(glm::normalize(surface.normal), glm::normalize(hit.normal)) < Reprojection.normalThreshold) {
+        return -1;
+    }
+    return tap.y * width + tap.x;
+}
+
+// Per-worker tile deques. Owners pop from the front, idle workers steal from the back.
+class TileScheduler {
+public:
+    explicit TileScheduler(unsigned workerCount) : queues(workerCount) {}
+
+    void push(unsigned worker, int tile) { queues[worker].tiles.push_back(tile); }
+
+    bool next(unsigned worker, int& tile) {
+        {
+            Queue& own = queues[worker];
+            std::lock_guard lock(own.mutex);
+            if (!own.tiles.empty()) {
+                tile = own.tiles.front();
+                own.tiles.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = queues[(worker + i) % queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tiles.empty()) {
+                tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+    std::vector<Queue> queues;
+};
+
+}  // namespace
+
+CpuTracer::CpuTracer(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+                     unsigned threadCount)
+    : vertices(vertices), indices(indices), faces(faces), bvh(vertices, indices),
+      threadCount(threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency())),
+      sobolMatrices(sobol::generatorMatrices()), blueNoise(generateBlueNoise(sobol::BlueNoiseSize)) {}
+
+void CpuTracer::setLightResampling(const LightResamplingSettings& settings) {
+    resampling = settings;
+    if (settings.enabled && emitters.empty()) {
+        emitters = buildEmitterTable(vertices, indices, faces);
+    }
+    // The history of other settings would leak into the next frame
+    previousFirstHits.clear();
+    previousReservoirs.clear();
+}
+
+void CpuTracer::render(const Controls& controls, int width, int height) {
+    if (width != imageWidth || height != imageHeight) {
+        imageWidth = width;
+        imageHeight = height;
+        accumBuffer.assign(static_cast<size_t>(width) * height, glm::vec4(0.0f));
+        previousFirstHits.clear();
+        previousReservoirs.clear();
+    }
+
+    if (!resamplesLights()) {
+        forEachTile(width, height, [&](const Tile& tile) { renderTile(controls, tile, width, height); });
+        return;
+    }
+    // Frame 0 starts the history over, like resetHistory of the reprojection controls
+    const size_t pixelCount = accumBuffer.size();
+    const bool history = controls.frame != 0 && previousFirstHits.size() == pixelCount;
+    frameColors.resize(pixelCount);
+    firstHits.resize(pixelCount);
+    candidateReservoirs.resize(pixelCount);
+    reservoirs.resize(pixelCount);
+    forEachTile(width, height, [&](const Tile& tile) { renderTile(controls, tile, width, height); });
+    forEachTile(width, height, [&](const Tile& tile) {
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                resampleTemporal(controls, history, x, y);
+            }
+        }
+    });
+    forEachTile(width, height, [&](const Tile& tile) {
+        for (int y = tile.y0; y < tile.y1; y++) {
+            for (int x = tile.x0; x < tile.x1; x++) {
+                resampleSpatial(controls, x, y);
+                const size_t pixel = static_cast<size_t>(y) * width + x;
+                accumulate(controls, pixel, frameColors[pixel]);
+            }
+        }
+    });
+    std::swap(previousFirstHits, firstHits);
+    std::swap(previousReservoirs, reservoirs);
+    previousControls = controls;
+}
+
+void CpuTracer::forEachTile(int width, int height, const std::function<void(const Tile&)>& body) const {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += TileSize) {
+        for (int x = 0; x < width; x += TileSize) {
+            tiles.push_back({x, y, std::min(x + TileSize, width), std::min(y + TileSize, height)});
+        }
+    }
+
+    // Seed each worker with a contiguous run of tiles, stealing balances the rest
+    TileScheduler scheduler(threadCount);
+    size_t perWorker = (tiles.size() + threadCount - 1) / threadCount;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        scheduler.push(static_cast<unsigned>(i / perWorker), static_cast<int>(i));
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned worker = 0; worker < threadCount; worker++) {
+        workers.emplace_back([&, worker] {
+            int tile;
+            while (scheduler.next(worker, tile)) {
+                body(tiles[tile]);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void CpuTracer::renderTile(const Controls& controls, const Tile& tile, int width, int height) {
+    const bool resampled = resamplesLights();
+    for (int y = tile.y0; y < tile.y1; y++) {
+        for (int x = tile.x0; x < tile.x1; x++) {
+            const size_t pixel = static_cast<size_t>(y) * width + x;
+            if (resampled) {
+                frameColors[pixel] = tracePixel(controls, x, y, width, height, &firstHits[pixel]);
+            } else {
+                accumulate(controls, pixel, tracePixel(controls, x, y, width, height, nullptr));
+            }
+        }
+    }
+}
+
+void CpuTracer::accumulate(const Controls& controls, size_t pixel, const glm::vec3& color) {
+    glm::vec4 newColor = glm::vec4(color, 1.0f);
+    glm::vec4& oldColor = accumBuffer[pixel];
+    if (controls.accumulate == 1) {
+        newColor = (oldColor * static_cast<float>(controls.frame) + newColor) / static_cast<float>(controls.frame + 1);
+    }
+    oldColor = newColor;
+}
+
+void CpuTracer::resampleTemporal(const Controls& controls, bool history, int x, int y) {
+    const size_t index = static_cast<size_t>(y) * imageWidth + x;
+    const FirstHit& surface = firstHits[index];
+    Reservoir reservoir;
+    if (surface.coverage == 0.0f) {
+        candidateReservoirs[index] = reservoir;
+        return;
+    }
+
+    uint32_t seed = pixelSeed(x, y, controls, 0);
+    const int candidates = std::max(1, resampling.candidates);
+    for (int i = 0; i < candidates; i++) {
+        uint32_t emitter;
+        glm::vec2 uv;
+        float areaPdf;
+        sampleEmitter(emitters, seed, emitter, uv, areaPdf);
+        const float w = areaPdf > 0.0f ? targetPdf(surface, emitters[emitter], uv) / areaPdf : 0.0f;
+        updateReservoir(reservoir, emitter, uv, w, 1.0f, seed);
+    }
+    finalizeReservoir(reservoir, surface, emitters, reservoir.M);
+
+    // The spatial pass empties reservoirs it found shadowed, so the history only carries visible light
+    const int previous = history ? previousPixel(surface, previousControls, previousFirstHits, imageWidth, imageHeight) : -1;
+    if (previous >= 0) {
+        Reservoir past = previousReservoirs[previous];
+        past.M = std::min(past.M, static_cast<float>(std::max(0, resampling.historyLimit) * candidates));
+        if (past.emitter < emitters.size()) {
+            Reservoir merged;
+            mergeReservoir(merged, reservoir, surface, emitters, seed);
+            mergeReservoir(merged, past, surface, emitters, seed);
+            finalizeReservoir(merged, surface, emitters, merged.M);
+            reservoir = merged;
+        }
+    }
+    candidateReservoirs[index] = reservoir;
+}
+
+void CpuTracer::resampleSpatial(const Controls& controls, int x, int y) {
+    const size_t index = static_cast<size_t>(y) * imageWidth + x;
+    const FirstHit& surface = firstHits[index];
+    const Reservoir& canonical = candidateReservoirs[index];
+    if (surface.coverage == 0.0f) {
+        reservoirs[index] = Reservoir{};
+        return;
+    }
+
+    uint32_t seed = pixelSeed(x, y, controls, 1);
+    Reservoir reservoir;
+    mergeReservoir(reservoir, canonical, surface, emitters, seed);
+    // Pixels whose reservoir was merged, -1 for the canonical one
+    int merged[MaxNeighbors + 1];
+    int mergedCount = 1;
+    merged[0] = -1;
+    const int neighbors = std::clamp(resampling.neighbors, 0, MaxNeighbors);
+    const float radius = std::max(1.0f, resampling.radius);
+    for (int i = 0; i < neighbors; i++) {
+        const float distance = radius * std::sqrt(rand(seed));
+        const float angle = 2.0f * M_PI_F * rand(seed);
+        const int nx = x + static_cast<int>(std::round(distance * std::cos(angle)));
+        const int ny = y + static_cast<int>(std::round(distance * std::sin(angle)));
+        if ((nx == x && ny == y) || nx < 0 || ny < 0 || nx >= imageWidth || ny >= imageHeight) {
+            continue;
+        }
+        const int neighborIndex = ny * imageWidth + nx;
+        const FirstHit& other = firstHits[neighborIndex];
+        if (other.coverage == 0.0f || !similarSurface(surface, other.normal, other.depth)) {
+            continue;
+        }
+        mergeReservoir(reservoir, candidateReservoirs[neighborIndex], surface, emitters, seed);
+        merged[mergedCount++] = neighborIndex;
+    }
+
+    float normalization = reservoir.M;
+    if (resampling.unbiased && reservoir.wSum > 0.0f) {
+        // Only the inputs whose surface could have drawn the chosen light count: those it reaches unshadowed
+        normalization = 0.0f;
+        const EmitterEntry& emitter = emitters[reservoir.emitter];
+        for (int i = 0; i < mergedCount; i++) {
+            const FirstHit& source = merged[i] < 0 ? surface : firstHits[merged[i]];
+            const float M = merged[i] < 0 ? canonical.M : candidateReservoirs[merged[i]].M;
+            if (targetPdf(source, emitter, reservoir.uv) > 0.0f &&
+                (merged[i] < 0 || emitterVisible(bvh, source.position, emitter, reservoir.uv))) {
+                normalization += M;
+            }
+        }
+    }
+    finalizeReservoir(reservoir, surface, emitters, normalization);
+
+    const EmitterEntry& emitter = emitters[reservoir.emitter];
+    if (reservoir.W > 0.0f && emitterVisible(bvh, surface.position, emitter, reservoir.uv)) {
+        frameColors[index] += emitterLight(surface, emitter, reservoir.uv) * reservoir.W * surface.coverage * controls.light_intensity;
+    } else {
+        reservoir.W = 0.0f;
+    }
+    reservoirs[index] = reservoir;
+}
+
+glm::vec3 CpuTracer::tracePixel(const Controls& controls, int x, int y, int width, int height, FirstHit* firstHit) const {
+    glm::vec3 color(0.0f);
+    // The reservoirs shade the first hit of sample 0, so only samples scattering off that surface too leave them their light
+    bool resampledPixel = false;
+    uint32_t resampledSamples = 0;
+    if (firstHit != nullptr) {
+        *firstHit = FirstHit{};
+    }
+    const auto samples = static_cast<uint32_t>(std::max(1, controls.samplesPerFrame));
+    for (uint32_t sampleNum = 0; sampleNum < samples; sampleNum++) {
+        const uint32_t index = sampleNum + samples * (controls.frame + controls.frameOffset);
+        glm::uvec2 s = pcg2d(glm::uvec2(x, y) * (index + 1));
+        uint32_t seed = s.x + s.y;
+        const sobol::PixelSampler qmc{sobolMatrices.data(), blueNoise.data(), static_cast<uint32_t>(x), static_cast<uint32_t>(y), index};
+        auto get1D = [&](uint32_t dimension) { return sampler == Sampler::Sobol ? qmc.get1D(dimension) : rand(seed); };
+        auto get2D = [&](uint32_t dimension) {
+            glm::vec2 u;
+            if (sampler == Sampler::Sobol) {
+                qmc.get2D(dimension, u.x, u.y);
+            } else {
+                u.x = rand(seed);
+                u.y = rand(seed);
+            }
+            return u;
+        };
+
+        const glm::vec2 jitter = get2D(sobol::DimLens);
+        float jitterX = jitter.x;
+        float jitterY = jitter.y;
+        glm::vec2 inUV = glm::vec2(x + jitterX, y + jitterY) / glm::vec2(width, height);
+        glm::vec2 d = inUV * 2.0f - 1.0f;
+        float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+        float scale = std::tan(glm::radians(controls.fov) * 0.5f);
+        d.x *= aspectRatio * scale;
+        d.y *= scale;
+
+        Ray ray;
+        ray.origin = controls.cameraPosition;
+        ray.direction = glm::normalize(glm::vec3(d.x, d.y, -1));
+        glm::vec3 weight(1.0f);
+        GuideRecord records[MaxDepth];
+        int recordCount = 0;
+        CacheRecord cacheRecords[MaxDepth];
+        int cacheRecordCount = 0;
+        const bool updatesCache = radianceCache != nullptr && cacheUpdating && sampleNum % radianceCache->header().updateStride == 0;
+        // Primary cone and the footprint the diffuse and glossy bounces add to it, see integrator.glsl
+        const float coneSpread = 2.0f * scale / static_cast<float>(height);
+        float coneWidth = 0.0f;
+        float spread = 0.0f;
+        float bouncePdf = 0.0f;
+        bool resampledSample = false;
+        // Light the reservoirs add still reaches the guiding and cache records, not the color
+        auto addLight = [&](const glm::vec3& light, bool resampled = false) {
+            if (light == glm::vec3(0.0f)) {
+                return;
+            }
+            if (!resampled) {
+                color += light * controls.light_intensity;
+            }
+            for (int i = 0; i < recordCount; i++) {
+                records[i].radiance += glm::max(light, 0.0f) / glm::max(records[i].weight, 1e-8f);
+            }
+            for (int i = 0; i < cacheRecordCount; i++) {
+                cacheRecords[i].radiance += glm::max(light, 0.0f) / glm::max(cacheRecords[i].weight, 1e-8f);
+            }
+        };
+
+        for (int depth = 0; depth < MaxDepth; depth++) {
+            if (depth > 2) {
+                float maxComponent = std::max(weight.r, std::max(weight.g, weight.b));
+                float rrProbability = std::clamp(maxComponent, 0.1f, 0.9f);
+                if (get1D(sobol::bounceDimension(depth) + sobol::DimRussianRoulette) > rrProbability) {
+                    break;
+                }
+                weight /= rrProbability;
+            }
+
+            RayHit hit;
+            if (!bvh.intersect(ray, hit)) {
+                break;
+            }
+
+            // ==================== CLOSEST HIT ====================
+            const Vertex& v0 = vertices[indices[3 * hit.primitive + 0]];
+            const Vertex& v1 = vertices[indices[3 * hit.primitive + 1]];
+            const Vertex& v2 = vertices[indices[3 * hit.primitive + 2]];
+            const glm::vec3 bary(1.0f - hit.u - hit.v, hit.u, hit.v);
+            const glm::vec3 position = v0.position * bary.x + v1.position * bary.y + v2.position * bary.z;
+            // Normals from the file may disagree with the winding the loader's y flip leaves, turn
+            // them to the side of the geometric normal so glass still tells entering from leaving
+            const glm::vec3 geometricNormal = -glm::cross(v1.position - v0.position, v2.position - v0.position);
+            glm::vec3 normal = -(v0.normal * bary.x + v1.normal * bary.y + v2.normal * bary.z);
+            if (glm::dot(normal, geometricNormal) < 0.0f) {
+                normal = -normal;
+            }
+            const Face& face = faces[hit.primitive];
+            const glm::vec3 brdf = glm::vec3(face.diffuse[0], face.diffuse[1], face.diffuse[2]) / M_PI_F;
+            const glm::vec3 emission(face.emission[0], face.emission[1], face.emission[2]);
+            const glm::vec3 specular(face.specular[0], face.specular[1], face.specular[2]);
+            const glm::vec3 transmittance(face.transmittance[0], face.transmittance[1], face.transmittance[2]);
+
+            coneWidth += coneSpread * hit.t;
+            if (bouncePdf > 0.0f) {
+                spread += glm::distance(ray.origin, position) / std::sqrt(bouncePdf);
+            }
+
+            if (firstHit != nullptr && sampleNum == 0 && depth == 0) {
+                *firstHit = FirstHit{position, glm::distance(position, controls.cameraPosition), normal, 0.0f, brdf, 0.0f};
+                resampledPixel = face.illum == 2.0f || face.illum == 3.0f;
+            }
+            addLight(weight * emission, depth == 1 && resampledSample);
+            if (depth == 0 && resampledPixel && (face.illum == 2.0f || face.illum == 3.0f)) {
+                // At an edge the first hit may be another surface than sample 0's, whose light the reservoirs don't find
+                resampledSample = sampleNum == 0 ||
+                                  (brdf == firstHit->brdf &&
+                                   std::abs(glm::distance(position, controls.cameraPosition) - firstHit->depth) <= 0.1f * firstHit->depth &&
+                                   glm::dot(glm::normalize(normal), glm::normalize(firstHit->normal)) >= 0.9f);
+                resampledSamples += resampledSample;
+                if (sampleNum == 0) {
+                    firstHit->shininess = face.illum == 2.0f ? 5.0f : face.shininess;
+                }
+            }
+
+            if (radianceCache != nullptr && (face.illum == 2.0f || face.illum == 3.0f)) {
+                const RadianceGrid::Header& cache = radianceCache->header();
+                glm::vec3 cached;
+                if (depth > 0 && coneWidth + spread > cache.footprint * cache.cellSize && radianceCache->lookup(position, normal, cached)) {
+                    addLight(weight * cached);
+                    break;
+                }
+                if (updatesCache) {
+                    const uint32_t cell = radianceCache->claim(position, normal);
+                    if (cell != RadianceGrid::NoCell) {
+                        cacheRecords[cacheRecordCount++] = {cell, weight, glm::vec3(0.0f)};
+                    }
+                }
+            }
+
+            ray.origin = position;
+            bouncePdf = 0.0f;
+            if (face.illum == 5.0f) {
+                ray.direction = glm::reflect(ray.direction, normal);
+                weight *= specular;
+            } else if ((face.illum == 2.0f || face.illum == 3.0f) && guiding != nullptr) {
+                const float shininess = face.illum == 2.0f ? 5.0f : face.shininess;
+                const glm::vec2 u = get2D(sobol::bounceDimension(depth) + sobol::DimBsdf);
+                const uint32_t leaf = guiding->leafAt(position);
+                const float bsdfFraction = guiding->trained(leaf) ? guidingBsdfFraction : 1.0f;
+                // u.x picks the technique and is stretched back to [0, 1) for it, which saves a
+                // sampler dimension per bounce and keeps both techniques' samples stratified
+                const bool guided = u.x >= bsdfFraction;
+                float guidePdf = 0.0f;
+                if (guided) {
+                    ray.direction = guiding->sample(leaf, {(u.x - bsdfFraction) / (1.0f - bsdfFraction), u.y}, guidePdf);
+                } else {
+                    ray.direction = sampleDirection(u.x / bsdfFraction, u.y, normal, shininess);
+                }
+                const glm::vec3 direction = glm::normalize(ray.direction);
+                const float cosine = glm::dot(direction, normal);
+                if (cosine <= 0.0f) {
+                    break;
+                }
+                // The guide's density of a BSDF direction takes another descent, a guided one came with it
+                if (!guided && bsdfFraction < 1.0f) {
+                    guidePdf = guiding->pdf(leaf, direction);
+                }
+                // The unguided weight over the mixture's density relative to the BSDF's
+                const float bsdfPdf = sampleDirectionPdf(cosine, shininess);
+                const float pdf = bsdfFraction * bsdfPdf + (1.0f - bsdfFraction) * guidePdf;
+                const float scatter = sampleDirectionZ(cosine, shininess) * 2.0f * M_PI_F * bsdfPdf;
+                weight *= brdf * scatter / pdf;
+                bouncePdf = pdf;
+                if (guidingRecording) {
+                    records[recordCount++] = {leaf, guiding->slot(leaf, direction), pdf / scatter, weight, glm::vec3(0.0f)};
+                }
+            } else if (face.illum == 2.0f || face.illum == 3.0f) {
+                const glm::vec2 u = get2D(sobol::bounceDimension(depth) + sobol::DimBsdf);
+                const float shininess = face.illum == 2.0f ? 5.0f : face.shininess;
+                ray.direction = sampleDirection(u.x, u.y, normal, shininess);
+                float pdf = 1.0f / (2.0f * M_PI_F);
+                weight *= brdf * glm::dot(ray.direction, normal) / pdf;
+                if (radianceCache != nullptr) {
+                    bouncePdf = sampleDirectionPdf(glm::dot(glm::normalize(ray.direction), normal), shininess);
+                }
+            } else if (face.illum == 7.0f) {
+                float cosi = glm::dot(ray.direction, normal);
+                float etai = 1.0f;
+                float etat = face.ior;
+                glm::vec3 n = normal;
+
+                if (cosi >= 0.0f) {
+                    float temp = etai;
+                    etai = etat * 0.94f;
+                    etat = temp * 1.06f;
+                    n = -normal;
+                } else {
+                    cosi = -cosi;
+                }
+
+                float eta = etai / etat;
+                float k = 1.0f - eta * eta * (1.0f - cosi * cosi);
+
+                glm::vec3 reflected = glm::reflect(ray.direction, normal);
+                glm::vec3 refracted = k >= 0.0f ? glm::normalize(eta * ray.direction + (eta * cosi - std::sqrt(k)) * n) : reflected;
+
+                float r = (etai - etat) / (etai + etat);
+                float R0 = r * r;
+                float fresnel = R0 + (1.0f - R0) * std::pow(1.0f - cosi, 5.0f);
+                fresnel = std::clamp(fresnel + 0.1f, 0.0f, 1.0f);
+
+                if (get1D(sobol::bounceDimension(depth) + sobol::DimFresnel) < fresnel) {
+                    ray.direction = reflected;
+                    weight *= specular * face.ior;
+                } else {
+                    ray.direction = refracted;
+                    weight *= transmittance * 10.0f;
+                }
+            }
+        }
+        for (int i = 0; i < recordCount; i++) {
+            guiding->record(records[i].leaf, records[i].slot, luminance(records[i].radiance) / records[i].pdf);
+        }
+        for (int i = 0; i < cacheRecordCount; i++) {
+            radianceCache->record(cacheRecords[i].cell, cacheRecords[i].radiance);
+        }
+    }
+    if (firstHit != nullptr) {
+        firstHit->coverage = static_cast<float>(resampledSamples) / static_cast<float>(samples);
+    }
+    return color / static_cast<float>(samples);
+}
+
+void CpuTracer::readPixels(std::vector<unsigned char>& pixels) const {
+    pixels.resize(accumBuffer.size() * 4);
+    for (size_t i = 0; i < accumBuffer.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            pixels[i * 4 + c] = static_cast<unsigned char>(std::lround(std::clamp(accumBuffer[i][c], 0.0f, 1.0f) * 255.0f));
+        }
+    }
+}
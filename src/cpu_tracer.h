@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "controls.h"
+#include "emitter_table.h"
+#include "guiding_tree.h"
+#include "radiance_grid.h"
+#include "render_settings.h"
+#include "scene_data.h"
+
+// Reference path tracer running on the host. It follows raygen.rgen and
+// closesthit.rchit step by step (same RNG, sampling and material models), so
+// its output can be used as a fallback renderer and to check GPU results.
+class CpuTracer {
+public:
+    static constexpr int TileSize = 16;
+    static constexpr int MaxDepth = 8;
+
+    enum class Sampler {
+        Random,  // The pcg chain raygen.rgen used before the Sobol sampler, for comparisons
+        Sobol,
+    };
+
+    // Mirrors Surface of light_resampling.glsl: the first hit of a pixel's sample 0
+    struct FirstHit {
+        glm::vec3 position{0.0f};
+        float depth = 0.0f;  // From the camera, 0 on a miss
+        glm::vec3 normal{0.0f};
+        float shininess = 0.0f;
+        glm::vec3 brdf{0.0f};
+        float coverage = 0.0f;  // Share of the samples leaving their direct light to the reservoirs
+    };
+    // Mirrors Reservoir of light_resampling.glsl
+    struct Reservoir {
+        glm::vec2 uv{0.0f};
+        uint32_t emitter = 0;
+        float W = 0.0f;
+        float wSum = 0.0f;
+        float M = 0.0f;
+    };
+
+    CpuTracer(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+              unsigned threadCount = 0);
+
+    // Traces one frame (controls.samplesPerFrame paths per pixel) and resolves it into the
+    // accumulation buffer the same way raygen.rgen writes outputImage.
+    void render(const Controls& controls, int width, int height);
+
+    // Converts the float accumulation buffer to clamped RGBA8.
+    void readPixels(std::vector<unsigned char>& pixels) const;
+
+    void setSampler(Sampler type) { sampler = type; }
+    // Guides diffuse and glossy bounces by the tree as guiding.glsl does, and records into it
+    // while recording. Null turns guiding off; the tree must outlive its use.
+    void setGuiding(GuidingTree* tree, float bsdfFraction, bool recording) {
+        guiding = tree;
+        guidingBsdfFraction = bsdfFraction;
+        guidingRecording = recording;
+    }
+    // Ends wide paths in the grid as radiance_cache.glsl does, and records into it while
+    // updating; resolve() it between frames. Null traces full paths; the grid must outlive its use.
+    void setRadianceCache(RadianceGrid* grid, bool updating) {
+        radianceCache = grid;
+        cacheUpdating = updating;
+    }
+
+    // Leaves the direct light of diffuse and glossy first hits to reservoirs and runs the
+    // passes of restir_temporal.comp and restir_spatial.comp after each frame's trace, as
+    // LightResampling does. Disabled settings find emitters by the BSDF alone.
+    void setLightResampling(const LightResamplingSettings& settings);
+
+    const std::vector<glm::vec4>& accumulation() const { return accumBuffer; }
+    const Bvh& getBvh() const { return bvh; }
+
+private:
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
+
+    glm::vec3 tracePixel(const Controls& controls, int x, int y, int width, int height, FirstHit* firstHit) const;
+    void renderTile(const Controls& controls, const Tile& tile, int width, int height);
+    void accumulate(const Controls& controls, size_t pixel, const glm::vec3& color);
+    bool resamplesLights() const { return resampling.enabled && !emitters.empty(); }
+    // Runs body on every tile of the image, spread over the worker threads
+    void forEachTile(int width, int height, const std::function<void(const Tile&)>& body) const;
+    // The passes of restir_temporal.comp and restir_spatial.comp over the frame's first hits
+    void resampleTemporal(const Controls& controls, bool history, int x, int y);
+    void resampleSpatial(const Controls& controls, int x, int y);
+
+    const std::vector<Vertex>& vertices;
+    const std::vector<uint32_t>& indices;
+    const std::vector<Face>& faces;
+    Bvh bvh;
+    unsigned threadCount;
+    Sampler sampler = Sampler::Sobol;
+    GuidingTree* guiding = nullptr;
+    float guidingBsdfFraction = 0.5f;
+    bool guidingRecording = false;
+    RadianceGrid* radianceCache = nullptr;
+    bool cacheUpdating = false;
+    LightResamplingSettings resampling;
+    std::vector<EmitterEntry> emitters;
+    std::vector<glm::vec3> frameColors;  // The trace's colors, which the spatial pass adds to before accumulating
+    std::vector<FirstHit> firstHits;
+    std::vector<FirstHit> previousFirstHits;
+    std::vector<Reservoir> candidateReservoirs;
+    std::vector<Reservoir> reservoirs;
+    std::vector<Reservoir> previousReservoirs;
+    Controls previousControls;
+    std::vector<uint32_t> sobolMatrices;
+    std::vector<uint32_t> blueNoise;
+    int imageWidth = 0;
+    int imageHeight = 0;
+    std::vector<glm::vec4> accumBuffer;
+};
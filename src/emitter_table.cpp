@@ -0,0 +1,28 @@
+#include "emitter_table.h"
+
+std::vector<EmitterEntry> buildEmitterTable(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                            const std::vector<Face>& faces) {
+    std::vector<EmitterEntry> entries;
+    double totalPower = 0.0;
+    std::vector<double> powers;
+    for (size_t i = 0; i < faces.size() && 3 * i + 2 < indices.size(); i++) {
+        const glm::vec3 emission{faces[i].emission[0], faces[i].emission[1], faces[i].emission[2]};
+        if (emission == glm::vec3(0.0f)) continue;
+        const glm::vec3 a = vertices[indices[3 * i]].position;
+        const glm::vec3 b = vertices[indices[3 * i + 1]].position;
+        const glm::vec3 c = vertices[indices[3 * i + 2]].position;
+        const float area = 0.5f * glm::length(glm::cross(b - a, c - a));
+        const double power = glm::dot(emission, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * static_cast<double>(area);
+        if (power <= 0.0) continue;
+        entries.push_back({glm::vec4(a, area), glm::vec4(b - a, 0.0f), glm::vec4(c - a, 0.0f), glm::vec4(emission, 0.0f)});
+        powers.push_back(power);
+        totalPower += power;
+    }
+    double cumulative = 0.0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        cumulative += powers[i];
+        entries[i].edge1.w = i + 1 == entries.size() ? 1.0f : static_cast<float>(cumulative / totalPower);
+        entries[i].edge2.w = static_cast<float>(powers[i] / totalPower);
+    }
+    return entries;
+}
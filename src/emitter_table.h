@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_data.h"
+
+// Mirrors Emitter of light_resampling.glsl
+struct EmitterEntry {
+    glm::vec4 corner;    // w the area
+    glm::vec4 edge1;     // w the probability of drawing this or an earlier emitter
+    glm::vec4 edge2;     // w the probability of drawing this emitter
+    glm::vec4 emission;
+};
+
+// Every emissive triangle, drawn by its power: luminance times area. Shared by
+// LightResampling and the CPU tracer's mirror of it.
+std::vector<EmitterEntry> buildEmitterTable(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                            const std::vector<Face>& faces);
@@ -0,0 +1,130 @@
+#include "environment_distribution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+namespace {
+
+constexpr float Pi = 3.14159265358979323846f;
+
+float luminance(const float* rgb) {
+    return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+// Turns count weights at cdf[1..count] into a CDF from 0 to 1 and returns their
+// sum; all zero weights give a uniform CDF
+float integrate(float* cdf, uint32_t count) {
+    cdf[0] = 0.0f;
+    double sum = 0.0;
+    for (uint32_t i = 1; i <= count; i++) {
+        sum += cdf[i];
+        cdf[i] = static_cast<float>(sum);
+    }
+    for (uint32_t i = 1; i <= count; i++) {
+        cdf[i] = sum > 0.0 ? static_cast<float>(cdf[i] / sum) : static_cast<float>(i) / static_cast<float>(count);
+    }
+    cdf[count] = 1.0f;
+    return static_cast<float>(sum);
+}
+
+// Largest i below count with cdf[i] <= u, the entry whose range holds u
+uint32_t search(const float* cdf, uint32_t count, float u) {
+    return static_cast<uint32_t>(std::upper_bound(cdf + 1, cdf + count, u) - cdf) - 1;
+}
+
+glm::vec2 toUv(glm::vec3 direction) {
+    direction = glm::normalize(direction);
+    float u = std::atan2(direction.z, direction.x) / (2.0f * Pi);
+    return {u < 0.0f ? u + 1.0f : u, std::acos(std::clamp(-direction.y, -1.0f, 1.0f)) / Pi};
+}
+
+}  // namespace
+
+glm::vec3 EnvironmentDistribution::lookup(glm::vec3 direction) const {
+    if (width == 0) return glm::vec3(0.0f);
+    const glm::vec2 uv = toUv(direction);
+    const uint32_t x = std::min(static_cast<uint32_t>(uv.x * static_cast<float>(width)), width - 1);
+    const uint32_t y = std::min(static_cast<uint32_t>(uv.y * static_cast<float>(height)), height - 1);
+    const float* texel = &radiance[(static_cast<size_t>(y) * width + x) * 3];
+    return {texel[0], texel[1], texel[2]};
+}
+
+glm::vec3 EnvironmentDistribution::sample(glm::vec2 u, float& density) const {
+    if (width == 0) {
+        density = 0.0f;
+        return glm::vec3(0.0f, -1.0f, 0.0f);
+    }
+    const uint32_t row = search(marginal.data(), height, u.x);
+    const float rowMass = marginal[row + 1] - marginal[row];
+    const float* rowCdf = &conditional[static_cast<size_t>(row) * (width + 1)];
+    const uint32_t column = search(rowCdf, width, u.y);
+    const float columnMass = rowCdf[column + 1] - rowCdf[column];
+
+    // Position within the texel from what is left of u
+    const float x = (static_cast<float>(column) + std::clamp((u.y - rowCdf[column]) / std::max(columnMass, 1e-20f), 0.0f, 1.0f)) /
+                    static_cast<float>(width);
+    const float y = (static_cast<float>(row) + std::clamp((u.x - marginal[row]) / std::max(rowMass, 1e-20f), 0.0f, 1.0f)) /
+                    static_cast<float>(height);
+    const float phi = 2.0f * Pi * x;
+    const float theta = Pi * y;
+    const float sinTheta = std::sin(theta);
+    density = sinTheta > 0.0f ? rowMass * columnMass * static_cast<float>(width * height) / (2.0f * Pi * Pi * sinTheta) : 0.0f;
+    return {sinTheta * std::cos(phi), -std::cos(theta), sinTheta * std::sin(phi)};
+}
+
+float EnvironmentDistribution::pdf(glm::vec3 direction) const {
+    if (width == 0) return 0.0f;
+    const glm::vec2 uv = toUv(direction);
+    const uint32_t x = std::min(static_cast<uint32_t>(uv.x * static_cast<float>(width)), width - 1);
+    const uint32_t y = std::min(static_cast<uint32_t>(uv.y * static_cast<float>(height)), height - 1);
+    const float sinTheta = std::sin(uv.y * Pi);
+    if (sinTheta <= 0.0f) return 0.0f;
+    const float* rowCdf = &conditional[static_cast<size_t>(y) * (width + 1)];
+    const float mass = (marginal[y + 1] - marginal[y]) * (rowCdf[x + 1] - rowCdf[x]);
+    return mass * static_cast<float>(width * height) / (2.0f * Pi * Pi * sinTheta);
+}
+
+EnvironmentDistribution buildEnvironmentDistribution(const HdrImage& image, float intensity, ThreadPool& pool) {
+    EnvironmentDistribution result;
+    if (image.width <= 0 || image.height <= 0) {
+        return result;
+    }
+    const uint32_t width = result.width = static_cast<uint32_t>(image.width);
+    const uint32_t height = result.height = static_cast<uint32_t>(image.height);
+    result.radiance.resize(image.rgb.size());
+    result.conditional.resize(static_cast<size_t>(height) * (width + 1));
+    result.marginal.resize(height + 1);
+
+    // Bands of rows per task, each scaling its texels and integrating its conditional CDFs
+    std::vector<float> rowSums(height);
+    const uint32_t bands = std::min<uint32_t>(height, static_cast<uint32_t>(pool.size()) * 4);
+    std::vector<std::future<void>> pending;
+    for (uint32_t band = 0; band < bands; band++) {
+        pending.push_back(pool.submit([&, band] {
+            for (uint32_t y = band * height / bands; y < (band + 1) * height / bands; y++) {
+                const float sinTheta = std::sin((static_cast<float>(y) + 0.5f) / static_cast<float>(height) * Pi);
+                float* cdf = &result.conditional[static_cast<size_t>(y) * (width + 1)];
+                for (uint32_t x = 0; x < width; x++) {
+                    const size_t texel = (static_cast<size_t>(y) * width + x) * 3;
+                    for (int c = 0; c < 3; c++) {
+                        // Negative and non-finite texels of broken files would poison the CDFs
+                        const float value = image.rgb[texel + c] * intensity;
+                        result.radiance[texel + c] = std::isfinite(value) ? std::max(value, 0.0f) : 0.0f;
+                    }
+                    cdf[x + 1] = luminance(&result.radiance[texel]) * sinTheta;
+                }
+                rowSums[y] = integrate(cdf, width);
+            }
+        }));
+    }
+    for (std::future<void>& task : pending) {
+        task.get();
+    }
+
+    std::copy(rowSums.begin(), rowSums.end(), result.marginal.begin() + 1);
+    const float total = integrate(result.marginal.data(), height);
+    // Each texel spans (2 pi / width) (pi / height) of the parameter square, dw = sin(theta) du dv
+    result.power = total * 2.0f * Pi * Pi / static_cast<float>(width * height);
+    return result;
+}
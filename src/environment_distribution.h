@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "image_reader.h"
+#include "thread_pool.h"
+
+// A lat-long environment and the distribution that importance samples it,
+// mirrored by shaders/environment.glsl. Rows run from the scene's up (-Y, the
+// mesh loader flips Y) down to -up, columns once around it starting at +X.
+//
+// Texels are picked with probability proportional to luminance times the
+// sine of their row's polar angle, first a row from the marginal CDF, then a
+// column from that row's conditional CDF, and sampled uniformly within.
+struct EnvironmentDistribution {
+    uint32_t width = 0;  // 0 for no environment
+    uint32_t height = 0;
+    std::vector<float> radiance;     // RGB per texel, top row first
+    std::vector<float> marginal;     // CDF over rows, height + 1 entries from 0 to 1
+    std::vector<float> conditional;  // CDF over the columns of each row, width + 1 entries per row
+    float power = 0.0f;              // Luminance integrated over the sphere
+
+    // Nearest texel in the direction, black without an environment.
+    glm::vec3 lookup(glm::vec3 direction) const;
+    // Direction for a uniform sample u and its solid angle density.
+    glm::vec3 sample(glm::vec2 u, float& pdf) const;
+    // Solid angle density of sample() producing the direction.
+    float pdf(glm::vec3 direction) const;
+};
+
+// Scales the image by intensity and builds the CDFs, the rows in parallel on
+// the pool; must not be called from one of its workers. An image without any
+// luminance gives uniform CDFs.
+EnvironmentDistribution buildEnvironmentDistribution(const HdrImage& image, float intensity, ThreadPool& pool);
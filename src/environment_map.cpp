@@ -0,0 +1,50 @@
+#include "environment_map.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// Mirrors the members of the Environment block ahead of its data array
+struct EnvironmentHeader {
+    uint32_t width;
+    uint32_t height;
+    uint32_t sampling;  // ENVIRONMENT_IMPORTANCE or ENVIRONMENT_UNIFORM
+    uint32_t padding;
+};
+
+}  // namespace
+
+EnvironmentMap::EnvironmentMap(const Context& context, const HdrImage& image, const EnvironmentSettings& settings, ThreadPool& pool)
+    : path(settings.path), sampling(settings.sampling) {
+    const EnvironmentDistribution distribution = buildEnvironmentDistribution(image, settings.intensity, pool);
+    width = distribution.width;
+    height = distribution.height;
+    power = distribution.power;
+
+    // Texels, then the marginal CDF, then the conditional CDFs row by row
+    const EnvironmentHeader header{width, height, static_cast<uint32_t>(sampling), 0};
+    std::vector<uint8_t> contents(sizeof(header));
+    std::memcpy(contents.data(), &header, sizeof(header));
+    for (const std::vector<float>* array : {&distribution.radiance, &distribution.marginal, &distribution.conditional}) {
+        const size_t offset = contents.size();
+        contents.resize(offset + array->size() * sizeof(float));
+        std::memcpy(contents.data() + offset, array->data(), array->size() * sizeof(float));
+    }
+    bytes = contents.size();
+    data = Buffer{context, Buffer::Type::Storage, bytes, contents.data()};
+}
+
+std::string EnvironmentMap::report() const {
+    if (!enabled()) {
+        return "Environment: none";
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "Environment: " << path << ", " << width << "x" << height << ", "
+        << (sampling == EnvironmentSampling::Importance ? "importance" : "uniform") << " sampling, power " << power << ", "
+        << static_cast<double>(bytes) / (1 << 20) << " MB";
+    return out.str();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "context.h"
+#include "environment_distribution.h"
+#include "image_reader.h"
+#include "render_settings.h"
+#include "thread_pool.h"
+
+// The environment of the tracing passes as one storage buffer at binding 17,
+// the Environment block of environment.glsl: a header, the texels and the
+// CDFs of EnvironmentDistribution. miss.rmiss looks it up and the integrator
+// samples it as a light. Without a map the header's zero width turns both off,
+// leaving misses black as before.
+class EnvironmentMap {
+public:
+    static constexpr uint32_t Binding = 17;
+
+    // image is empty when no environment is set or it failed to load. Builds the
+    // distribution on the pool; must not be called from one of its workers.
+    EnvironmentMap(const Context& context, const HdrImage& image, const EnvironmentSettings& settings, ThreadPool& pool);
+
+    const Buffer& buffer() const { return data; }
+    bool enabled() const { return width > 0; }
+    std::string report() const;
+
+private:
+    std::string path;
+    EnvironmentSampling sampling;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    float power = 0.0f;
+    vk::DeviceSize bytes = 0;
+    Buffer data;
+};
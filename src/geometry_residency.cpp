@@ -0,0 +1,635 @@
+#include "geometry_residency.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+constexpr uint32_t BoxTriangles = 12;
+
+// Unit cube with four vertices per side, so each side keeps its own normal
+void unitBox(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    for (int axis = 0; axis < 3; axis++) {
+        for (int side = 0; side < 2; side++) {
+            glm::vec3 normal(0.0f);
+            normal[axis] = side ? 1.0f : -1.0f;
+            const auto base = static_cast<uint32_t>(vertices.size());
+            for (int corner = 0; corner < 4; corner++) {
+                const glm::vec2 uv(static_cast<float>(corner & 1), static_cast<float>(corner >> 1));
+                glm::vec3 position(0.0f);
+                position[axis] = static_cast<float>(side);
+                position[(axis + 1) % 3] = uv.x;
+                position[(axis + 2) % 3] = uv.y;
+                vertices.push_back({position, normal, uv});
+            }
+            // Winding doesn't matter, the instances disable facing culling
+            for (uint32_t index : {0u, 1u, 3u, 0u, 3u, 2u}) {
+                indices.push_back(base + index);
+            }
+        }
+    }
+}
+
+// Origin and size of a cluster's proxy box, padded so a flat cluster still gets a hittable box
+std::pair<glm::vec3, glm::vec3> boxPlacement(const MeshCluster& cluster) {
+    const glm::vec3 size = cluster.boundsMax - cluster.boundsMin;
+    const float padding = 1e-3f * std::max({size.x, size.y, size.z, 1e-3f});
+    return {cluster.boundsMin - padding, size + 2.0f * padding};
+}
+
+// The cluster's diffuse color averaged by triangle area, the other parameters of its largest
+// triangle. Without emission or texture: a proxy only stands in for the silhouette.
+Face proxyFace(const MeshCluster& cluster, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+               const std::vector<Face>& faces) {
+    Face face{};
+    glm::vec3 diffuse(0.0f);
+    float totalArea = 0.0f;
+    float largestArea = -1.0f;
+    for (uint32_t primitive = cluster.firstPrimitive; primitive < cluster.firstPrimitive + cluster.primitiveCount; primitive++) {
+        const glm::vec3 a = vertices[indices[3 * primitive + 0]].position;
+        const glm::vec3 b = vertices[indices[3 * primitive + 1]].position;
+        const glm::vec3 c = vertices[indices[3 * primitive + 2]].position;
+        const float area = 0.5f * glm::length(glm::cross(b - a, c - a));
+        const Face& source = faces[primitive];
+        diffuse += area * glm::vec3(source.diffuse[0], source.diffuse[1], source.diffuse[2]);
+        totalArea += area;
+        if (area > largestArea) {
+            largestArea = area;
+            face = source;
+        }
+    }
+    if (totalArea > 0.0f) {
+        diffuse /= totalArea;
+    }
+    for (int i = 0; i < 3; i++) {
+        face.diffuse[i] = diffuse[i];
+        face.emission[i] = 0.0f;
+    }
+    face.diffuseTexture = -1.0f;
+    return face;
+}
+
+// Scene data, LOD levels and proxies one after the other
+template <typename T>
+std::vector<T> concatenate(std::initializer_list<const std::vector<T>*> parts) {
+    std::vector<T> result;
+    for (const std::vector<T>* part : parts) result.insert(result.end(), part->begin(), part->end());
+    return result;
+}
+
+// Into one device local acceleration structure input buffer
+template <typename T>
+Buffer upload(const Context& context, const std::vector<T>& data) {
+    Buffer buffer{context, Buffer::Type::DeviceAccelInput, std::max<vk::DeviceSize>(sizeof(T) * data.size(), sizeof(T))};
+    if (!data.empty()) buffer.upload(context, data.data(), sizeof(T) * data.size());
+    return buffer;
+}
+
+}  // namespace
+
+GeometryResidency::GeometryResidency(const Context& context, const std::vector<Vertex>& sceneVertices,
+                                     const std::vector<uint32_t>& sceneIndices, const std::vector<Face>& sceneFaces,
+                                     std::vector<MeshCluster> meshClusters, const std::vector<std::vector<MeshLod>>& lods,
+                                     SerializedAccels serializedAccels, const GeometrySettings& settings, const Controls& camera,
+                                     uint32_t viewHeight)
+    : context(context),
+      stream(settings.stream),
+      lodPixels(settings.lodPixels),
+      levelCount(1),
+      budgetBytes(static_cast<vk::DeviceSize>(settings.budgetMB) << 20) {
+    const auto clusterCount = static_cast<uint32_t>(meshClusters.size());
+    const auto scenePrimitives = static_cast<uint32_t>(sceneFaces.size());
+
+    // LOD levels follow the scene primitives
+    std::vector<uint32_t> lodIndices;
+    std::vector<Face> lodFaces;
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        ClusterState& state = clusters.emplace_back();
+        state.cluster = meshClusters[i];
+        state.levels.push_back({state.cluster.firstPrimitive, state.cluster.primitiveCount});
+        if (i >= lods.size()) continue;
+        for (const MeshLod& lod : lods[i]) {
+            state.levels.push_back({scenePrimitives + static_cast<uint32_t>(lodFaces.size()), static_cast<uint32_t>(lod.faces.size())});
+            lodIndices.insert(lodIndices.end(), lod.indices.begin(), lod.indices.end());
+            lodFaces.insert(lodFaces.end(), lod.faces.begin(), lod.faces.end());
+        }
+        levelCount = std::max(levelCount, static_cast<uint32_t>(state.levels.size()));
+    }
+    const auto proxyPrimitives = scenePrimitives + static_cast<uint32_t>(lodFaces.size());
+    sceneVertexCount = static_cast<uint32_t>(sceneVertices.size());
+    scenePrimitiveCount = scenePrimitives;
+    proxyPrimitive = proxyPrimitives;
+
+    // Custom index level * clusterCount + i is cluster i at that level, levelCount * clusterCount + i its proxy
+    std::vector<Vertex> box;
+    std::vector<uint32_t> boxTriangles;
+    unitBox(box, boxTriangles);
+    std::vector<Vertex> proxyVertices;
+    std::vector<uint32_t> proxyIndices;
+    std::vector<Face> proxyFaces;
+    std::vector<uint32_t> firstPrimitives((levelCount + 1) * clusterCount);
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        const ClusterState& state = clusters[i];
+        const MeshCluster& cluster = state.cluster;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            firstPrimitives[level * clusterCount + i] = state.levels[std::min<size_t>(level, state.levels.size() - 1)].firstPrimitive;
+        }
+        firstPrimitives[levelCount * clusterCount + i] = proxyPrimitives + i * BoxTriangles;
+        if (!stream) continue;
+
+        const auto [origin, size] = boxPlacement(cluster);
+        const auto base = static_cast<uint32_t>(sceneVertices.size() + proxyVertices.size());
+        for (Vertex vertex : box) {
+            vertex.position = origin + vertex.position * size;
+            proxyVertices.push_back(vertex);
+        }
+        for (uint32_t index : boxTriangles) {
+            proxyIndices.push_back(base + index);
+        }
+        proxyFaces.insert(proxyFaces.end(), BoxTriangles, proxyFace(cluster, sceneVertices, sceneIndices, sceneFaces));
+    }
+    vertexCount = static_cast<uint32_t>(sceneVertices.size() + proxyVertices.size());
+    vertices = upload(context, concatenate({&sceneVertices, &proxyVertices}));
+    indices = upload(context, concatenate({&sceneIndices, &lodIndices, &proxyIndices}));
+    faceData = concatenate({&sceneFaces, &lodFaces, &proxyFaces});
+    faces = upload(context, faceData);
+    faceMaterials = Buffer{context, Buffer::Type::DeviceStorage, sizeof(uint32_t) * std::max<size_t>(faceData.size(), 1)};
+    uploadMaterials();
+    clusterPrimitives = Buffer{context, Buffer::Type::Storage, sizeof(uint32_t) * firstPrimitives.size(), firstPrimitives.data()};
+    const std::vector<uint32_t> zeroHits(clusterCount);
+    clusterHits = Buffer{context, Buffer::Type::Storage, sizeof(uint32_t) * clusterCount, zeroHits.data()};
+
+    // One unit box BLAS serves every proxy through its instance transform
+    if (stream) {
+        boxVertices = upload(context, box);
+        boxIndices = upload(context, boxTriangles);
+        vk::AccelerationStructureGeometryTrianglesDataKHR boxData;
+        boxData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
+        boxData.setVertexData(boxVertices.deviceAddress);
+        boxData.setVertexStride(sizeof(Vertex));
+        boxData.setMaxVertex(static_cast<uint32_t>(box.size()));
+        boxData.setIndexType(vk::IndexType::eUint32);
+        boxData.setIndexData(boxIndices.deviceAddress);
+        vk::AccelerationStructureGeometryKHR boxGeometry{vk::GeometryTypeKHR::eTriangles, {boxData}, vk::GeometryFlagBitsKHR::eOpaque};
+        boxAccel = std::make_unique<Accel>(context, boxGeometry, BoxTriangles, vk::AccelerationStructureTypeKHR::eBottomLevel);
+    }
+
+    // Serialized BLASes of another mesh or driver are dropped and built instead
+    bool serializedMatch = serializedAccels.size() == clusterCount;
+    for (uint32_t i = 0; serializedMatch && i < clusterCount; i++) {
+        serializedMatch = serializedAccels[i].size() == clusters[i].levels.size() &&
+                          std::none_of(serializedAccels[i].begin(), serializedAccels[i].end(), [](const auto& data) { return data.empty(); });
+    }
+    if (serializedMatch && Accel::compatible(context, serializedAccels.front().front())) {
+        serialized = std::move(serializedAccels);
+    } else if (!serializedAccels.empty()) {
+        std::cout << "Serialized acceleration structures don't match this device, building them" << std::endl;
+    }
+
+    // BLAS sizes are known before building, so residency is decided up front
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        ClusterState& state = clusters[i];
+        for (uint32_t levelIndex = 0; levelIndex < state.levels.size(); levelIndex++) {
+            LodLevel& level = state.levels[levelIndex];
+            if (!serialized.empty()) {
+                level.bytes = Accel::deserializedSize(serialized[i][levelIndex]);
+                continue;
+            }
+            level.bytes = buildBytes(level);
+        }
+        state.level = selectLevel(state, camera, viewHeight);
+    }
+    lodCameraPosition = camera.cameraPosition;
+    lodFov = camera.fov;
+    lodViewHeight = viewHeight;
+
+    // Start with the clusters nearest the camera, later updates follow the hits
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    auto distance = [&](uint32_t i) {
+        return glm::length(0.5f * (clusters[i].cluster.boundsMin + clusters[i].cluster.boundsMax) - camera.cameraPosition);
+    };
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return distance(a) < distance(b); });
+    for (uint32_t index : order) {
+        if (!pageIn(index)) break;
+    }
+
+    instances = Buffer{context, Buffer::Type::AccelInput, sizeof(vk::AccelerationStructureInstanceKHR) * clusterCount};
+    writeInstances();
+    vk::AccelerationStructureGeometryInstancesDataKHR instancesData;
+    instancesData.setArrayOfPointers(false);
+    instancesData.setData(instances.deviceAddress);
+    instanceGeometry.setGeometryType(vk::GeometryTypeKHR::eInstances);
+    instanceGeometry.setGeometry({instancesData});
+    instanceGeometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+    topAccel = std::make_unique<Accel>(context, instanceGeometry, clusterCount, vk::AccelerationStructureTypeKHR::eTopLevel);
+    if (stream || levelCount > 1) {
+        std::cout << report() << std::endl;
+    }
+}
+
+vk::AccelerationStructureGeometryKHR GeometryResidency::levelGeometry(const LodLevel& level) const {
+    vk::AccelerationStructureGeometryTrianglesDataKHR triangleData;
+    triangleData.setVertexFormat(vk::Format::eR32G32B32Sfloat);
+    triangleData.setVertexData(vertices.deviceAddress);
+    triangleData.setVertexStride(sizeof(Vertex));
+    triangleData.setMaxVertex(vertexCount);
+    triangleData.setIndexType(vk::IndexType::eUint32);
+    triangleData.setIndexData(indices.deviceAddress + 3 * sizeof(uint32_t) * level.firstPrimitive);
+
+    vk::AccelerationStructureGeometryKHR geometry;
+    geometry.setGeometryType(vk::GeometryTypeKHR::eTriangles);
+    geometry.setGeometry({triangleData});
+    geometry.setFlags(vk::GeometryFlagBitsKHR::eOpaque);
+    return geometry;
+}
+
+vk::DeviceSize GeometryResidency::buildBytes(const LodLevel& level) const {
+    vk::AccelerationStructureGeometryKHR geometry = levelGeometry(level);
+    vk::AccelerationStructureBuildGeometryInfoKHR buildInfo;
+    buildInfo.setType(vk::AccelerationStructureTypeKHR::eBottomLevel);
+    buildInfo.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace);
+    buildInfo.setGeometries(geometry);
+    return context.device
+        ->getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, level.primitiveCount)
+        .accelerationStructureSize;
+}
+
+vk::DeviceSize GeometryResidency::residencyLimit() const {
+    vk::DeviceSize limit = budgetBytes;
+    if (limit == 0) {
+        // A tenth of the budget is left for allocations made later, what else this process uses is not ours
+        const Context::MemoryBudget memory = context.deviceLocalBudget();
+        const vk::DeviceSize usable = memory.budget - memory.budget / 10;
+        const vk::DeviceSize others = memory.usage > residentBytes ? memory.usage - residentBytes : 0;
+        limit = usable > others ? usable - others : 0;
+    }
+    return failedLimit > 0 ? std::min(limit, failedLimit) : limit;
+}
+
+std::unique_ptr<Accel> GeometryResidency::buildLevel(uint32_t index, uint32_t level, vk::DeviceSize freed) {
+    const LodLevel& lod = clusters[index].levels[level];
+    if (stream && residentBytes - freed + lod.bytes > residencyLimit()) {
+        return nullptr;
+    }
+    try {
+        if (!serialized.empty() && !serialized[index][level].empty()) {
+            return std::make_unique<Accel>(context, serialized[index][level], vk::AccelerationStructureTypeKHR::eBottomLevel);
+        }
+        return std::make_unique<Accel>(context, levelGeometry(lod), lod.primitiveCount, vk::AccelerationStructureTypeKHR::eBottomLevel);
+    } catch (const vk::OutOfDeviceMemoryError&) {
+        if (!stream) throw;
+        // Whatever the budget says, the device holds no more than this right now
+        failedLimit = std::max<vk::DeviceSize>(residentBytes, 1);
+        return nullptr;
+    }
+}
+
+bool GeometryResidency::pageIn(uint32_t index) {
+    ClusterState& state = clusters[index];
+    state.accel = buildLevel(index, state.level, 0);
+    if (!state.accel) {
+        return false;
+    }
+    residentBytes += state.bytes();
+    return true;
+}
+
+std::unique_ptr<Accel> GeometryResidency::pageOut(uint32_t index) {
+    ClusterState& state = clusters[index];
+    residentBytes -= state.bytes();
+    return std::move(state.accel);
+}
+
+SerializedAccels GeometryResidency::serializeAll() const {
+    SerializedAccels result(clusters.size());
+    for (size_t i = 0; i < clusters.size(); i++) {
+        for (const LodLevel& level : clusters[i].levels) {
+            Accel accel{context, levelGeometry(level), level.primitiveCount, vk::AccelerationStructureTypeKHR::eBottomLevel,
+                        vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace | vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction};
+            accel.compact(context);
+            result[i].push_back(accel.serialize(context));
+        }
+    }
+    return result;
+}
+
+uint32_t GeometryResidency::selectLevel(const ClusterState& state, const Controls& camera, uint32_t viewHeight) const {
+    const auto coarsest = static_cast<uint32_t>(state.levels.size() - 1);
+    if (coarsest == 0) {
+        return 0;
+    }
+    // Projected diameter of the bounding sphere; every halving of it below lodPixels allows the next level,
+    // which has about a quarter of the triangles, so triangles per pixel stay about the same
+    const glm::vec3 center = 0.5f * (state.cluster.boundsMin + state.cluster.boundsMax);
+    const float radius = 0.5f * glm::length(state.cluster.boundsMax - state.cluster.boundsMin);
+    const float distance = glm::length(center - camera.cameraPosition);
+    if (distance <= radius) {
+        return 0;
+    }
+    const float pixels = radius / (distance * std::tan(0.5f * glm::radians(camera.fov))) * static_cast<float>(viewHeight);
+    if (pixels >= lodPixels) {
+        return 0;
+    }
+    const float level = std::floor(std::log2(lodPixels / std::max(pixels, 1e-6f))) + 1.0f;
+    return std::min(coarsest, static_cast<uint32_t>(level));
+}
+
+void GeometryResidency::writeInstances() {
+    const auto clusterCount = static_cast<uint32_t>(clusters.size());
+    std::vector<vk::AccelerationStructureInstanceKHR> data(clusterCount);
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        const ClusterState& state = clusters[i];
+        vk::AccelerationStructureInstanceKHR& instance = data[i];
+        instance.setMask(0xFF);
+        instance.setFlags(vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable);
+        if (state.accel) {
+            instance.setTransform(std::array{
+                std::array{1.0f, 0.0f, 0.0f, 0.0f},
+                std::array{0.0f, 1.0f, 0.0f, 0.0f},
+                std::array{0.0f, 0.0f, 1.0f, 0.0f},
+            });
+            instance.setInstanceCustomIndex(state.level * clusterCount + i);
+            instance.setAccelerationStructureReference(state.accel->buffer.deviceAddress);
+        } else {
+            const auto [origin, size] = boxPlacement(state.cluster);
+            instance.setTransform(std::array{
+                std::array{size.x, 0.0f, 0.0f, origin.x},
+                std::array{0.0f, size.y, 0.0f, origin.y},
+                std::array{0.0f, 0.0f, size.z, origin.z},
+            });
+            instance.setInstanceCustomIndex(levelCount * clusterCount + i);
+            instance.setAccelerationStructureReference(boxAccel->buffer.deviceAddress);
+        }
+    }
+    instances.copyData(context, data.data(), sizeof(vk::AccelerationStructureInstanceKHR) * data.size());
+}
+
+bool GeometryResidency::update(const Controls& camera, uint32_t viewHeight) {
+    // Replaced and evicted BLASes live until the rebuilt TLAS no longer references them
+    std::vector<std::unique_ptr<Accel>> retired;
+    const bool levelsChanged = switchLevels(camera, viewHeight, retired);
+    const bool residencyChanged = stream && ++frames % UpdateInterval == 0 && updateResidency(retired);
+    if (!levelsChanged && !residencyChanged) {
+        return false;
+    }
+
+    writeInstances();
+    topAccel->build(context, instanceGeometry, static_cast<uint32_t>(clusters.size()));
+    retired.clear();
+    if (residencyChanged) {
+        std::cout << report() << std::endl;
+    }
+    return true;
+}
+
+bool GeometryResidency::switchLevels(const Controls& camera, uint32_t viewHeight, std::vector<std::unique_ptr<Accel>>& retired) {
+    if (levelCount == 1) {
+        return false;
+    }
+    if (camera.cameraPosition != lodCameraPosition || camera.fov != lodFov || viewHeight != lodViewHeight) {
+        lodCameraPosition = camera.cameraPosition;
+        lodFov = camera.fov;
+        lodViewHeight = viewHeight;
+        lodsPending = true;
+    }
+    if (!lodsPending) {
+        return false;
+    }
+
+    // Paged out clusters only note their level, it is built when they page in. A level that
+    // doesn't fit the budget is tried again when the view changes.
+    lodsPending = false;
+    int builds = 0;
+    for (uint32_t i = 0; i < clusters.size(); i++) {
+        ClusterState& state = clusters[i];
+        const uint32_t level = selectLevel(state, camera, viewHeight);
+        if (level == state.level) continue;
+        if (!state.accel) {
+            state.level = level;
+            continue;
+        }
+        if (builds == MaxBuildsPerUpdate) {
+            lodsPending = true;
+            continue;
+        }
+        std::unique_ptr<Accel> accel = buildLevel(i, level, state.bytes());
+        if (!accel) continue;
+        residentBytes = residentBytes - state.bytes() + state.levels[level].bytes;
+        retired.push_back(std::move(state.accel));
+        state.accel = std::move(accel);
+        state.level = level;
+        builds++;
+    }
+    return builds > 0;
+}
+
+bool GeometryResidency::updateResidency(std::vector<std::unique_ptr<Accel>>& retired) {
+    updates++;
+
+    const auto clusterCount = static_cast<uint32_t>(clusters.size());
+    std::vector<uint32_t> hits(clusterCount);
+    void* mapped = context.device->mapMemory(*clusterHits.memory, 0, VK_WHOLE_SIZE);
+    std::memcpy(hits.data(), mapped, sizeof(uint32_t) * clusterCount);
+    std::memset(mapped, 0, sizeof(uint32_t) * clusterCount);
+    context.device->unmapMemory(*clusterHits.memory);
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        clusters[i].heat = 0.5f * clusters[i].heat + static_cast<float>(hits[i]);
+        if (hits[i] > 0) clusters[i].lastHit = updates;
+    }
+
+    // Paged out clusters the rays reach, hottest first; eviction candidates least recently hit first
+    std::vector<uint32_t> wanted;
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < clusterCount; i++) {
+        if (!clusters[i].accel && hits[i] > 0) wanted.push_back(i);
+        if (clusters[i].accel) victims.push_back(i);
+    }
+    std::sort(wanted.begin(), wanted.end(), [&](uint32_t a, uint32_t b) { return clusters[a].heat > clusters[b].heat; });
+    std::sort(victims.begin(), victims.end(), [&](uint32_t a, uint32_t b) {
+        return std::tie(clusters[a].lastHit, clusters[a].heat) < std::tie(clusters[b].lastHit, clusters[b].heat);
+    });
+
+    size_t nextVictim = 0;
+    size_t evicted = 0;
+    auto evictUntil = [&](vk::DeviceSize needed, float heat) {
+        while (residentBytes + needed > residencyLimit() && nextVictim < victims.size()) {
+            const ClusterState& victim = clusters[victims[nextVictim]];
+            if (victim.lastHit == updates && victim.heat >= heat) break;
+            retired.push_back(pageOut(victims[nextVictim++]));
+            evicted++;
+        }
+        return residentBytes + needed <= residencyLimit();
+    };
+
+    // The budget can shrink under other processes, give memory back first
+    evictUntil(0, std::numeric_limits<float>::max());
+    int builds = 0;
+    for (uint32_t index : wanted) {
+        if (builds == MaxBuildsPerUpdate || !evictUntil(clusters[index].bytes(), clusters[index].heat) || !pageIn(index)) break;
+        builds++;
+    }
+    return builds > 0 || evicted > 0;
+}
+
+bool GeometryResidency::patchFaces(const std::vector<std::pair<uint32_t, Face>>& changes) {
+    auto same = [](const Face& a, const Face& b) { return std::memcmp(&a, &b, sizeof(Face)) == 0; };
+
+    // A face is the whole material, so the old value of an edited one finds its LOD triangles
+    std::vector<std::pair<Face, Face>> materials;
+    for (const auto& [primitive, face] : changes) {
+        const Face old = faceData[primitive];
+        if (std::none_of(materials.begin(), materials.end(), [&](const auto& material) { return same(material.first, old); })) {
+            materials.emplace_back(old, face);
+        }
+        faceData[primitive] = face;
+    }
+    // Proxies keep their averaged color, they only stand in until the cluster pages in
+    for (uint32_t primitive = scenePrimitiveCount; primitive < proxyPrimitive; primitive++) {
+        for (const auto& [old, face] : materials) {
+            if (same(faceData[primitive], old)) {
+                faceData[primitive] = face;
+                break;
+            }
+        }
+    }
+    faces.upload(context, faceData.data(), sizeof(Face) * faceData.size());
+    return uploadMaterials();
+}
+
+bool GeometryResidency::uploadMaterials() {
+    auto less = [](const Face& a, const Face& b) { return std::memcmp(&a, &b, sizeof(Face)) < 0; };
+    // Uses of each distinct face, then its index in the table
+    std::map<Face, uint32_t, decltype(less)> index(less);
+    for (const Face& face : faceData) index[face]++;
+    std::vector<std::pair<uint32_t, Face>> uses;
+    for (const auto& [face, count] : index) uses.emplace_back(count, face);
+    std::stable_sort(uses.begin(), uses.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<Face> table;
+    for (const auto& [count, face] : uses) {
+        index[face] = static_cast<uint32_t>(table.size());
+        table.push_back(face);
+    }
+    std::vector<uint32_t> primitiveMaterials(faceData.size());
+    for (size_t i = 0; i < faceData.size(); i++) {
+        primitiveMaterials[i] = index[faceData[i]];
+    }
+
+    const vk::DeviceSize bytes = sizeof(Face) * std::max<size_t>(table.size(), 1);
+    const bool grown = !materials.buffer || bytes > materials.descBufferInfo.range;
+    if (grown) {
+        materials = Buffer{context, Buffer::Type::DeviceStorage, bytes};
+    }
+    if (!table.empty()) {
+        materials.upload(context, table.data(), sizeof(Face) * table.size());
+        faceMaterials.upload(context, primitiveMaterials.data(), sizeof(uint32_t) * primitiveMaterials.size());
+    }
+    return grown;
+}
+
+uint32_t GeometryResidency::patchVertices(const std::vector<Vertex>& sceneVertices, const std::vector<uint32_t>& changed,
+                                          const std::vector<uint32_t>& sceneIndices) {
+    std::vector<bool> moved(sceneVertices.size());
+    for (uint32_t vertex : changed) moved[vertex] = true;
+    // One staged copy of the span of the ascending changes, the unchanged ones in it rewrite what they were
+    if (!changed.empty()) {
+        vertices.upload(context, &sceneVertices[changed.front()], sizeof(Vertex) * (changed.back() - changed.front() + 1),
+                        sizeof(Vertex) * changed.front());
+    }
+
+    std::vector<Vertex> box;
+    std::vector<uint32_t> boxTriangles;
+    unitBox(box, boxTriangles);
+    std::vector<std::unique_ptr<Accel>> retired;
+    uint32_t rebuilt = 0;
+    for (uint32_t i = 0; i < clusters.size(); i++) {
+        ClusterState& state = clusters[i];
+        MeshCluster& cluster = state.cluster;
+        bool affected = false;
+        glm::vec3 low(std::numeric_limits<float>::max());
+        glm::vec3 high(std::numeric_limits<float>::lowest());
+        for (uint32_t index = 3 * cluster.firstPrimitive; index < 3 * (cluster.firstPrimitive + cluster.primitiveCount); index++) {
+            const uint32_t vertex = sceneIndices[index];
+            affected = affected || moved[vertex];
+            low = glm::min(low, sceneVertices[vertex].position);
+            high = glm::max(high, sceneVertices[vertex].position);
+        }
+        if (!affected) continue;
+        cluster.boundsMin = low;
+        cluster.boundsMax = high;
+
+        // Serialized BLASes show the old geometry, this cluster's levels are built from now on
+        std::unique_ptr<Accel> old = state.accel ? pageOut(i) : nullptr;
+        if (!serialized.empty()) {
+            for (uint32_t level = 0; level < state.levels.size(); level++) {
+                serialized[i][level].clear();
+                state.levels[level].bytes = buildBytes(state.levels[level]);
+            }
+        }
+        if (old) {
+            retired.push_back(std::move(old));
+            if (pageIn(i)) rebuilt++;
+        }
+
+        if (stream) {
+            const auto [origin, size] = boxPlacement(cluster);
+            std::vector<Vertex> proxy = box;
+            for (Vertex& vertex : proxy) {
+                vertex.position = origin + vertex.position * size;
+            }
+            vertices.upload(context, proxy.data(), sizeof(Vertex) * proxy.size(),
+                              sizeof(Vertex) * (sceneVertexCount + static_cast<vk::DeviceSize>(i) * box.size()));
+        }
+    }
+
+    // Bounds moved, so may the LOD levels
+    lodsPending = levelCount > 1;
+    writeInstances();
+    topAccel->build(context, instanceGeometry, static_cast<uint32_t>(clusters.size()));
+    return rebuilt;
+}
+
+std::string GeometryResidency::report() const {
+    uint64_t traced = 0;
+    uint64_t fullDetail = 0;
+    size_t resident = 0;
+    std::vector<size_t> perLevel(levelCount);
+    for (const ClusterState& state : clusters) {
+        fullDetail += state.levels.front().primitiveCount;
+        if (!state.accel) continue;
+        traced += state.levels[state.level].primitiveCount;
+        perLevel[state.level]++;
+        resident++;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "Geometry: ";
+    if (levelCount > 1) {
+        out << "LOD below " << lodPixels << " px";
+    } else {
+        out << "full detail";
+    }
+    out << ", " << traced << "/" << fullDetail << " triangles in " << resident << "/" << clusters.size() << " clusters resident, "
+        << static_cast<double>(residentBytes) / (1 << 20) << " MB of BLAS";
+    if (stream) {
+        out << " within " << static_cast<double>(residencyLimit()) / (1 << 20) << " MB";
+    }
+    if (levelCount > 1) {
+        out << ", clusters per level";
+        for (size_t level = 0; level < perLevel.size(); level++) {
+            out << (level ? "/" : " ") << perLevel[level];
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "context.h"
+#include "controls.h"
+#include "mesh_clusters.h"
+#include "mesh_lod.h"
+#include "render_settings.h"
+#include "scene_bundle.h"
+#include "scene_data.h"
+
+// The scene's acceleration structures as one TLAS instance per mesh cluster.
+// A resident cluster is traced through its own BLAS; a paged out cluster
+// through a box proxy shaded with the cluster's average diffuse color, so
+// rendering degrades instead of failing when the BLASes exceed device memory.
+//
+// Clusters with an LOD chain (mesh_lod.h) are traced at the level their
+// projected size asks for, only that level's BLAS being built. BLASes of a
+// scene bundle (scene_bundle.h) are deserialized instead of built when the
+// driver accepts them.
+//
+// Vertices, indices and faces stay in shared device local buffers (scene,
+// then the LOD levels, then the proxy boxes), each cluster level a contiguous
+// range of them. The instance custom index selects the range's first primitive
+// from binding 15, and the hit shaders count hits per instance at binding 16
+// (clusters.glsl). update() pages clusters in by those counts and out least
+// recently hit first to stay within the budget.
+class GeometryResidency {
+public:
+    static constexpr uint32_t PrimitivesBinding = 15;
+    static constexpr uint32_t HitsBinding = 16;
+    static constexpr uint32_t MaterialsBinding = 24;
+    static constexpr uint32_t FaceMaterialsBinding = 25;
+    // Frames between residency updates
+    static constexpr int UpdateInterval = 8;
+    // BLAS builds per update, bounds the stall of one update
+    static constexpr int MaxBuildsPerUpdate = 8;
+
+    // clusters come from buildClusters, lods from buildClusterLods or empty for full detail
+    // only, serialized from a scene bundle or empty. Without streaming all clusters stay resident.
+    GeometryResidency(const Context& context, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                      const std::vector<Face>& faces, std::vector<MeshCluster> clusters, const std::vector<std::vector<MeshLod>>& lods,
+                      SerializedAccels serialized, const GeometrySettings& settings, const Controls& camera, uint32_t viewHeight);
+    GeometryResidency(const GeometryResidency&) = delete;
+    GeometryResidency& operator=(const GeometryResidency&) = delete;
+
+    const Accel& topLevel() const { return *topAccel; }
+    const Buffer& vertexBuffer() const { return vertices; }
+    const Buffer& indexBuffer() const { return indices; }
+    const Buffer& faceBuffer() const { return faces; }
+    const Buffer& primitiveBuffer() const { return clusterPrimitives; }
+    const Buffer& hitBuffer() const { return clusterHits; }
+    // The distinct faces of faceBuffer(), most used first, and each primitive's index into them,
+    // so pathtrace.comp keeps the most used materials in shared memory.
+    const Buffer& materialBuffer() const { return materials; }
+    const Buffer& faceMaterialBuffer() const { return faceMaterials; }
+    // Whether the hit shaders should count cluster hits, the COUNT_CLUSTER_HITS specialization.
+    bool streaming() const { return stream; }
+    // Whether the BLASes come from the serialized ones given at construction.
+    bool deserializing() const { return !serialized.empty(); }
+    // Compacted and serialized BLAS of every cluster level for a scene bundle, built one at a time.
+    SerializedAccels serializeAll() const;
+
+    // Call once per frame after its submission finished. Reselects LOD levels when the camera
+    // or view changed, and every UpdateInterval frames reads the hit counts and pages clusters
+    // in and out. Rebuilds the TLAS in place and returns true if any instance changed.
+    bool update(const Controls& camera, uint32_t viewHeight);
+    std::string report() const;
+
+    // Live edits (scene_edit.h), with no frame in flight. patchFaces writes new materials of
+    // scene primitives in place, and of the LOD triangles that copied their old material; returns
+    // true when the material table outgrew its buffer, whose descriptors must then be rewritten.
+    // patchVertices writes the changed vertices and rebuilds the BLAS of every resident
+    // cluster using one, then the TLAS; returns the count of rebuilt BLASes.
+    bool patchFaces(const std::vector<std::pair<uint32_t, Face>>& changes);
+    uint32_t patchVertices(const std::vector<Vertex>& sceneVertices, const std::vector<uint32_t>& changed,
+                           const std::vector<uint32_t>& sceneIndices);
+
+private:
+    struct LodLevel {
+        uint32_t firstPrimitive = 0;
+        uint32_t primitiveCount = 0;
+        vk::DeviceSize bytes = 0;  // BLAS size, known before building
+    };
+
+    struct ClusterState {
+        MeshCluster cluster;
+        std::vector<LodLevel> levels;  // Full detail first
+        uint32_t level = 0;            // Traced while resident, built on page in
+        std::unique_ptr<Accel> accel;  // Null while paged out
+        float heat = 0.0f;             // Decaying hit count
+        int lastHit = -1;              // Update that last saw a hit
+        vk::DeviceSize bytes() const { return levels[level].bytes; }
+    };
+
+    vk::AccelerationStructureGeometryKHR levelGeometry(const LodLevel& level) const;
+    vk::DeviceSize buildBytes(const LodLevel& level) const;
+    vk::DeviceSize residencyLimit() const;
+    // A BLAS of the level if it fits the limit once freed bytes are released, else null
+    std::unique_ptr<Accel> buildLevel(uint32_t index, uint32_t level, vk::DeviceSize freed);
+    bool pageIn(uint32_t index);
+    std::unique_ptr<Accel> pageOut(uint32_t index);
+    uint32_t selectLevel(const ClusterState& state, const Controls& camera, uint32_t viewHeight) const;
+    bool switchLevels(const Controls& camera, uint32_t viewHeight, std::vector<std::unique_ptr<Accel>>& retired);
+    bool updateResidency(std::vector<std::unique_ptr<Accel>>& retired);
+    void writeInstances();
+    // Rebuilds the material table from faceData, true when it needed a larger buffer
+    bool uploadMaterials();
+
+    const Context& context;
+    bool stream;
+    float lodPixels;
+    uint32_t levelCount;  // Rows of the primitive table before the proxies
+    vk::DeviceSize budgetBytes;
+    vk::DeviceSize residentBytes = 0;
+    vk::DeviceSize failedLimit = 0;  // Residency at the last failed allocation, caps the limit after it
+    uint32_t vertexCount = 0;
+    uint32_t sceneVertexCount = 0;     // Proxy box vertices follow
+    uint32_t scenePrimitiveCount = 0;  // LOD levels follow, then proxyPrimitive
+    uint32_t proxyPrimitive = 0;
+    int updates = 0;
+    int frames = 0;
+
+    // View of the last LOD selection; lodsPending while switches wait for the build cap
+    glm::vec3 lodCameraPosition = glm::vec3(0.0f);
+    float lodFov = 0.0f;
+    uint32_t lodViewHeight = 0;
+    bool lodsPending = false;
+
+    std::vector<ClusterState> clusters;
+    SerializedAccels serialized;  // Empty unless compatible with the device
+    Buffer vertices;
+    Buffer indices;
+    Buffer faces;
+    std::vector<Face> faceData;  // What faces holds, for the edits
+    Buffer materials;
+    Buffer faceMaterials;
+    Buffer clusterPrimitives;
+    Buffer clusterHits;
+
+    Buffer boxVertices;
+    Buffer boxIndices;
+    std::unique_ptr<Accel> boxAccel;
+
+    Buffer instances;
+    vk::AccelerationStructureGeometryKHR instanceGeometry;
+    std::unique_ptr<Accel> topAccel;
+};
@@ -0,0 +1,278 @@
+#include "guiding_tree.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <queue>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+constexpr float Pi = 3.14159265358979323846f;
+constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
+double quadTotal(const std::array<double, 4>& energy) { return energy[0] + energy[1] + energy[2] + energy[3]; }
+
+float quadTotal(const GuidingTree::QuadNode& node) { return node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3]; }
+
+}  // namespace
+
+GuidingTree::GuidingTree(glm::vec3 boundsMin, glm::vec3 boundsMax, uint32_t maxSpatialNodes, uint32_t maxQuadNodes)
+    : maxSpatial(std::max(maxSpatialNodes, 1u)), maxQuads(std::max(maxQuadNodes, std::max(maxSpatialNodes, 1u))) {
+    // Padded so flat scenes still split and vertices on the bounds fall inside
+    const glm::vec3 pad = 1e-3f * (boundsMax - boundsMin) + glm::vec3(1e-4f);
+    this->boundsMin = boundsMin - pad;
+    this->boundsMax = boundsMax + pad;
+    records = std::vector<std::atomic<uint64_t>>(maxRecordWords() / 2);
+    reset();
+}
+
+void GuidingTree::reset() {
+    spatial.assign(1, SpatialNode{});
+    lower.assign(1, boundsMin);
+    upper.assign(1, boundsMax);
+    spatial[0].split = 0.5f * (boundsMin.x + boundsMax.x);
+    quads.assign(1, QuadNode{});
+    iterations = 0;
+    for (auto& record : records) record.store(0, std::memory_order_relaxed);
+}
+
+glm::vec2 GuidingTree::toSquare(glm::vec3 direction) {
+    const float cosTheta = std::clamp(direction.z, -1.0f, 1.0f);
+    float phi = std::atan2(direction.y, direction.x) / (2.0f * Pi);
+    if (phi < 0.0f) phi += 1.0f;
+    return glm::clamp(glm::vec2(0.5f * (cosTheta + 1.0f), phi), glm::vec2(0.0f), glm::vec2(OneMinusEpsilon));
+}
+
+glm::vec3 GuidingTree::toDirection(glm::vec2 square) {
+    const float cosTheta = 2.0f * square.x - 1.0f;
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * Pi * square.y;
+    return {sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta};
+}
+
+uint32_t GuidingTree::leafAt(glm::vec3 position) const {
+    uint32_t node = 0;
+    while (spatial[node].child != 0) {
+        const SpatialNode& current = spatial[node];
+        node = current.child + (position[current.axis] >= current.split ? 1 : 0);
+    }
+    return node;
+}
+
+bool GuidingTree::trained(uint32_t leaf) const { return quadTotal(quads[spatial[leaf].quadtree]) > 0.0f; }
+
+glm::vec3 GuidingTree::sample(uint32_t leaf, glm::vec2 u, float& pdf) const {
+    uint32_t node = spatial[leaf].quadtree;
+    glm::vec2 origin(0.0f);
+    float size = 1.0f;
+    float density = 1.0f;  // Over the unit square
+    while (true) {
+        const QuadNode& current = quads[node];
+        const float total = quadTotal(current);
+        if (total <= 0.0f) break;
+        // Column by the energy of its two quadrants, then the row within it, reusing u
+        const float left = (current.energy[0] + current.energy[2]) / total;
+        int x = 0;
+        if (u.x < left) {
+            u.x /= left;
+        } else {
+            x = 1;
+            u.x = (u.x - left) / (1.0f - left);
+        }
+        const float bottom = current.energy[x] / (current.energy[x] + current.energy[x + 2]);
+        int y = 0;
+        if (u.y < bottom) {
+            u.y /= bottom;
+        } else {
+            y = 1;
+            u.y = (u.y - bottom) / (1.0f - bottom);
+        }
+        u = glm::min(u, glm::vec2(OneMinusEpsilon));
+        const int quadrant = x + 2 * y;
+        density *= 4.0f * current.energy[quadrant] / total;
+        size *= 0.5f;
+        origin += glm::vec2(x, y) * size;
+        if (current.child[quadrant] == 0) break;
+        node = current.child[quadrant];
+    }
+    pdf = density / (4.0f * Pi);
+    return toDirection(origin + u * size);
+}
+
+float GuidingTree::pdf(uint32_t leaf, glm::vec3 direction) const {
+    glm::vec2 p = toSquare(direction);
+    uint32_t node = spatial[leaf].quadtree;
+    float density = 1.0f;
+    while (true) {
+        const QuadNode& current = quads[node];
+        const float total = quadTotal(current);
+        if (total <= 0.0f) break;
+        const int x = p.x >= 0.5f ? 1 : 0;
+        const int y = p.y >= 0.5f ? 1 : 0;
+        const int quadrant = x + 2 * y;
+        density *= 4.0f * current.energy[quadrant] / total;
+        p = 2.0f * p - glm::vec2(x, y);
+        if (current.child[quadrant] == 0) break;
+        node = current.child[quadrant];
+    }
+    return density / (4.0f * Pi);
+}
+
+uint32_t GuidingTree::slot(uint32_t leaf, glm::vec3 direction) const {
+    glm::vec2 p = toSquare(direction);
+    uint32_t node = spatial[leaf].quadtree;
+    while (true) {
+        const int x = p.x >= 0.5f ? 1 : 0;
+        const int y = p.y >= 0.5f ? 1 : 0;
+        const int quadrant = x + 2 * y;
+        if (quads[node].child[quadrant] == 0) return 4 * node + quadrant;
+        p = 2.0f * p - glm::vec2(x, y);
+        node = quads[node].child[quadrant];
+    }
+}
+
+void GuidingTree::record(uint32_t leaf, uint32_t slot, float value) {
+    records[leaf].fetch_add(1, std::memory_order_relaxed);
+    const float clamped = value > 0.0f ? std::min(value, MaxRecord) : 0.0f;
+    records[spatial.size() + slot].fetch_add(static_cast<uint64_t>(clamped * FixedPoint), std::memory_order_relaxed);
+}
+
+void GuidingTree::addRecords(const uint32_t* words) {
+    for (size_t i = 0; i < recordWords() / 2; i++) {
+        const uint64_t value = words[2 * i] | static_cast<uint64_t>(words[2 * i + 1]) << 32;
+        if (value != 0) records[i].fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+void GuidingTree::splitLeaves(const std::vector<double>& samples) {
+    const double threshold = SpatialThreshold * std::sqrt(std::pow(2.0, iterations));
+    // Busiest leaves first, so a full tree refines where the samples are
+    std::priority_queue<std::pair<double, uint32_t>> pending;
+    for (uint32_t i = 0; i < samples.size(); i++) {
+        if (spatial[i].child == 0 && samples[i] > threshold) pending.emplace(samples[i], i);
+    }
+    while (!pending.empty() && spatial.size() + 2 <= maxSpatial) {
+        const auto [count, leaf] = pending.top();
+        pending.pop();
+        const auto first = static_cast<uint32_t>(spatial.size());
+        const uint32_t axis = spatial[leaf].axis;
+        const uint32_t childAxis = (axis + 1) % 3;
+        for (int side = 0; side < 2; side++) {
+            glm::vec3 low = lower[leaf];
+            glm::vec3 high = upper[leaf];
+            (side == 0 ? high : low)[axis] = spatial[leaf].split;
+            SpatialNode child;
+            child.axis = childAxis;
+            child.split = 0.5f * (low[childAxis] + high[childAxis]);
+            child.quadtree = spatial[leaf].quadtree;  // Both start from the parent's distribution
+            spatial.push_back(child);
+            lower.push_back(low);
+            upper.push_back(high);
+            if (count / 2.0 > threshold) pending.emplace(count / 2.0, first + side);
+        }
+        spatial[leaf].child = first;
+    }
+}
+
+void GuidingTree::rebuildQuad(uint32_t node, uint32_t oldNode, const std::array<double, 4>& energy, double total, int depth,
+                              const std::vector<std::array<double, 4>>& recorded, std::vector<QuadNode>& out) const {
+    for (int quadrant = 0; quadrant < 4; quadrant++) {
+        out[node].energy[quadrant] = static_cast<float>(energy[quadrant]);
+        // Below the fraction a quadrant stays a leaf, merging whatever was below it
+        if (energy[quadrant] <= SubdivideFraction * total || depth >= MaxQuadtreeDepth || out.size() >= maxQuads) continue;
+        const auto child = static_cast<uint32_t>(out.size());
+        out.emplace_back();
+        out[node].child[quadrant] = child;
+        const uint32_t oldChild = oldNode != NoNode && quads[oldNode].child[quadrant] != 0 ? quads[oldNode].child[quadrant] : NoNode;
+        const double quarter = energy[quadrant] / 4.0;
+        const std::array<double, 4> childEnergy = oldChild != NoNode ? recorded[oldChild] : std::array<double, 4>{quarter, quarter, quarter, quarter};
+        rebuildQuad(child, oldChild, childEnergy, total, depth + 1, recorded, out);
+    }
+}
+
+void GuidingTree::refine() {
+    const size_t oldSpatialCount = spatial.size();
+    std::vector<double> samples(oldSpatialCount);
+    for (size_t i = 0; i < oldSpatialCount; i++) samples[i] = static_cast<double>(records[i].load(std::memory_order_relaxed));
+
+    // Recorded energy of every quadrant of the old trees, interior ones summing their children.
+    // Children always follow their parents.
+    std::vector<std::array<double, 4>> recorded(quads.size());
+    for (size_t node = quads.size(); node-- > 0;) {
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            const uint32_t child = quads[node].child[quadrant];
+            recorded[node][quadrant] = child != 0 ? quadTotal(recorded[child])
+                                                  : static_cast<double>(records[oldSpatialCount + 4 * node + quadrant].load(
+                                                        std::memory_order_relaxed)) / FixedPoint;
+        }
+    }
+
+    splitLeaves(samples);
+
+    // A quadtree that recorded nothing, say behind a wall no path reached, keeps its distribution
+    std::vector<char> kept(quads.size(), 0);
+    for (const SpatialNode& node : spatial) {
+        if (node.child != 0 || quadTotal(recorded[node.quadtree]) > 0.0 || kept[node.quadtree]) continue;
+        std::vector<uint32_t> stack{node.quadtree};
+        while (!stack.empty()) {
+            const uint32_t current = stack.back();
+            stack.pop_back();
+            kept[current] = 1;
+            for (int quadrant = 0; quadrant < 4; quadrant++) {
+                recorded[current][quadrant] = quads[current].energy[quadrant];
+                if (quads[current].child[quadrant] != 0) stack.push_back(quads[current].child[quadrant]);
+            }
+        }
+    }
+
+    // Roots first, one per leaf, then the subdivisions of each leaf in turn
+    std::vector<QuadNode> rebuilt;
+    std::vector<std::pair<uint32_t, uint32_t>> roots;  // Spatial leaf, old root
+    for (uint32_t i = 0; i < spatial.size(); i++) {
+        if (spatial[i].child != 0) {
+            spatial[i].quadtree = 0;
+            continue;
+        }
+        roots.emplace_back(i, spatial[i].quadtree);
+        spatial[i].quadtree = static_cast<uint32_t>(rebuilt.size());
+        rebuilt.emplace_back();
+    }
+    for (const auto& [leaf, oldRoot] : roots) {
+        rebuildQuad(spatial[leaf].quadtree, oldRoot, recorded[oldRoot], quadTotal(recorded[oldRoot]), 1, recorded, rebuilt);
+    }
+    quads = std::move(rebuilt);
+
+    iterations++;
+    for (auto& record : records) record.store(0, std::memory_order_relaxed);
+}
+
+std::vector<glm::uvec4> GuidingTree::pack(bool recording, float bsdfFraction) const {
+    std::vector<glm::uvec4> packed;
+    packed.reserve(1 + spatial.size() + 2 * quads.size());
+    packed.emplace_back(static_cast<uint32_t>(spatial.size()), recording ? 1u : 0u, std::bit_cast<uint32_t>(bsdfFraction), 0u);
+    for (const SpatialNode& node : spatial) {
+        packed.emplace_back(node.child, node.axis, std::bit_cast<uint32_t>(node.split), node.quadtree);
+    }
+    for (const QuadNode& node : quads) {
+        packed.emplace_back(std::bit_cast<uint32_t>(node.energy[0]), std::bit_cast<uint32_t>(node.energy[1]),
+                            std::bit_cast<uint32_t>(node.energy[2]), std::bit_cast<uint32_t>(node.energy[3]));
+        packed.emplace_back(node.child[0], node.child[1], node.child[2], node.child[3]);
+    }
+    return packed;
+}
+
+std::string GuidingTree::report() const {
+    size_t leaves = 0;
+    size_t trainedLeaves = 0;
+    for (uint32_t i = 0; i < spatial.size(); i++) {
+        if (spatial[i].child != 0) continue;
+        leaves++;
+        if (trained(i)) trainedLeaves++;
+    }
+    std::ostringstream out;
+    out << "iteration " << iterations << ", " << leaves << " spatial leaves (" << trainedLeaves << " trained), " << quads.size()
+        << " quadtree nodes";
+    return out.str();
+}
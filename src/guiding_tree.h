@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// The spatial-directional tree of path guiding (Muller et al. 2017, "Practical
+// Path Guiding for Efficient Light-Transport Simulation"), mirrored by
+// shaders/guiding.glsl and used as is by the CPU tracer.
+//
+// A binary tree halves the scene bounds along x, y and z in turn. Every leaf
+// has a quadtree over the directions in the equal-area cylindrical mapping
+// (cos theta, phi) of world space, each node holding the energy of its four
+// quadrants. Directions are drawn by descending the quadtree with probability
+// proportional to energy, uniformly within the quadrant it ends in.
+//
+// Paths record the luminance of the radiance found behind each diffuse or
+// glossy vertex, times the BSDF and cosine there and over the density of the
+// direction taken, into the quadrant of that direction. The guide so learns the
+// product of the light and the lobe rather than the light alone, which would
+// spend samples on directions the BSDF all but cancels. refine() then splits spatial leaves that saw more samples
+// than the iteration allows, subdivides quadrants holding more than
+// SubdivideFraction of their quadtree's energy and merges the rest, and makes
+// the recorded energy the distribution sampled next.
+class GuidingTree {
+public:
+    static constexpr int MaxQuadtreeDepth = 20;
+    static constexpr double SubdivideFraction = 0.01;
+    // Samples a spatial leaf may see at iteration 0 before it splits, times sqrt(2^iteration) after
+    static constexpr double SpatialThreshold = 12000.0;
+    // Records are 64-bit fixed point sums, each one clamped to fit 32 bits
+    static constexpr float FixedPoint = 65536.0f;
+    static constexpr float MaxRecord = 65535.0f;
+
+    struct SpatialNode {
+        uint32_t child = 0;  // First of two, 0 for a leaf
+        uint32_t axis = 0;   // Split by the node or, for a leaf, by its children once it splits
+        float split = 0.0f;
+        uint32_t quadtree = 0;  // Root of a leaf's quadtree
+    };
+    struct QuadNode {
+        float energy[4] = {};    // Quadrants (0,0), (1,0), (0,1), (1,1) of the node's square
+        uint32_t child[4] = {};  // 0 for a quadrant without children
+    };
+
+    // maxQuadNodes is raised to hold a root for every spatial node
+    GuidingTree(glm::vec3 boundsMin, glm::vec3 boundsMax, uint32_t maxSpatialNodes, uint32_t maxQuadNodes);
+
+    uint32_t leafAt(glm::vec3 position) const;
+    // Whether the leaf's quadtree has energy to sample from
+    bool trained(uint32_t leaf) const;
+    // Direction for a uniform sample u and its solid angle density.
+    glm::vec3 sample(uint32_t leaf, glm::vec2 u, float& pdf) const;
+    // Solid angle density of sample() producing the direction.
+    float pdf(uint32_t leaf, glm::vec3 direction) const;
+    // Quadrant the direction falls into, 4 * node + quadrant, for record().
+    uint32_t slot(uint32_t leaf, glm::vec3 direction) const;
+
+    // Thread safe. value is the luminance found times the BSDF and cosine, over the density of the direction.
+    void record(uint32_t leaf, uint32_t slot, float value);
+    // Adds the record buffer of guiding.glsl, recordWords() words: a 64-bit (low, high) sample
+    // count per spatial node, then a 64-bit fixed point energy per quadrant.
+    void addRecords(const uint32_t* words);
+    size_t recordWords() const { return 2 * (spatial.size() + 4 * quads.size()); }
+
+    // Builds the next iteration's tree from the records and clears them.
+    void refine();
+    // Clears the trees and the records, back to a single untrained leaf.
+    void reset();
+    int iteration() const { return iterations; }
+
+    // Contents of the GuidingTree block of guiding.glsl: its header, the spatial nodes, then two uvec4 per quadtree node.
+    std::vector<glm::uvec4> pack(bool recording, float bsdfFraction) const;
+    // Capacity of pack() and recordWords(), for sizing the buffers once.
+    size_t maxPackedNodes() const { return 1 + maxSpatial + 2 * static_cast<size_t>(maxQuads); }
+    size_t maxRecordWords() const { return 2 * (maxSpatial + 4 * static_cast<size_t>(maxQuads)); }
+    std::string report() const;
+
+private:
+    // Equal-area mapping between the unit square and the sphere of directions
+    static glm::vec2 toSquare(glm::vec3 direction);
+    static glm::vec3 toDirection(glm::vec2 square);
+
+    void splitLeaves(const std::vector<double>& samples);
+    // Fills the allocated node of out from the energies of its quadrants; oldNode is the node of
+    // old they were recorded into, NoNode for a new one whose energies are its parent's quarters
+    void rebuildQuad(uint32_t node, uint32_t oldNode, const std::array<double, 4>& energy, double total, int depth,
+                     const std::vector<std::array<double, 4>>& recorded, std::vector<QuadNode>& out) const;
+
+    static constexpr uint32_t NoNode = ~0u;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    uint32_t maxSpatial;
+    uint32_t maxQuads;
+    int iterations = 0;
+    std::vector<SpatialNode> spatial;
+    std::vector<glm::vec3> lower;  // Box of every spatial node
+    std::vector<glm::vec3> upper;
+    std::vector<QuadNode> quads;
+    std::vector<std::atomic<uint64_t>> records;  // maxRecordWords() / 2, laid out as in recordWords()
+};
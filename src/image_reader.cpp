@@ -0,0 +1,336 @@
+#include "image_reader.h"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data, const std::string& path) : data(data), path(path) {}
+
+    uint8_t u8() {
+        require(1);
+        return data[offset++];
+    }
+    uint16_t u16() {
+        const uint16_t low = u8();
+        return static_cast<uint16_t>(low | (u8() << 8));
+    }
+    uint32_t u32() {
+        const uint32_t low = u16();
+        return low | (static_cast<uint32_t>(u16()) << 16);
+    }
+    void skip(size_t count) {
+        require(count);
+        offset += count;
+    }
+    void seek(size_t position) {
+        if (position > data.size()) fail("truncated file");
+        offset = position;
+    }
+
+    // Whitespace separated decimal of a PNM header, skipping # comments
+    int number() {
+        while (true) {
+            require(1);
+            if (data[offset] == '#') {
+                while (offset < data.size() && data[offset] != '\n') offset++;
+            } else if (std::isspace(data[offset])) {
+                offset++;
+            } else {
+                break;
+            }
+        }
+        if (!std::isdigit(data[offset])) fail("malformed header");
+        int value = 0;
+        while (offset < data.size() && std::isdigit(data[offset])) {
+            value = value * 10 + (data[offset++] - '0');
+        }
+        return value;
+    }
+
+    // Up to the next newline, which is consumed
+    std::string line() {
+        std::string text;
+        while (true) {
+            const char c = static_cast<char>(u8());
+            if (c == '\n') return text;
+            text += c;
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& reason) const { throw std::runtime_error(path + ": " + reason); }
+
+private:
+    void require(size_t count) const {
+        if (offset + count > data.size()) fail("truncated file");
+    }
+
+    const std::vector<uint8_t>& data;
+    const std::string& path;
+    size_t offset = 0;
+};
+
+void checkSize(Reader& reader, int width, int height) {
+    if (width <= 0 || height <= 0 || width > 32768 || height > 32768) reader.fail("invalid image size");
+}
+
+DecodedImage readPnm(Reader& reader, char type) {
+    const bool gray = type == '2' || type == '5';
+    const bool ascii = type == '2' || type == '3';
+    DecodedImage image;
+    image.width = reader.number();
+    image.height = reader.number();
+    checkSize(reader, image.width, image.height);
+    const int maxValue = reader.number();
+    if (maxValue <= 0 || maxValue > 65535) reader.fail("invalid maximum value");
+    if (!ascii) reader.skip(1);  // Single whitespace before the raster
+
+    auto channel = [&] {
+        int value;
+        if (ascii) {
+            value = reader.number();
+        } else if (maxValue > 255) {
+            value = reader.u8() << 8;
+            value |= reader.u8();
+        } else {
+            value = reader.u8();
+        }
+        return static_cast<uint8_t>(std::min(value, maxValue) * 255 / maxValue);
+    };
+    image.rgba.resize(static_cast<size_t>(image.width) * image.height * 4);
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+        image.rgba[i + 0] = channel();
+        image.rgba[i + 1] = gray ? image.rgba[i] : channel();
+        image.rgba[i + 2] = gray ? image.rgba[i] : channel();
+        image.rgba[i + 3] = 255;
+    }
+    return image;
+}
+
+DecodedImage readTga(Reader& reader) {
+    const uint8_t idLength = reader.u8();
+    const uint8_t colorMapType = reader.u8();
+    const uint8_t imageType = reader.u8();
+    reader.skip(9);  // Color map specification and origin
+    DecodedImage image;
+    image.width = reader.u16();
+    image.height = reader.u16();
+    const uint8_t bitsPerPixel = reader.u8();
+    const uint8_t descriptor = reader.u8();
+    checkSize(reader, image.width, image.height);
+
+    const bool rle = imageType == 10 || imageType == 11;
+    const bool gray = imageType == 3 || imageType == 11;
+    if (colorMapType != 0 || (imageType != 2 && imageType != 3 && !rle)) reader.fail("unsupported TGA type");
+    if (gray ? bitsPerPixel != 8 : (bitsPerPixel != 24 && bitsPerPixel != 32)) reader.fail("unsupported TGA depth");
+    reader.skip(idLength);
+
+    // Pixels are stored BGR(A), bottom row first unless bit 5 of the descriptor is set
+    const size_t count = static_cast<size_t>(image.width) * image.height;
+    std::vector<uint8_t> pixels(count * 4);
+    auto readPixel = [&](uint8_t* out) {
+        if (gray) {
+            out[0] = out[1] = out[2] = reader.u8();
+            out[3] = 255;
+            return;
+        }
+        out[2] = reader.u8();
+        out[1] = reader.u8();
+        out[0] = reader.u8();
+        out[3] = bitsPerPixel == 32 ? reader.u8() : 255;
+    };
+    for (size_t i = 0; i < count;) {
+        if (!rle) {
+            readPixel(&pixels[4 * i++]);
+            continue;
+        }
+        const uint8_t header = reader.u8();
+        const size_t run = std::min<size_t>((header & 0x7f) + 1, count - i);
+        if (header & 0x80) {
+            readPixel(&pixels[4 * i]);
+            for (size_t k = 1; k < run; k++) {
+                std::copy_n(&pixels[4 * i], 4, &pixels[4 * (i + k)]);
+            }
+        } else {
+            for (size_t k = 0; k < run; k++) {
+                readPixel(&pixels[4 * (i + k)]);
+            }
+        }
+        i += run;
+    }
+
+    const bool topFirst = descriptor & 0x20;
+    const size_t rowBytes = static_cast<size_t>(image.width) * 4;
+    image.rgba.resize(pixels.size());
+    for (int y = 0; y < image.height; y++) {
+        const int source = topFirst ? y : image.height - 1 - y;
+        std::copy_n(&pixels[source * rowBytes], rowBytes, &image.rgba[y * rowBytes]);
+    }
+    return image;
+}
+
+DecodedImage readBmp(Reader& reader) {
+    reader.skip(10);
+    const uint32_t pixelOffset = reader.u32();
+    const uint32_t headerSize = reader.u32();
+    if (headerSize < 40) reader.fail("unsupported BMP header");
+    DecodedImage image;
+    image.width = static_cast<int32_t>(reader.u32());
+    const int32_t height = static_cast<int32_t>(reader.u32());
+    reader.skip(2);  // Planes
+    const uint16_t bitsPerPixel = reader.u16();
+    const uint32_t compression = reader.u32();
+    image.height = height < 0 ? -height : height;
+    checkSize(reader, image.width, image.height);
+    // Bitfields of a 32 bit image are assumed to be the usual BGRA layout
+    if ((bitsPerPixel != 24 && bitsPerPixel != 32) || (compression != 0 && compression != 3)) reader.fail("unsupported BMP encoding");
+
+    // Rows are padded to 4 bytes and stored bottom up unless the height is negative
+    const size_t stride = (static_cast<size_t>(image.width) * bitsPerPixel / 8 + 3) & ~size_t(3);
+    image.rgba.resize(static_cast<size_t>(image.width) * image.height * 4);
+    for (int y = 0; y < image.height; y++) {
+        const int row = height < 0 ? y : image.height - 1 - y;
+        reader.seek(pixelOffset + row * stride);
+        uint8_t* out = &image.rgba[static_cast<size_t>(y) * image.width * 4];
+        for (int x = 0; x < image.width; x++, out += 4) {
+            out[2] = reader.u8();
+            out[1] = reader.u8();
+            out[0] = reader.u8();
+            out[3] = bitsPerPixel == 32 ? reader.u8() : 255;
+        }
+    }
+    return image;
+}
+
+HdrImage readRadiance(Reader& reader) {
+    // Header lines up to a blank one, then the resolution string
+    bool rgbe = true;
+    while (true) {
+        const std::string line = reader.line();
+        if (line.empty()) break;
+        if (line.rfind("FORMAT=", 0) == 0) rgbe = line == "FORMAT=32-bit_rle_rgbe";
+    }
+    if (!rgbe) reader.fail("unsupported Radiance format");
+    HdrImage image;
+    char sign[2][3];
+    if (std::sscanf(reader.line().c_str(), "%2s %d %2s %d", sign[0], &image.height, sign[1], &image.width) != 4 ||
+        std::strcmp(sign[0], "-Y") != 0 || std::strcmp(sign[1], "+X") != 0) {
+        reader.fail("unsupported Radiance orientation");
+    }
+    checkSize(reader, image.width, image.height);
+
+    // New style run-length encoded scanlines hold each component separately,
+    // anything else is flat RGBE
+    const size_t width = image.width;
+    std::vector<uint8_t> scanline(width * 4);
+    image.rgb.resize(width * image.height * 3);
+    for (int y = 0; y < image.height; y++) {
+        const uint8_t first[4] = {reader.u8(), reader.u8(), reader.u8(), reader.u8()};
+        if (width >= 8 && width < 32768 && first[0] == 2 && first[1] == 2 && ((first[2] << 8) | first[3]) == image.width) {
+            for (int component = 0; component < 4; component++) {
+                for (size_t x = 0; x < width;) {
+                    size_t run = reader.u8();
+                    const bool repeat = run > 128;
+                    if (repeat) run -= 128;
+                    if (run == 0 || x + run > width) reader.fail("corrupt run-length encoding");
+                    const uint8_t value = repeat ? reader.u8() : 0;
+                    for (size_t k = 0; k < run; k++, x++) {
+                        scanline[x * 4 + component] = repeat ? value : reader.u8();
+                    }
+                }
+            }
+        } else {
+            std::copy_n(first, 4, scanline.begin());
+            for (size_t i = 4; i < scanline.size(); i++) scanline[i] = reader.u8();
+        }
+        for (size_t x = 0; x < width; x++) {
+            const uint8_t* texel = &scanline[x * 4];
+            const float scale = texel[3] ? std::ldexp(1.0f, texel[3] - 136) : 0.0f;
+            for (int c = 0; c < 3; c++) {
+                image.rgb[(y * width + x) * 3 + c] = (texel[c] + 0.5f) * scale;
+            }
+        }
+    }
+    return image;
+}
+
+HdrImage readPfm(Reader& reader, bool color) {
+    HdrImage image;
+    image.width = reader.number();
+    image.height = reader.number();
+    checkSize(reader, image.width, image.height);
+    reader.line();  // Rest of the size line
+    // The sign of the scale gives the byte order, negative for little endian, which u32 reads
+    const bool swap = std::stof(reader.line()) > 0.0f;
+
+    // Rows are stored bottom up
+    const size_t width = image.width;
+    image.rgb.resize(width * image.height * 3);
+    for (int row = image.height - 1; row >= 0; row--) {
+        for (size_t x = 0; x < width; x++) {
+            float* out = &image.rgb[(row * width + x) * 3];
+            for (int c = 0; c < (color ? 3 : 1); c++) {
+                uint32_t bits = reader.u32();
+                if (swap) bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+                out[c] = std::bit_cast<float>(bits);
+            }
+            if (!color) out[1] = out[2] = out[0];
+        }
+    }
+    return image;
+}
+
+}  // namespace
+
+DecodedImage readImage(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + path);
+    }
+    const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    Reader reader{data, path};
+
+    if (data.size() >= 2 && data[0] == 'P' && data[1] >= '2' && data[1] <= '6' && data[1] != '4') {
+        reader.skip(2);
+        return readPnm(reader, static_cast<char>(data[1]));
+    }
+    if (data.size() >= 2 && data[0] == 'B' && data[1] == 'M') {
+        return readBmp(reader);
+    }
+    // TGA has no signature, go by the extension
+    if (path.size() > 4) {
+        std::string ext = path.substr(path.size() - 4);
+        for (char& c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (ext == ".tga") {
+            return readTga(reader);
+        }
+    }
+    reader.fail("unsupported image format");
+}
+
+HdrImage readHdrImage(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + path);
+    }
+    const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    Reader reader{data, path};
+
+    if (data.size() >= 2 && data[0] == '#' && data[1] == '?') {
+        return readRadiance(reader);
+    }
+    if (data.size() >= 2 && data[0] == 'P' && (data[1] == 'F' || data[1] == 'f')) {
+        reader.skip(2);
+        return readPfm(reader, data[1] == 'F');
+    }
+    reader.fail("unsupported HDR image format");
+}
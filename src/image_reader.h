@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 8-bit image decoded to RGBA, top row first.
+struct DecodedImage {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> rgba;
+};
+
+// Linear RGB floats, top row first.
+struct HdrImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> rgb;
+};
+
+// Decoders for the uncompressed formats MTL texture maps commonly use:
+// binary and ASCII PNM (.ppm, .pgm), TGA (raw and RLE) and BMP (24 and
+// 32 bit). The format is picked from the file header. Throws
+// std::runtime_error on unreadable or unsupported files.
+DecodedImage readImage(const std::string& path);
+// Radiance RGBE (.hdr, flat or run-length encoded, -Y +X orientation only) and
+// PFM (.pfm, color or grayscale, either byte order). Throws like readImage.
+HdrImage readHdrImage(const std::string& path);
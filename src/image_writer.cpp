@@ -0,0 +1,251 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "wavelet_denoise.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../external/stb/stb_image_write.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+
+void toRgba8(const float* pixels, size_t count, std::vector<unsigned char>& out) {
+    out.resize(count * 4);
+    for (size_t i = 0; i < count * 4; i++) {
+        out[i] = static_cast<unsigned char>(std::lround(std::clamp(pixels[i], 0.0f, 1.0f) * 255.0f));
+    }
+}
+
+std::string extensionOf(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos) return {};
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+}
+
+template <typename T>
+void put(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void putAttribute(std::ofstream& out, const char* name, const char* type, int32_t size) {
+    out.write(name, static_cast<std::streamsize>(std::strlen(name) + 1));
+    out.write(type, static_cast<std::streamsize>(std::strlen(type) + 1));
+    put(out, size);
+}
+
+}  // namespace
+
+ImageWriter::ImageWriter(size_t capacity) : capacity(std::max<size_t>(1, capacity)), worker([this] { run(); }) {}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    worker.join();
+    if (pipe) {
+        pclose(pipe);
+    }
+}
+
+bool ImageWriter::tryPush(OutputFrame frame) {
+    {
+        std::lock_guard lock(mutex);
+        if (queue.size() < capacity) {
+            queue.push_back(std::move(frame));
+            queueChanged.notify_all();
+            return true;
+        }
+        dropped++;
+    }
+    if (frame.release) frame.release();
+    return false;
+}
+
+void ImageWriter::push(OutputFrame frame) {
+    std::unique_lock lock(mutex);
+    queueChanged.wait(lock, [this] { return queue.size() < capacity; });
+    queue.push_back(std::move(frame));
+    queueChanged.notify_all();
+}
+
+void ImageWriter::flush() {
+    std::unique_lock lock(mutex);
+    queueChanged.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+bool ImageWriter::openPipe(const std::string& command) {
+#ifdef _WIN32
+    pipe = popen(command.c_str(), "wb");
+#else
+    pipe = popen(command.c_str(), "w");
+#endif
+    if (!pipe) {
+        std::cerr << "Failed to open output pipe: " << command << std::endl;
+    }
+    return pipe != nullptr;
+}
+
+void ImageWriter::run() {
+    while (true) {
+        OutputFrame frame;
+        {
+            std::unique_lock lock(mutex);
+            queueChanged.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            frame = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+        }
+        queueChanged.notify_all();
+
+        write(frame);
+        if (frame.release) frame.release();
+
+        {
+            std::lock_guard lock(mutex);
+            busy = false;
+        }
+        queueChanged.notify_all();
+    }
+}
+
+void ImageWriter::write(const OutputFrame& frame) {
+    if (frame.consume) {
+        frame.consume(frame);
+    }
+    if (frame.toPipe && pipe) {
+        std::vector<unsigned char> rgba;
+        toRgba8(frame.pixels, static_cast<size_t>(frame.width) * frame.height, rgba);
+        fwrite(rgba.data(), 1, rgba.size(), pipe);
+        fflush(pipe);
+    }
+    if (frame.path.empty()) return;
+
+    const std::string ext = extensionOf(frame.path);
+    bool written;
+    if (ext == ".pfm") {
+        written = writePfm(frame.path, frame.pixels, frame.width, frame.height);
+    } else if (ext == ".exr") {
+        written = writeExr(frame.path, frame.pixels, frame.width, frame.height);
+    } else {
+        written = writePng(frame.path, frame.pixels, frame.width, frame.height, frame.denoise);
+    }
+    if (written) {
+        std::cout << "Image dumped to " << frame.path << std::endl;
+    } else {
+        std::cerr << "Failed to write " << frame.path << std::endl;
+    }
+}
+
+std::string ImageWriter::formatPath(const std::string& pattern, int index) {
+    if (pattern.find('%') == std::string::npos) return pattern;
+    std::vector<char> buffer(pattern.size() + 32);
+    std::snprintf(buffer.data(), buffer.size(), pattern.c_str(), index);
+    return buffer.data();
+}
+
+bool ImageWriter::writePng(const std::string& path, const float* pixels, int width, int height, bool denoise) {
+    std::vector<unsigned char> rgba;
+    toRgba8(pixels, static_cast<size_t>(width) * height, rgba);
+    if (denoise) {
+        waveletDenoiseImage(rgba.data(), width, height, 4, 5.0f);
+    }
+    return stbi_write_png(path.c_str(), width, height, 4, rgba.data(), width * 4) != 0;
+}
+
+// Portable float map: RGB, little endian (negative scale), bottom row first.
+bool ImageWriter::writePfm(const std::string& path, const float* pixels, int width, int height) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out << "PF\n" << width << " " << height << "\n-1.0\n";
+    std::vector<float> row(static_cast<size_t>(width) * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        const float* src = pixels + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+    return static_cast<bool>(out);
+}
+
+// Uncompressed scanline OpenEXR with 32-bit float B, G, R channels. The GPU
+// stores history length in alpha, so it is not written.
+bool ImageWriter::writeExr(const std::string& path, const float* pixels, int width, int height) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    put<uint32_t>(out, 20000630u);  // Magic number
+    put<uint32_t>(out, 2u);         // Version 2, single part scanline
+
+    const char* channels[] = {"B", "G", "R"};
+    putAttribute(out, "channels", "chlist", 3 * (2 + 16) + 1);
+    for (const char* name : channels) {
+        out.write(name, 2);
+        put<int32_t>(out, 2);  // FLOAT
+        put<uint8_t>(out, 0);  // pLinear
+        put<uint8_t>(out, 0);
+        put<uint8_t>(out, 0);
+        put<uint8_t>(out, 0);
+        put<int32_t>(out, 1);  // xSampling
+        put<int32_t>(out, 1);  // ySampling
+    }
+    put<uint8_t>(out, 0);
+
+    putAttribute(out, "compression", "compression", 1);
+    put<uint8_t>(out, 0);  // NO_COMPRESSION
+    for (const char* window : {"dataWindow", "displayWindow"}) {
+        putAttribute(out, window, "box2i", 16);
+        put<int32_t>(out, 0);
+        put<int32_t>(out, 0);
+        put<int32_t>(out, width - 1);
+        put<int32_t>(out, height - 1);
+    }
+    putAttribute(out, "lineOrder", "lineOrder", 1);
+    put<uint8_t>(out, 0);  // INCREASING_Y
+    putAttribute(out, "pixelAspectRatio", "float", 4);
+    put<float>(out, 1.0f);
+    putAttribute(out, "screenWindowCenter", "v2f", 8);
+    put<float>(out, 0.0f);
+    put<float>(out, 0.0f);
+    putAttribute(out, "screenWindowWidth", "float", 4);
+    put<float>(out, 1.0f);
+    put<uint8_t>(out, 0);  // End of header
+
+    const auto lineBytes = static_cast<int32_t>(width * 3 * sizeof(float));
+    const uint64_t tableStart = static_cast<uint64_t>(out.tellp());
+    const uint64_t firstLine = tableStart + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    for (int y = 0; y < height; y++) {
+        put<uint64_t>(out, firstLine + static_cast<uint64_t>(y) * (8 + lineBytes));
+    }
+
+    std::vector<float> line(static_cast<size_t>(width) * 3);
+    for (int y = 0; y < height; y++) {
+        const float* src = pixels + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            line[0 * width + x] = src[x * 4 + 2];
+            line[1 * width + x] = src[x * 4 + 1];
+            line[2 * width + x] = src[x * 4 + 0];
+        }
+        put<int32_t>(out, y);
+        put<int32_t>(out, lineBytes);
+        out.write(reinterpret_cast<const char*>(line.data()), lineBytes);
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// One frame handed to the writer thread. The pixels stay owned by the
+// producer until release is called from the writer thread.
+struct OutputFrame {
+    const float* pixels = nullptr;  // RGBA32F, tightly packed, top row first
+    int width = 0;
+    int height = 0;
+    std::string path;  // Format is picked from the extension: .png, .pfm or .exr
+    bool denoise = false;
+    bool toPipe = false;
+    std::function<void(const OutputFrame&)> consume;  // Extra consumer, e.g. sending the pixels to a render farm coordinator
+    std::function<void()> release;
+};
+
+// Background image writer with a bounded queue, so encoding and disk I/O
+// never run on the render loop.
+class ImageWriter {
+public:
+    explicit ImageWriter(size_t capacity = 4);
+    ~ImageWriter();
+
+    // Non-blocking; drops (and releases) the frame when the queue is full.
+    bool tryPush(OutputFrame frame);
+    // Blocks while the queue is full.
+    void push(OutputFrame frame);
+    // Waits until every queued frame has been written.
+    void flush();
+
+    // Streams raw RGBA8 frames to the stdin of a command, e.g. an ffmpeg rawvideo encoder.
+    bool openPipe(const std::string& command);
+
+    size_t droppedFrames() const { return dropped; }
+
+    static std::string formatPath(const std::string& pattern, int index);
+    static bool writePng(const std::string& path, const float* pixels, int width, int height, bool denoise);
+    static bool writePfm(const std::string& path, const float* pixels, int width, int height);
+    static bool writeExr(const std::string& path, const float* pixels, int width, int height);
+
+private:
+    void run();
+    void write(const OutputFrame& frame);
+
+    size_t capacity;
+    std::deque<OutputFrame> queue;
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    bool busy = false;
+    bool stopping = false;
+    size_t dropped = 0;
+    FILE* pipe = nullptr;
+    std::thread worker;
+};
@@ -0,0 +1,147 @@
+#include "light_groups.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <tuple>
+#include <sstream>
+
+namespace {
+
+// Mirrors the members of the LightGroupTable block ahead of its entries
+struct TableHeader {
+    uint32_t emitters;  // Entries that follow, one per emission with a group of its own
+    uint32_t overflowGroup;
+    uint32_t environmentGroup;
+    uint32_t padding;
+};
+
+struct Emitter {
+    glm::vec3 emission;
+    double power = 0.0;
+    uint32_t faces = 0;
+};
+
+std::string emissionName(glm::vec3 emission) {
+    std::ostringstream out;
+    out << "emission (" << emission.r << ", " << emission.g << ", " << emission.b << ")";
+    return out.str();
+}
+
+}  // namespace
+
+LightGroups::LightGroups(const Context& context, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                         const std::vector<Face>& faces, const LightGroupSettings& settings, bool environment) {
+    // Emitted power of every distinct emission, luminance times area
+    auto key = [](const Face& face) { return std::make_tuple(face.emission[0], face.emission[1], face.emission[2]); };
+    std::map<std::tuple<float, float, float>, Emitter> byEmission;
+    for (size_t i = 0; i < faces.size() && 3 * i + 2 < indices.size(); i++) {
+        const Face& face = faces[i];
+        const glm::vec3 emission{face.emission[0], face.emission[1], face.emission[2]};
+        if (emission == glm::vec3(0.0f)) continue;
+        const glm::vec3 a = vertices[indices[3 * i]].position;
+        const glm::vec3 b = vertices[indices[3 * i + 1]].position;
+        const glm::vec3 c = vertices[indices[3 * i + 2]].position;
+        Emitter& emitter = byEmission[key(face)];
+        emitter.emission = emission;
+        emitter.power += glm::dot(emission, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * 0.5 * glm::length(glm::cross(b - a, c - a));
+        emitter.faces++;
+    }
+    std::vector<Emitter> emitters;
+    for (const auto& [emission, emitter] : byEmission) emitters.push_back(emitter);
+    std::sort(emitters.begin(), emitters.end(), [](const Emitter& a, const Emitter& b) { return a.power > b.power; });
+
+    const uint32_t requested = static_cast<uint32_t>(std::clamp(settings.count, 0, MaxLightGroups));
+    const uint32_t sources = static_cast<uint32_t>(emitters.size()) + (environment ? 1 : 0);
+    const uint32_t used = requested == 0 ? 0 : std::clamp(sources, 1u, requested);
+    const bool ownEnvironment = environment && used > 1;
+    const uint32_t emitterGroups = used - (ownEnvironment ? 1 : 0);
+
+    TableHeader header{0, 0, 0, 0};
+    std::vector<glm::vec4> entries;
+    groups.resize(used);
+    for (uint32_t i = 0; i < emitters.size() && emitterGroups > 0; i++) {
+        // The last emitter group takes every emitter that has no group of its own
+        const bool shared = emitters.size() > emitterGroups && i >= emitterGroups - 1;
+        const uint32_t group = shared ? emitterGroups - 1 : i;
+        if (!shared) {
+            uint32_t bits = group;
+            float encoded;
+            std::memcpy(&encoded, &bits, sizeof(encoded));
+            entries.emplace_back(emitters[i].emission, encoded);
+            groups[group].name = emissionName(emitters[i].emission) + ", " + std::to_string(emitters[i].faces) + " faces";
+        }
+        header.overflowGroup = group;
+    }
+    if (emitters.size() > emitterGroups && emitterGroups > 0) {
+        groups[emitterGroups - 1].name = std::to_string(emitters.size() - emitterGroups + 1) + " other emissive materials";
+    }
+    if (environment && used > 0) {
+        header.environmentGroup = used - 1;
+        Group& group = groups[header.environmentGroup];
+        group.name = group.name.empty() ? "environment" : group.name + " and the environment";
+    }
+    for (uint32_t i = 0; i < used; i++) {
+        groups[i].intensity = settings.groups[i].intensity;
+        groups[i].tint = settings.groups[i].tint;
+        if (groups[i].name.empty()) groups[i].name = "no emitters";
+    }
+    header.emitters = static_cast<uint32_t>(entries.size());
+
+    // Never empty, so the binding is valid with light groups off
+    std::vector<uint8_t> contents(sizeof(header) + entries.size() * sizeof(glm::vec4));
+    std::memcpy(contents.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(contents.data() + sizeof(header), entries.data(), entries.size() * sizeof(glm::vec4));
+    }
+    table = Buffer{context, Buffer::Type::Storage, contents.size(), contents.data()};
+}
+
+void LightGroups::writeScales(float lightIntensity, glm::vec4* scales) const {
+    for (uint32_t i = 0; i < static_cast<uint32_t>(MaxLightGroups); i++) {
+        scales[i] = i < groups.size() ? glm::vec4(lightIntensity * groups[i].intensity * groups[i].tint, 0.0f) : glm::vec4(0.0f);
+    }
+}
+
+bool LightGroups::select(uint32_t group) {
+    if (group > groups.size()) {
+        return false;
+    }
+    selected = group;
+    return true;
+}
+
+void LightGroups::adjust(float intensityStep, float& lightIntensity) {
+    if (selected == 0) {
+        lightIntensity += intensityStep;
+    } else {
+        Group& group = groups[selected - 1];
+        group.intensity = std::max(0.0f, group.intensity + intensityStep);
+    }
+}
+
+std::string LightGroups::describeSelection(float lightIntensity) const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    if (selected == 0) {
+        out << "Light intensity " << lightIntensity << " (all groups)";
+    } else {
+        const Group& group = groups[selected - 1];
+        out << "Light group " << selected << " (" << group.name << "): intensity " << group.intensity << ", tint (" << group.tint.r
+            << ", " << group.tint.g << ", " << group.tint.b << ")";
+    }
+    return out.str();
+}
+
+std::string LightGroups::report() const {
+    if (groups.empty()) {
+        return "Light groups: off";
+    }
+    std::ostringstream out;
+    out << "Light groups: " << groups.size() << ", keys 1-" << groups.size() << " select one and 0 all of them, UP/DOWN relight";
+    for (size_t i = 0; i < groups.size(); i++) {
+        out << "\n  " << i + 1 << ": " << groups[i].name;
+    }
+    return out.str();
+}
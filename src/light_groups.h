@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "render_settings.h"
+#include "scene_data.h"
+
+// Emitters the megakernel accumulates apart (light_groups.glsl), so
+// reproject.comp composes the image from per-group intensities and tints and
+// a light edit keeps the accumulation instead of restarting it.
+//
+// Emissive materials, told apart by their emission, are ordered by emitted
+// power; the strongest get a group each and, when there are more than groups,
+// the rest share the last emitter group. The environment gets a group of its
+// own as long as there are at least two.
+class LightGroups {
+public:
+    static constexpr uint32_t TableBinding = 18;
+    static constexpr uint32_t SamplesBinding = 19;
+
+    LightGroups(const Context& context, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                const std::vector<Face>& faces, const LightGroupSettings& settings, bool environment);
+    LightGroups(const LightGroups&) = delete;
+    LightGroups& operator=(const LightGroups&) = delete;
+
+    // Groups accumulated apart, 0 when off. The LIGHT_GROUPS specialization constant.
+    uint32_t count() const { return static_cast<uint32_t>(groups.size()); }
+    const Buffer& tableBuffer() const { return table; }
+    // Composition weight of every group for reproject.comp: the global
+    // intensity times the group's intensity and tint, zero past count().
+    void writeScales(float lightIntensity, glm::vec4* scales) const;
+
+    // Light edits: group 0 is the global intensity, groups count from 1.
+    // select returns false for a group that doesn't exist.
+    bool select(uint32_t group);
+    void adjust(float intensityStep, float& lightIntensity);
+    // The selected group and its composition, for the console.
+    std::string describeSelection(float lightIntensity) const;
+    std::string report() const;
+
+private:
+    struct Group {
+        std::string name;
+        float intensity = 1.0f;
+        glm::vec3 tint = glm::vec3(1.0f);
+    };
+
+    std::vector<Group> groups;
+    uint32_t selected = 0;
+    Buffer table;
+};
@@ -0,0 +1,180 @@
+#include "light_resampling.h"
+
+#include "emitter_table.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Mirrors the members of the Emitters block ahead of its entries
+struct EmitterHeader {
+    uint32_t count;
+    uint32_t padding[3];
+};
+
+// Mirrors Reservoir of light_resampling.glsl
+struct Reservoir {
+    glm::vec2 uv;
+    uint32_t emitter;
+    float W;
+    float wSum;
+    float M;
+    glm::vec2 padding;
+};
+
+// Mirrors the specialization constants of light_resampling.glsl
+struct ResamplingConstants {
+    uint32_t candidates;
+    uint32_t neighbors;
+    float radius;
+    uint32_t historyLimit;
+    vk::Bool32 unbiased;
+};
+
+constexpr uint32_t GroupSize = 16;
+
+}  // namespace
+
+LightResampling::LightResampling(Context& context, const Accel& topAccel, const std::vector<Vertex>& vertices,
+                                 const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+                                 const LightResamplingSettings& settings, const vk::DescriptorBufferInfo& controls,
+                                 const vk::DescriptorBufferInfo& reprojectControls, vk::Extent2D extent)
+    : context(context), settings(settings) {
+    const std::vector<EmitterEntry> entries = buildEmitterTable(vertices, indices, faces);
+    emitters = static_cast<uint32_t>(entries.size());
+
+    // Never empty, so the binding is valid without emitters
+    const EmitterHeader header{emitters, {0, 0, 0}};
+    std::vector<uint8_t> contents(sizeof(header) + std::max<size_t>(entries.size(), 1) * sizeof(EmitterEntry));
+    std::memcpy(contents.data(), &header, sizeof(header));
+    if (!entries.empty()) {
+        std::memcpy(contents.data() + sizeof(header), entries.data(), entries.size() * sizeof(EmitterEntry));
+    }
+    emitterTable = Buffer{context, Buffer::Type::Storage, contents.size(), contents.data()};
+
+    const auto stage = vk::ShaderStageFlagBits::eCompute;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        {0, vk::DescriptorType::eAccelerationStructureKHR, 1, stage},  // TLAS
+        {1, vk::DescriptorType::eStorageImage, 1, stage},              // Sample image
+        {2, vk::DescriptorType::eStorageImage, 1, stage},              // First-hit position
+        {3, vk::DescriptorType::eStorageImage, 1, stage},              // First-hit normal
+        {4, vk::DescriptorType::eStorageImage, 1, stage},              // First-hit BRDF
+        {5, vk::DescriptorType::eStorageImage, 1, stage},              // Previous first-hit position
+        {6, vk::DescriptorType::eStorageImage, 1, stage},              // Previous first-hit normal
+        {7, vk::DescriptorType::eUniformBufferDynamic, 1, stage},      // Reprojection controls
+        {8, vk::DescriptorType::eStorageBuffer, 1, stage},             // Emitters
+        {9, vk::DescriptorType::eStorageBuffer, 1, stage},             // Previous reservoirs
+        {10, vk::DescriptorType::eStorageBuffer, 1, stage},            // Candidate reservoirs
+        {11, vk::DescriptorType::eStorageBuffer, 1, stage},            // Reservoirs
+        {14, vk::DescriptorType::eUniformBufferDynamic, 1, stage},     // Controls
+    };
+    vk::DescriptorSetLayoutCreateInfo descSetLayoutInfo;
+    descSetLayoutInfo.setBindings(bindings);
+    descSetLayout = context.device->createDescriptorSetLayoutUnique(descSetLayoutInfo);
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+    pipelineLayoutInfo.setSetLayouts(*descSetLayout);
+    pipelineLayout = context.device->createPipelineLayoutUnique(pipelineLayoutInfo);
+
+    for (vk::UniqueDescriptorSet& descSet : descSets) {
+        descSet = context.allocateDescSet(*descSetLayout);
+        std::vector<vk::WriteDescriptorSet> writes{
+            {*descSet, 7, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, reprojectControls},
+            {*descSet, 8, 0, vk::DescriptorType::eStorageBuffer, nullptr, emitterTable.descBufferInfo},
+            {*descSet, 14, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, controls},
+        };
+        vk::WriteDescriptorSet accelWrite{*descSet, 0, 0, 1, vk::DescriptorType::eAccelerationStructureKHR};
+        accelWrite.setPNext(&topAccel.descAccelInfo);
+        writes.push_back(accelWrite);
+        context.device->updateDescriptorSets(writes, nullptr);
+    }
+
+    const ResamplingConstants constants{static_cast<uint32_t>(std::max(1, settings.candidates)),
+                                        static_cast<uint32_t>(std::clamp(settings.neighbors, 0, 8)), std::max(1.0f, settings.radius),
+                                        static_cast<uint32_t>(std::max(0, settings.historyLimit)), settings.unbiased};
+    const std::array<vk::SpecializationMapEntry, 5> entriesMap{
+        vk::SpecializationMapEntry{0, offsetof(ResamplingConstants, candidates), sizeof(uint32_t)},
+        vk::SpecializationMapEntry{1, offsetof(ResamplingConstants, neighbors), sizeof(uint32_t)},
+        vk::SpecializationMapEntry{2, offsetof(ResamplingConstants, radius), sizeof(float)},
+        vk::SpecializationMapEntry{3, offsetof(ResamplingConstants, historyLimit), sizeof(uint32_t)},
+        vk::SpecializationMapEntry{4, offsetof(ResamplingConstants, unbiased), sizeof(vk::Bool32)}};
+    const vk::SpecializationInfo specialization{static_cast<uint32_t>(entriesMap.size()), entriesMap.data(), sizeof(constants), &constants};
+    auto createCompute = [&](const char* name) {
+        vk::UniqueShaderModule module = context.loadShader(name);
+        vk::PipelineShaderStageCreateInfo stageInfo{{}, vk::ShaderStageFlagBits::eCompute, *module, "main", &specialization};
+        auto result = context.device->createComputePipelineUnique(nullptr, {{}, stageInfo, *pipelineLayout});
+        if (result.result != vk::Result::eSuccess) {
+            throw std::runtime_error(std::string("Failed to create light resampling pipeline ") + name);
+        }
+        return std::move(result.value);
+    };
+    temporalPipeline = createCompute("restir_temporal.comp.spv");
+    spatialPipeline = createCompute("restir_spatial.comp.spv");
+
+    resize(extent);
+}
+
+void LightResampling::resize(vk::Extent2D newExtent) {
+    extent = newExtent;
+    const vk::DeviceSize bytes = sizeof(Reservoir) * extent.width * extent.height;
+    candidates = Buffer{context, Buffer::Type::DeviceStorage, bytes};
+    reservoirs = {Buffer{context, Buffer::Type::DeviceStorage, bytes}, Buffer{context, Buffer::Type::DeviceStorage, bytes}};
+    bindReservoirs();
+}
+
+void LightResampling::bindReservoirs() {
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (int parity = 0; parity < 2; parity++) {
+        const vk::DescriptorSet descSet = *descSets[parity];
+        writes.push_back({descSet, 9, 0, vk::DescriptorType::eStorageBuffer, nullptr, reservoirs[1 - parity].descBufferInfo});
+        writes.push_back({descSet, 10, 0, vk::DescriptorType::eStorageBuffer, nullptr, candidates.descBufferInfo});
+        writes.push_back({descSet, 11, 0, vk::DescriptorType::eStorageBuffer, nullptr, reservoirs[parity].descBufferInfo});
+    }
+    context.device->updateDescriptorSets(writes, nullptr);
+}
+
+void LightResampling::bindImages(int parity, const Image& sample, const Image& position, const Image& normal, const Image& brdf,
+                                 const Image& previousPosition, const Image& previousNormal) {
+    const vk::DescriptorSet descSet = *descSets[parity];
+    std::vector<vk::WriteDescriptorSet> writes{
+        {descSet, 1, 0, vk::DescriptorType::eStorageImage, sample.descImageInfo},
+        {descSet, 2, 0, vk::DescriptorType::eStorageImage, position.descImageInfo},
+        {descSet, 3, 0, vk::DescriptorType::eStorageImage, normal.descImageInfo},
+        {descSet, 4, 0, vk::DescriptorType::eStorageImage, brdf.descImageInfo},
+        {descSet, 5, 0, vk::DescriptorType::eStorageImage, previousPosition.descImageInfo},
+        {descSet, 6, 0, vk::DescriptorType::eStorageImage, previousNormal.descImageInfo},
+    };
+    context.device->updateDescriptorSets(writes, nullptr);
+}
+
+void LightResampling::record(vk::CommandBuffer commandBuffer, uint32_t controlsOffset, int parity, StageTimer* timer) const {
+    // Both dynamic uniforms live in the same ring slot
+    const std::array<uint32_t, 2> offsets{controlsOffset, controlsOffset};
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descSets[parity], offsets);
+    const uint32_t groupsX = (extent.width + GroupSize - 1) / GroupSize;
+    const uint32_t groupsY = (extent.height + GroupSize - 1) / GroupSize;
+    vk::MemoryBarrier passDone{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *temporalPipeline);
+    commandBuffer.dispatch(groupsX, groupsY, 1);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, passDone,
+                                  nullptr, nullptr);
+    if (timer) timer->mark(commandBuffer, "restir temporal");
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *spatialPipeline);
+    commandBuffer.dispatch(groupsX, groupsY, 1);
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, passDone,
+                                  nullptr, nullptr);
+    if (timer) timer->mark(commandBuffer, "restir spatial");
+}
+
+std::string LightResampling::report() const {
+    std::ostringstream out;
+    out << "Resampled lights: " << emitters << " emissive triangles, " << settings.candidates << " candidates, "
+        << settings.neighbors << " neighbors" << (settings.unbiased ? ", unbiased" : "");
+    return out.str();
+}
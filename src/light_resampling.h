@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "render_settings.h"
+#include "scene_data.h"
+#include "stage_timer.h"
+
+// Direct light of the emissive triangles at first hits by spatiotemporal
+// reservoir resampling (light_resampling.glsl). The megakernel leaves the
+// emitters its first bounce off a diffuse or glossy first hit would find to
+// the reservoirs and writes that hit's BSDF; restir_temporal.comp then draws
+// candidates on the emitters by power and merges the pixel's reservoir of the
+// previous frame, and restir_spatial.comp merges nearby pixels' reservoirs
+// and adds the light of the one sample it keeps to the frame's samples, ahead
+// of reproject.comp.
+//
+// Needs ray queries. The emitter table is built once, like LightGroups.
+class LightResampling {
+public:
+    static constexpr uint32_t BrdfBinding = 9;  // Of the megakernel's set, see integrator.glsl
+    // Timer marks recorded per frame: temporal and spatial
+    static constexpr uint32_t MarksPerFrame = 2;
+
+    // controls and reprojectControls are the blocks of the frame's UniformRing, read at the same offset.
+    LightResampling(Context& context, const Accel& topAccel, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                    const std::vector<Face>& faces, const LightResamplingSettings& settings, const vk::DescriptorBufferInfo& controls,
+                    const vk::DescriptorBufferInfo& reprojectControls, vk::Extent2D extent);
+    LightResampling(const LightResampling&) = delete;
+    LightResampling& operator=(const LightResampling&) = delete;
+
+    uint32_t emitterCount() const { return emitters; }
+    // Reallocates the reservoirs for a new trace extent, forgetting their history.
+    void resize(vk::Extent2D extent);
+    // Points the descriptor set of one frame parity at that frame's images and the previous frame's G-buffer.
+    void bindImages(int parity, const Image& sample, const Image& position, const Image& normal, const Image& brdf,
+                    const Image& previousPosition, const Image& previousNormal);
+    // Records both passes of one frame after the trace, marking them on timer when given.
+    void record(vk::CommandBuffer commandBuffer, uint32_t controlsOffset, int parity, StageTimer* timer) const;
+    std::string report() const;
+
+private:
+    void bindReservoirs();
+
+    Context& context;
+    LightResamplingSettings settings;
+    vk::Extent2D extent;
+    uint32_t emitters = 0;
+
+    Buffer emitterTable;
+    Buffer candidates;
+    std::array<Buffer, 2> reservoirs;  // Written by the frame of that parity, read by the next
+
+    vk::UniqueDescriptorSetLayout descSetLayout;
+    std::array<vk::UniqueDescriptorSet, 2> descSets;
+    vk::UniquePipelineLayout pipelineLayout;
+    vk::UniquePipeline temporalPipeline;
+    vk::UniquePipeline spatialPipeline;
+};
@@ -0,0 +1,76 @@
+#include "mesh_clusters.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+void computeBounds(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, MeshCluster& cluster) {
+    cluster.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    cluster.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    const size_t end = 3 * static_cast<size_t>(cluster.firstPrimitive + cluster.primitiveCount);
+    for (size_t i = 3 * static_cast<size_t>(cluster.firstPrimitive); i < end; i++) {
+        cluster.boundsMin = glm::min(cluster.boundsMin, vertices[indices[i]].position);
+        cluster.boundsMax = glm::max(cluster.boundsMax, vertices[indices[i]].position);
+    }
+}
+
+}  // namespace
+
+std::vector<MeshCluster> buildClusters(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Face>& faces,
+                                       uint32_t maxTriangles) {
+    const auto primitiveCount = static_cast<uint32_t>(indices.size() / 3);
+    std::vector<MeshCluster> clusters;
+    if (maxTriangles == 0 || primitiveCount <= maxTriangles) {
+        clusters.push_back({0, primitiveCount});
+        computeBounds(vertices, indices, clusters.back());
+        return clusters;
+    }
+
+    std::vector<glm::vec3> centroids(primitiveCount);
+    for (uint32_t i = 0; i < primitiveCount; i++) {
+        centroids[i] = (vertices[indices[3 * i]].position + vertices[indices[3 * i + 1]].position + vertices[indices[3 * i + 2]].position) /
+                       3.0f;
+    }
+
+    // Ranges of order are split depth first, left before right, so clusters come out in primitive order
+    std::vector<uint32_t> order(primitiveCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::vector<std::pair<uint32_t, uint32_t>> ranges{{0, primitiveCount}};
+    while (!ranges.empty()) {
+        const auto [begin, end] = ranges.back();
+        ranges.pop_back();
+        if (end - begin <= maxTriangles) {
+            clusters.push_back({begin, end - begin});
+            continue;
+        }
+        glm::vec3 low(std::numeric_limits<float>::max());
+        glm::vec3 high(-std::numeric_limits<float>::max());
+        for (uint32_t i = begin; i < end; i++) {
+            low = glm::min(low, centroids[order[i]]);
+            high = glm::max(high, centroids[order[i]]);
+        }
+        const glm::vec3 extent = high - low;
+        const int axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+        const uint32_t middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        ranges.push_back({middle, end});
+        ranges.push_back({begin, middle});
+    }
+
+    std::vector<uint32_t> sortedIndices(indices.size());
+    std::vector<Face> sortedFaces(faces.size());
+    for (uint32_t i = 0; i < primitiveCount; i++) {
+        std::copy_n(&indices[3 * order[i]], 3, &sortedIndices[3 * i]);
+        sortedFaces[i] = faces[order[i]];
+    }
+    indices = std::move(sortedIndices);
+    faces = std::move(sortedFaces);
+    for (MeshCluster& cluster : clusters) {
+        computeBounds(vertices, indices, cluster);
+    }
+    return clusters;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_data.h"
+
+// A contiguous primitive range of the mesh with its bounds.
+struct MeshCluster {
+    uint32_t firstPrimitive = 0;
+    uint32_t primitiveCount = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+// Splits the mesh into spatially coherent clusters of at most maxTriangles by
+// recursive median splits of the triangle centroids along the widest axis, and
+// reorders indices and faces so every cluster is one contiguous range. A limit
+// of 0 keeps the whole mesh as a single cluster in its original order.
+std::vector<MeshCluster> buildClusters(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Face>& faces,
+                                       uint32_t maxTriangles);
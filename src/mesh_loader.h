@@ -3,34 +3,44 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <glm/glm.hpp>
+#include <unordered_map>
 
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-};
-
-struct Face {
-    float diffuse[3];
-    float emission[3];
-    float specular[3];
-    float transmittance[3];
-    float shininess;
-    float ior;
-    float illum;
-};
-
-inline void loadFromFile(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Face>& faces, const std::string& file) {
+#include "scene_data.h"
+
+// texturePaths, when given, receives the diffuse maps the faces index; without it faces are untextured.
+inline void loadFromFile(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<Face>& faces, const std::string& file,
+                         std::vector<std::string>* texturePaths = nullptr) {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
     std::string warn, err;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file.c_str(), "../assets/CornellBox")) {
+    // Materials are looked up next to the .obj
+    const std::string materialDir = std::filesystem::path(file).parent_path().string();
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, file.c_str(), materialDir.c_str())) {
         throw std::runtime_error(warn + err);
     }
 
+    // map_Kd of every material, each file listed once
+    std::vector<int> materialTextures(materials.size(), -1);
+    if (texturePaths) {
+        std::unordered_map<std::string, int> known;
+        for (size_t i = 0; i < materials.size(); i++) {
+            std::string name = materials[i].diffuse_texname;
+            if (name.empty()) continue;
+            std::replace(name.begin(), name.end(), '\\', '/');
+            const std::string path = (std::filesystem::path(materialDir) / name).string();
+            auto [entry, added] = known.emplace(path, static_cast<int>(texturePaths->size()));
+            if (added) texturePaths->push_back(path);
+            materialTextures[i] = entry->second;
+        }
+    }
+
     // Loop over shapes
     for (const auto& shape : shapes) {
         // Record where this shape’s vertices start so that later we
@@ -38,6 +48,7 @@ inline void loadFromFile(std::vector<Vertex>& vertices, std::vector<uint32_t>& i
         size_t startIndex = vertices.size();
         // Check if the OBJ file provided normals
         bool hasNormals = !attrib.normals.empty();
+        bool hasTexcoords = !attrib.texcoords.empty();
 
         // Loop over all indices in this shape
         for (auto idx : shape.mesh.indices) {
@@ -58,6 +69,12 @@ inline void loadFromFile(std::vector<Vertex>& vertices, std::vector<uint32_t>& i
                 vertex.normal.z = 0.f;
             }
 
+            // OBJ texture coordinates start at the bottom row, images at the top
+            if (hasTexcoords && idx.texcoord_index >= 0) {
+                vertex.uv.x = attrib.texcoords[2 * idx.texcoord_index + 0];
+                vertex.uv.y = 1.0f - attrib.texcoords[2 * idx.texcoord_index + 1];
+            }
+
             vertices.push_back(vertex);
             indices.push_back(static_cast<uint32_t>(indices.size()));
         }
@@ -101,6 +118,7 @@ inline void loadFromFile(std::vector<Vertex>& vertices, std::vector<uint32_t>& i
             face.shininess = materials[matIndex].shininess;
             face.ior = materials[matIndex].ior;
             face.illum = materials[matIndex].illum;
+            face.diffuseTexture = static_cast<float>(materialTextures[matIndex]);
 
             faces.push_back(face);
         }
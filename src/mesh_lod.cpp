@@ -0,0 +1,342 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <queue>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Edges between faces of different materials resist moving this much more than the surface
+constexpr double MaterialBoundaryWeight = 100.0;
+// Collapses turning a triangle further than this (cosine of the normals) are refused
+constexpr double MinNormalCosine = 0.2;
+
+// Symmetric 4x4 plane distance quadric, upper triangle row by row
+struct Quadric {
+    std::array<double, 10> a{};
+
+    void addPlane(const glm::dvec3& n, double d, double weight) {
+        a[0] += weight * n.x * n.x;
+        a[1] += weight * n.x * n.y;
+        a[2] += weight * n.x * n.z;
+        a[3] += weight * n.x * d;
+        a[4] += weight * n.y * n.y;
+        a[5] += weight * n.y * n.z;
+        a[6] += weight * n.y * d;
+        a[7] += weight * n.z * n.z;
+        a[8] += weight * n.z * d;
+        a[9] += weight * d * d;
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        for (size_t i = 0; i < a.size(); i++) a[i] += other.a[i];
+        return *this;
+    }
+
+    double error(const glm::dvec3& p) const {
+        return a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x + a[4] * p.y * p.y +
+               2.0 * a[5] * p.y * p.z + 2.0 * a[6] * p.y + a[7] * p.z * p.z + 2.0 * a[8] * p.z + a[9];
+    }
+};
+
+struct Point {
+    glm::dvec3 position;
+    Quadric quadric;
+    std::vector<uint32_t> triangles;  // May hold triangles that collapsed since
+    std::vector<uint32_t> vertices;   // Mesh vertices at this position
+    uint32_t version = 0;             // Bumped when the quadric or neighborhood changes
+    bool locked = false;
+    bool removed = false;
+};
+
+struct Triangle {
+    std::array<uint32_t, 3> points;
+    std::array<uint32_t, 3> vertices;
+    uint32_t face;
+    bool alive = true;
+};
+
+// Moving point from onto point to
+struct Collapse {
+    double cost;
+    uint32_t from, to;
+    uint32_t fromVersion, toVersion;
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+struct PositionHash {
+    size_t operator()(const glm::vec3& p) const {
+        std::array<uint32_t, 3> bits;
+        std::memcpy(bits.data(), &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+glm::dvec3 triangleNormal(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c) {
+    return glm::cross(b - a, c - a);
+}
+
+class Simplifier {
+public:
+    Simplifier(const std::vector<Vertex>& vertices, const uint32_t* indices, const Face* faces, uint32_t triangleCount)
+        : meshVertices(vertices) {
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> welded;
+        std::unordered_map<std::string, uint32_t> materials;
+        triangles.resize(triangleCount);
+        materialOf.resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            Triangle& triangle = triangles[t];
+            triangle.face = t;
+            for (int k = 0; k < 3; k++) {
+                const uint32_t vertex = indices[3 * t + k];
+                auto [entry, added] = welded.emplace(vertices[vertex].position, static_cast<uint32_t>(points.size()));
+                if (added) {
+                    points.emplace_back().position = vertices[vertex].position;
+                }
+                Point& point = points[entry->second];
+                if (std::find(point.vertices.begin(), point.vertices.end(), vertex) == point.vertices.end()) {
+                    point.vertices.push_back(vertex);
+                }
+                point.triangles.push_back(t);
+                triangle.points[k] = entry->second;
+                triangle.vertices[k] = vertex;
+            }
+            const std::string key(reinterpret_cast<const char*>(&faces[t]), sizeof(Face));
+            materialOf[t] = materials.emplace(key, static_cast<uint32_t>(materials.size())).first->second;
+        }
+        alive = triangleCount;
+
+        // Surface quadrics weighted by area
+        for (const Triangle& triangle : triangles) {
+            const glm::dvec3 normal = normalOf(triangle);
+            const double length = glm::length(normal);
+            if (length == 0.0) continue;
+            const glm::dvec3 n = normal / length;
+            const double d = -glm::dot(n, points[triangle.points[0]].position);
+            for (uint32_t point : triangle.points) {
+                points[point].quadric.addPlane(n, d, 0.5 * length);
+            }
+        }
+
+        // Edge use: open and non-manifold edges lock their ends, material edges add boundary planes
+        struct EdgeUse {
+            uint32_t triangles = 0;
+            uint32_t material = 0;
+            bool materialBoundary = false;
+        };
+        std::unordered_map<uint64_t, EdgeUse> edges;
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                EdgeUse& use = edges[edgeKey(triangles[t].points[k], triangles[t].points[(k + 1) % 3])];
+                if (use.triangles++ == 0) {
+                    use.material = materialOf[t];
+                } else if (use.material != materialOf[t]) {
+                    use.materialBoundary = true;
+                }
+            }
+        }
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            const Triangle& triangle = triangles[t];
+            const glm::dvec3 normal = normalOf(triangle);
+            for (int k = 0; k < 3; k++) {
+                const uint32_t a = triangle.points[k];
+                const uint32_t b = triangle.points[(k + 1) % 3];
+                const EdgeUse& use = edges[edgeKey(a, b)];
+                if (use.triangles != 2) {
+                    points[a].locked = points[b].locked = true;
+                } else if (use.materialBoundary) {
+                    const glm::dvec3 edge = points[b].position - points[a].position;
+                    const glm::dvec3 across = glm::cross(edge, normal);
+                    const double length = glm::length(across);
+                    if (length == 0.0) continue;
+                    const glm::dvec3 n = across / length;
+                    const double d = -glm::dot(n, points[a].position);
+                    const double weight = MaterialBoundaryWeight * glm::dot(edge, edge);
+                    points[a].quadric.addPlane(n, d, weight);
+                    points[b].quadric.addPlane(n, d, weight);
+                }
+            }
+        }
+
+        for (const auto& [key, use] : edges) {
+            consider(static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key));
+        }
+    }
+
+    void run(uint32_t targetTriangles) {
+        while (alive > targetTriangles && !queue.empty()) {
+            const Collapse collapse = queue.top();
+            queue.pop();
+            const Point& from = points[collapse.from];
+            const Point& to = points[collapse.to];
+            if (from.removed || to.removed || from.version != collapse.fromVersion || to.version != collapse.toVersion) continue;
+            if (!preservesTopology(collapse.from, collapse.to) || flipsTriangle(collapse.from, collapse.to)) continue;
+            apply(collapse.from, collapse.to);
+        }
+    }
+
+    MeshLod result(const Face* faces) const {
+        MeshLod lod;
+        lod.indices.reserve(3 * alive);
+        lod.faces.reserve(alive);
+        for (const Triangle& triangle : triangles) {
+            if (!triangle.alive) continue;
+            lod.indices.insert(lod.indices.end(), triangle.vertices.begin(), triangle.vertices.end());
+            lod.faces.push_back(faces[triangle.face]);
+        }
+        return lod;
+    }
+
+private:
+    static uint64_t edgeKey(uint32_t a, uint32_t b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); }
+
+    glm::dvec3 normalOf(const Triangle& triangle) const {
+        return triangleNormal(points[triangle.points[0]].position, points[triangle.points[1]].position, points[triangle.points[2]].position);
+    }
+
+    bool contains(const Triangle& triangle, uint32_t point) const {
+        return std::find(triangle.points.begin(), triangle.points.end(), point) != triangle.points.end();
+    }
+
+    // Queues the cheaper direction of collapsing edge a-b, if either end may move
+    void consider(uint32_t a, uint32_t b) {
+        Quadric sum = points[a].quadric;
+        sum += points[b].quadric;
+        const double toB = points[a].locked ? -1.0 : sum.error(points[b].position);
+        const double toA = points[b].locked ? -1.0 : sum.error(points[a].position);
+        if (toB < 0.0 && toA < 0.0) return;
+        const bool moveA = toA < 0.0 || (toB >= 0.0 && toB <= toA);
+        const uint32_t from = moveA ? a : b;
+        const uint32_t to = moveA ? b : a;
+        queue.push({std::max(0.0, moveA ? toB : toA), from, to, points[from].version, points[to].version});
+    }
+
+    std::vector<uint32_t> neighbors(uint32_t point) const {
+        std::vector<uint32_t> result;
+        for (uint32_t t : points[point].triangles) {
+            if (!triangles[t].alive) continue;
+            for (uint32_t other : triangles[t].points) {
+                if (other != point) result.push_back(other);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    // Link condition: an interior edge shares exactly the two opposite points, more would fold the surface
+    bool preservesTopology(uint32_t from, uint32_t to) const {
+        const std::vector<uint32_t> a = neighbors(from);
+        const std::vector<uint32_t> b = neighbors(to);
+        std::vector<uint32_t> shared;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(shared));
+        return shared.size() <= 2;
+    }
+
+    bool flipsTriangle(uint32_t from, uint32_t to) const {
+        for (uint32_t t : points[from].triangles) {
+            const Triangle& triangle = triangles[t];
+            if (!triangle.alive || contains(triangle, to)) continue;
+            std::array<glm::dvec3, 3> moved;
+            for (int k = 0; k < 3; k++) {
+                moved[k] = points[triangle.points[k] == from ? to : triangle.points[k]].position;
+            }
+            const glm::dvec3 before = normalOf(triangle);
+            const glm::dvec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+            const double lengths = glm::length(before) * glm::length(after);
+            if (lengths == 0.0 || glm::dot(before, after) < MinNormalCosine * lengths) return true;
+        }
+        return false;
+    }
+
+    // The vertex at point whose normal is closest to normal, keeping hard edges hard
+    uint32_t closestVertex(uint32_t point, const glm::vec3& normal) const {
+        uint32_t best = points[point].vertices.front();
+        float bestCosine = -2.0f;
+        for (uint32_t vertex : points[point].vertices) {
+            const float cosine = glm::dot(meshVertices[vertex].normal, normal);
+            if (cosine > bestCosine) {
+                bestCosine = cosine;
+                best = vertex;
+            }
+        }
+        return best;
+    }
+
+    void apply(uint32_t from, uint32_t to) {
+        for (uint32_t t : points[from].triangles) {
+            Triangle& triangle = triangles[t];
+            if (!triangle.alive) continue;
+            if (contains(triangle, to)) {
+                triangle.alive = false;
+                alive--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (triangle.points[k] != from) continue;
+                triangle.points[k] = to;
+                triangle.vertices[k] = closestVertex(to, meshVertices[triangle.vertices[k]].normal);
+            }
+            points[to].triangles.push_back(t);
+        }
+        Point& target = points[to];
+        target.quadric += points[from].quadric;
+        target.version++;
+        target.triangles.erase(std::remove_if(target.triangles.begin(), target.triangles.end(),
+                                              [&](uint32_t t) { return !triangles[t].alive; }),
+                               target.triangles.end());
+        points[from].removed = true;
+        points[from].triangles.clear();
+        for (uint32_t neighbor : neighbors(to)) {
+            consider(to, neighbor);
+        }
+    }
+
+    const std::vector<Vertex>& meshVertices;
+    std::vector<Point> points;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> materialOf;
+    uint32_t alive = 0;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+};
+
+}  // namespace
+
+MeshLod simplifyMesh(const std::vector<Vertex>& vertices, const uint32_t* indices, const Face* faces, uint32_t triangleCount,
+                     uint32_t targetTriangles) {
+    Simplifier simplifier{vertices, indices, faces, triangleCount};
+    simplifier.run(targetTriangles);
+    return simplifier.result(faces);
+}
+
+std::vector<std::vector<MeshLod>> buildClusterLods(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                                   const std::vector<Face>& faces, const std::vector<MeshCluster>& clusters, int levels,
+                                                   ThreadPool& pool) {
+    std::vector<std::future<std::vector<MeshLod>>> pending;
+    for (const MeshCluster& cluster : clusters) {
+        pending.push_back(pool.submit([&, cluster] {
+            std::vector<MeshLod> chain;
+            chain.reserve(levels - 1);
+            const uint32_t* levelIndices = indices.data() + 3 * static_cast<size_t>(cluster.firstPrimitive);
+            const Face* levelFaces = faces.data() + cluster.firstPrimitive;
+            uint32_t triangleCount = cluster.primitiveCount;
+            for (int level = 1; level < levels; level++) {
+                chain.push_back(simplifyMesh(vertices, levelIndices, levelFaces, triangleCount, triangleCount / 4));
+                levelIndices = chain.back().indices.data();
+                levelFaces = chain.back().faces.data();
+                triangleCount = static_cast<uint32_t>(chain.back().faces.size());
+            }
+            return chain;
+        }));
+    }
+    std::vector<std::vector<MeshLod>> lods;
+    for (auto& chain : pending) {
+        lods.push_back(chain.get());
+    }
+    return lods;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh_clusters.h"
+#include "scene_data.h"
+#include "thread_pool.h"
+
+// A simplified triangle list over the mesh's own vertices, each triangle
+// keeping the face (material) of the triangle it came from.
+struct MeshLod {
+    std::vector<uint32_t> indices;
+    std::vector<Face> faces;
+};
+
+// Quadric error edge collapse (Garland and Heckbert) down to targetTriangles
+// or as far as the constraints allow. Vertices are welded by position for the
+// connectivity and collapse onto one of their neighbors, so no new vertices are
+// needed. Open and non-manifold edges, cluster borders among them, are kept as
+// they are so neighboring clusters at other levels don't crack; edges between
+// faces of different materials are held in place by extra boundary quadrics.
+MeshLod simplifyMesh(const std::vector<Vertex>& vertices, const uint32_t* indices, const Face* faces, uint32_t triangleCount,
+                     uint32_t targetTriangles);
+
+// LOD chains of every cluster, lods[cluster][level - 1] for levels 1 to levels - 1,
+// each level a quarter of the triangles of the one before. Clusters are simplified
+// in parallel on the pool; must not be called from one of its workers.
+std::vector<std::vector<MeshLod>> buildClusterLods(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+                                                   const std::vector<Face>& faces, const std::vector<MeshCluster>& clusters, int levels,
+                                                   ThreadPool& pool);
@@ -0,0 +1,85 @@
+#include "path_guiding.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+GuidingTree makeTree(const std::vector<Vertex>& vertices, const GuidingSettings& settings) {
+    glm::vec3 boundsMin(0.0f);
+    glm::vec3 boundsMax(0.0f);
+    if (!vertices.empty()) {
+        boundsMin = boundsMax = vertices[0].position;
+    }
+    for (const Vertex& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    // Without guiding the tree only backs the buffers, keep it minimal
+    const uint32_t spatialNodes = settings.enabled ? static_cast<uint32_t>(std::max(settings.spatialNodes, 1)) : 1;
+    const uint32_t quadtreeNodes = settings.enabled ? static_cast<uint32_t>(std::max(settings.quadtreeNodes, 1)) : 1;
+    return GuidingTree{boundsMin, boundsMax, spatialNodes, quadtreeNodes};
+}
+
+}  // namespace
+
+PathGuiding::PathGuiding(const Context& context, const std::vector<Vertex>& vertices, const GuidingSettings& settings)
+    : context(context), settings(settings), tree(makeTree(vertices, settings)) {
+    this->settings.iterations = std::max(this->settings.iterations, 1);
+    this->settings.bsdfFraction = std::clamp(this->settings.bsdfFraction, 0.0f, 1.0f);
+    // Sized for the largest tree once, so the descriptors never change
+    treeData = Buffer{context, Buffer::Type::Storage, sizeof(glm::uvec4) * tree.maxPackedNodes()};
+    const std::vector<uint32_t> zeros(tree.maxRecordWords(), 0);
+    records = Buffer{context, Buffer::Type::Storage, sizeof(uint32_t) * zeros.size(), zeros.data()};
+    upload();
+}
+
+void PathGuiding::upload() {
+    const std::vector<glm::uvec4> packed = tree.pack(training(), settings.bsdfFraction);
+    treeData.copyData(context, packed.data(), sizeof(glm::uvec4) * packed.size());
+}
+
+void PathGuiding::update() {
+    if (!training()) {
+        return;
+    }
+    passFrames++;
+    if (passFrames < 1 << tree.iteration()) {
+        return;
+    }
+
+    const size_t words = tree.recordWords();
+    void* mapped = context.device->mapMemory(*records.memory, 0, VK_WHOLE_SIZE);
+    tree.addRecords(static_cast<const uint32_t*>(mapped));
+    std::memset(mapped, 0, sizeof(uint32_t) * words);
+    context.device->unmapMemory(*records.memory);
+
+    tree.refine();
+    passFrames = 0;
+    upload();
+    std::cout << "Path guiding: " << tree.report() << (training() ? "" : ", training done") << std::endl;
+}
+
+void PathGuiding::restart() {
+    if (!settings.enabled) {
+        return;
+    }
+    tree.reset();
+    passFrames = 0;
+    void* mapped = context.device->mapMemory(*records.memory, 0, VK_WHOLE_SIZE);
+    std::memset(mapped, 0, sizeof(uint32_t) * tree.maxRecordWords());
+    context.device->unmapMemory(*records.memory);
+    upload();
+}
+
+std::string PathGuiding::report() const {
+    if (!settings.enabled) {
+        return "Path guiding: off";
+    }
+    std::ostringstream out;
+    out << "Path guiding: " << settings.iterations << " training passes of 2^k frames, " << settings.bsdfFraction
+        << " of bounces from the BSDF, up to " << settings.spatialNodes << " spatial and " << settings.quadtreeNodes << " quadtree nodes";
+    return out.str();
+}
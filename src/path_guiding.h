@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "guiding_tree.h"
+#include "render_settings.h"
+#include "scene_data.h"
+
+// Path guiding of the megakernel (guiding.glsl) by a GuidingTree learned
+// online. The tree is packed into the storage buffer at binding 20, and paths
+// add their records to the one at binding 21 with atomics, read back and
+// cleared on the host like the cluster hit counts.
+//
+// Training pass k lasts 2^k frames. At its end update() refines the tree from
+// the pass's records and uploads it. The frames of every tree are unbiased, so
+// the accumulation keeps them all rather than restarting with each pass. After
+// the last pass recording stops and the tree stays as it is until restart().
+class PathGuiding {
+public:
+    static constexpr uint32_t TreeBinding = 20;
+    static constexpr uint32_t RecordsBinding = 21;
+
+    PathGuiding(const Context& context, const std::vector<Vertex>& vertices, const GuidingSettings& settings);
+    PathGuiding(const PathGuiding&) = delete;
+    PathGuiding& operator=(const PathGuiding&) = delete;
+
+    // The PATH_GUIDING specialization constant. Both buffers are valid either way.
+    bool enabled() const { return settings.enabled; }
+    bool training() const { return settings.enabled && tree.iteration() < settings.iterations; }
+    const Buffer& treeBuffer() const { return treeData; }
+    const Buffer& recordBuffer() const { return records; }
+
+    // Call once per frame after its submission finished.
+    void update();
+    // Forgets the tree and trains again, after scene edits.
+    void restart();
+    std::string report() const;
+
+private:
+    void upload();
+
+    const Context& context;
+    GuidingSettings settings;
+    GuidingTree tree;
+    int passFrames = 0;
+    Buffer treeData;
+    Buffer records;
+};
@@ -0,0 +1,88 @@
+#include "radiance_cache.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t GroupSize = 256;
+
+}  // namespace
+
+RadianceCache::RadianceCache(Context& context, const std::vector<Vertex>& vertices, const RadianceCacheSettings& settings)
+    : context(context), settings(settings) {
+    // Without the cache the buffers only back the bindings, keep them minimal
+    const size_t budget = settings.enabled ? static_cast<size_t>(std::max(settings.budgetMB, 1)) << 20 : 0;
+    params.capacity = RadianceGrid::capacityFor(budget);
+    params.cellSize = RadianceGrid::cellSizeFor(vertices, settings.resolution);
+    params.footprint = std::max(settings.footprint, 0.0f);
+    params.minSamples = static_cast<uint32_t>(std::max(settings.minSamples, 1));
+    params.maxSamples = static_cast<uint32_t>(std::max(settings.maxSamples, settings.minSamples));
+    params.maxAge = static_cast<uint32_t>(std::max(settings.maxAge, 1));
+    params.updateStride = static_cast<uint32_t>(std::max(settings.updateStride, 1));
+    headerData = Buffer{context, Buffer::Type::Storage, sizeof(params), &params};
+    cells = Buffer{context, Buffer::Type::DeviceStorage, sizeof(uint32_t) * RadianceGrid::CellWords * params.capacity};
+    restart();
+    if (!settings.enabled) {
+        return;
+    }
+
+    const auto stage = vk::ShaderStageFlagBits::eCompute;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        {HeaderBinding, vk::DescriptorType::eStorageBuffer, 1, stage},
+        {CellsBinding, vk::DescriptorType::eStorageBuffer, 1, stage},
+    };
+    vk::DescriptorSetLayoutCreateInfo descSetLayoutInfo;
+    descSetLayoutInfo.setBindings(bindings);
+    descSetLayout = context.device->createDescriptorSetLayoutUnique(descSetLayoutInfo);
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+    pipelineLayoutInfo.setSetLayouts(*descSetLayout);
+    pipelineLayout = context.device->createPipelineLayoutUnique(pipelineLayoutInfo);
+
+    descSet = context.allocateDescSet(*descSetLayout);
+    std::vector<vk::WriteDescriptorSet> writes{
+        {*descSet, HeaderBinding, 0, vk::DescriptorType::eStorageBuffer, nullptr, headerData.descBufferInfo},
+        {*descSet, CellsBinding, 0, vk::DescriptorType::eStorageBuffer, nullptr, cells.descBufferInfo},
+    };
+    context.device->updateDescriptorSets(writes, nullptr);
+
+    vk::UniqueShaderModule module = context.loadShader("radiance_cache_resolve.comp.spv");
+    vk::PipelineShaderStageCreateInfo stageInfo{{}, stage, *module, "main"};
+    auto result = context.device->createComputePipelineUnique(nullptr, {{}, stageInfo, *pipelineLayout});
+    if (result.result != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to create radiance cache pipeline!");
+    }
+    resolvePipeline = std::move(result.value);
+}
+
+void RadianceCache::record(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags traceStages, StageTimer* timer) const {
+    if (!settings.enabled) {
+        return;
+    }
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *resolvePipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descSet, nullptr);
+    commandBuffer.dispatch((params.capacity + GroupSize - 1) / GroupSize, 1, 1);
+    // The next frame's paths read and claim the resolved cells
+    vk::MemoryBarrier resolveDone{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, traceStages, {}, resolveDone, nullptr, nullptr);
+    if (timer) timer->mark(commandBuffer, "cache resolve");
+}
+
+void RadianceCache::restart() {
+    context.oneTimeSubmit([&](vk::CommandBuffer commandBuffer) {  //
+        commandBuffer.fillBuffer(*cells.buffer, 0, VK_WHOLE_SIZE, 0);
+    });
+}
+
+std::string RadianceCache::report() const {
+    if (!settings.enabled) {
+        return "Radiance cache: off";
+    }
+    std::ostringstream out;
+    out << "Radiance cache: " << params.capacity << " cells ("
+        << (sizeof(uint32_t) * RadianceGrid::CellWords * params.capacity >> 20) << " MB) of " << params.cellSize
+        << ", paths end past " << params.footprint << " cells, one sample in " << params.updateStride << " records";
+    return out.str();
+}
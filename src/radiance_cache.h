@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "radiance_grid.h"
+#include "render_settings.h"
+#include "scene_data.h"
+#include "stage_timer.h"
+
+// Early path termination of the megakernel by a world-space hash grid of
+// radiance (radiance_cache.glsl, laid out like RadianceGrid). The header sits
+// in the storage buffer at binding 10 and the cells in the device buffer at
+// binding 11; paths claim cells and add their records with atomics, and
+// radiance_cache_resolve.comp folds them into the cells' means after the
+// trace, so the next frame's paths read what this one found.
+//
+// The cells live on the device only and never come back to the host; the
+// CPU tracer keeps a RadianceGrid of its own.
+class RadianceCache {
+public:
+    static constexpr uint32_t HeaderBinding = 10;
+    static constexpr uint32_t CellsBinding = 11;
+    // Timer marks recorded per frame: the resolve
+    static constexpr uint32_t MarksPerFrame = 1;
+
+    RadianceCache(Context& context, const std::vector<Vertex>& vertices, const RadianceCacheSettings& settings);
+    RadianceCache(const RadianceCache&) = delete;
+    RadianceCache& operator=(const RadianceCache&) = delete;
+
+    // The RADIANCE_CACHE specialization constant. Both buffers are valid either way.
+    bool enabled() const { return settings.enabled; }
+    const RadianceGrid::Header& header() const { return params; }
+    const Buffer& headerBuffer() const { return headerData; }
+    const Buffer& cellBuffer() const { return cells; }
+
+    // Records the resolve of one frame after its trace, ahead of the next frame's traceStages.
+    void record(vk::CommandBuffer commandBuffer, vk::PipelineStageFlags traceStages, StageTimer* timer) const;
+    // Empties every cell, after scene edits.
+    void restart();
+    std::string report() const;
+
+private:
+    const Context& context;
+    RadianceCacheSettings settings;
+    RadianceGrid::Header params;
+    Buffer headerData;
+    Buffer cells;
+
+    vk::UniqueDescriptorSetLayout descSetLayout;
+    vk::UniqueDescriptorSet descSet;
+    vk::UniquePipelineLayout pipelineLayout;
+    vk::UniquePipeline resolvePipeline;
+};
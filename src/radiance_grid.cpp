@@ -0,0 +1,159 @@
+#include "radiance_grid.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+// Integer hash of radiance_cache.glsl
+uint32_t hashWord(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Dominant axis of the normal and its sign, 0 to 5
+uint32_t normalBin(glm::vec3 normal) {
+    const glm::vec3 a = glm::abs(normal);
+    const int axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+    return 2 * axis + (normal[axis] < 0.0f ? 1 : 0);
+}
+
+uint32_t cellHash(glm::vec3 position, glm::vec3 normal, float cellSize) {
+    const glm::ivec3 cell(glm::floor(position / cellSize));
+    return hashWord(static_cast<uint32_t>(cell.x) +
+                    hashWord(static_cast<uint32_t>(cell.y) + hashWord(static_cast<uint32_t>(cell.z) + hashWord(normalBin(normal)))));
+}
+
+uint32_t checksum(uint32_t hash) {
+    return hashWord(hash ^ 0x9e3779b9u) | 1u;
+}
+
+float bitsToFloat(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint32_t floatToBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+}  // namespace
+
+RadianceGrid::RadianceGrid(const Header& header)
+    : params(header), cells(static_cast<size_t>(header.capacity) * CellWords) {
+    reset();
+}
+
+uint32_t RadianceGrid::capacityFor(size_t budgetBytes) {
+    const size_t fit = std::max<size_t>(budgetBytes / (CellWords * sizeof(uint32_t)), 1);
+    return static_cast<uint32_t>(std::bit_floor(std::min<size_t>(fit, size_t(1) << 31)));
+}
+
+float RadianceGrid::cellSizeFor(const std::vector<Vertex>& vertices, int resolution) {
+    glm::vec3 boundsMin(0.0f);
+    glm::vec3 boundsMax(0.0f);
+    if (!vertices.empty()) {
+        boundsMin = boundsMax = vertices[0].position;
+    }
+    for (const Vertex& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    const glm::vec3 extent = boundsMax - boundsMin;
+    const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    return std::max(longest, 1e-3f) / static_cast<float>(std::max(resolution, 1));
+}
+
+uint32_t RadianceGrid::claim(glm::vec3 position, glm::vec3 normal) {
+    const uint32_t hash = cellHash(position, normal, params.cellSize);
+    const uint32_t key = checksum(hash);
+    for (uint32_t probe = 0; probe < MaxProbes; probe++) {
+        const uint32_t cell = (hash + probe) & (params.capacity - 1);
+        uint32_t expected = 0;
+        if (cells[cell * CellWords].compare_exchange_strong(expected, key, std::memory_order_relaxed) || expected == key) {
+            return cell;
+        }
+    }
+    return NoCell;
+}
+
+bool RadianceGrid::lookup(glm::vec3 position, glm::vec3 normal, glm::vec3& radiance) const {
+    const uint32_t hash = cellHash(position, normal, params.cellSize);
+    const uint32_t key = checksum(hash);
+    for (uint32_t probe = 0; probe < MaxProbes; probe++) {
+        const size_t word = static_cast<size_t>((hash + probe) & (params.capacity - 1)) * CellWords;
+        if (cells[word].load(std::memory_order_relaxed) != key) continue;
+        if (cells[word + 9].load(std::memory_order_relaxed) < params.minSamples) return false;
+        radiance = glm::vec3(bitsToFloat(cells[word + 6].load(std::memory_order_relaxed)),
+                             bitsToFloat(cells[word + 7].load(std::memory_order_relaxed)),
+                             bitsToFloat(cells[word + 8].load(std::memory_order_relaxed)));
+        return true;
+    }
+    return false;
+}
+
+void RadianceGrid::record(uint32_t cell, glm::vec3 radiance) {
+    const size_t word = static_cast<size_t>(cell) * CellWords;
+    if (cells[word + 4].fetch_add(1, std::memory_order_relaxed) >= MaxUpdates) {
+        return;
+    }
+    for (int c = 0; c < 3; c++) {
+        const float clamped = std::clamp(radiance[c], 0.0f, MaxRecord);
+        cells[word + 1 + c].fetch_add(static_cast<uint32_t>(clamped * FixedPoint), std::memory_order_relaxed);
+    }
+}
+
+void RadianceGrid::resolve() {
+    for (size_t word = 0; word < cells.size(); word += CellWords) {
+        if (cells[word].load(std::memory_order_relaxed) == 0) continue;
+        const uint32_t updates = std::min(cells[word + 4].load(std::memory_order_relaxed), MaxUpdates);
+        if (updates == 0) {
+            const uint32_t age = cells[word + 5].load(std::memory_order_relaxed) + 1;
+            if (age > params.maxAge) {
+                for (uint32_t i = 0; i < CellWords; i++) cells[word + i].store(0, std::memory_order_relaxed);
+            } else {
+                cells[word + 5].store(age, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        const uint32_t samples = cells[word + 9].load(std::memory_order_relaxed);
+        const float blend = static_cast<float>(updates) / static_cast<float>(samples + updates);
+        for (int c = 0; c < 3; c++) {
+            const float mean = static_cast<float>(cells[word + 1 + c].load(std::memory_order_relaxed)) / (updates * FixedPoint);
+            const float resolved = bitsToFloat(cells[word + 6 + c].load(std::memory_order_relaxed));
+            cells[word + 6 + c].store(floatToBits(resolved + (mean - resolved) * blend), std::memory_order_relaxed);
+            cells[word + 1 + c].store(0, std::memory_order_relaxed);
+        }
+        cells[word + 4].store(0, std::memory_order_relaxed);
+        cells[word + 5].store(0, std::memory_order_relaxed);
+        cells[word + 9].store(std::min(samples + updates, params.maxSamples), std::memory_order_relaxed);
+    }
+}
+
+void RadianceGrid::reset() {
+    for (auto& word : cells) word.store(0, std::memory_order_relaxed);
+}
+
+uint32_t RadianceGrid::occupied() const {
+    uint32_t count = 0;
+    for (size_t word = 0; word < cells.size(); word += CellWords) {
+        if (cells[word].load(std::memory_order_relaxed) != 0) count++;
+    }
+    return count;
+}
+
+std::string RadianceGrid::report() const {
+    std::ostringstream out;
+    out << occupied() << " of " << params.capacity << " cells of " << params.cellSize << " used";
+    return out.str();
+}
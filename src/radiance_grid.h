@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "scene_data.h"
+
+// World-space hash grid of outgoing radiance (Müller et al. 2021, "Real-time
+// Neural Radiance Caching for Path Tracing", in the spatial hash form of
+// Binder et al. 2019, "Massively Parallel Path Space Filtering"), mirrored by
+// shaders/radiance_cache.glsl and used as is by the CPU tracer.
+//
+// A cell is a cube of cellSize around a position, told apart by the dominant
+// axis of the normal, and lives in an open addressing table of a power of two
+// capacity probed linearly. Paths record the light found behind their diffuse
+// and glossy vertices into the vertex's cell; resolve() folds the frame's
+// records into each cell's running mean, ages the cells nothing reached and
+// evicts those older than maxAge. A path whose footprint grew past footprint
+// cells ends at the next diffuse or glossy vertex by taking its cell's mean.
+class RadianceGrid {
+public:
+    // Mirrors the RadianceCacheHeader block of radiance_cache.glsl
+    struct Header {
+        uint32_t capacity = 1;      // Cells, a power of two
+        float cellSize = 1.0f;      // World-space edge of a cell
+        float footprint = 1.0f;     // Path footprint, in cells, past which paths end in the cache
+        uint32_t minSamples = 4;    // Records a cell needs before paths end in it
+        uint32_t maxSamples = 256;  // Records the running mean stands for at most, so it follows changes
+        uint32_t maxAge = 32;       // Frames without records before a cell is evicted
+        uint32_t updateStride = 8;  // One sample in updateStride records into the cache
+        uint32_t padding = 0;
+    };
+
+    // Words of a cell: checksum (0 when free), the frame's fixed point RGB sum,
+    // its record count, age, resolved RGB (float bits), resolved sample count, padding
+    static constexpr uint32_t CellWords = 12;
+    static constexpr uint32_t MaxProbes = 8;
+    static constexpr float FixedPoint = 1024.0f;
+    // Each record is clamped, and a cell takes MaxUpdates per frame, so the sums fit 32 bits
+    static constexpr float MaxRecord = 1000.0f;
+    static constexpr uint32_t MaxUpdates = 1024;
+    static constexpr uint32_t NoCell = 0xffffffffu;
+
+    explicit RadianceGrid(const Header& header);
+
+    // Largest power of two capacity within budgetBytes, at least one cell.
+    static uint32_t capacityFor(size_t budgetBytes);
+    // Cell size that fits resolution cells along the longest side of the vertices' bounds.
+    static float cellSizeFor(const std::vector<Vertex>& vertices, int resolution);
+
+    const Header& header() const { return params; }
+    // Index of the cell at position and normal, claimed when free; NoCell when its probes are taken.
+    uint32_t claim(glm::vec3 position, glm::vec3 normal);
+    // Resolved radiance of the cell, false when it is missing or has fewer than minSamples.
+    bool lookup(glm::vec3 position, glm::vec3 normal, glm::vec3& radiance) const;
+    // Thread safe. radiance is the light found behind the vertex over its path weight.
+    void record(uint32_t cell, glm::vec3 radiance);
+    // Folds the frame's records into the cells, ages and evicts, at the end of a frame.
+    void resolve();
+    void reset();
+    uint32_t occupied() const;
+    std::string report() const;
+
+private:
+    const Header params;
+    std::vector<std::atomic<uint32_t>> cells;
+};
@@ -0,0 +1,138 @@
+#include "readback.h"
+
+ReadbackRing::ReadbackRing(const Context& context, vk::Extent2D extent, uint32_t slotCount)
+    : context(context), extent(extent), size(static_cast<vk::DeviceSize>(extent.width) * extent.height * 4 * sizeof(float)) {
+    vk::CommandBufferAllocateInfo commandBufferInfo;
+    commandBufferInfo.setCommandPool(*context.commandPool);
+    commandBufferInfo.setCommandBufferCount(slotCount);
+    std::vector<vk::UniqueCommandBuffer> commandBuffers = context.device->allocateCommandBuffersUnique(commandBufferInfo);
+    std::vector<vk::UniqueCommandBuffer> transferCommandBuffers;
+    if (context.separateTransfer()) {
+        commandBufferInfo.setCommandPool(*context.transferCommandPool);
+        transferCommandBuffers = context.device->allocateCommandBuffersUnique(commandBufferInfo);
+    }
+
+    for (uint32_t i = 0; i < slotCount; i++) {
+        auto slot = std::make_unique<Slot>();
+        slot->buffer = Buffer{context, Buffer::Type::Readback, size};
+        slot->mapped = context.device->mapMemory(*slot->buffer.memory, 0, VK_WHOLE_SIZE);
+        slot->commandBuffer = std::move(commandBuffers[i]);
+        slot->fence = context.device->createFenceUnique({});
+        coherent = static_cast<bool>(slot->buffer.memoryFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+        if (context.separateTransfer()) {
+            slot->deviceBuffer = Buffer{context, Buffer::Type::DeviceCopy, size};
+            slot->transferCommandBuffer = std::move(transferCommandBuffers[i]);
+            slot->copied = context.device->createSemaphoreUnique({});
+        }
+        slots.push_back(std::move(slot));
+    }
+}
+
+ReadbackRing::~ReadbackRing() {
+    for (auto& slot : slots) {
+        if (slot->state == InFlight) {
+            (void)context.device->waitForFences(*slot->fence, true, UINT64_MAX);
+        }
+        context.device->unmapMemory(*slot->buffer.memory);
+    }
+}
+
+bool ReadbackRing::capture(vk::Image image, OutputFrame request, uint32_t layer) {
+    Slot* slot = nullptr;
+    for (auto& candidate : slots) {
+        if (candidate->state == Free) {
+            slot = candidate.get();
+            break;
+        }
+    }
+    if (!slot) {
+        skipped++;
+        return false;
+    }
+
+    vk::CommandBuffer commandBuffer = *slot->commandBuffer;
+    commandBuffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    Image::setImageLayout(commandBuffer, image, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
+
+    vk::BufferImageCopy region;
+    region.setImageSubresource({vk::ImageAspectFlagBits::eColor, 0, layer, 1});
+    region.setImageExtent({extent.width, extent.height, 1});
+    const bool separate = context.separateTransfer();
+    const vk::Buffer copyTarget = separate ? *slot->deviceBuffer.buffer : *slot->buffer.buffer;
+    commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, copyTarget, region);
+
+    Image::setImageLayout(commandBuffer, image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eGeneral);
+
+    vk::BufferMemoryBarrier hostBarrier;
+    hostBarrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+    hostBarrier.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+    hostBarrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    hostBarrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    hostBarrier.setBuffer(*slot->buffer.buffer);
+    hostBarrier.setSize(VK_WHOLE_SIZE);
+    context.device->resetFences(*slot->fence);
+    if (!separate) {
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, {}, hostBarrier, {});
+        commandBuffer.end();
+        context.queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer), *slot->fence);
+    } else {
+        // The device copy changes hands; the main queue overwrites it on the slot's next
+        // capture without taking it back, its old contents aren't needed then
+        vk::BufferMemoryBarrier release{vk::AccessFlagBits::eTransferWrite, {}, context.queueFamilyIndex, context.transferQueueFamilyIndex,
+                                        *slot->deviceBuffer.buffer, 0, VK_WHOLE_SIZE};
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, release, {});
+        commandBuffer.end();
+        context.queue.submit(vk::SubmitInfo().setCommandBuffers(commandBuffer).setSignalSemaphores(*slot->copied));
+
+        vk::CommandBuffer transferCommands = *slot->transferCommandBuffer;
+        transferCommands.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        vk::BufferMemoryBarrier acquire = release;
+        acquire.setSrcAccessMask({});
+        acquire.setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+        transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, acquire, {});
+        transferCommands.copyBuffer(*slot->deviceBuffer.buffer, *slot->buffer.buffer, vk::BufferCopy{0, 0, size});
+        transferCommands.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, {}, hostBarrier, {});
+        transferCommands.end();
+        const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+        context.transferQueue.submit(vk::SubmitInfo{*slot->copied, waitStage, transferCommands}, *slot->fence);
+    }
+
+    request.pixels = static_cast<const float*>(slot->mapped);
+    request.width = static_cast<int>(extent.width);
+    request.height = static_cast<int>(extent.height);
+    slot->request = std::move(request);
+    slot->state = InFlight;
+    return true;
+}
+
+void ReadbackRing::poll(ImageWriter& writer) {
+    for (auto& slot : slots) {
+        if (slot->state == InFlight && context.device->getFenceStatus(*slot->fence) == vk::Result::eSuccess) {
+            handOff(*slot, writer, false);
+        }
+    }
+}
+
+void ReadbackRing::drain(ImageWriter& writer) {
+    for (auto& slot : slots) {
+        if (slot->state == InFlight) {
+            (void)context.device->waitForFences(*slot->fence, true, UINT64_MAX);
+            handOff(*slot, writer, true);
+        }
+    }
+}
+
+void ReadbackRing::handOff(Slot& slot, ImageWriter& writer, bool block) {
+    if (!coherent) {
+        context.device->invalidateMappedMemoryRanges(vk::MappedMemoryRange{*slot.buffer.memory, 0, VK_WHOLE_SIZE});
+    }
+    slot.state = Writing;
+    OutputFrame frame = std::move(slot.request);
+    Slot* released = &slot;
+    frame.release = [released] { released->state = Free; };
+    if (block) {
+        writer.push(std::move(frame));
+    } else {
+        writer.tryPush(std::move(frame));
+    }
+}
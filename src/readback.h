@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "image_writer.h"
+
+// Ring of persistently mapped, host cached readback buffers. A capture
+// records an image copy into a free slot and is fenced on its own, finished
+// slots are handed to the ImageWriter and recycled once written.
+//
+// With a dedicated transfer family the main queue only copies the image into
+// device memory and releases it; the transfer queue acquires that copy and
+// moves it over the bus into the readback buffer while the main queue renders on.
+class ReadbackRing {
+public:
+    ReadbackRing(const Context& context, vk::Extent2D extent, uint32_t slotCount = 3);
+    ~ReadbackRing();
+
+    // Queues a copy of a layer of an eGeneral RGBA32F image. Returns false
+    // (never blocks) when every slot is still in flight or being written.
+    bool capture(vk::Image image, OutputFrame request, uint32_t layer = 0);
+
+    // Forwards every copy whose fence has signaled to the writer.
+    void poll(ImageWriter& writer);
+
+    // Blocks until all pending copies are handed to the writer.
+    void drain(ImageWriter& writer);
+
+    size_t skippedCaptures() const { return skipped; }
+
+private:
+    enum State { Free, InFlight, Writing };
+
+    struct Slot {
+        Buffer buffer;
+        void* mapped = nullptr;
+        vk::UniqueCommandBuffer commandBuffer;
+        // Only with a dedicated transfer family
+        Buffer deviceBuffer;
+        vk::UniqueCommandBuffer transferCommandBuffer;
+        vk::UniqueSemaphore copied;
+        vk::UniqueFence fence;
+        std::atomic<int> state{Free};
+        OutputFrame request;
+    };
+
+    void handOff(Slot& slot, ImageWriter& writer, bool block);
+
+    const Context& context;
+    vk::Extent2D extent;
+    vk::DeviceSize size;
+    bool coherent = false;
+    std::vector<std::unique_ptr<Slot>> slots;
+    size_t skipped = 0;
+};
@@ -0,0 +1,373 @@
+#include "render_farm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "image_writer.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using SocketHandle = SOCKET;
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using SocketHandle = int;
+constexpr SocketHandle INVALID_SOCKET = -1;
+#endif
+
+namespace {
+
+constexpr uint32_t JobMagic = 0x4a465056;     // "VPFJ"
+constexpr uint32_t ResultMagic = 0x52465056;  // "VPFR"
+constexpr int64_t MaxResultPixels = 16384ll * 16384ll;
+
+struct JobMessage {
+    uint32_t magic;
+    FarmJob job;
+};
+
+struct ResultHeader {
+    uint32_t magic;
+    int32_t width;
+    int32_t height;
+    int64_t samples;
+};
+
+void initSockets() {
+#ifdef _WIN32
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    if (!started) {
+        throw std::runtime_error("failed to initialize winsock");
+    }
+#endif
+}
+
+void closeSocket(intptr_t socket) {
+#ifdef _WIN32
+    closesocket(static_cast<SocketHandle>(socket));
+#else
+    close(static_cast<SocketHandle>(socket));
+#endif
+}
+
+std::string quote(const std::string& arg) {
+    return "\"" + arg + "\"";
+}
+
+// Listening socket on all interfaces for remote workers, loopback only otherwise.
+SocketHandle listenOn(int port, bool remote, int& boundPort) {
+    SocketHandle listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        throw std::runtime_error("failed to create farm socket");
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(remote ? INADDR_ANY : INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        closeSocket(listener);
+        throw std::runtime_error("failed to listen on port " + std::to_string(port));
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+    boundPort = ntohs(address.sin_port);
+    return listener;
+}
+
+// Waits up to timeoutMs for a worker to connect.
+bool acceptWorker(SocketHandle listener, int timeoutMs, FarmConnection& connection) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(listener, &readable);
+    timeval timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    if (select(static_cast<int>(listener + 1), &readable, nullptr, nullptr, &timeout) <= 0) {
+        return false;
+    }
+    SocketHandle socket = accept(listener, nullptr, nullptr);
+    if (socket == INVALID_SOCKET) {
+        return false;
+    }
+    connection = FarmConnection{static_cast<intptr_t>(socket)};
+    return true;
+}
+
+}  // namespace
+
+std::vector<FarmJob> splitFrames(int width, int height, int totalFrames, int shardCount) {
+    shardCount = std::clamp(shardCount, 1, std::max(1, totalFrames));
+    std::vector<FarmJob> jobs;
+    int firstFrame = 0;
+    for (int i = 0; i < shardCount; i++) {
+        int frameCount = totalFrames / shardCount + (i < totalFrames % shardCount ? 1 : 0);
+        jobs.push_back({width, height, firstFrame, frameCount});
+        firstFrame += frameCount;
+    }
+    return jobs;
+}
+
+FarmResult mergeResults(const std::vector<FarmResult>& results) {
+    FarmResult merged;
+    if (results.empty()) return merged;
+    merged.width = results[0].width;
+    merged.height = results[0].height;
+
+    std::vector<double> sum(results[0].pixels.size(), 0.0);
+    for (const FarmResult& result : results) {
+        if (result.width != merged.width || result.height != merged.height) {
+            throw std::runtime_error("render farm results differ in size");
+        }
+        const auto weight = static_cast<double>(result.samples);
+        for (size_t i = 0; i < sum.size(); i++) {
+            sum[i] += result.pixels[i] * weight;
+        }
+        merged.samples += result.samples;
+    }
+
+    merged.pixels.resize(sum.size());
+    const double scale = merged.samples > 0 ? 1.0 / static_cast<double>(merged.samples) : 0.0;
+    for (size_t i = 0; i < sum.size(); i++) {
+        merged.pixels[i] = static_cast<float>(sum[i] * scale);
+    }
+    return merged;
+}
+
+FarmConnection::FarmConnection(FarmConnection&& other) noexcept : socket(other.socket) {
+    other.socket = -1;
+}
+
+FarmConnection& FarmConnection::operator=(FarmConnection&& other) noexcept {
+    if (this != &other) {
+        if (isOpen()) closeSocket(socket);
+        socket = other.socket;
+        other.socket = -1;
+    }
+    return *this;
+}
+
+FarmConnection::~FarmConnection() {
+    if (isOpen()) closeSocket(socket);
+}
+
+FarmConnection FarmConnection::connect(const std::string& address) {
+    initSockets();
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        throw std::runtime_error("expected host:port, got " + address);
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        throw std::runtime_error("failed to resolve " + address);
+    }
+
+    FarmConnection connection;
+    for (addrinfo* candidate = addresses; candidate; candidate = candidate->ai_next) {
+        SocketHandle socket = ::socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (socket == INVALID_SOCKET) continue;
+        if (::connect(socket, candidate->ai_addr, static_cast<int>(candidate->ai_addrlen)) == 0) {
+            connection = FarmConnection{static_cast<intptr_t>(socket)};
+            break;
+        }
+        closeSocket(socket);
+    }
+    freeaddrinfo(addresses);
+    if (!connection.isOpen()) {
+        throw std::runtime_error("failed to connect to " + address);
+    }
+    return connection;
+}
+
+bool FarmConnection::sendAll(const void* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    constexpr int flags = MSG_NOSIGNAL;
+#else
+    constexpr int flags = 0;
+#endif
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+        const auto sent = send(static_cast<SocketHandle>(socket), bytes, chunk, flags);
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool FarmConnection::receiveAll(void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 20));
+        const auto received = recv(static_cast<SocketHandle>(socket), bytes, chunk, 0);
+        if (received <= 0) return false;
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+bool FarmConnection::sendJob(const FarmJob& job) {
+    JobMessage message{JobMagic, job};
+    return sendAll(&message, sizeof(message));
+}
+
+bool FarmConnection::receiveJob(FarmJob& job) {
+    JobMessage message{};
+    if (!receiveAll(&message, sizeof(message)) || message.magic != JobMagic) return false;
+    job = message.job;
+    return true;
+}
+
+bool FarmConnection::sendResult(const float* pixels, int width, int height, int64_t samples) {
+    ResultHeader header{ResultMagic, width, height, samples};
+    return sendAll(&header, sizeof(header)) && sendAll(pixels, static_cast<size_t>(width) * height * 4 * sizeof(float));
+}
+
+bool FarmConnection::receiveResult(FarmResult& result) {
+    ResultHeader header{};
+    if (!receiveAll(&header, sizeof(header)) || header.magic != ResultMagic) return false;
+    if (header.width <= 0 || header.height <= 0 || static_cast<int64_t>(header.width) * header.height > MaxResultPixels) return false;
+    result.width = header.width;
+    result.height = header.height;
+    result.samples = header.samples;
+    result.pixels.resize(static_cast<size_t>(header.width) * header.height * 4);
+    return receiveAll(result.pixels.data(), result.pixels.size() * sizeof(float));
+}
+
+int runFarmCoordinator(const RenderSettings& settings, int argc, char** argv) {
+    initSockets();
+    const FarmSettings& farm = settings.farm;
+    const int workerGuess = std::max(1, farm.localWorkers);
+    const std::vector<FarmJob> jobs = splitFrames(settings.width, settings.height, settings.frames, farm.shards > 0 ? farm.shards : workerGuess);
+
+    int port = 0;
+    SocketHandle listener = listenOn(farm.port, farm.port > 0, port);
+    std::cout << "Render farm: " << settings.frames << " frame(s) in " << jobs.size() << " shard(s), listening on port " << port << std::endl;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<FarmJob> pending(jobs.begin(), jobs.end());
+    std::vector<FarmResult> results;
+    int activeWorkers = 0;
+    int runningLocal = farm.localWorkers;
+
+    // Hands out shards until none are left, a failed shard goes back to the queue
+    auto serve = [&](FarmConnection connection) {
+        while (true) {
+            FarmJob job;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return !pending.empty() || results.size() == jobs.size(); });
+                if (pending.empty()) break;
+                job = pending.front();
+                pending.pop_front();
+            }
+
+            FarmResult result;
+            bool valid = connection.sendJob(job) && connection.receiveResult(result) && result.width == job.width && result.height == job.height;
+            std::lock_guard lock(mutex);
+            if (!valid) {
+                std::cerr << "Render farm: worker lost, requeueing frames " << job.firstFrame << "+" << job.frameCount << std::endl;
+                pending.push_front(job);
+                activeWorkers--;
+                changed.notify_all();
+                return;
+            }
+            std::cout << "Render farm: frames " << job.firstFrame << "+" << job.frameCount << " done (" << results.size() + 1 << "/"
+                      << jobs.size() << ")" << std::endl;
+            results.push_back(std::move(result));
+            changed.notify_all();
+        }
+        connection.sendJob({});
+        std::lock_guard lock(mutex);
+        activeWorkers--;
+        changed.notify_all();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    std::string command = quote(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        command += " " + quote(argv[i]);
+    }
+    command += " --worker 127.0.0.1:" + std::to_string(port);
+#ifdef _WIN32
+    command = "\"" + command + "\"";  // cmd.exe strips the outer quotes
+#endif
+    for (int i = 0; i < farm.localWorkers; i++) {
+        threads.emplace_back([&, command] {
+            if (std::system(command.c_str()) != 0) {
+                std::cerr << "Render farm: local worker exited with an error" << std::endl;
+            }
+            std::lock_guard lock(mutex);
+            runningLocal--;
+        });
+    }
+
+    bool failed = false;
+    while (true) {
+        {
+            std::lock_guard lock(mutex);
+            if (results.size() == jobs.size()) break;
+            // Without remote workers nobody else can pick up the remaining shards
+            if (farm.port == 0 && activeWorkers == 0 && runningLocal == 0) {
+                failed = true;
+                break;
+            }
+        }
+        FarmConnection connection;
+        if (acceptWorker(listener, 200, connection)) {
+            std::lock_guard lock(mutex);
+            activeWorkers++;
+            threads.emplace_back(serve, std::move(connection));
+        }
+    }
+    closeSocket(listener);
+    {
+        std::lock_guard lock(mutex);
+        changed.notify_all();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failed) {
+        std::cerr << "Render farm: all workers exited with shards left" << std::endl;
+        return 1;
+    }
+
+    FarmResult merged = mergeResults(results);
+    auto finished = std::chrono::steady_clock::now();
+    std::cout << "Render farm: " << merged.samples << " spp in " << std::chrono::duration<double>(finished - start).count() << " s"
+              << std::endl;
+
+    ImageWriter writer;
+    OutputFrame frame{merged.pixels.data(), merged.width, merged.height};
+    frame.path = settings.output.path;
+    frame.denoise = true;
+    writer.push(std::move(frame));
+    writer.flush();
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "render_settings.h"
+
+// One shard of the sample budget: frames [firstFrame, firstFrame + frameCount)
+// of the global frame sequence, traced with controls.frameOffset = firstFrame.
+struct FarmJob {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t firstFrame = 0;
+    int32_t frameCount = 0;  // 0 tells the worker there is nothing left
+};
+
+// Float accumulation buffer of one shard, averaged over `samples` per pixel.
+struct FarmResult {
+    int32_t width = 0;
+    int32_t height = 0;
+    int64_t samples = 0;
+    std::vector<float> pixels;  // RGBA32F, top row first
+};
+
+// Splits totalFrames into shardCount contiguous, disjoint runs.
+std::vector<FarmJob> splitFrames(int width, int height, int totalFrames, int shardCount);
+
+// Sample weighted average of equally sized shard results.
+FarmResult mergeResults(const std::vector<FarmResult>& results);
+
+// Blocking TCP connection carrying FarmJob and FarmResult messages. Both ends
+// are assumed to share endianness, which holds for the x86 and ARM hosts we run on.
+class FarmConnection {
+public:
+    FarmConnection() = default;
+    explicit FarmConnection(intptr_t socket) : socket(socket) {}
+    FarmConnection(FarmConnection&& other) noexcept;
+    FarmConnection& operator=(FarmConnection&& other) noexcept;
+    ~FarmConnection();
+
+    // address is host:port
+    static FarmConnection connect(const std::string& address);
+
+    bool sendJob(const FarmJob& job);
+    bool receiveJob(FarmJob& job);
+    bool sendResult(const float* pixels, int width, int height, int64_t samples);
+    bool receiveResult(FarmResult& result);
+
+    bool isOpen() const { return socket != -1; }
+
+private:
+    bool sendAll(const void* data, size_t size);
+    bool receiveAll(void* data, size_t size);
+
+    intptr_t socket = -1;
+};
+
+// Shards the frame budget of one render over worker processes, spawning
+// settings.farm.localWorkers copies of this executable and accepting remote
+// workers on settings.farm.port. Shards of workers that disconnect are
+// handed to the next free worker. Writes the merged image to the output path.
+int runFarmCoordinator(const RenderSettings& settings, int argc, char** argv);
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "controls.h"
+
+// Megakernel is the single raygen.rgen launch, wavefront the staged pipeline of wavefront.h.
+enum class Integrator { Megakernel, Wavefront };
+
+// How the megakernel traces: the ray tracing pipeline (raygen.rgen) or inline ray queries from compute (pathtrace.comp).
+enum class Backend { Pipeline, RayQuery };
+
+inline const char* backendName(Backend backend) {
+    return backend == Backend::Pipeline ? "pipeline" : "rayquery";
+}
+
+struct RayQuerySettings {
+    int workgroupWidth = 8;
+    int workgroupHeight = 8;
+    int materialCacheSize = 256;  // Most used materials each workgroup keeps in shared memory
+};
+
+struct TextureSettings {
+    bool compress = false;  // BC1 block compression of the diffuse maps
+    int budgetMB = 0;       // Resident texture memory, 0 for no limit
+};
+
+struct GeometrySettings {
+    bool stream = false;           // Page clusters of the mesh in and out of device memory
+    int clusterTriangles = 65536;  // Largest cluster when streaming or with LODs
+    int budgetMB = 0;              // Resident cluster memory, 0 for what the device budget allows
+    int lodLevels = 1;             // Simplified levels per cluster including full detail, 1 for none
+    float lodPixels = 256.0f;      // Projected cluster size below which coarser levels are traced
+    std::string bundle;            // Scene bundle file, loaded when it matches the mesh and these settings, else written
+
+    bool clustered() const { return stream || lodLevels > 1; }
+};
+
+// How integrator.glsl draws the environment's light samples, by the map's luminance or uniformly over the sphere.
+enum class EnvironmentSampling { Importance, Uniform };
+
+struct EnvironmentSettings {
+    std::string path;  // Lat-long .hdr or .pfm seen by rays leaving the scene, none for black
+    float intensity = 1.0f;
+    EnvironmentSampling sampling = EnvironmentSampling::Importance;
+};
+
+struct LightGroupSettings {
+    struct Group {
+        float intensity = 1.0f;
+        glm::vec3 tint = glm::vec3(1.0f);
+    };
+
+    int count = 0;  // Groups accumulated apart for relighting, 0 to sum all emitters into one image
+    std::array<Group, MaxLightGroups> groups;  // Initial composition of each group
+};
+
+// Path guiding of the megakernel, see path_guiding.h. For mostly diffuse scenes, as mirror and glass
+// bounces are never guided and glossy ones gain nothing at equal time, so off unless asked for.
+// Training pass k traces 2^k frames, each ending in a rebuilt tree that the accumulation carries
+// on with; the tree stays as it is after the last.
+struct GuidingSettings {
+    bool enabled = false;
+    int iterations = 4;
+    float bsdfFraction = 0.75f;   // Share of diffuse and glossy directions still drawn from the BSDF
+    int spatialNodes = 16384;     // Capacity of the spatial tree
+    int quadtreeNodes = 1 << 17;  // Capacity of all directional quadtrees together
+};
+
+// Direct light of emitters at first hits by reservoir resampling, see light_resampling.h.
+struct LightResamplingSettings {
+    bool enabled = false;
+    int candidates = 8;     // Emitter points drawn per pixel and frame
+    int neighbors = 4;      // Reservoirs of nearby pixels merged per pixel, at most 8
+    float radius = 16.0f;   // Of the disk neighbors come from, in pixels
+    int historyLimit = 20;  // Frames of candidates the temporal history stands for at most
+    bool unbiased = false;  // Normalize reuse by the surfaces that reach the light, at one shadow ray per neighbor
+};
+
+// World-space radiance cache ending wide paths early, see radiance_cache.h.
+struct RadianceCacheSettings {
+    bool enabled = false;
+    int budgetMB = 64;       // Memory of the cells, rounded down to a power of two of them
+    int resolution = 128;    // Cells along the longest side of the scene's bounds
+    float footprint = 1.0f;  // Path footprint, in cells, past which paths end in the cache
+    int updateStride = 8;    // One sample in updateStride records into the cache
+    int minSamples = 4;      // Records a cell needs before paths end in it
+    int maxSamples = 256;    // Records a cell's mean stands for at most
+    int maxAge = 32;         // Frames without records before a cell is evicted
+};
+
+// Several cameras traced by one launch, one image each, see view_batch.h.
+struct ViewBatchSettings {
+    std::string viewsPath;                  // One view per line: x y z [target x y z [fov]]
+    int orbitViews = 0;                     // Views on a circle around the scene instead, turntable style
+    std::string pattern = "view_%03d.png";  // Output of each view, numbered from 0
+
+    bool enabled() const { return !viewsPath.empty() || orbitViews > 0; }
+};
+
+struct OutputSettings {
+    std::string path = "output.png";
+    std::string sequence;     // Numbered frames, e.g. frames/frame_%05d.exr
+    std::string pipeCommand;  // Raw RGBA8 stream, e.g. "ffmpeg -f rawvideo -pix_fmt rgba -s 1200x1200 -i - out.mp4"
+    int captureEvery = 0;
+    std::string checkpoint;    // Accumulation checkpoint written every checkpointEvery frames and on exit
+    int checkpointEvery = 256;
+    std::string resume;        // Checkpoint to continue from when it matches the scene and these settings
+};
+
+struct FarmSettings {
+    int localWorkers = 0;     // Worker processes spawned on this machine
+    int port = 0;             // Accept workers from other hosts on this port, 0 for local only
+    int shards = 0;           // Pieces the frame budget is split into, 0 for one per worker
+    std::string coordinator;  // host:port when running as a worker
+};
+
+// Everything a run needs, from an .ini file (template_inis/) or a bare .obj
+// path, with command line flags taking precedence.
+struct RenderSettings {
+    std::string meshPath;
+    int width = 1200;
+    int height = 1200;
+    float renderScale = 1.0f;  // Interactive trace resolution relative to the window
+    int samplesPerPixel = 0;   // Sample budget of a final render, 0 to use frames
+    int samplesPerFrame = SamplesPerFrame;  // Paths per pixel of an accumulating frame
+    int previewSamplesPerFrame = 1;         // Of an interactive preview frame, which shows alone
+    bool useCpu = false;
+    Integrator integrator = Integrator::Megakernel;
+    Backend backend = Backend::Pipeline;
+    RayQuerySettings rayQuery;
+    TextureSettings textures;
+    GeometrySettings geometry;
+    EnvironmentSettings environment;
+    LightGroupSettings lightGroups;
+    GuidingSettings guiding;
+    LightResamplingSettings resampling;
+    RadianceCacheSettings radianceCache;
+    ViewBatchSettings views;
+    bool stageTimings = false;     // Print GPU time per integrator stage
+    bool compareBackends = false;  // Time frames with every supported backend, then exit
+    bool validatePicks = false;    // Check each pick against the GPU's first hit of the frame
+    int frames = 1;
+    Controls camera;
+    OutputSettings output;
+    FarmSettings farm;
+};
+
+inline std::string trim(const std::string& text) {
+    const char* whitespace = " \t\r\n";
+    size_t begin = text.find_first_not_of(whitespace);
+    if (begin == std::string::npos) return {};
+    size_t end = text.find_last_not_of(whitespace);
+    return text.substr(begin, end - begin + 1);
+}
+
+// Value of attribute `name` on the first `<tag ...>` element, or fallback.
+inline std::string xmlAttribute(const std::string& xml, const std::string& tag, const std::string& name, const std::string& fallback = {}) {
+    size_t start = xml.find("<" + tag);
+    if (start == std::string::npos) return fallback;
+    size_t end = xml.find('>', start);
+    std::string element = xml.substr(start, end - start);
+    size_t attr = element.find(" " + name + "=\"");
+    if (attr == std::string::npos) return fallback;
+    attr += name.size() + 3;
+    return element.substr(attr, element.find('"', attr) - attr);
+}
+
+// Relative paths in the .ini files are relative to the project root, which
+// is usually a parent of the working directory (the build folder).
+inline std::filesystem::path resolvePath(const std::filesystem::path& path, const std::filesystem::path& hint) {
+    if (path.is_absolute() || std::filesystem::exists(path)) return path;
+    for (std::filesystem::path base = hint; !base.empty(); base = base.parent_path()) {
+        if (std::filesystem::exists(base / path)) return base / path;
+        if (base == base.parent_path()) break;
+    }
+    for (std::filesystem::path base = ".."; std::filesystem::exists(base); base /= "..") {
+        if (std::filesystem::exists(base / path)) return base / path;
+        if (std::filesystem::equivalent(base, base / "..")) break;
+    }
+    return path;
+}
+
+// "<intensity>[:<r>,<g>,<b>]" of one light group.
+inline void parseLightGroup(LightGroupSettings::Group& group, const std::string& text) {
+    const size_t colon = text.find(':');
+    group.intensity = std::max(0.0f, std::stof(text.substr(0, colon)));
+    if (colon != std::string::npos) {
+        std::stringstream tint(text.substr(colon + 1));
+        std::string component;
+        for (int c = 0; c < 3 && std::getline(tint, component, ','); c++) {
+            group.tint[c] = std::max(0.0f, std::stof(component));
+        }
+    }
+}
+
+inline void loadSceneXml(RenderSettings& settings, const std::filesystem::path& scenePath) {
+    std::ifstream file(scenePath);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open scene " + scenePath.string());
+    }
+    std::stringstream stream;
+    stream << file.rdbuf();
+    const std::string xml = stream.str();
+
+    std::string mesh = xmlAttribute(xml, "object type=\"primitive\"", "filename");
+    if (mesh.empty()) {
+        throw std::runtime_error("scene " + scenePath.string() + " has no mesh primitive");
+    }
+    settings.meshPath = (scenePath.parent_path() / mesh).string();
+
+    // The loader flips Y, so the camera is flipped with it
+    const std::string camera = xml.substr(std::min(xml.size(), xml.find("<cameradata>")));
+    settings.camera.cameraPosition = glm::vec3(std::stof(xmlAttribute(camera, "pos", "x", "0")),
+                                               -std::stof(xmlAttribute(camera, "pos", "y", "1")),
+                                               std::stof(xmlAttribute(camera, "pos", "z", "5")));
+    settings.camera.fov = std::stof(xmlAttribute(camera, "heightangle", "v", "45"));
+}
+
+inline void loadIni(RenderSettings& settings, const std::filesystem::path& iniPath) {
+    std::ifstream file(iniPath);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open " + iniPath.string());
+    }
+
+    std::string line, section;
+    std::filesystem::path scene;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == ';' || line[0] == '#') continue;
+        if (line.front() == '[') {
+            section = line.substr(1, line.find(']') - 1);
+            continue;
+        }
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) continue;
+        const std::string key = trim(line.substr(0, equals));
+        const std::string value = trim(line.substr(equals + 1));
+
+        if (section == "IO" && key == "scene") scene = resolvePath(value, iniPath.parent_path());
+        else if (section == "IO" && key == "output") settings.output.path = value;
+        else if (section == "Settings" && key == "imageWidth") settings.width = std::stoi(value);
+        else if (section == "Settings" && key == "imageHeight") settings.height = std::stoi(value);
+        else if (section == "Settings" && key == "samplesPerPixel") settings.samplesPerPixel = std::stoi(value);
+        else if (section == "Settings" && key == "samplesPerFrame") settings.samplesPerFrame = std::stoi(value);
+        else if (section == "Settings" && key == "previewSamplesPerFrame") settings.previewSamplesPerFrame = std::stoi(value);
+        else if (section == "Settings" && key == "renderScale") settings.renderScale = std::stof(value);
+        else if (section == "Settings" && key == "compressTextures") settings.textures.compress = value == "1" || value == "true";
+        else if (section == "Settings" && key == "textureBudgetMB") settings.textures.budgetMB = std::max(0, std::stoi(value));
+        else if (section == "Settings" && key == "streamGeometry") settings.geometry.stream = value == "1" || value == "true";
+        else if (section == "Settings" && key == "clusterTriangles") settings.geometry.clusterTriangles = std::max(1, std::stoi(value));
+        else if (section == "Settings" && key == "geometryBudgetMB") settings.geometry.budgetMB = std::max(0, std::stoi(value));
+        else if (section == "Settings" && key == "lodLevels") settings.geometry.lodLevels = std::clamp(std::stoi(value), 1, 8);
+        else if (section == "Settings" && key == "lodPixels") settings.geometry.lodPixels = std::max(1.0f, std::stof(value));
+        else if (section == "IO" && key == "sceneBundle") settings.geometry.bundle = value;
+        else if (section == "IO" && key == "checkpoint") settings.output.checkpoint = value;
+        else if (section == "Settings" && key == "checkpointEvery") settings.output.checkpointEvery = std::max(1, std::stoi(value));
+        else if (section == "IO" && key == "environment") settings.environment.path = resolvePath(value, iniPath.parent_path()).string();
+        else if (section == "Settings" && key == "lightGroups") settings.lightGroups.count = std::clamp(std::stoi(value), 0, MaxLightGroups);
+        else if (section == "LightGroups" && key.rfind("group", 0) == 0) {
+            // group<N> = <intensity>[:<r>,<g>,<b>], N from 1
+            const int index = std::stoi(key.substr(5)) - 1;
+            if (index >= 0 && index < MaxLightGroups) parseLightGroup(settings.lightGroups.groups[index], value);
+        }
+        else if (section == "Settings" && key == "pathGuiding") settings.guiding.enabled = value == "1" || value == "true";
+        else if (section == "Settings" && key == "guidingIterations") settings.guiding.iterations = std::clamp(std::stoi(value), 1, 16);
+        else if (section == "Settings" && key == "resampledLights") settings.resampling.enabled = value == "1" || value == "true";
+        else if (section == "Settings" && key == "restirCandidates") settings.resampling.candidates = std::clamp(std::stoi(value), 1, 64);
+        else if (section == "Settings" && key == "restirNeighbors") settings.resampling.neighbors = std::clamp(std::stoi(value), 0, 8);
+        else if (section == "Settings" && key == "radianceCache") settings.radianceCache.enabled = value == "1" || value == "true";
+        else if (section == "Settings" && key == "cacheBudgetMB") settings.radianceCache.budgetMB = std::max(1, std::stoi(value));
+        else if (section == "Settings" && key == "cacheResolution") settings.radianceCache.resolution = std::clamp(std::stoi(value), 1, 65536);
+        else if (section == "Settings" && key == "cacheFootprint") settings.radianceCache.footprint = std::max(0.0f, std::stof(value));
+        else if (section == "IO" && key == "views") settings.views.viewsPath = resolvePath(value, iniPath.parent_path()).string();
+        else if (section == "IO" && key == "viewOutput") settings.views.pattern = value;
+        else if (section == "Settings" && key == "orbitViews") settings.views.orbitViews = std::max(0, std::stoi(value));
+        else if (section == "Settings" && key == "environmentIntensity") settings.environment.intensity = std::max(0.0f, std::stof(value));
+    }
+    if (scene.empty()) {
+        throw std::runtime_error(iniPath.string() + " has no [IO] scene");
+    }
+    loadSceneXml(settings, scene);
+
+    // Output directories are given relative to the project root as well
+    std::filesystem::path output = settings.output.path;
+    std::filesystem::path outputDir = resolvePath(output.parent_path(), iniPath.parent_path());
+    settings.output.path = (outputDir / output.filename()).string();
+}
+
+inline RenderSettings parseRenderSettings(int argc, char** argv) {
+    RenderSettings settings;
+    const std::filesystem::path input = argv[1];
+    if (input.extension() == ".ini") {
+        loadIni(settings, input);
+    } else if (input.extension() == ".xml") {
+        loadSceneXml(settings, input);
+    } else {
+        settings.meshPath = input.string();
+    }
+
+    bool framesGiven = false;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--cpu") settings.useCpu = true;
+        else if (arg == "--frames" && hasValue) {
+            settings.frames = std::max(1, std::stoi(argv[++i]));
+            framesGiven = true;
+        }
+        else if (arg == "--integrator" && hasValue) {
+            const std::string name = argv[++i];
+            if (name == "wavefront") settings.integrator = Integrator::Wavefront;
+            else if (name == "megakernel") settings.integrator = Integrator::Megakernel;
+            else throw std::runtime_error("unknown integrator " + name);
+        }
+        else if (arg == "--timings") settings.stageTimings = true;
+        else if (arg == "--backend" && hasValue) {
+            const std::string name = argv[++i];
+            if (name == backendName(Backend::Pipeline)) settings.backend = Backend::Pipeline;
+            else if (name == backendName(Backend::RayQuery)) settings.backend = Backend::RayQuery;
+            else throw std::runtime_error("unknown backend " + name);
+        }
+        else if (arg == "--workgroup" && hasValue) {
+            // WIDTHxHEIGHT, e.g. 16x8
+            const std::string shape = argv[++i];
+            const size_t x = shape.find('x');
+            settings.rayQuery.workgroupWidth = std::stoi(shape.substr(0, x));
+            settings.rayQuery.workgroupHeight = x == std::string::npos ? 1 : std::stoi(shape.substr(x + 1));
+        }
+        else if (arg == "--material-cache" && hasValue) settings.rayQuery.materialCacheSize = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--compare-backends") settings.compareBackends = true;
+        else if (arg == "--validate-picks") settings.validatePicks = true;
+        else if (arg == "--compress-textures") settings.textures.compress = true;
+        else if (arg == "--texture-budget" && hasValue) settings.textures.budgetMB = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--stream-geometry") settings.geometry.stream = true;
+        else if (arg == "--cluster-triangles" && hasValue) settings.geometry.clusterTriangles = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--geometry-budget" && hasValue) {
+            settings.geometry.budgetMB = std::max(0, std::stoi(argv[++i]));
+            settings.geometry.stream = true;
+        }
+        else if (arg == "--lod-levels" && hasValue) settings.geometry.lodLevels = std::clamp(std::stoi(argv[++i]), 1, 8);
+        else if (arg == "--lod-pixels" && hasValue) settings.geometry.lodPixels = std::max(1.0f, std::stof(argv[++i]));
+        else if (arg == "--bundle" && hasValue) settings.geometry.bundle = argv[++i];
+        else if (arg == "--environment" && hasValue) settings.environment.path = argv[++i];
+        else if (arg == "--environment-intensity" && hasValue) settings.environment.intensity = std::max(0.0f, std::stof(argv[++i]));
+        else if (arg == "--environment-sampling" && hasValue) {
+            const std::string name = argv[++i];
+            if (name == "importance") settings.environment.sampling = EnvironmentSampling::Importance;
+            else if (name == "uniform") settings.environment.sampling = EnvironmentSampling::Uniform;
+            else throw std::runtime_error("unknown environment sampling " + name);
+        }
+        else if (arg == "--light-groups" && hasValue) settings.lightGroups.count = std::clamp(std::stoi(argv[++i]), 0, MaxLightGroups);
+        else if (arg == "--light-group" && hasValue) {
+            // <N>=<intensity>[:<r>,<g>,<b>], N from 1
+            const std::string group = argv[++i];
+            const size_t equals = group.find('=');
+            const int index = std::stoi(group.substr(0, equals)) - 1;
+            if (equals == std::string::npos || index < 0 || index >= MaxLightGroups) {
+                throw std::runtime_error("invalid light group " + group);
+            }
+            parseLightGroup(settings.lightGroups.groups[index], group.substr(equals + 1));
+        }
+        else if (arg == "--guiding") settings.guiding.enabled = true;
+        else if (arg == "--guiding-iterations" && hasValue) settings.guiding.iterations = std::clamp(std::stoi(argv[++i]), 1, 16);
+        else if (arg == "--guiding-bsdf-fraction" && hasValue) settings.guiding.bsdfFraction = std::clamp(std::stof(argv[++i]), 0.0f, 1.0f);
+        else if (arg == "--restir") settings.resampling.enabled = true;
+        else if (arg == "--restir-candidates" && hasValue) settings.resampling.candidates = std::clamp(std::stoi(argv[++i]), 1, 64);
+        else if (arg == "--restir-neighbors" && hasValue) settings.resampling.neighbors = std::clamp(std::stoi(argv[++i]), 0, 8);
+        else if (arg == "--restir-unbiased") settings.resampling.unbiased = true;
+        else if (arg == "--radiance-cache") settings.radianceCache.enabled = true;
+        else if (arg == "--cache-budget" && hasValue) settings.radianceCache.budgetMB = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--cache-resolution" && hasValue) settings.radianceCache.resolution = std::clamp(std::stoi(argv[++i]), 1, 65536);
+        else if (arg == "--cache-footprint" && hasValue) settings.radianceCache.footprint = std::max(0.0f, std::stof(argv[++i]));
+        else if (arg == "--cache-update-stride" && hasValue) settings.radianceCache.updateStride = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--views" && hasValue) settings.views.viewsPath = argv[++i];
+        else if (arg == "--orbit" && hasValue) settings.views.orbitViews = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--view-output" && hasValue) settings.views.pattern = argv[++i];
+        else if (arg == "--spp" && hasValue) settings.samplesPerPixel = std::stoi(argv[++i]);
+        else if (arg == "--samples-per-frame" && hasValue) settings.samplesPerFrame = std::stoi(argv[++i]);
+        else if (arg == "--preview-samples" && hasValue) settings.previewSamplesPerFrame = std::stoi(argv[++i]);
+        else if (arg == "--width" && hasValue) settings.width = std::stoi(argv[++i]);
+        else if (arg == "--height" && hasValue) settings.height = std::stoi(argv[++i]);
+        else if (arg == "--scale" && hasValue) settings.renderScale = std::stof(argv[++i]);
+        else if (arg == "--output" && hasValue) settings.output.path = argv[++i];
+        else if (arg == "--sequence" && hasValue) settings.output.sequence = argv[++i];
+        else if (arg == "--pipe" && hasValue) settings.output.pipeCommand = argv[++i];
+        else if (arg == "--capture-every" && hasValue) settings.output.captureEvery = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--checkpoint" && hasValue) settings.output.checkpoint = argv[++i];
+        else if (arg == "--checkpoint-every" && hasValue) settings.output.checkpointEvery = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--resume" && hasValue) settings.output.resume = argv[++i];
+        else if (arg == "--farm" && hasValue) settings.farm.localWorkers = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--listen" && hasValue) settings.farm.port = std::stoi(argv[++i]);
+        else if (arg == "--shards" && hasValue) settings.farm.shards = std::max(0, std::stoi(argv[++i]));
+        else if (arg == "--worker" && hasValue) settings.farm.coordinator = argv[++i];
+    }
+
+    settings.samplesPerFrame = std::max(1, settings.samplesPerFrame);
+    settings.previewSamplesPerFrame = std::max(1, settings.previewSamplesPerFrame);
+    settings.camera.samplesPerFrame = settings.samplesPerFrame;
+    if (settings.samplesPerPixel > 0 && !framesGiven) {
+        settings.frames = (settings.samplesPerPixel + settings.samplesPerFrame - 1) / settings.samplesPerFrame;
+    }
+    // Workers get their frames and size from the coordinator and only send results back
+    if (!settings.farm.coordinator.empty()) {
+        settings.farm = FarmSettings{0, 0, 0, settings.farm.coordinator};
+        settings.output.sequence.clear();
+        settings.output.pipeCommand.clear();
+        settings.output.captureEvery = 0;
+        settings.output.checkpoint.clear();
+        settings.output.resume.clear();
+        settings.guiding.enabled = false;  // Its training restarts would cut the shard short
+        settings.views = {};
+    }
+
+    settings.width = std::max(1, settings.width);
+    settings.height = std::max(1, settings.height);
+    settings.renderScale = std::clamp(settings.renderScale, 0.1f, 1.0f);
+    settings.rayQuery.workgroupWidth = std::max(1, settings.rayQuery.workgroupWidth);
+    settings.rayQuery.workgroupHeight = std::max(1, settings.rayQuery.workgroupHeight);
+    if ((!settings.output.sequence.empty() || !settings.output.pipeCommand.empty()) && settings.output.captureEvery == 0) {
+        settings.output.captureEvery = 1;
+    }
+    // A resumed render keeps checkpointing to the file it came from
+    if (settings.output.checkpoint.empty()) {
+        settings.output.checkpoint = settings.output.resume;
+    }
+    return settings;
+}
@@ -0,0 +1,236 @@
+#include "scene_bundle.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+
+constexpr char Magic[8] = {'V', 'P', 'T', 'B', 'N', 'D', 'L', '2'};
+
+class Writer {
+public:
+    explicit Writer(std::ofstream& file) : file(file) {}
+
+    template <typename T>
+    void value(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    template <typename T>
+    void array(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        value<uint64_t>(values.size());
+        file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(sizeof(T) * values.size()));
+    }
+    void string(const std::string& text) { array(std::vector<char>(text.begin(), text.end())); }
+
+private:
+    std::ofstream& file;
+};
+
+// Every read checks the stream, so a truncated or foreign file just reads as invalid
+class Reader {
+public:
+    explicit Reader(std::ifstream& file) : file(file) {
+        file.seekg(0, std::ios::end);
+        remaining = static_cast<uint64_t>(file.tellg());
+        file.seekg(0);
+    }
+
+    template <typename T>
+    bool value(T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return read(&value, sizeof(T));
+    }
+    template <typename T>
+    bool array(std::vector<T>& values) {
+        uint64_t count = 0;
+        if (!value(count) || count > remaining / sizeof(T)) return false;
+        values.resize(count);
+        return read(values.data(), sizeof(T) * count);
+    }
+    bool string(std::string& text) {
+        std::vector<char> chars;
+        if (!array(chars)) return false;
+        text.assign(chars.begin(), chars.end());
+        return true;
+    }
+
+private:
+    bool read(void* data, uint64_t size) {
+        if (size > remaining) return false;
+        file.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+        remaining -= size;
+        return static_cast<bool>(file);
+    }
+
+    std::ifstream& file;
+    uint64_t remaining = 0;
+};
+
+void writeKey(Writer& out, const SceneBundle::Key& key) {
+    out.value<uint64_t>(key.files.size());
+    for (const SceneBundle::FileStamp& file : key.files) {
+        out.string(file.path);
+        out.value(file.size);
+        out.value(file.time);
+    }
+    out.value(key.clusterTriangles);
+    out.value(key.lodLevels);
+}
+
+bool readKey(Reader& in, SceneBundle::Key& key) {
+    uint64_t fileCount = 0;
+    if (!in.value(fileCount)) return false;
+    for (uint64_t i = 0; i < fileCount; i++) {
+        SceneBundle::FileStamp& file = key.files.emplace_back();
+        if (!in.string(file.path) || !in.value(file.size) || !in.value(file.time)) return false;
+    }
+    return in.value(key.clusterTriangles) && in.value(key.lodLevels);
+}
+
+// The arguments of every line of file starting with keyword, as the whitespace separated
+// tokens after it. Files that can't be opened have none.
+std::vector<std::vector<std::string>> keywordLines(const std::filesystem::path& file, const std::string& keyword) {
+    std::vector<std::vector<std::string>> result;
+    std::ifstream stream(file);
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream tokens(line);
+        std::string token;
+        if (!(tokens >> token) || token != keyword) continue;
+        std::vector<std::string>& arguments = result.emplace_back();
+        while (tokens >> token) {
+            arguments.push_back(token);
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+SceneBundle::FileStamp SceneBundle::FileStamp::of(const std::string& path) {
+    FileStamp stamp;
+    stamp.path = std::filesystem::absolute(path).lexically_normal().string();
+    std::error_code error;
+    stamp.size = std::filesystem::file_size(path, error);
+    if (error) stamp.size = 0;
+    const auto time = std::filesystem::last_write_time(path, error);
+    stamp.time = error ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+    return stamp;
+}
+
+bool SceneBundle::FileStamp::operator==(const FileStamp& other) const {
+    return path == other.path && size == other.size && time == other.time;
+}
+
+// Libraries and maps are found next to the mesh like loadFromFile does, and a map is the
+// last token of its map_Kd line, after any options.
+SceneBundle::Key SceneBundle::Key::of(const std::string& meshPath, uint32_t clusterTriangles, uint32_t lodLevels) {
+    Key key;
+    key.files.push_back(FileStamp::of(meshPath));
+    const std::filesystem::path materialDir = std::filesystem::path(meshPath).parent_path();
+    for (const auto& libraries : keywordLines(meshPath, "mtllib")) {
+        for (const std::string& library : libraries) {
+            key.files.push_back(FileStamp::of((materialDir / library).string()));
+            for (const auto& map : keywordLines(materialDir / library, "map_Kd")) {
+                if (map.empty()) continue;
+                std::string name = map.back();
+                std::replace(name.begin(), name.end(), '\\', '/');
+                key.files.push_back(FileStamp::of((materialDir / name).string()));
+            }
+        }
+    }
+    key.clusterTriangles = clusterTriangles;
+    key.lodLevels = lodLevels;
+    return key;
+}
+
+bool SceneBundle::Key::operator==(const Key& other) const {
+    return files == other.files && clusterTriangles == other.clusterTriangles && lodLevels == other.lodLevels;
+}
+
+bool readSceneBundle(const std::string& path, const SceneBundle::Key& key, SceneBundle& bundle) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    Reader in{file};
+    char magic[sizeof(Magic)];
+    SceneBundle::Key stored;
+    if (!in.value(magic) || !std::equal(std::begin(magic), std::end(magic), Magic) || !readKey(in, stored) || !(stored == key)) {
+        return false;
+    }
+
+    SceneBundle result;
+    uint64_t pathCount = 0;
+    if (!in.array(result.vertices) || !in.array(result.indices) || !in.array(result.faces) || !in.value(pathCount)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < pathCount; i++) {
+        if (!in.string(result.texturePaths.emplace_back())) return false;
+    }
+    if (!in.array(result.clusters)) {
+        return false;
+    }
+    result.lods.resize(result.clusters.size());
+    result.accels.resize(result.clusters.size());
+    for (size_t i = 0; i < result.clusters.size(); i++) {
+        uint32_t lodCount = 0;
+        if (!in.value(lodCount) || lodCount >= key.lodLevels) return false;
+        for (uint32_t level = 0; level < lodCount; level++) {
+            MeshLod& lod = result.lods[i].emplace_back();
+            if (!in.array(lod.indices) || !in.array(lod.faces)) return false;
+        }
+        uint32_t accelCount = 0;
+        if (!in.value(accelCount) || accelCount > lodCount + 1) return false;
+        for (uint32_t level = 0; level < accelCount; level++) {
+            if (!in.array(result.accels[i].emplace_back())) return false;
+        }
+    }
+    bundle = std::move(result);
+    return true;
+}
+
+void writeSceneBundle(const std::string& path, const SceneBundle::Key& key, const SceneBundle& bundle) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open " + temporary);
+        }
+        Writer out{file};
+        out.value(Magic);
+        writeKey(out, key);
+        out.array(bundle.vertices);
+        out.array(bundle.indices);
+        out.array(bundle.faces);
+        out.value<uint64_t>(bundle.texturePaths.size());
+        for (const std::string& texturePath : bundle.texturePaths) {
+            out.string(texturePath);
+        }
+        out.array(bundle.clusters);
+        for (size_t i = 0; i < bundle.clusters.size(); i++) {
+            const std::vector<MeshLod> noLods;
+            const std::vector<MeshLod>& lods = i < bundle.lods.size() ? bundle.lods[i] : noLods;
+            out.value(static_cast<uint32_t>(lods.size()));
+            for (const MeshLod& lod : lods) {
+                out.array(lod.indices);
+                out.array(lod.faces);
+            }
+            const auto accelCount = static_cast<uint32_t>(i < bundle.accels.size() ? bundle.accels[i].size() : 0);
+            out.value(accelCount);
+            for (uint32_t level = 0; level < accelCount; level++) {
+                out.array(bundle.accels[i][level]);
+            }
+        }
+        if (!file) {
+            throw std::runtime_error("failed to write " + temporary);
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mesh_clusters.h"
+#include "mesh_lod.h"
+#include "scene_data.h"
+
+// Serialized compacted BLAS of every cluster level, accels[cluster][level],
+// as written by vkCmdCopyAccelerationStructureToMemoryKHR.
+using SerializedAccels = std::vector<std::vector<std::vector<uint8_t>>>;
+
+// What a run would otherwise get from parsing the mesh, clustering it and
+// generating its LODs, plus the cluster BLASes of the last device that built
+// them. Only valid for the mesh file and geometry settings it was made from.
+struct SceneBundle {
+    // A file's absolute path, size and write time, 0 when it is missing
+    struct FileStamp {
+        std::string path;
+        uint64_t size = 0;
+        int64_t time = 0;
+
+        static FileStamp of(const std::string& path);
+        bool operator==(const FileStamp& other) const;
+    };
+
+    struct Key {
+        // The mesh first, then every mtllib it names and every diffuse map of those
+        std::vector<FileStamp> files;
+        uint32_t clusterTriangles = 0;  // 0 for the whole mesh as one cluster
+        uint32_t lodLevels = 1;
+
+        // Of the mesh and material files as they are now
+        static Key of(const std::string& meshPath, uint32_t clusterTriangles, uint32_t lodLevels);
+        bool operator==(const Key& other) const;
+    };
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;  // Cluster order
+    std::vector<Face> faces;
+    std::vector<std::string> texturePaths;
+    std::vector<MeshCluster> clusters;
+    std::vector<std::vector<MeshLod>> lods;
+    SerializedAccels accels;
+};
+
+// False when the file is missing, truncated or made from other scene files or other settings.
+bool readSceneBundle(const std::string& path, const SceneBundle::Key& key, SceneBundle& bundle);
+// Through a temporary file, so an interrupted write never leaves a partial bundle.
+void writeSceneBundle(const std::string& path, const SceneBundle::Key& key, const SceneBundle& bundle);
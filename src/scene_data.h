@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+struct Face {
+    float diffuse[3];
+    float emission[3];
+    float specular[3];
+    float transmittance[3];
+    float shininess;
+    float ior;
+    float illum;
+    float diffuseTexture;  // Index into the scene's texture list, -1 for none
+};
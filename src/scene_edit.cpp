@@ -0,0 +1,81 @@
+#include "scene_edit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+SceneWatcher::SceneWatcher(const std::string& meshPath) : meshPath(meshPath), lastPoll(std::chrono::steady_clock::now()) { scan(); }
+
+// The mesh and every mtllib it names, with their current write times
+void SceneWatcher::scan() {
+    files.clear();
+    std::error_code error;
+    const std::filesystem::path mesh = meshPath;
+    files.emplace_back(mesh, std::filesystem::last_write_time(mesh, error));
+
+    std::ifstream file(meshPath);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("mtllib", 0) != 0) continue;
+        std::istringstream names(line.substr(6));
+        std::string name;
+        while (names >> name) {
+            const std::filesystem::path library = mesh.parent_path() / name;
+            files.emplace_back(library, std::filesystem::last_write_time(library, error));
+        }
+    }
+}
+
+bool SceneWatcher::changed() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll < PollInterval) {
+        return false;
+    }
+    lastPoll = now;
+
+    bool written = false;
+    for (auto& [path, time] : files) {
+        std::error_code error;
+        const auto current = std::filesystem::last_write_time(path, error);
+        if (!error && current != time) {
+            written = true;
+        }
+    }
+    if (written) {
+        // The mesh may name other libraries now
+        scan();
+        pending = true;
+        return false;
+    }
+    const bool settled = pending;
+    pending = false;
+    return settled;
+}
+
+SceneEdit diffScene(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+                    const std::vector<std::string>& texturePaths, const LoadedMesh& mesh) {
+    SceneEdit edit;
+    if (mesh.vertices.size() != vertices.size() || mesh.faces.size() != faces.size()) {
+        edit.restart = "the triangle count changed";
+        return edit;
+    }
+    // Faces index the texture list, a new one means a new texture set
+    if (mesh.texturePaths != texturePaths) {
+        edit.restart = "the texture maps changed";
+        return edit;
+    }
+
+    for (uint32_t primitive = 0; primitive < faces.size(); primitive++) {
+        const Face& face = mesh.faces[indices[3 * primitive] / 3];
+        if (std::memcmp(&face, &faces[primitive], sizeof(Face)) == 0) continue;
+        edit.faces.emplace_back(primitive, face);
+        edit.emissionChanged = edit.emissionChanged || std::memcmp(face.emission, faces[primitive].emission, sizeof(face.emission)) != 0;
+    }
+    for (uint32_t vertex = 0; vertex < vertices.size(); vertex++) {
+        if (std::memcmp(&mesh.vertices[vertex], &vertices[vertex], sizeof(Vertex)) != 0) {
+            edit.vertices.push_back(vertex);
+        }
+    }
+    return edit;
+}
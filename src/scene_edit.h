@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "scene_data.h"
+
+// The mesh file and the material libraries it names, polled for writes so a
+// running render can pick up edits (see diffScene).
+class SceneWatcher {
+public:
+    static constexpr std::chrono::milliseconds PollInterval{500};
+
+    explicit SceneWatcher(const std::string& meshPath);
+
+    // True once per batch of writes. Files are stat'ed at most every PollInterval, and a
+    // change is only reported once the files stopped changing for a poll, so a save
+    // that writes in pieces is read whole.
+    bool changed();
+
+private:
+    void scan();
+
+    std::string meshPath;
+    std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> files;
+    std::chrono::steady_clock::time_point lastPoll;
+    bool pending = false;
+};
+
+// A fresh parse of the mesh, in file order as loadFromFile returns it.
+struct LoadedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Face> faces;
+    std::vector<std::string> texturePaths;
+};
+
+// What changed between the loaded scene and a fresh parse of its files, in the
+// loaded scene's (cluster) primitive order. Vertices are never shared between
+// triangles, so the scene's primitive p is triangle indices[3p] / 3 of the file.
+struct SceneEdit {
+    std::vector<std::pair<uint32_t, Face>> faces;  // Primitive and its new material
+    std::vector<uint32_t> vertices;                // Moved or otherwise changed, ascending
+    bool emissionChanged = false;
+    std::string restart;  // Why the edit can't be applied in place, empty when it can
+
+    bool empty() const { return faces.empty() && vertices.empty(); }
+};
+
+SceneEdit diffScene(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces,
+                    const std::vector<std::string>& texturePaths, const LoadedMesh& mesh);
@@ -0,0 +1,90 @@
+#include "scene_query.h"
+
+#include <algorithm>
+#include <cmath>
+
+SceneQuery::SceneQuery(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces)
+    : vertices(vertices), indices(indices), faces(faces), bvh(vertices, indices), traversal(bvh) {
+    for (uint32_t i = 0; i < faces.size(); i++) {
+        if (faces[i].emission[0] > 0.0f || faces[i].emission[1] > 0.0f || faces[i].emission[2] > 0.0f) {
+            emitters.push_back(i);
+        }
+    }
+}
+
+Ray SceneQuery::cameraRay(const Controls& controls, glm::vec2 pixel, int width, int height) {
+    glm::vec2 d = pixel / glm::vec2(width, height) * 2.0f - 1.0f;
+    float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+    float scale = std::tan(glm::radians(controls.fov) * 0.5f);
+    d.x *= aspectRatio * scale;
+    d.y *= scale;
+
+    Ray ray;
+    ray.origin = controls.cameraPosition;
+    ray.direction = glm::normalize(glm::vec3(d.x, d.y, -1));
+    return ray;
+}
+
+bool SceneQuery::pick(const Controls& controls, double x, double y, int width, int height, RayHit& hit) const {
+    Ray ray = cameraRay(controls, glm::vec2(x, y), width, height);
+    return traversal.intersect(ray, hit);
+}
+
+bool SceneQuery::validateHit(const Ray& ray, float t, float tolerance) const {
+    RayHit hit;
+    if (!traversal.intersect(ray, hit)) return t == 0.0f;
+    // Coplanar triangles may legitimately swap, so only the distance has to agree
+    return t > 0.0f && std::abs(hit.t - t) <= tolerance * std::max(1.0f, t);
+}
+
+glm::vec3 SceneQuery::frameCamera(float fov, float aspectRatio) const {
+    const Aabb& box = traversal.bounds();
+    glm::vec3 center = box.centroid();
+    float radius = glm::length(box.max - box.min) * 0.5f;
+    float halfAngle = glm::radians(fov) * 0.5f;
+    if (aspectRatio < 1.0f) {
+        halfAngle = std::atan(std::tan(halfAngle) * aspectRatio);
+    }
+    float distance = radius / std::sin(halfAngle);
+    return {center.x, center.y, center.z + distance};
+}
+
+std::vector<float> SceneQuery::lightVisibility(const glm::vec3& point) const {
+    constexpr int SampleCount = 16;
+    std::vector<float> visibility(emitters.size(), 0.0f);
+
+    for (size_t e = 0; e < emitters.size(); e++) {
+        const uint32_t prim = emitters[e];
+        const glm::vec3 p0 = vertices[indices[3 * prim + 0]].position;
+        const glm::vec3 p1 = vertices[indices[3 * prim + 1]].position;
+        const glm::vec3 p2 = vertices[indices[3 * prim + 2]].position;
+
+        // Stratified 4x4 grid folded onto the triangle
+        RayPacket<SampleCount> packet;
+        for (int i = 0; i < SampleCount; i++) {
+            float u = (static_cast<float>(i % 4) + 0.5f) / 4.0f;
+            float v = (static_cast<float>(i / 4) + 0.5f) / 4.0f;
+            if (u + v > 1.0f) {
+                u = 1.0f - u;
+                v = 1.0f - v;
+            }
+            glm::vec3 target = p0 + u * (p1 - p0) + v * (p2 - p0);
+            glm::vec3 toLight = target - point;
+            float distance = glm::length(toLight);
+
+            Ray ray;
+            ray.origin = point;
+            ray.direction = toLight / distance;
+            ray.tMax = distance * 0.999f;
+            packet.set(i, ray);
+        }
+        traversal.intersect(packet);
+
+        int unoccluded = 0;
+        for (const RayHit& hit : packet.hits) {
+            unoccluded += hit.valid() ? 0 : 1;
+        }
+        visibility[e] = static_cast<float>(unoccluded) / SampleCount;
+    }
+    return visibility;
+}
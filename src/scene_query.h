@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "controls.h"
+#include "scene_data.h"
+#include "wide_bvh.h"
+
+// Host side ray queries over the loaded triangle soup: picking, camera
+// framing and light visibility.
+class SceneQuery {
+public:
+    using Traversal = WideBvh<DefaultWideBvhWidth>;
+
+    SceneQuery(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, const std::vector<Face>& faces);
+
+    // Primary ray through a pixel, using the camera model of raygen.rgen.
+    static Ray cameraRay(const Controls& controls, glm::vec2 pixel, int width, int height);
+
+    bool pick(const Controls& controls, double x, double y, int width, int height, RayHit& hit) const;
+
+    // Whether the closest hit along ray is at distance t, the GPU's first hit for it or 0 when that
+    // missed, within tolerance relative to the distance.
+    bool validateHit(const Ray& ray, float t, float tolerance = 1e-3f) const;
+
+    // Camera position that fits the scene bounds in the vertical field of view.
+    glm::vec3 frameCamera(float fov, float aspectRatio) const;
+
+    // Fraction of each emitter visible from a point, one 16-ray packet per emitter.
+    std::vector<float> lightVisibility(const glm::vec3& point) const;
+
+private:
+    const std::vector<Vertex>& vertices;
+    const std::vector<uint32_t>& indices;
+    const std::vector<Face>& faces;
+    Bvh bvh;
+    Traversal traversal;
+    std::vector<uint32_t> emitters;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Owen-scrambled Sobol sampler, mirrored by shaders/sampler.glsl.
+//
+// Every 1D or 2D request is keyed by a dimension. It draws from the first
+// two Sobol dimensions with the sample index shuffled per key (Burley 2020,
+// "Practical Hash-based Owen Scrambling"), so only those generator matrices
+// are needed. Pixels of one BlueNoiseSize tile share the scramble and are told
+// apart by a blue-noise digital shift (XOR of the top bits), which keeps every
+// net stratified; tiles are scrambled independently.
+namespace sobol {
+
+constexpr int Dimensions = 4;
+constexpr int Bits = 32;
+constexpr int BlueNoiseSize = 64;
+
+// Dimension layout of one path: the lens sample, then six per bounce
+constexpr uint32_t DimLens = 0;
+constexpr uint32_t DimRussianRoulette = 0;
+constexpr uint32_t DimBsdf = 1;
+constexpr uint32_t DimFresnel = 3;
+constexpr uint32_t DimLight = 4;  // Environment light sample
+
+inline uint32_t bounceDimension(uint32_t depth) {
+    return 2 + depth * 6;
+}
+
+// Direction numbers of the first Dimensions Sobol dimensions (Joe & Kuo),
+// Bits per dimension, dimension 0 is the van der Corput sequence.
+inline std::vector<uint32_t> generatorMatrices() {
+    struct Polynomial {
+        uint32_t degree;
+        uint32_t coefficients;
+        uint32_t m[3];
+    };
+    const Polynomial polynomials[Dimensions - 1] = {{1, 0, {1}}, {2, 1, {1, 3}}, {3, 1, {1, 3, 1}}};
+
+    std::vector<uint32_t> matrices(Dimensions * Bits);
+    for (int i = 0; i < Bits; i++) {
+        matrices[i] = 1u << (31 - i);
+    }
+    for (int d = 1; d < Dimensions; d++) {
+        const Polynomial& p = polynomials[d - 1];
+        uint32_t* v = &matrices[d * Bits];
+        for (uint32_t i = 0; i < p.degree; i++) {
+            v[i] = p.m[i] << (31 - i);
+        }
+        for (uint32_t i = p.degree; i < Bits; i++) {
+            v[i] = v[i - p.degree] ^ (v[i - p.degree] >> p.degree);
+            for (uint32_t k = 1; k < p.degree; k++) {
+                if ((p.coefficients >> (p.degree - 1 - k)) & 1u) v[i] ^= v[i - k];
+            }
+        }
+    }
+    return matrices;
+}
+
+inline uint32_t sample(const uint32_t* matrices, uint32_t index, int dimension) {
+    uint32_t result = 0;
+    const uint32_t* v = matrices + dimension * Bits;
+    for (int bit = 0; index; bit++, index >>= 1) {
+        if (index & 1u) result ^= v[bit];
+    }
+    return result;
+}
+
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return seed ^ (value + (seed << 6) + (seed >> 2));
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+inline uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Owen scrambling: every bit is flipped depending on the bits above it.
+inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+}
+
+inline float toFloat(uint32_t x) {
+    return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Per pixel and dimension sampler state, the CPU side of sampler.glsl.
+class PixelSampler {
+public:
+    PixelSampler(const uint32_t* matrices, const uint32_t* blueNoise, uint32_t x, uint32_t y, uint32_t index)
+        : matrices(matrices), blueNoise(blueNoise), x(x), y(y), index(index),
+          tileSeed(hash((x / BlueNoiseSize) | ((y / BlueNoiseSize) << 16))) {}
+
+    float get1D(uint32_t dimension) const {
+        const uint32_t seed = hash(hashCombine(tileSeed, dimension));
+        const uint32_t shuffled = nestedUniformScramble(index, seed);
+        return toFloat(nestedUniformScramble(sample(matrices, shuffled, 0), hashCombine(seed, 0)) ^ shift(dimension));
+    }
+
+    void get2D(uint32_t dimension, float& u, float& v) const {
+        const uint32_t seed = hash(hashCombine(tileSeed, dimension));
+        const uint32_t shuffled = nestedUniformScramble(index, seed);
+        u = toFloat(nestedUniformScramble(sample(matrices, shuffled, 0), hashCombine(seed, 0)) ^ shift(dimension));
+        v = toFloat(nestedUniformScramble(sample(matrices, shuffled, 1), hashCombine(seed, 1)) ^ shift(dimension + 1));
+    }
+
+private:
+    // Blue-noise rank in the top bits, each dimension reads the tile at its own offset
+    uint32_t shift(uint32_t dimension) const {
+        const uint32_t tx = (x + dimension * 37u) % BlueNoiseSize;
+        const uint32_t ty = (y + dimension * 23u) % BlueNoiseSize;
+        return blueNoise[ty * BlueNoiseSize + tx] << 20;
+    }
+
+    const uint32_t* matrices;
+    const uint32_t* blueNoise;
+    uint32_t x, y, index;
+    uint32_t tileSeed;
+};
+
+}  // namespace sobol
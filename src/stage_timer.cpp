@@ -0,0 +1,90 @@
+#include "stage_timer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+StageTimer::StageTimer(const Context& context, uint32_t maxMarks) : context(context), maxMarks(maxMarks) {
+    const uint32_t validBits = context.physicalDevice.getQueueFamilyProperties()[context.queueFamilyIndex].timestampValidBits;
+    if (validBits == 0) {
+        return;
+    }
+    validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    timestampPeriod = context.physicalDevice.getProperties().limits.timestampPeriod;
+    queryPool = context.device->createQueryPoolUnique({{}, vk::QueryType::eTimestamp, maxMarks + 1});
+}
+
+void StageTimer::begin(vk::CommandBuffer commandBuffer) {
+    marks.clear();
+    if (!supported()) return;
+    commandBuffer.resetQueryPool(*queryPool, 0, maxMarks + 1);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *queryPool, 0);
+}
+
+void StageTimer::mark(vk::CommandBuffer commandBuffer, std::string_view stage) {
+    write(commandBuffer, {stage});
+}
+
+void StageTimer::repeat(vk::CommandBuffer commandBuffer, uint32_t count) {
+    if (count == 0 || count > marks.size()) return;
+    write(commandBuffer, {{}, count});
+}
+
+void StageTimer::write(vk::CommandBuffer commandBuffer, Mark mark) {
+    if (!supported() || marks.size() >= maxMarks) return;
+    marks.push_back(mark);
+    commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *queryPool, static_cast<uint32_t>(marks.size()));
+}
+
+void StageTimer::collect() {
+    if (!supported() || marks.empty()) return;
+    std::vector<uint64_t> timestamps(marks.size() + 1);
+    const vk::Result result =
+        context.device->getQueryPoolResults(*queryPool, 0, static_cast<uint32_t>(timestamps.size()), timestamps.size() * sizeof(uint64_t),
+                                            timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    if (result != vk::Result::eSuccess) return;
+
+    std::vector<double> milliseconds(marks.size());
+    for (size_t i = 0; i < marks.size(); i++) {
+        const uint64_t ticks = (timestamps[i + 1] - timestamps[i]) & validMask;
+        milliseconds[i] = static_cast<double>(ticks) * timestampPeriod * 1e-6;
+    }
+    auto add = [&](std::string_view stage, double time) {
+        auto total = std::find_if(totals.begin(), totals.end(), [&](const auto& entry) { return entry.first == stage; });
+        if (total == totals.end()) {
+            totals.emplace_back(stage, time);
+        } else {
+            total->second += time;
+        }
+    };
+    for (size_t i = 0; i < marks.size(); i++) {
+        if (marks[i].repeats == 0) {
+            add(marks[i].stage, milliseconds[i]);
+            continue;
+        }
+        // Only the stage marks among the repeated ones share the time
+        double repeated = 0.0;
+        for (size_t j = i - marks[i].repeats; j < i; j++) {
+            if (marks[j].repeats == 0) repeated += milliseconds[j];
+        }
+        for (size_t j = i - marks[i].repeats; j < i; j++) {
+            if (marks[j].repeats == 0 && repeated > 0.0) add(marks[j].stage, milliseconds[i] * milliseconds[j] / repeated);
+        }
+    }
+    collectedFrames++;
+}
+
+std::string StageTimer::report() {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    const int frames = std::max(1, collectedFrames);
+    double sum = 0.0;
+    for (const auto& [stage, total] : totals) {
+        out << stage << " " << total / frames << " ms | ";
+        sum += total;
+    }
+    out << "total " << sum / frames << " ms per frame over " << collectedFrames << " frame(s)";
+    totals.clear();
+    collectedFrames = 0;
+    return out.str();
+}
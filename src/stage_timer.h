@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "context.h"
+
+// GPU timestamps between named marks of one command buffer. Each mark closes
+// an interval that is added to its stage; totals are averaged per frame. The
+// marks are kept after recording, so pre-recorded command buffers that write
+// the same marks can be submitted and collected any number of times.
+class StageTimer {
+public:
+    StageTimer(const Context& context, uint32_t maxMarks);
+
+    // Resets the queries and writes the first timestamp, forgetting the marks of earlier recordings.
+    void begin(vk::CommandBuffer commandBuffer);
+    // Attributes the time since the previous mark to stage. Marks past maxMarks are dropped.
+    void mark(vk::CommandBuffer commandBuffer, std::string_view stage);
+    // Closes an interval that ran the work of the previous count marks again, like the further
+    // waves of a frame, and splits its time over their stages in proportion to theirs.
+    void repeat(vk::CommandBuffer commandBuffer, uint32_t count);
+    // Reads back the last submitted frame, after its submission finished.
+    void collect();
+
+    // Average milliseconds per frame of every stage since the last report, then starts over.
+    std::string report();
+    int frames() const { return collectedFrames; }
+    bool supported() const { return timestampPeriod > 0.0f; }
+
+private:
+    const Context& context;
+    vk::UniqueQueryPool queryPool;
+    uint32_t maxMarks;
+    float timestampPeriod = 0.0f;
+    uint64_t validMask = ~0ull;
+    struct Mark {
+        std::string_view stage;
+        uint32_t repeats = 0;  // Marks before it whose stages share its time, 0 for a stage's own
+    };
+
+    void write(vk::CommandBuffer commandBuffer, Mark mark);
+
+    std::vector<Mark> marks;
+    std::vector<std::pair<std::string_view, double>> totals;
+    int collectedFrames = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Wall time of the startup phases, which run on the main thread and the
+// startup thread pool at once. Phases are kept relative to construction so
+// the report shows how they overlapped.
+class StartupTimeline {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    StartupTimeline() : origin(Clock::now()) {}
+
+    // Runs task as the named phase and returns its result.
+    template <typename F>
+    auto time(const std::string& name, F&& task) -> decltype(task()) {
+        const Clock::time_point begin = Clock::now();
+        struct Record {
+            StartupTimeline& timeline;
+            const std::string& name;
+            Clock::time_point begin;
+            ~Record() { timeline.record(name, begin, Clock::now()); }
+        } record{*this, name, begin};
+        return task();
+    }
+
+    void record(const std::string& name, Clock::time_point begin, Clock::time_point end) {
+        std::lock_guard lock(mutex);
+        phases.push_back({name, milliseconds(begin), milliseconds(end)});
+    }
+
+    // Phases ordered by start, then the time since construction, e.g. to the first frame.
+    std::string report(const std::string& total) const {
+        std::lock_guard lock(mutex);
+        std::vector<Phase> sorted = phases;
+        std::sort(sorted.begin(), sorted.end(), [](const Phase& a, const Phase& b) { return a.begin < b.begin; });
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << "Startup:";
+        for (const Phase& phase : sorted) {
+            out << "\n  " << std::left << std::setw(20) << phase.name << std::right << std::setw(9) << phase.begin << " - " << std::setw(9)
+                << phase.end << " ms (" << phase.end - phase.begin << " ms)";
+        }
+        out << "\n  " << total << ": " << milliseconds(Clock::now()) << " ms";
+        return out.str();
+    }
+
+private:
+    struct Phase {
+        std::string name;
+        double begin;
+        double end;
+    };
+
+    double milliseconds(Clock::time_point time) const { return std::chrono::duration<double, std::milli>(time - origin).count(); }
+
+    Clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Phase> phases;
+};
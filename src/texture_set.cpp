@@ -0,0 +1,350 @@
+#include "texture_set.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "image_reader.h"
+
+namespace {
+
+// Level 0 first, each level holds RGBA8 texels or BC1 blocks
+struct MipChain {
+    std::vector<vk::Extent2D> extents;
+    std::vector<std::vector<uint8_t>> levels;
+    std::string error;
+};
+
+const std::array<float, 256>& srgbToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> values{};
+        for (int i = 0; i < 256; i++) {
+            const float c = static_cast<float>(i) / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return values;
+    }();
+    return table;
+}
+
+uint8_t linearToSrgb(float c) {
+    c = std::clamp(c, 0.0f, 1.0f);
+    const float encoded = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::lround(encoded * 255.0f));
+}
+
+// 2x2 box filter in linear space; odd edges fold the last texel in twice
+std::vector<uint8_t> downsample(const std::vector<uint8_t>& source, vk::Extent2D from, vk::Extent2D to) {
+    const std::array<float, 256>& linear = srgbToLinearTable();
+    std::vector<uint8_t> result(static_cast<size_t>(to.width) * to.height * 4);
+    for (uint32_t y = 0; y < to.height; y++) {
+        for (uint32_t x = 0; x < to.width; x++) {
+            float sum[4] = {};
+            for (uint32_t tap = 0; tap < 4; tap++) {
+                const uint32_t sx = std::min(2 * x + (tap & 1), from.width - 1);
+                const uint32_t sy = std::min(2 * y + (tap >> 1), from.height - 1);
+                const uint8_t* texel = &source[(static_cast<size_t>(sy) * from.width + sx) * 4];
+                for (int c = 0; c < 3; c++) sum[c] += linear[texel[c]];
+                sum[3] += texel[3];
+            }
+            uint8_t* out = &result[(static_cast<size_t>(y) * to.width + x) * 4];
+            for (int c = 0; c < 3; c++) out[c] = linearToSrgb(sum[c] * 0.25f);
+            out[3] = static_cast<uint8_t>(std::lround(sum[3] * 0.25f));
+        }
+    }
+    return result;
+}
+
+uint16_t toRgb565(const float* c) {
+    const auto r = static_cast<uint16_t>(std::lround(std::clamp(c[0], 0.0f, 255.0f) * 31.0f / 255.0f));
+    const auto g = static_cast<uint16_t>(std::lround(std::clamp(c[1], 0.0f, 255.0f) * 63.0f / 255.0f));
+    const auto b = static_cast<uint16_t>(std::lround(std::clamp(c[2], 0.0f, 255.0f) * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void fromRgb565(uint16_t v, float* c) {
+    c[0] = static_cast<float>((v >> 11) & 31) * 255.0f / 31.0f;
+    c[1] = static_cast<float>((v >> 5) & 63) * 255.0f / 63.0f;
+    c[2] = static_cast<float>(v & 31) * 255.0f / 31.0f;
+}
+
+// BC1 in four color mode with the endpoints at the inset bounding box of the block
+std::vector<uint8_t> compressBc1(const std::vector<uint8_t>& texels, vk::Extent2D extent) {
+    const uint32_t blocksX = (extent.width + 3) / 4;
+    const uint32_t blocksY = (extent.height + 3) / 4;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocksX) * blocksY * 8);
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            float pixels[16][3];
+            float low[3] = {255.0f, 255.0f, 255.0f};
+            float high[3] = {0.0f, 0.0f, 0.0f};
+            for (uint32_t i = 0; i < 16; i++) {
+                const uint32_t x = std::min(bx * 4 + (i & 3), extent.width - 1);
+                const uint32_t y = std::min(by * 4 + (i >> 2), extent.height - 1);
+                const uint8_t* texel = &texels[(static_cast<size_t>(y) * extent.width + x) * 4];
+                for (int c = 0; c < 3; c++) {
+                    pixels[i][c] = texel[c];
+                    low[c] = std::min(low[c], pixels[i][c]);
+                    high[c] = std::max(high[c], pixels[i][c]);
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                const float inset = (high[c] - low[c]) / 16.0f;
+                low[c] += inset;
+                high[c] -= inset;
+            }
+            // Pick the box diagonal along which green and blue follow red
+            const float mean[3] = {(low[0] + high[0]) * 0.5f, (low[1] + high[1]) * 0.5f, (low[2] + high[2]) * 0.5f};
+            for (int c = 1; c < 3; c++) {
+                float covariance = 0.0f;
+                for (uint32_t i = 0; i < 16; i++) covariance += (pixels[i][0] - mean[0]) * (pixels[i][c] - mean[c]);
+                if (covariance < 0.0f) std::swap(low[c], high[c]);
+            }
+
+            uint16_t color0 = toRgb565(high);
+            uint16_t color1 = toRgb565(low);
+            if (color0 < color1) std::swap(color0, color1);
+            float palette[4][3];
+            fromRgb565(color0, palette[0]);
+            fromRgb565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+                palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+            }
+
+            uint32_t indices = 0;
+            if (color0 != color1) {
+                for (uint32_t i = 0; i < 16; i++) {
+                    uint32_t best = 0;
+                    float bestDistance = INFINITY;
+                    for (uint32_t p = 0; p < 4; p++) {
+                        float distance = 0.0f;
+                        for (int c = 0; c < 3; c++) distance += (pixels[i][c] - palette[p][c]) * (pixels[i][c] - palette[p][c]);
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= best << (2 * i);
+                }
+            }
+
+            uint8_t* block = &blocks[(static_cast<size_t>(by) * blocksX + bx) * 8];
+            std::memcpy(block + 0, &color0, 2);
+            std::memcpy(block + 2, &color1, 2);
+            std::memcpy(block + 4, &indices, 4);
+        }
+    }
+    return blocks;
+}
+
+MipChain buildMipChain(const std::string& path, bool compress) {
+    MipChain chain;
+    DecodedImage image;
+    try {
+        image = readImage(path);
+    } catch (const std::exception& error) {
+        chain.error = error.what();
+        image = DecodedImage{1, 1, {255, 255, 255, 255}};
+    }
+
+    vk::Extent2D extent{static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height)};
+    std::vector<uint8_t> level = std::move(image.rgba);
+    while (true) {
+        chain.extents.push_back(extent);
+        chain.levels.push_back(compress ? compressBc1(level, extent) : level);
+        if (extent.width == 1 && extent.height == 1) break;
+        const vk::Extent2D next{std::max(1u, extent.width / 2), std::max(1u, extent.height / 2)};
+        level = downsample(level, extent, next);
+        extent = next;
+    }
+    return chain;
+}
+
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+TextureSet::TextureSet(const Context& context, const std::vector<std::string>& paths, const TextureSettings& settings, ThreadPool& pool) {
+    if (paths.size() > Context::MaxTextures) {
+        throw std::runtime_error("Scene uses " + std::to_string(paths.size()) + " textures, at most " +
+                                 std::to_string(Context::MaxTextures) + " are supported!");
+    }
+
+    // Block compression only where the device can sample it
+    const vk::FormatFeatureFlags sampled = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    const bool compress = settings.compress &&
+        (context.physicalDevice.getFormatProperties(vk::Format::eBc1RgbSrgbBlock).optimalTilingFeatures & sampled) == sampled;
+    if (settings.compress && !compress) {
+        std::cerr << "BC1 textures unsupported, keeping RGBA8." << std::endl;
+    }
+    format = compress ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eR8G8B8A8Srgb;
+
+    // Decode on the pool, the empty set holds the white fallback alone
+    std::vector<std::future<MipChain>> pending;
+    for (const std::string& path : paths) {
+        pending.push_back(pool.submit([path, compress] { return buildMipChain(path, compress); }));
+    }
+    std::vector<MipChain> chains;
+    for (size_t i = 0; i < pending.size(); i++) {
+        chains.push_back(pending[i].get());
+        if (!chains.back().error.empty()) {
+            std::cerr << "Texture " << paths[i] << " not loaded (" << chains.back().error << "), using white." << std::endl;
+        }
+    }
+    if (chains.empty()) {
+        chains.push_back(buildMipChain("", compress));  // Fails to open, leaving the white texel
+    }
+
+    // Resident budget: drop the top level of the largest texture until the set fits
+    auto chainBytes = [](const MipChain& chain) {
+        vk::DeviceSize bytes = 0;
+        for (const auto& level : chain.levels) bytes += level.size();
+        return bytes;
+    };
+    std::vector<uint32_t> dropped(chains.size(), 0);
+    const vk::DeviceSize budget = static_cast<vk::DeviceSize>(settings.budgetMB) << 20;
+    if (budget > 0) {
+        vk::DeviceSize total = 0;
+        for (const MipChain& chain : chains) total += chainBytes(chain);
+        while (total > budget) {
+            size_t largest = chains.size();
+            for (size_t i = 0; i < chains.size(); i++) {
+                if (chains[i].levels.size() > 1 && (largest == chains.size() || chainBytes(chains[i]) > chainBytes(chains[largest]))) {
+                    largest = i;
+                }
+            }
+            if (largest == chains.size()) break;
+            total -= chains[largest].levels.front().size();
+            chains[largest].levels.erase(chains[largest].levels.begin());
+            chains[largest].extents.erase(chains[largest].extents.begin());
+            dropped[largest]++;
+        }
+    }
+
+    // Images, and every level packed into one staging buffer
+    const vk::DeviceSize texelAlignment = 16;
+    vk::DeviceSize stagingSize = 0;
+    for (const MipChain& chain : chains) {
+        for (const auto& level : chain.levels) stagingSize = alignUp(stagingSize, texelAlignment) + level.size();
+    }
+    std::vector<uint8_t> staging(stagingSize);
+    std::vector<std::vector<vk::BufferImageCopy>> copies(chains.size());
+    vk::DeviceSize offset = 0;
+    for (size_t i = 0; i < chains.size(); i++) {
+        const MipChain& chain = chains[i];
+        Texture texture;
+        texture.path = i < paths.size() ? paths[i] : "";
+        texture.extent = chain.extents.front();
+        texture.levels = static_cast<uint32_t>(chain.levels.size());
+        texture.droppedLevels = dropped[i];
+
+        vk::ImageCreateInfo imageInfo;
+        imageInfo.setImageType(vk::ImageType::e2D);
+        imageInfo.setExtent({texture.extent.width, texture.extent.height, 1});
+        imageInfo.setMipLevels(texture.levels);
+        imageInfo.setArrayLayers(1);
+        imageInfo.setFormat(format);
+        imageInfo.setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+        texture.image = context.device->createImageUnique(imageInfo);
+
+        vk::MemoryRequirements requirements = context.device->getImageMemoryRequirements(*texture.image);
+        vk::MemoryAllocateInfo memoryInfo;
+        memoryInfo.setAllocationSize(requirements.size);
+        memoryInfo.setMemoryTypeIndex(context.findMemoryType(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+        texture.memory = context.device->allocateMemoryUnique(memoryInfo);
+        context.device->bindImageMemory(*texture.image, *texture.memory, 0);
+        texture.bytes = requirements.size;
+        totalBytes += texture.bytes;
+
+        vk::ImageViewCreateInfo viewInfo;
+        viewInfo.setImage(*texture.image);
+        viewInfo.setViewType(vk::ImageViewType::e2D);
+        viewInfo.setFormat(format);
+        viewInfo.setSubresourceRange({vk::ImageAspectFlagBits::eColor, 0, texture.levels, 0, 1});
+        texture.view = context.device->createImageViewUnique(viewInfo);
+
+        for (uint32_t level = 0; level < texture.levels; level++) {
+            offset = alignUp(offset, texelAlignment);
+            std::memcpy(staging.data() + offset, chain.levels[level].data(), chain.levels[level].size());
+            vk::BufferImageCopy copy;
+            copy.setBufferOffset(offset);
+            copy.setImageSubresource({vk::ImageAspectFlagBits::eColor, level, 0, 1});
+            copy.setImageExtent({chain.extents[level].width, chain.extents[level].height, 1});
+            copies[i].push_back(copy);
+            offset += chain.levels[level].size();
+        }
+        textures.push_back(std::move(texture));
+    }
+    chains.clear();
+
+    // Copied on the transfer queue, then handed to the tracing queue in shader read layout
+    Buffer stagingBuffer{context, Buffer::Type::Staging, std::max<vk::DeviceSize>(stagingSize, 1), staging.data()};
+    auto transitions = [&](vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::AccessFlags srcAccess, vk::AccessFlags dstAccess) {
+        std::vector<vk::ImageMemoryBarrier> barriers;
+        for (const Texture& texture : textures) {
+            barriers.push_back({srcAccess, dstAccess, oldLayout, newLayout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, *texture.image,
+                                {vk::ImageAspectFlagBits::eColor, 0, texture.levels, 0, 1}});
+        }
+        return barriers;
+    };
+    context.transferSubmit(
+        [&](vk::CommandBuffer commandBuffer) {
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr,
+                                          transitions(vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, {},
+                                                      vk::AccessFlagBits::eTransferWrite));
+            for (size_t i = 0; i < textures.size(); i++) {
+                commandBuffer.copyBufferToImage(*stagingBuffer.buffer, *textures[i].image, vk::ImageLayout::eTransferDstOptimal, copies[i]);
+            }
+        },
+        transitions(vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eTransferWrite,
+                    vk::AccessFlagBits::eShaderRead));
+
+    // Trilinear with wrapping, the tracing shaders pick the level from the ray cone
+    vk::SamplerCreateInfo samplerInfo;
+    samplerInfo.setMagFilter(vk::Filter::eLinear);
+    samplerInfo.setMinFilter(vk::Filter::eLinear);
+    samplerInfo.setMipmapMode(vk::SamplerMipmapMode::eLinear);
+    samplerInfo.setAddressModeU(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setAddressModeV(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setAddressModeW(vk::SamplerAddressMode::eRepeat);
+    samplerInfo.setMaxLod(VK_LOD_CLAMP_NONE);
+    sampler = context.device->createSamplerUnique(samplerInfo);
+
+    for (const Texture& texture : textures) {
+        imageInfos.push_back({*sampler, *texture.view, vk::ImageLayout::eShaderReadOnlyOptimal});
+    }
+}
+
+vk::WriteDescriptorSet TextureSet::descriptorWrite(vk::DescriptorSet set) const {
+    vk::WriteDescriptorSet write;
+    write.setDstSet(set);
+    write.setDstBinding(Binding);
+    write.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+    write.setImageInfo(imageInfos);
+    return write;
+}
+
+std::string TextureSet::report() const {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "Textures: " << textures.size() << (format == vk::Format::eBc1RgbSrgbBlock ? " BC1" : " RGBA8") << ", "
+        << static_cast<double>(totalBytes) / (1 << 20) << " MB resident";
+    for (const Texture& texture : textures) {
+        if (texture.path.empty()) continue;
+        out << "\n  " << texture.path << ": " << texture.extent.width << "x" << texture.extent.height << ", " << texture.levels << " levels";
+        if (texture.droppedLevels > 0) {
+            out << " (" << texture.droppedLevels << " dropped by the budget)";
+        }
+        out << ", " << static_cast<double>(texture.bytes) / (1 << 20) << " MB";
+    }
+    return out.str();
+}
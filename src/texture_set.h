@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "render_settings.h"
+#include "thread_pool.h"
+
+// The scene's diffuse maps as one descriptor-indexed array of sampled images
+// (binding 13 of the tracing passes, indexed by Face::diffuseTexture). Files
+// are decoded, mipmapped and optionally BC1 compressed on a thread pool, then
+// uploaded with a single staging submission. Maps that fail to load become a
+// white texel, which leaves the face's diffuse color unchanged.
+class TextureSet {
+public:
+    static constexpr uint32_t Binding = 13;
+
+    TextureSet(const Context& context, const std::vector<std::string>& paths, const TextureSettings& settings, ThreadPool& pool);
+
+    // Descriptors of the binding, never empty so the array can always be declared.
+    const std::vector<vk::DescriptorImageInfo>& descriptorInfos() const { return imageInfos; }
+    uint32_t count() const { return static_cast<uint32_t>(imageInfos.size()); }
+    vk::WriteDescriptorSet descriptorWrite(vk::DescriptorSet set) const;
+
+    vk::DeviceSize residentBytes() const { return totalBytes; }
+    // One line per texture with its size, mip levels and device memory.
+    std::string report() const;
+
+private:
+    struct Texture {
+        std::string path;
+        vk::Extent2D extent;  // Of the resident top level, after the budget dropped levels
+        uint32_t levels = 0;
+        uint32_t droppedLevels = 0;
+        vk::DeviceSize bytes = 0;
+        vk::UniqueImage image;
+        vk::UniqueDeviceMemory memory;
+        vk::UniqueImageView view;
+    };
+
+    std::vector<Texture> textures;
+    vk::UniqueSampler sampler;
+    std::vector<vk::DescriptorImageInfo> imageInfos;
+    vk::Format format = vk::Format::eR8G8B8A8Srgb;
+    vk::DeviceSize totalBytes = 0;
+};
@@ -0,0 +1,24 @@
+#include "uniform_ring.h"
+
+UniformRing::UniformRing(const Context& context, uint32_t slotCount, const std::vector<vk::DeviceSize>& blockSizes)
+    : context(context), slotCount(slotCount), blockSizes(blockSizes) {
+    const vk::DeviceSize alignment = context.physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+    auto alignUp = [&](vk::DeviceSize value) { return (value + alignment - 1) / alignment * alignment; };
+    for (vk::DeviceSize size : blockSizes) {
+        blockOffsets.push_back(slotStride);
+        slotStride += alignUp(size);
+    }
+    buffer = Buffer{context, Buffer::Type::Uniform, slotStride * slotCount};
+    mapped = static_cast<uint8_t*>(context.device->mapMemory(*buffer.memory, 0, VK_WHOLE_SIZE));
+    std::memset(mapped, 0, slotStride * slotCount);
+}
+
+UniformRing::~UniformRing() {
+    if (mapped) {
+        context.device->unmapMemory(*buffer.memory);
+    }
+}
+
+vk::DescriptorBufferInfo UniformRing::descriptorInfo(uint32_t block) const {
+    return {*buffer.buffer, blockOffsets[block], blockSizes[block]};
+}
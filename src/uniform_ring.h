@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "context.h"
+
+// Per-frame shader constants in one persistently mapped buffer. Every slot
+// holds each block (e.g. Controls and ReprojectControls) at an offset aligned
+// for uniform descriptors. Shaders bind a block as a dynamic uniform buffer and
+// a command buffer picks its slot with offset(), so command buffers are
+// recorded once while the block contents change every frame.
+class UniformRing {
+public:
+    UniformRing(const Context& context, uint32_t slotCount, const std::vector<vk::DeviceSize>& blockSizes);
+    ~UniformRing();
+    UniformRing(const UniformRing&) = delete;
+    UniformRing& operator=(const UniformRing&) = delete;
+
+    // Descriptor of one block of slot 0, for a eUniformBufferDynamic binding.
+    vk::DescriptorBufferInfo descriptorInfo(uint32_t block) const;
+    // Dynamic offset selecting a slot.
+    uint32_t offset(uint32_t slot) const { return static_cast<uint32_t>(slot * slotStride); }
+    uint32_t slots() const { return slotCount; }
+
+    // Host coherent, visible to the next submission that reads the slot.
+    template <typename T>
+    void write(uint32_t slot, uint32_t block, const T& value) {
+        std::memcpy(mapped + slot * slotStride + blockOffsets[block], &value, sizeof(T));
+    }
+
+private:
+    const Context& context;
+    Buffer buffer;
+    uint8_t* mapped = nullptr;
+    uint32_t slotCount;
+    vk::DeviceSize slotStride = 0;
+    std::vector<vk::DeviceSize> blockOffsets;
+    std::vector<vk::DeviceSize> blockSizes;
+};
@@ -0,0 +1,90 @@
+#include "view_batch.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <glm/gtc/constants.hpp>
+
+BatchView BatchView::lookAt(glm::vec3 position, glm::vec3 target, float fov) {
+    const glm::vec3 forward = glm::normalize(target - position);
+    glm::vec3 right = glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    // Looking straight along the vertical axis, keep the controls' right
+    right = glm::length(right) > 1e-4f ? glm::normalize(right) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 up = glm::cross(right, forward);
+    return BatchView{glm::vec4(position, fov), glm::vec4(right, 0.0f), glm::vec4(up, 0.0f), glm::vec4(-forward, 0.0f)};
+}
+
+std::vector<BatchView> readViews(const std::string& path, float fov) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open views " + path);
+    }
+    std::vector<BatchView> views;
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        std::istringstream values(line);
+        glm::vec3 position;
+        if (!(values >> position.x >> position.y >> position.z)) {
+            throw std::runtime_error("invalid view in " + path + ": " + line);
+        }
+        glm::vec3 target;
+        if (!(values >> target.x >> target.y >> target.z)) {
+            target = position - glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        float viewFov = fov;
+        values >> viewFov;
+        views.push_back(BatchView::lookAt(position, target, viewFov));
+    }
+    if (views.empty()) {
+        throw std::runtime_error(path + " has no views");
+    }
+    return views;
+}
+
+std::vector<BatchView> orbitViews(int count, const std::vector<Vertex>& vertices, const Controls& camera) {
+    glm::vec3 boundsMin(0.0f);
+    glm::vec3 boundsMax(0.0f);
+    if (!vertices.empty()) {
+        boundsMin = boundsMax = vertices[0].position;
+    }
+    for (const Vertex& vertex : vertices) {
+        boundsMin = glm::min(boundsMin, vertex.position);
+        boundsMax = glm::max(boundsMax, vertex.position);
+    }
+    const glm::vec3 center = 0.5f * (boundsMin + boundsMax);
+    const glm::vec2 offset(camera.cameraPosition.x - center.x, camera.cameraPosition.z - center.z);
+    const float radius = std::max(glm::length(offset), 1e-3f);
+    const float start = std::atan2(offset.x, offset.y);
+
+    std::vector<BatchView> views;
+    for (int i = 0; i < count; i++) {
+        const float angle = start + 2.0f * glm::pi<float>() * static_cast<float>(i) / static_cast<float>(count);
+        const glm::vec3 position(center.x + radius * std::sin(angle), camera.cameraPosition.y, center.z + radius * std::cos(angle));
+        views.push_back(BatchView::lookAt(position, glm::vec3(center.x, camera.cameraPosition.y, center.z), camera.fov));
+    }
+    return views;
+}
+
+ViewBatch::ViewBatch(const Context& context, std::vector<BatchView> views, vk::Extent2D extent)
+    : views(std::move(views)), imageExtent(this->views.empty() ? vk::Extent2D{1, 1} : extent) {
+    const BatchView placeholder = BatchView::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), 45.0f);
+    const BatchView* data = this->views.empty() ? &placeholder : this->views.data();
+    viewData = Buffer{context, Buffer::Type::Storage, sizeof(BatchView) * std::max<size_t>(this->views.size(), 1), data};
+    accumulation = Image{context, imageExtent, vk::Format::eR32G32B32A32Sfloat,
+                         vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc, std::max(count(), 1u)};
+}
+
+std::string ViewBatch::report() const {
+    if (views.empty()) {
+        return "View batch: off";
+    }
+    std::ostringstream out;
+    out << "View batch: " << views.size() << " views of " << imageExtent.width << "x" << imageExtent.height << " in one launch";
+    return out.str();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "render_settings.h"
+#include "scene_data.h"
+
+// One camera of a batch, mirrors BatchView of views.glsl. Unlike Controls it
+// can look anywhere: the basis turns raygen's camera space, looking down -Z,
+// into the world.
+struct BatchView {
+    glm::vec4 positionFov;  // w is the vertical field of view in degrees
+    glm::vec4 right;
+    glm::vec4 up;
+    glm::vec4 back;  // Opposite the viewing direction
+
+    static BatchView lookAt(glm::vec3 position, glm::vec3 target, float fov);
+};
+
+// Views of a file, one per line: x y z [target x y z [fov]], in the loaded
+// mesh's coordinates. Without a target the view looks down -Z like Controls.
+std::vector<BatchView> readViews(const std::string& path, float fov);
+// count views on a level circle around the vertical axis through the scene's
+// center, the first one at the camera's distance and height in front of it.
+std::vector<BatchView> orbitViews(int count, const std::vector<Vertex>& vertices, const Controls& camera);
+
+// Several cameras traced by one launch of the megakernel (views.glsl): raygen
+// and pathtrace.comp run VIEW_COUNT slices deep, each accumulating its view
+// into a layer of an image array at the full output size. Pipeline, shader
+// binding table, scene and descriptors are shared by all views, and small
+// images still fill the device.
+//
+// Without views both bindings hold a one-view placeholder and VIEW_COUNT is 0.
+class ViewBatch {
+public:
+    static constexpr uint32_t ViewsBinding = 22;
+    static constexpr uint32_t ImageBinding = 23;
+
+    ViewBatch(const Context& context, std::vector<BatchView> views, vk::Extent2D extent);
+    ViewBatch(const ViewBatch&) = delete;
+    ViewBatch& operator=(const ViewBatch&) = delete;
+
+    // The VIEW_COUNT specialization constant and the launch depth, 0 without a batch.
+    uint32_t count() const { return static_cast<uint32_t>(views.size()); }
+    vk::Extent2D extent() const { return imageExtent; }
+    const Buffer& viewBuffer() const { return viewData; }
+    const Image& image() const { return accumulation; }
+    std::string report() const;
+
+private:
+    std::vector<BatchView> views;
+    vk::Extent2D imageExtent;
+    Buffer viewData;
+    Image accumulation;
+};
@@ -0,0 +1,261 @@
+#include "wavefront.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include "environment_map.h"
+#include "texture_set.h"
+
+namespace {
+
+enum PrepareMode : uint32_t { PrepareExtend = 0, PrepareShade = 1 };
+
+constexpr uint32_t MissClass = 0;
+
+uint32_t alignUp(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Every stage sees the queue and counter writes of the previous one, indirect arguments included.
+void stageBarrier(vk::CommandBuffer commandBuffer) {
+    const auto shaders = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eRayTracingShaderKHR;
+    vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite,
+                              vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead};
+    commandBuffer.pipelineBarrier(shaders, shaders | vk::PipelineStageFlagBits::eDrawIndirect, {}, barrier, nullptr, nullptr);
+}
+
+}  // namespace
+
+WavefrontIntegrator::WavefrontIntegrator(Context& context, const SceneBindings& scene, const vk::DescriptorBufferInfo& controls,
+                                         vk::Extent2D extent)
+    : context(context) {
+    const auto stages = vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR;
+    std::vector<vk::DescriptorSetLayoutBinding> bindings{
+        {0, vk::DescriptorType::eAccelerationStructureKHR, 1, vk::ShaderStageFlagBits::eRaygenKHR},  // TLAS
+        {1, vk::DescriptorType::eStorageImage, 1, stages},                                           // Sample image
+        {2, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Vertices
+        {3, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Indices
+        {4, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Faces
+        {5, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Sobol matrices
+        {6, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Blue noise
+        {7, vk::DescriptorType::eStorageImage, 1, stages},                                           // First-hit position
+        {8, vk::DescriptorType::eStorageImage, 1, stages},                                           // First-hit normal
+        {9, vk::DescriptorType::eStorageBuffer, 1, stages},                                          // Path state
+        {10, vk::DescriptorType::eStorageBuffer, 1, stages},                                         // Hits
+        {11, vk::DescriptorType::eStorageBuffer, 1, stages},                                         // Queues
+        {12, vk::DescriptorType::eStorageBuffer, 1, stages},                                         // Counters
+        {TextureSet::Binding, vk::DescriptorType::eCombinedImageSampler, scene.textures->count(),
+         vk::ShaderStageFlagBits::eClosestHitKHR},  // Diffuse maps
+        {14, vk::DescriptorType::eUniformBufferDynamic, 1, stages},                                  // Controls
+        {15, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},        // Cluster primitives
+        {16, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eClosestHitKHR},        // Cluster hits
+        {EnvironmentMap::Binding, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eMissKHR},  // Environment
+    };
+    vk::DescriptorSetLayoutCreateInfo descSetLayoutInfo;
+    descSetLayoutInfo.setBindings(bindings);
+    descSetLayout = context.device->createDescriptorSetLayoutUnique(descSetLayoutInfo);
+
+    vk::PushConstantRange pushRange{stages, 0, sizeof(WavefrontControls)};
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
+    pipelineLayoutInfo.setSetLayouts(*descSetLayout);
+    pipelineLayoutInfo.setPushConstantRanges(pushRange);
+    pipelineLayout = context.device->createPipelineLayoutUnique(pipelineLayoutInfo);
+
+    for (vk::UniqueDescriptorSet& descSet : descSets) {
+        descSet = context.allocateDescSet(*descSetLayout);
+        std::vector<vk::WriteDescriptorSet> writes{
+            {*descSet, 2, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.vertices->descBufferInfo},
+            {*descSet, 3, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.indices->descBufferInfo},
+            {*descSet, 4, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.faces->descBufferInfo},
+            {*descSet, 5, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.sobolMatrices->descBufferInfo},
+            {*descSet, 6, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.blueNoise->descBufferInfo},
+            {*descSet, 14, 0, vk::DescriptorType::eUniformBufferDynamic, nullptr, controls},
+            {*descSet, 15, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.clusterPrimitives->descBufferInfo},
+            {*descSet, 16, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.clusterHits->descBufferInfo},
+            {*descSet, EnvironmentMap::Binding, 0, vk::DescriptorType::eStorageBuffer, nullptr, scene.environment->descBufferInfo},
+        };
+        vk::WriteDescriptorSet accelWrite{*descSet, 0, 0, 1, vk::DescriptorType::eAccelerationStructureKHR};
+        accelWrite.setPNext(&scene.topAccel->descAccelInfo);
+        writes.push_back(accelWrite);
+        writes.push_back(scene.textures->descriptorWrite(*descSet));
+        context.device->updateDescriptorSets(writes, nullptr);
+    }
+
+    createPipelines(scene.countClusterHits);
+    resize(extent);
+}
+
+void WavefrontIntegrator::createPipelines(bool countClusterHits) {
+    auto createCompute = [&](const char* name, const vk::SpecializationInfo* specialization = nullptr) {
+        vk::UniqueShaderModule module = context.loadShader(name);
+        vk::PipelineShaderStageCreateInfo stage{{}, vk::ShaderStageFlagBits::eCompute, *module, "main", specialization};
+        auto result = context.device->createComputePipelineUnique(nullptr, {{}, stage, *pipelineLayout});
+        if (result.result != vk::Result::eSuccess) {
+            throw std::runtime_error(std::string("Failed to create wavefront pipeline ") + name);
+        }
+        return std::move(result.value);
+    };
+    generatePipeline = createCompute("wavefront_generate.comp.spv");
+    preparePipeline = createCompute("wavefront_prepare.comp.spv");
+    classifyPipeline = createCompute("wavefront_classify.comp.spv");
+    scatterPipeline = createCompute("wavefront_scatter.comp.spv");
+    accumulatePipeline = createCompute("wavefront_accumulate.comp.spv");
+
+    // The material class is a specialization constant, so each shade pipeline compiles to one branch
+    shadePipelines.resize(WavefrontCounters::MaterialClasses);
+    vk::SpecializationMapEntry classEntry{0, 0, sizeof(uint32_t)};
+    for (uint32_t materialClass = MissClass + 1; materialClass < WavefrontCounters::MaterialClasses; materialClass++) {
+        vk::SpecializationInfo specialization{1, &classEntry, sizeof(uint32_t), &materialClass};
+        shadePipelines[materialClass] = createCompute("wavefront_shade.comp.spv", &specialization);
+    }
+
+    // Extend is a ray tracing pipeline of its own, reusing the megakernel's miss and closest hit shaders
+    std::array<vk::UniqueShaderModule, 3> modules{context.loadShader("wavefront_extend.rgen.spv"),
+                                                  context.loadShader("miss.rmiss.spv"),
+                                                  context.loadShader("closesthit.rchit.spv")};
+    const vk::Bool32 countHits = countClusterHits;
+    vk::SpecializationMapEntry countHitsEntry{3, 0, sizeof(vk::Bool32)};
+    vk::SpecializationInfo hitSpecialization{1, &countHitsEntry, sizeof(vk::Bool32), &countHits};
+    std::array<vk::PipelineShaderStageCreateInfo, 3> stages{
+        vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eRaygenKHR, *modules[0], "main"},
+        vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eMissKHR, *modules[1], "main"},
+        vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eClosestHitKHR, *modules[2], "main", &hitSpecialization},
+    };
+    std::array<vk::RayTracingShaderGroupCreateInfoKHR, 3> groups{
+        vk::RayTracingShaderGroupCreateInfoKHR{vk::RayTracingShaderGroupTypeKHR::eGeneral, 0, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                               VK_SHADER_UNUSED_KHR},
+        vk::RayTracingShaderGroupCreateInfoKHR{vk::RayTracingShaderGroupTypeKHR::eGeneral, 1, VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR,
+                                               VK_SHADER_UNUSED_KHR},
+        vk::RayTracingShaderGroupCreateInfoKHR{vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup, VK_SHADER_UNUSED_KHR, 2,
+                                               VK_SHADER_UNUSED_KHR, VK_SHADER_UNUSED_KHR},
+    };
+    vk::RayTracingPipelineCreateInfoKHR rtPipelineInfo;
+    rtPipelineInfo.setStages(stages);
+    rtPipelineInfo.setGroups(groups);
+    rtPipelineInfo.setMaxPipelineRayRecursionDepth(1);
+    rtPipelineInfo.setLayout(*pipelineLayout);
+    auto result = context.device->createRayTracingPipelineKHRUnique(nullptr, nullptr, rtPipelineInfo);
+    if (result.result != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to create wavefront extend pipeline!");
+    }
+    extendPipeline = std::move(result.value);
+
+    // One shader binding table buffer, every group at its own base aligned region
+    auto properties = context.physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+    auto rtProperties = properties.get<vk::PhysicalDeviceRayTracingPipelinePropertiesKHR>();
+    const uint32_t handleSize = rtProperties.shaderGroupHandleSize;
+    const uint32_t handleStride = alignUp(handleSize, rtProperties.shaderGroupHandleAlignment);
+    const uint32_t regionSize = alignUp(handleStride, rtProperties.shaderGroupBaseAlignment);
+
+    std::vector<uint8_t> handles(groups.size() * handleSize);
+    if (context.device->getRayTracingShaderGroupHandlesKHR(*extendPipeline, 0, static_cast<uint32_t>(groups.size()), handles.size(),
+                                                           handles.data()) != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to process wavefront RT group handles!");
+    }
+    std::vector<uint8_t> table(groups.size() * regionSize);
+    for (size_t i = 0; i < groups.size(); i++) {
+        std::copy_n(handles.data() + i * handleSize, handleSize, table.data() + i * regionSize);
+    }
+    extendSBT = Buffer{context, Buffer::Type::ShaderBindingTable, table.size(), table.data()};
+    raygenRegion = vk::StridedDeviceAddressRegionKHR{extendSBT.deviceAddress + 0 * regionSize, handleStride, handleStride};
+    missRegion = vk::StridedDeviceAddressRegionKHR{extendSBT.deviceAddress + 1 * regionSize, handleStride, handleStride};
+    hitRegion = vk::StridedDeviceAddressRegionKHR{extendSBT.deviceAddress + 2 * regionSize, handleStride, handleStride};
+}
+
+void WavefrontIntegrator::resize(vk::Extent2D newExtent) {
+    extent = newExtent;
+    pathCount = extent.width * extent.height;
+    paths = Buffer{context, Buffer::Type::DeviceStorage, pathCount * 4 * sizeof(glm::vec4)};
+    hits = Buffer{context, Buffer::Type::DeviceStorage, pathCount * 3 * sizeof(glm::vec4)};
+    queues = Buffer{context, Buffer::Type::DeviceStorage, pathCount * 3 * sizeof(uint32_t)};
+    counters = Buffer{context, Buffer::Type::DeviceStorage, sizeof(WavefrontCounters)};
+    bindPathBuffers();
+}
+
+void WavefrontIntegrator::bindPathBuffers() {
+    std::vector<vk::WriteDescriptorSet> writes;
+    for (const vk::UniqueDescriptorSet& descSet : descSets) {
+        writes.push_back({*descSet, 9, 0, vk::DescriptorType::eStorageBuffer, nullptr, paths.descBufferInfo});
+        writes.push_back({*descSet, 10, 0, vk::DescriptorType::eStorageBuffer, nullptr, hits.descBufferInfo});
+        writes.push_back({*descSet, 11, 0, vk::DescriptorType::eStorageBuffer, nullptr, queues.descBufferInfo});
+        writes.push_back({*descSet, 12, 0, vk::DescriptorType::eStorageBuffer, nullptr, counters.descBufferInfo});
+    }
+    context.device->updateDescriptorSets(writes, nullptr);
+}
+
+void WavefrontIntegrator::bindImages(int parity, const Image& sample, const Image& position, const Image& normal) {
+    vk::DescriptorSet descSet = *descSets[parity];
+    std::vector<vk::WriteDescriptorSet> writes{
+        {descSet, 1, 0, vk::DescriptorType::eStorageImage, sample.descImageInfo},
+        {descSet, 7, 0, vk::DescriptorType::eStorageImage, position.descImageInfo},
+        {descSet, 8, 0, vk::DescriptorType::eStorageImage, normal.descImageInfo},
+    };
+    context.device->updateDescriptorSets(writes, nullptr);
+}
+
+void WavefrontIntegrator::record(vk::CommandBuffer commandBuffer, uint32_t controlsOffset, int parity, uint32_t samples, StageTimer* timer) const {
+    const auto stages = vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR;
+    WavefrontControls push{0, 0, pathCount, 0};
+    auto pushControls = [&] { commandBuffer.pushConstants(*pipelineLayout, stages, 0, sizeof(WavefrontControls), &push); };
+    // The first wave marks its stages, the others share one interval split like it
+    uint32_t sample = 0;
+    auto mark = [&](std::string_view stage) {
+        if (timer && sample == 0) timer->mark(commandBuffer, stage);
+    };
+    auto dispatch = [&](vk::Pipeline pipeline, uint32_t groups) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        pushControls();
+        commandBuffer.dispatch(groups, 1, 1);
+        stageBarrier(commandBuffer);
+    };
+    auto dispatchIndirect = [&](vk::Pipeline pipeline, vk::DeviceSize argsOffset) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        pushControls();
+        commandBuffer.dispatchIndirect(*counters.buffer, argsOffset);
+    };
+    const uint32_t pathGroups = (pathCount + 255) / 256;
+
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *descSets[parity], controlsOffset);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, *pipelineLayout, 0, *descSets[parity], controlsOffset);
+
+    for (; sample < samples; sample++) {
+        push.sample = sample;
+        push.depth = 0;
+        dispatch(*generatePipeline, pathGroups);
+        mark("generate");
+
+        for (uint32_t depth = 0; depth < MaxDepth; depth++) {
+            push.depth = depth;
+
+            push.mode = PrepareExtend;
+            dispatch(*preparePipeline, 1);
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, *extendPipeline);
+            pushControls();
+            commandBuffer.traceRaysIndirectKHR(raygenRegion, missRegion, hitRegion, {},
+                                               counters.deviceAddress + offsetof(WavefrontCounters, traceArgs));
+            stageBarrier(commandBuffer);
+            mark("extend");
+
+            dispatchIndirect(*classifyPipeline, offsetof(WavefrontCounters, rayDispatchArgs));
+            stageBarrier(commandBuffer);
+            push.mode = PrepareShade;
+            dispatch(*preparePipeline, 1);
+            dispatchIndirect(*scatterPipeline, offsetof(WavefrontCounters, rayDispatchArgs));
+            stageBarrier(commandBuffer);
+            mark("sort");
+
+            // Classes touch disjoint paths and only meet in atomics, so they run without barriers in between
+            for (uint32_t materialClass = MissClass + 1; materialClass < WavefrontCounters::MaterialClasses; materialClass++) {
+                dispatchIndirect(*shadePipelines[materialClass], offsetof(WavefrontCounters, shadeArgs) + materialClass * 3 * sizeof(uint32_t));
+            }
+            stageBarrier(commandBuffer);
+            mark("shade");
+        }
+
+        dispatch(*accumulatePipeline, pathGroups);
+        mark("accumulate");
+    }
+    if (timer && samples > 1) timer->repeat(commandBuffer, WaveMarks);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "context.h"
+#include "render_settings.h"
+#include "stage_timer.h"
+
+// Mirrors the Counters buffer of wavefront.glsl.
+struct WavefrontCounters {
+    static constexpr uint32_t MaterialClasses = 6;
+
+    uint32_t rayCount[2];
+    uint32_t classCount[MaterialClasses];
+    uint32_t classOffset[MaterialClasses];
+    uint32_t classCursor[MaterialClasses];
+    uint32_t traceArgs[3];
+    uint32_t rayDispatchArgs[3];
+    uint32_t shadeArgs[MaterialClasses * 3];
+};
+
+// Mirrors the push constant block of wavefront.glsl. The frame's Controls
+// come from the uniform block of controls.glsl.
+struct WavefrontControls {
+    uint32_t sample = 0;
+    uint32_t depth = 0;
+    uint32_t pathCount = 0;
+    uint32_t mode = 0;
+};
+
+// Path tracer split into stages connected by GPU queues, the alternative to
+// the raygen.rgen megakernel. Every wave traces one path per pixel through
+// generate, then per bounce extend, a counting sort of the hits by material
+// and one shade dispatch per material class, so each warp runs a single
+// material branch. Writes the same sample and G-buffer images as raygen.rgen.
+class WavefrontIntegrator {
+public:
+    static constexpr uint32_t MaxDepth = 8;
+    // Timer marks of a wave: generate and accumulate, extend, sort and shade per bounce
+    static constexpr uint32_t WaveMarks = 2 + 3 * MaxDepth;
+    // Timer marks recorded per frame, whatever its samples: the first wave's and one for the rest
+    static constexpr uint32_t MarksPerFrame = WaveMarks + 1;
+
+    // controls is the Controls block of the frame's UniformRing, bound at binding 14.
+    WavefrontIntegrator(Context& context, const SceneBindings& scene, const vk::DescriptorBufferInfo& controls, vk::Extent2D extent);
+
+    // Reallocates the path state for a new trace extent.
+    void resize(vk::Extent2D extent);
+    // Points the descriptor set of one frame parity at that frame's images.
+    void bindImages(int parity, const Image& sample, const Image& position, const Image& normal);
+    // Records the samples waves of one frame reading the controls at controlsOffset
+    // of the ring, whose samplesPerFrame they must match, marking the stages on timer when given:
+    // the first wave's one by one, the other waves' in one interval the timer splits like them.
+    void record(vk::CommandBuffer commandBuffer, uint32_t controlsOffset, int parity, uint32_t samples, StageTimer* timer) const;
+
+private:
+    void createPipelines(bool countClusterHits);
+    void bindPathBuffers();
+
+    Context& context;
+    vk::Extent2D extent;
+    uint32_t pathCount = 0;
+
+    Buffer paths;
+    Buffer hits;
+    Buffer queues;
+    Buffer counters;
+
+    vk::UniqueDescriptorSetLayout descSetLayout;
+    std::array<vk::UniqueDescriptorSet, 2> descSets;
+    vk::UniquePipelineLayout pipelineLayout;
+
+    vk::UniquePipeline generatePipeline;
+    vk::UniquePipeline preparePipeline;
+    vk::UniquePipeline classifyPipeline;
+    vk::UniquePipeline scatterPipeline;
+    vk::UniquePipeline accumulatePipeline;
+    std::vector<vk::UniquePipeline> shadePipelines;  // Indexed by material class, miss has none
+
+    vk::UniquePipeline extendPipeline;
+    Buffer extendSBT;
+    vk::StridedDeviceAddressRegionKHR raygenRegion;
+    vk::StridedDeviceAddressRegionKHR missRegion;
+    vk::StridedDeviceAddressRegionKHR hitRegion;
+};
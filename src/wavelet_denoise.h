@@ -10,7 +10,8 @@ inline void haar2DTransform(std::vector<float>& data, const int width, const int
         if (w < 2 || h < 2)
             break;
 
-        std::vector<float> temp(data.size());
+        // Coefficients outside the level's w x h corner belong to finer levels and are kept
+        std::vector<float> temp = data;
 
         for (int y = 0; y < h; y++) {
             for (int x = 0; x < w; x += 2) {
@@ -21,7 +22,7 @@ inline void haar2DTransform(std::vector<float>& data, const int width, const int
             }
         }
 
-        std::vector<float> temp2(data.size());
+        std::vector<float> temp2 = data;
         for (int x = 0; x < w; x++) {
             for (int y = 0; y < h; y += 2) {
                 int i = y * width + x;
@@ -41,7 +42,7 @@ inline void inverseHaar2DTransform(std::vector<float>& data, const int width, co
         if (w < 2 || h < 2)
             continue;
 
-        std::vector<float> temp(data.size());
+        std::vector<float> temp = data;
 
         for (int x = 0; x < w; x++) {
             for (int y = 0; y < h / 2; y++) {
@@ -55,7 +56,7 @@ inline void inverseHaar2DTransform(std::vector<float>& data, const int width, co
         }
 
         // Inverse horizontal transform:
-        std::vector<float> temp2(data.size());
+        std::vector<float> temp2 = data;
         for (int y = 0; y < h; y++) {
             // In each row, 'w' was halved in the horizontal transform.
             for (int x = 0; x < w / 2; x++) {
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+
+// Instruction set selection, WIDE_BVH_FORCE_SCALAR disables both SIMD paths.
+#if !defined(WIDE_BVH_FORCE_SCALAR)
+#if defined(__AVX2__)
+#define WIDE_BVH_USE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#define WIDE_BVH_USE_SSE 1
+#endif
+#endif
+
+#if defined(WIDE_BVH_USE_AVX2) || defined(WIDE_BVH_USE_SSE)
+#include <immintrin.h>
+#endif
+
+#if defined(WIDE_BVH_USE_AVX2)
+constexpr int DefaultWideBvhWidth = 8;
+#else
+constexpr int DefaultWideBvhWidth = 4;
+#endif
+
+// Child bounds are stored as structure of arrays so one node is tested with a single SIMD pass.
+template <int N>
+struct alignas(32) WideBvhNode {
+    float minX[N];
+    float minY[N];
+    float minZ[N];
+    float maxX[N];
+    float maxY[N];
+    float maxZ[N];
+    uint32_t child[N];  // Inner node index, or LeafFlag | first triangle
+    uint32_t count[N];  // Triangle count of leaf children
+    uint32_t validMask = 0;
+};
+
+// Coherent rays laid out per component so lanes map directly onto SIMD registers.
+template <int K>
+struct RayPacket {
+    static_assert(K == 8 || K == 16, "Packets hold 8 or 16 rays");
+    static constexpr uint32_t FullMask = (1u << K) - 1u;
+
+    alignas(32) float ox[K];
+    alignas(32) float oy[K];
+    alignas(32) float oz[K];
+    alignas(32) float ix[K];
+    alignas(32) float iy[K];
+    alignas(32) float iz[K];
+    alignas(32) float tMin[K];
+    alignas(32) float tMax[K];
+    glm::vec3 direction[K];
+    RayHit hits[K];
+
+    void set(int lane, const Ray& ray) {
+        glm::vec3 inv = safeInverse(ray.direction);
+        ox[lane] = ray.origin.x;
+        oy[lane] = ray.origin.y;
+        oz[lane] = ray.origin.z;
+        ix[lane] = inv.x;
+        iy[lane] = inv.y;
+        iz[lane] = inv.z;
+        tMin[lane] = ray.tMin;
+        tMax[lane] = ray.tMax;
+        direction[lane] = ray.direction;
+        hits[lane] = RayHit{};
+    }
+
+    static glm::vec3 safeInverse(const glm::vec3& d) {
+        constexpr float eps = 1e-20f;
+        return {1.0f / (std::abs(d.x) > eps ? d.x : std::copysign(eps, d.x)),
+                1.0f / (std::abs(d.y) > eps ? d.y : std::copysign(eps, d.y)),
+                1.0f / (std::abs(d.z) > eps ? d.z : std::copysign(eps, d.z))};
+    }
+};
+
+template <int N>
+class WideBvh {
+public:
+    static_assert(N == 4 || N == 8, "Wide BVH supports 4 or 8 children");
+    static constexpr uint32_t LeafFlag = 0x80000000u;
+    static constexpr int StackSize = 64 * N;
+
+    WideBvh() = default;
+    explicit WideBvh(const Bvh& bvh) { build(bvh); }
+
+    // Collapses a binary BVH by repeatedly opening the largest inner child until N slots are used.
+    void build(const Bvh& bvh) {
+        nodes.clear();
+        triangles.clear();
+        primIds.clear();
+        if (bvh.nodes.empty() || bvh.primIndices.empty()) return;
+
+        sceneBounds = bvh.bounds();
+        nodes.reserve(bvh.nodes.size() / 2 + 1);
+        triangles.reserve(bvh.primIndices.size());
+        primIds.reserve(bvh.primIndices.size());
+        collapse(bvh, 0);
+    }
+
+    bool intersect(const Ray& ray, RayHit& hit) const { return traverse<false>(ray, hit); }
+
+    bool occluded(const Ray& ray) const {
+        RayHit hit;
+        return traverse<true>(ray, hit);
+    }
+
+    // Packet traversal: a child is visited if any active lane overlaps it.
+    template <int K>
+    void intersect(RayPacket<K>& packet, uint32_t activeMask = RayPacket<K>::FullMask) const {
+        if (nodes.empty() || activeMask == 0) return;
+
+        struct Entry {
+            uint32_t child;
+            uint32_t count;
+            uint32_t mask;
+        };
+        Entry stack[StackSize];
+        int stackSize = 0;
+        stack[stackSize++] = {0, 0, activeMask};
+
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            if (entry.child & LeafFlag) {
+                const uint32_t first = entry.child & ~LeafFlag;
+                for (uint32_t bits = entry.mask; bits; bits &= bits - 1) {
+                    const int lane = countTrailingZeros(bits);
+                    const glm::vec3 origin(packet.ox[lane], packet.oy[lane], packet.oz[lane]);
+                    for (uint32_t i = first; i < first + entry.count; i++) {
+                        if (intersectTriangle(triangles[i], origin, packet.direction[lane], packet.tMin[lane], packet.tMax[lane],
+                                              packet.hits[lane])) {
+                            packet.hits[lane].primitive = primIds[i];
+                            packet.tMax[lane] = packet.hits[lane].t;
+                        }
+                    }
+                }
+                continue;
+            }
+
+            const WideBvhNode<N>& node = nodes[entry.child];
+            Entry children[N];
+            float order[N];
+            int childCount = 0;
+            for (uint32_t bits = node.validMask; bits; bits &= bits - 1) {
+                const int c = countTrailingZeros(bits);
+                float nearest;
+                const uint32_t mask = intersectPacketChild(node, c, packet, entry.mask, nearest);
+                if (mask) {
+                    children[childCount] = {node.child[c], node.count[c], mask};
+                    order[childCount] = nearest;
+                    childCount++;
+                }
+            }
+            pushSorted(stack, stackSize, children, order, childCount);
+        }
+    }
+
+    const Aabb& bounds() const { return sceneBounds; }
+    size_t nodeCount() const { return nodes.size(); }
+    size_t memoryFootprint() const {
+        return nodes.size() * sizeof(WideBvhNode<N>) + triangles.size() * sizeof(BvhTriangle) + primIds.size() * sizeof(uint32_t);
+    }
+
+private:
+    struct TraversalRay {
+        glm::vec3 origin;
+        glm::vec3 invDir;
+        glm::vec3 originInv;
+    };
+
+    static int countTrailingZeros(uint32_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return static_cast<int>(index);
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+
+    template <typename Entry>
+    static void pushSorted(Entry* stack, int& stackSize, Entry* children, float* order, int childCount) {
+        // Insertion sort far-to-near so the nearest child is popped first
+        for (int i = 1; i < childCount; i++) {
+            for (int j = i; j > 0 && order[j - 1] < order[j]; j--) {
+                std::swap(order[j - 1], order[j]);
+                std::swap(children[j - 1], children[j]);
+            }
+        }
+        for (int i = 0; i < childCount; i++) {
+            stack[stackSize++] = children[i];
+        }
+    }
+
+    uint32_t collapse(const Bvh& bvh, uint32_t binaryIndex) {
+        const auto wideIndex = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+
+        std::vector<uint32_t> slots;
+        const BvhNode& root = bvh.nodes[binaryIndex];
+        if (root.count > 0) {
+            slots.push_back(binaryIndex);
+        } else {
+            slots.push_back(root.leftFirst);
+            slots.push_back(root.leftFirst + 1);
+        }
+        while (slots.size() < N) {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (int i = 0; i < static_cast<int>(slots.size()); i++) {
+                const BvhNode& candidate = bvh.nodes[slots[i]];
+                if (candidate.count == 0 && candidate.bounds.area() > largestArea) {
+                    largest = i;
+                    largestArea = candidate.bounds.area();
+                }
+            }
+            if (largest < 0) break;
+            uint32_t opened = slots[largest];
+            slots[largest] = bvh.nodes[opened].leftFirst;
+            slots.push_back(bvh.nodes[opened].leftFirst + 1);
+        }
+
+        WideBvhNode<N> node;
+        for (int i = 0; i < N; i++) {
+            node.minX[i] = node.minY[i] = node.minZ[i] = std::numeric_limits<float>::max();
+            node.maxX[i] = node.maxY[i] = node.maxZ[i] = -std::numeric_limits<float>::max();
+            node.child[i] = 0;
+            node.count[i] = 0;
+        }
+        for (int i = 0; i < static_cast<int>(slots.size()); i++) {
+            const BvhNode& source = bvh.nodes[slots[i]];
+            node.minX[i] = source.bounds.min.x;
+            node.minY[i] = source.bounds.min.y;
+            node.minZ[i] = source.bounds.min.z;
+            node.maxX[i] = source.bounds.max.x;
+            node.maxY[i] = source.bounds.max.y;
+            node.maxZ[i] = source.bounds.max.z;
+            node.validMask |= 1u << i;
+            if (source.count > 0) {
+                node.child[i] = LeafFlag | static_cast<uint32_t>(triangles.size());
+                node.count[i] = source.count;
+                for (uint32_t p = 0; p < source.count; p++) {
+                    uint32_t prim = bvh.primIndices[source.leftFirst + p];
+                    triangles.push_back(bvh.getTriangles()[prim]);
+                    primIds.push_back(prim);
+                }
+            } else {
+                node.child[i] = collapse(bvh, slots[i]);
+            }
+        }
+        nodes[wideIndex] = node;
+        return wideIndex;
+    }
+
+    template <bool AnyHit>
+    bool traverse(const Ray& ray, RayHit& hit) const {
+        if (nodes.empty()) return false;
+
+        TraversalRay r;
+        r.origin = ray.origin;
+        r.invDir = RayPacket<8>::safeInverse(ray.direction);
+        r.originInv = r.origin * r.invDir;
+
+        struct Entry {
+            uint32_t child;
+            uint32_t count;
+            float t;
+        };
+        Entry stack[StackSize];
+        int stackSize = 0;
+        stack[stackSize++] = {0, 0, ray.tMin};
+        float tMax = ray.tMax;
+
+        while (stackSize > 0) {
+            const Entry entry = stack[--stackSize];
+            if (entry.t > tMax) continue;
+
+            if (entry.child & LeafFlag) {
+                const uint32_t first = entry.child & ~LeafFlag;
+                for (uint32_t i = first; i < first + entry.count; i++) {
+                    if (intersectTriangle(triangles[i], ray.origin, ray.direction, ray.tMin, tMax, hit)) {
+                        hit.primitive = primIds[i];
+                        tMax = hit.t;
+                        if constexpr (AnyHit) return true;
+                    }
+                }
+                continue;
+            }
+
+            const WideBvhNode<N>& node = nodes[entry.child];
+            alignas(32) float tNear[N];
+            uint32_t mask = intersectChildren(node, r, ray.tMin, tMax, tNear) & node.validMask;
+
+            Entry children[N];
+            float order[N];
+            int childCount = 0;
+            for (; mask; mask &= mask - 1) {
+                const int c = countTrailingZeros(mask);
+                children[childCount] = {node.child[c], node.count[c], tNear[c]};
+                order[childCount] = tNear[c];
+                childCount++;
+            }
+            pushSorted(stack, stackSize, children, order, childCount);
+        }
+        return hit.valid();
+    }
+
+    // Slab test of one ray against all N children, returns the overlap mask.
+    static uint32_t intersectChildren(const WideBvhNode<N>& node, const TraversalRay& r, float tMin, float tMax, float* tNear) {
+        uint32_t mask = 0;
+        int i = 0;
+#if defined(WIDE_BVH_USE_AVX2)
+        if constexpr (N == 8) {
+            const __m256 ix = _mm256_set1_ps(r.invDir.x), iy = _mm256_set1_ps(r.invDir.y), iz = _mm256_set1_ps(r.invDir.z);
+            const __m256 ox = _mm256_set1_ps(r.originInv.x), oy = _mm256_set1_ps(r.originInv.y), oz = _mm256_set1_ps(r.originInv.z);
+            const __m256 t0x = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.minX), ix), ox);
+            const __m256 t1x = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.maxX), ix), ox);
+            const __m256 t0y = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.minY), iy), oy);
+            const __m256 t1y = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.maxY), iy), oy);
+            const __m256 t0z = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.minZ), iz), oz);
+            const __m256 t1z = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(node.maxZ), iz), oz);
+            const __m256 tEnter = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+                                                _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_set1_ps(tMin)));
+            const __m256 tExit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+                                               _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(tMax)));
+            _mm256_storeu_ps(tNear, tEnter);
+            return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+        }
+#endif
+#if defined(WIDE_BVH_USE_SSE)
+        const __m128 ix = _mm_set1_ps(r.invDir.x), iy = _mm_set1_ps(r.invDir.y), iz = _mm_set1_ps(r.invDir.z);
+        const __m128 ox = _mm_set1_ps(r.originInv.x), oy = _mm_set1_ps(r.originInv.y), oz = _mm_set1_ps(r.originInv.z);
+        for (; i + 4 <= N; i += 4) {
+            const __m128 t0x = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.minX + i), ix), ox);
+            const __m128 t1x = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.maxX + i), ix), ox);
+            const __m128 t0y = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.minY + i), iy), oy);
+            const __m128 t1y = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.maxY + i), iy), oy);
+            const __m128 t0z = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.minZ + i), iz), oz);
+            const __m128 t1z = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(node.maxZ + i), iz), oz);
+            const __m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                             _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(tMin)));
+            const __m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                            _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+            _mm_storeu_ps(tNear + i, tEnter);
+            mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit))) << i;
+        }
+#endif
+        for (; i < N; i++) {
+            float t0x = node.minX[i] * r.invDir.x - r.originInv.x, t1x = node.maxX[i] * r.invDir.x - r.originInv.x;
+            float t0y = node.minY[i] * r.invDir.y - r.originInv.y, t1y = node.maxY[i] * r.invDir.y - r.originInv.y;
+            float t0z = node.minZ[i] * r.invDir.z - r.originInv.z, t1z = node.maxZ[i] * r.invDir.z - r.originInv.z;
+            float tEnter = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), tMin));
+            float tExit = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), tMax));
+            tNear[i] = tEnter;
+            if (tEnter <= tExit) mask |= 1u << i;
+        }
+        return mask;
+    }
+
+    // Slab test of one child against every active lane of a packet.
+    template <int K>
+    static uint32_t intersectPacketChild(const WideBvhNode<N>& node, int c, const RayPacket<K>& p, uint32_t activeMask, float& nearest) {
+        uint32_t mask = 0;
+        int lane = 0;
+        nearest = std::numeric_limits<float>::max();
+#if defined(WIDE_BVH_USE_AVX2)
+        {
+            const __m256 minX = _mm256_set1_ps(node.minX[c]), maxX = _mm256_set1_ps(node.maxX[c]);
+            const __m256 minY = _mm256_set1_ps(node.minY[c]), maxY = _mm256_set1_ps(node.maxY[c]);
+            const __m256 minZ = _mm256_set1_ps(node.minZ[c]), maxZ = _mm256_set1_ps(node.maxZ[c]);
+            for (; lane + 8 <= K; lane += 8) {
+                const __m256 ix = _mm256_load_ps(p.ix + lane), iy = _mm256_load_ps(p.iy + lane), iz = _mm256_load_ps(p.iz + lane);
+                const __m256 ox = _mm256_load_ps(p.ox + lane), oy = _mm256_load_ps(p.oy + lane), oz = _mm256_load_ps(p.oz + lane);
+                const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(minX, ox), ix), t1x = _mm256_mul_ps(_mm256_sub_ps(maxX, ox), ix);
+                const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(minY, oy), iy), t1y = _mm256_mul_ps(_mm256_sub_ps(maxY, oy), iy);
+                const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(minZ, oz), iz), t1z = _mm256_mul_ps(_mm256_sub_ps(maxZ, oz), iz);
+                const __m256 tEnter = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+                                                    _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_load_ps(p.tMin + lane)));
+                const __m256 tExit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+                                                   _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_load_ps(p.tMax + lane)));
+                const uint32_t hits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+                if (hits & (activeMask >> lane)) {
+                    alignas(32) float entered[8];
+                    _mm256_store_ps(entered, tEnter);
+                    for (uint32_t bits = hits & (activeMask >> lane) & 0xffu; bits; bits &= bits - 1) {
+                        nearest = std::min(nearest, entered[countTrailingZeros(bits)]);
+                    }
+                }
+                mask |= (hits & 0xffu) << lane;
+            }
+        }
+#endif
+#if defined(WIDE_BVH_USE_SSE)
+        {
+            const __m128 minX = _mm_set1_ps(node.minX[c]), maxX = _mm_set1_ps(node.maxX[c]);
+            const __m128 minY = _mm_set1_ps(node.minY[c]), maxY = _mm_set1_ps(node.maxY[c]);
+            const __m128 minZ = _mm_set1_ps(node.minZ[c]), maxZ = _mm_set1_ps(node.maxZ[c]);
+            for (; lane + 4 <= K; lane += 4) {
+                const __m128 ix = _mm_load_ps(p.ix + lane), iy = _mm_load_ps(p.iy + lane), iz = _mm_load_ps(p.iz + lane);
+                const __m128 ox = _mm_load_ps(p.ox + lane), oy = _mm_load_ps(p.oy + lane), oz = _mm_load_ps(p.oz + lane);
+                const __m128 t0x = _mm_mul_ps(_mm_sub_ps(minX, ox), ix), t1x = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+                const __m128 t0y = _mm_mul_ps(_mm_sub_ps(minY, oy), iy), t1y = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+                const __m128 t0z = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz), t1z = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+                const __m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+                                                 _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_load_ps(p.tMin + lane)));
+                const __m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+                                                _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_load_ps(p.tMax + lane)));
+                const uint32_t hits = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit)));
+                if (hits & (activeMask >> lane)) {
+                    alignas(16) float entered[4];
+                    _mm_store_ps(entered, tEnter);
+                    for (uint32_t bits = hits & (activeMask >> lane) & 0xfu; bits; bits &= bits - 1) {
+                        nearest = std::min(nearest, entered[countTrailingZeros(bits)]);
+                    }
+                }
+                mask |= (hits & 0xfu) << lane;
+            }
+        }
+#endif
+        for (; lane < K; lane++) {
+            float t0x = (node.minX[c] - p.ox[lane]) * p.ix[lane], t1x = (node.maxX[c] - p.ox[lane]) * p.ix[lane];
+            float t0y = (node.minY[c] - p.oy[lane]) * p.iy[lane], t1y = (node.maxY[c] - p.oy[lane]) * p.iy[lane];
+            float t0z = (node.minZ[c] - p.oz[lane]) * p.iz[lane], t1z = (node.maxZ[c] - p.oz[lane]) * p.iz[lane];
+            float tEnter = std::max(std::max(std::min(t0x, t1x), std::min(t0y, t1y)), std::max(std::min(t0z, t1z), p.tMin[lane]));
+            float tExit = std::min(std::min(std::max(t0x, t1x), std::max(t0y, t1y)), std::min(std::max(t0z, t1z), p.tMax[lane]));
+            if (tEnter <= tExit && (activeMask >> lane & 1u)) {
+                mask |= 1u << lane;
+                nearest = std::min(nearest, tEnter);
+            }
+        }
+        return mask & activeMask;
+    }
+
+    std::vector<WideBvhNode<N>> nodes;
+    std::vector<BvhTriangle> triangles;
+    std::vector<uint32_t> primIds;
+    Aabb sceneBounds;
+};